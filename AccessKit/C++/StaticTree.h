@@ -0,0 +1,135 @@
+#pragma once
+
+#include <windows.h>
+#include "accesskit.h"
+#include <cstddef>
+#include <cstdint>
+
+// One node of a fixed layout. The root is the node that is its own parent.
+struct StaticNode {
+    accesskit_node_id id;
+    accesskit_node_id parent;
+    accesskit_role role;
+    accesskit_rect rect;
+    const char* name;
+    COLORREF color;
+    bool focusable;
+};
+
+// Non-template view over the tables of a StaticTree, so code that consumes a
+// layout does not depend on its size.
+struct StaticTreeView {
+    // Breadth-first, so the children of every node are a contiguous range.
+    const StaticNode* nodes;
+    const uint32_t* firstChild;
+    const uint32_t* childCount;
+    // Indexed by node id.
+    const uint32_t* indexOfId;
+    // Next focusable node in tab order, wrapping around.
+    const uint32_t* nextFocus;
+    uint32_t firstFocus;
+    size_t size;
+
+    const StaticNode* find(accesskit_node_id id) const {
+        return id < size ? &nodes[indexOfId[id]] : nullptr;
+    }
+
+    uint32_t indexOf(accesskit_node_id id) const {
+        return indexOfId[id];
+    }
+};
+
+// Tables derived from a layout description at compile time. Ids must be dense
+// in [0, N); a description that is not a single tree leaves valid false.
+template <size_t N>
+struct StaticTree {
+    StaticNode nodes[N];
+    uint32_t firstChild[N];
+    uint32_t childCount[N];
+    uint32_t indexOfId[N];
+    uint32_t nextFocus[N];
+    uint32_t firstFocus;
+    bool valid;
+
+    constexpr StaticTreeView view() const {
+        return { nodes, firstChild, childCount, indexOfId, nextFocus, firstFocus, N };
+    }
+};
+
+template <size_t N>
+constexpr StaticTree<N> makeStaticTree(const StaticNode (&description)[N]) {
+    StaticTree<N> tree{};
+
+    // Every id in range and used once, with exactly one root
+    bool seen[N] = {};
+    size_t root = N;
+    for (size_t i = 0; i < N; i++) {
+        accesskit_node_id id = description[i].id;
+        if (id >= N || seen[id] || description[i].parent >= N) {
+            return tree;
+        }
+        seen[id] = true;
+        if (description[i].parent == id) {
+            if (root != N) {
+                return tree;
+            }
+            root = i;
+        }
+    }
+    if (root == N) {
+        return tree;
+    }
+
+    // Breadth-first order; children keep their declaration order
+    size_t order[N] = {};
+    size_t count = 0;
+    order[count++] = root;
+    for (size_t head = 0; head < count; head++) {
+        const StaticNode& parent = description[order[head]];
+        tree.firstChild[head] = static_cast<uint32_t>(count);
+        for (size_t i = 0; i < N; i++) {
+            if (i != order[head] && description[i].parent == parent.id) {
+                order[count++] = i;
+            }
+        }
+        tree.childCount[head] = static_cast<uint32_t>(count) - tree.firstChild[head];
+    }
+    if (count != N) {
+        return tree; // Some nodes are not reachable from the root
+    }
+    for (size_t i = 0; i < N; i++) {
+        tree.nodes[i] = description[order[i]];
+        tree.indexOfId[tree.nodes[i].id] = static_cast<uint32_t>(i);
+    }
+
+    // Tab order is document (pre-)order
+    uint32_t preorder[N] = {};
+    uint32_t stack[N] = {};
+    size_t stackSize = 0;
+    count = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        uint32_t node = stack[--stackSize];
+        preorder[count++] = node;
+        for (uint32_t child = tree.firstChild[node] + tree.childCount[node]; child > tree.firstChild[node]; child--) {
+            stack[stackSize++] = child - 1;
+        }
+    }
+
+    // Walk backwards twice so the last nodes wrap around to the first focusable one
+    uint32_t next = 0;
+    bool anyFocusable = false;
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t i = N; i > 0; i--) {
+            uint32_t node = preorder[i - 1];
+            tree.nextFocus[node] = next;
+            if (tree.nodes[node].focusable) {
+                next = node;
+                anyFocusable = true;
+            }
+        }
+    }
+    tree.firstFocus = anyFocusable ? next : 0;
+    tree.valid = true;
+    return tree;
+}
@@ -1,7 +1,18 @@
 #include <windows.h>
 #include "accesskit.h"
-#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstring>
 #include <memory>
+#include <vector>
+#include "../../Shared/WidgetModel.h"
+#include "../../Shared/DrawBatch.h"
+#include "../../Shared/FrameScheduler.h"
+#include "../../Shared/GdiRenderer.h"
+#include "../../Shared/WidgetPainter.h"
+#include "../../Shared/WidgetTreeDiff.h"
+#include "../../Shared/WorkStealingPool.h"
+#include "StaticTree.h"
 
 const WCHAR CLASS_NAME[] = L"AccessKitTest";
 const WCHAR WINDOW_TITLE[] = L"Accessible UI";
@@ -13,115 +24,278 @@ const accesskit_node_id BUTTON_3_ID = 4;
 const accesskit_node_id NAVBAR_ID = 3;
 #define INITIAL_FOCUS BUTTON_1_ID
 
-const accesskit_rect BUTTON_1_RECT = { 20.0, 20.0, 100.0, 60.0 };
-const accesskit_rect BUTTON_2_RECT = { 120.0, 20.0, 200.0, 60.0 };
-const accesskit_rect BUTTON_3_RECT = { 220.0, 20.0, 300.0, 60.0 };
-const accesskit_rect NAVBAR_RECT = { 0.0, 0.0, 320.0, 100.0 };
+constexpr accesskit_rect BUTTON_1_RECT = { 20.0, 20.0, 100.0, 60.0 };
+constexpr accesskit_rect BUTTON_2_RECT = { 120.0, 20.0, 200.0, 60.0 };
+constexpr accesskit_rect BUTTON_3_RECT = { 220.0, 20.0, 300.0, 60.0 };
+constexpr accesskit_rect NAVBAR_RECT = { 0.0, 0.0, 320.0, 100.0 };
+
+// The fixed part of the UI. Its tables are built by the compiler, so the
+// initial tree, painting and action routing need no runtime model.
+constexpr StaticNode LAYOUT_DESCRIPTION[] = {
+    { WINDOW_ID, WINDOW_ID, ACCESSKIT_ROLE_WINDOW, {}, nullptr, 0, false },
+    { NAVBAR_ID, WINDOW_ID, ACCESSKIT_ROLE_GROUP, NAVBAR_RECT, "Navbar", RGB(0, 0, 255), false },
+    { BUTTON_1_ID, NAVBAR_ID, ACCESSKIT_ROLE_BUTTON, BUTTON_1_RECT, "Button 1", RGB(200, 200, 200), true },
+    { BUTTON_2_ID, NAVBAR_ID, ACCESSKIT_ROLE_BUTTON, BUTTON_2_RECT, "Button 2", RGB(200, 200, 200), true },
+    { BUTTON_3_ID, NAVBAR_ID, ACCESSKIT_ROLE_BUTTON, BUTTON_3_RECT, "Button 3", RGB(200, 200, 200), true },
+};
+constexpr auto LAYOUT = makeStaticTree(LAYOUT_DESCRIPTION);
+static_assert(LAYOUT.valid, "LAYOUT_DESCRIPTION must be a single tree with dense ids");
+static_assert(LAYOUT.nodes[0].id == WINDOW_ID, "the layout root must be the window");
 
 const uint32_t SET_FOCUS_MSG = WM_USER;
 const uint32_t DO_DEFAULT_ACTION_MSG = WM_USER + 1;
-
-class Button {
-public:
-    accesskit_node_id id;
-    const char* name;
-    accesskit_rect rect;
-    COLORREF color;
-
-    Button(accesskit_node_id id, const char* name, accesskit_rect rect, COLORREF color)
-        : id(id), name(name), rect(rect), color(color) {}
-
-    accesskit_node* build() {
-        accesskit_node_builder* builder = accesskit_node_builder_new(ACCESSKIT_ROLE_BUTTON);
-        accesskit_node_builder_set_bounds(builder, rect);
-        accesskit_node_builder_set_name(builder, name);
-        accesskit_node_builder_add_action(builder, ACCESSKIT_ACTION_FOCUS);
-        accesskit_node_builder_set_default_action_verb(builder, ACCESSKIT_DEFAULT_ACTION_VERB_CLICK);
-        return accesskit_node_builder_build(builder);
+const UINT_PTR FRAME_TIMER = 1;
+// Widgets per task when building the initial tree in parallel
+const size_t NODES_PER_TASK = 2048;
+// Smaller models are built and diffed on the calling thread alone, since
+// waking threads would cost more than the work they take over
+const size_t PARALLEL_WIDGETS = 4 * NODES_PER_TASK;
+
+accesskit_role widgetRole(WidgetRole role) {
+    switch (role) {
+    case WidgetRole::Window:
+        return ACCESSKIT_ROLE_WINDOW;
+    case WidgetRole::Toolbar:
+        return ACCESSKIT_ROLE_GROUP;
+    case WidgetRole::ProgressBar:
+        return ACCESSKIT_ROLE_PROGRESS_INDICATOR;
+    default:
+        return ACCESSKIT_ROLE_BUTTON;
     }
+}
 
-    void draw(HDC hdc) {
-        HBRUSH brush = CreateSolidBrush(color);
-        RECT rectToDraw = { (LONG)rect.x0, (LONG)rect.y0, (LONG)rect.x1, (LONG)rect.y1 };
-        FillRect(hdc, &rectToDraw, brush);
-        SetBkMode(hdc, TRANSPARENT);
-        DrawTextA(hdc, name, -1, &rectToDraw, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
-        DeleteObject(brush);
+struct WindowState {
+    accesskit_windows_adapter* adapter;
+    accesskit_node_id focus;
+    // Fixed layout; widgets added at runtime live in the shared model, with
+    // node ids following the layout's.
+    StaticTreeView layout;
+    // Layout names widened once for the renderer; the layout names are ASCII.
+    std::vector<std::wstring> staticLabels;
+    WidgetModel model;
+    TextLayoutCache textCache;
+    DrawBatch drawBatch;
+    // Focus, node and paint changes wait here for the next frame
+    FrameScheduler scheduler;
+    // Nodes to send in the frame being committed
+    std::vector<accesskit_node_id> frameNodes;
+    // Created on first use, with threads only once the model is big enough
+    std::unique_ptr<WorkStealingPool> pool;
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    // Widget state as last sent, to find what a layout change really changed
+    WidgetTreeDiff treeDiff;
+    std::vector<WidgetId> diffChanged;
+    std::vector<WidgetId> diffRemoved;
+
+    WindowState(accesskit_windows_adapter* adapter, accesskit_node_id focus, StaticTreeView layout)
+        : adapter(adapter), focus(focus), layout(layout) {
+        for (size_t index = 0; index < layout.size; index++) {
+            const char* name = layout.nodes[index].name;
+            staticLabels.emplace_back(name != nullptr ? std::wstring(name, name + strlen(name)) : std::wstring());
+        }
     }
-};
 
-class Navbar {
-public:
-    accesskit_node_id id;
-    accesskit_rect rect;
-    std::vector<std::shared_ptr<Button>> buttons;
-    COLORREF color;
+    WorkStealingPool& workPool() {
+        bool parallel = model.GetWidgets().size() >= PARALLEL_WIDGETS;
+        if (pool == nullptr || (parallel && pool->GetThreadCount() == 1 && std::thread::hardware_concurrency() > 1)) {
+            pool.reset(new WorkStealingPool(parallel ? 0 : 1));
+        }
+        return *pool;
+    }
 
-    Navbar(accesskit_node_id id, accesskit_rect rect, std::vector<std::shared_ptr<Button>> buttons, COLORREF color)
-        : id(id), rect(rect), buttons(buttons), color(color) {}
+    accesskit_node_id nodeIdOf(WidgetId widget) const {
+        return static_cast<accesskit_node_id>(layout.size) + widget.index;
+    }
 
-    accesskit_node* build() {
-        accesskit_node_builder* builder = accesskit_node_builder_new(ACCESSKIT_ROLE_GROUP);
-        accesskit_node_builder_set_bounds(builder, rect);
-        accesskit_node_builder_set_name(builder, "Navbar");
-        for (const auto& button : buttons) {
-            accesskit_node_builder_push_child(builder, button->id);
+    WidgetId widgetOf(accesskit_node_id id) const {
+        if (id < layout.size) {
+            return kNoWidget;
         }
-        return accesskit_node_builder_build(builder);
+        return model.GetWidgets().handleAtSlot(static_cast<uint32_t>(id - layout.size));
     }
 
-    void draw(HDC hdc) {
-        HBRUSH brush = CreateSolidBrush(color);
-        RECT rectToDraw = { (LONG)rect.x0, (LONG)rect.y0, (LONG)rect.x1, (LONG)rect.y1 };
-        FillRect(hdc, &rectToDraw, brush);
-        DeleteObject(brush);
-        for (const auto& button : buttons) {
-            button->draw(hdc);
+    // Name of the button with the given id, whether static or added at runtime.
+    const char* buttonName(accesskit_node_id id) {
+        const StaticNode* node = layout.find(id);
+        if (node != nullptr) {
+            return node->role == ACCESSKIT_ROLE_BUTTON ? node->name : nullptr;
         }
+        WidgetId widget = widgetOf(id);
+        if (!model.Contains(widget) || model.Get(widget)->role != WidgetRole::Button) {
+            return nullptr;
+        }
+        return model.GetDerived().utf8Names[widget.index].c_str();
     }
-};
 
-struct WindowState {
-    accesskit_windows_adapter* adapter;
-    accesskit_node_id focus;
-    std::shared_ptr<Navbar> navbar;
-    std::vector<std::shared_ptr<Button>> buttons;
+    // Next node in tab order: the layout's focus order, then runtime widgets.
+    accesskit_node_id nextFocus(accesskit_node_id current) {
+        const std::vector<WidgetId>& dynamicOrder = model.GetDerived().focusOrder;
+        bool hasStaticFocus = layout.size > 0 && layout.nodes[layout.firstFocus].focusable;
+        const StaticNode* node = layout.find(current);
+        if (node != nullptr && hasStaticFocus) {
+            uint32_t next = layout.nextFocus[layout.indexOf(current)];
+            if (next == layout.firstFocus && node->focusable && !dynamicOrder.empty()) {
+                return nodeIdOf(dynamicOrder[0]);
+            }
+            return layout.nodes[next].id;
+        }
 
-    WindowState(accesskit_windows_adapter* adapter, accesskit_node_id focus)
-        : adapter(adapter), focus(focus) {}
+        WidgetId widget = widgetOf(current);
+        size_t index = 0;
+        if (model.Contains(widget) && model.GetDerived().focusPosition[widget.index] != DerivedData::kNotFocusable) {
+            index = model.GetDerived().focusPosition[widget.index] + 1;
+        }
+        if (index < dynamicOrder.size() && (index > 0 || !hasStaticFocus)) {
+            return nodeIdOf(dynamicOrder[index]);
+        }
+        if (hasStaticFocus) {
+            return layout.nodes[layout.firstFocus].id;
+        }
+        return dynamicOrder.empty() ? current : nodeIdOf(dynamicOrder[0]);
+    }
 
-    void addButton(std::shared_ptr<Button> button) {
-        buttons.push_back(button);
+    accesskit_node* buildRoot() {
+        accesskit_node_builder* builder = accesskit_node_builder_new(ACCESSKIT_ROLE_WINDOW);
+        if (layout.size > 0) {
+            for (uint32_t child = layout.firstChild[0]; child < layout.firstChild[0] + layout.childCount[0]; child++) {
+                accesskit_node_builder_push_child(builder, layout.nodes[child].id);
+            }
+        }
+        for (WidgetId root : model.GetRoots()) {
+            accesskit_node_builder_push_child(builder, nodeIdOf(root));
+        }
+        return accesskit_node_builder_build(builder);
     }
 
-    void addNavbar(std::shared_ptr<Navbar> navbar) {
-        this->navbar = navbar;
+    accesskit_node* buildStaticNode(uint32_t index) {
+        const StaticNode& node = layout.nodes[index];
+        accesskit_node_builder* builder = accesskit_node_builder_new(node.role);
+        accesskit_node_builder_set_bounds(builder, node.rect);
+        if (node.name != nullptr) {
+            accesskit_node_builder_set_name(builder, node.name);
+        }
+        if (node.focusable) {
+            accesskit_node_builder_add_action(builder, ACCESSKIT_ACTION_FOCUS);
+        }
+        if (node.role == ACCESSKIT_ROLE_BUTTON) {
+            accesskit_node_builder_set_default_action_verb(builder, ACCESSKIT_DEFAULT_ACTION_VERB_CLICK);
+        }
+        for (uint32_t child = layout.firstChild[index]; child < layout.firstChild[index] + layout.childCount[index]; child++) {
+            accesskit_node_builder_push_child(builder, layout.nodes[child].id);
+        }
+        return accesskit_node_builder_build(builder);
     }
 
-    accesskit_node* buildRoot() {
-        accesskit_node_builder* builder = accesskit_node_builder_new(ACCESSKIT_ROLE_WINDOW);
-        accesskit_node_builder_push_child(builder, NAVBAR_ID);
+    // Reads only the widget and derived data that is already current, so
+    // nodes can be built on several threads at once.
+    accesskit_node* buildWidgetNode(WidgetId id, const DerivedData& derived) const {
+        const Widget& widget = *model.Get(id);
+        const WidgetRect& rect = derived.screenRects[id.index];
+        accesskit_node_builder* builder = accesskit_node_builder_new(widgetRole(widget.role));
+        accesskit_node_builder_set_bounds(builder, { (double)rect.left, (double)rect.top, (double)rect.right, (double)rect.bottom });
+        accesskit_node_builder_set_name(builder, derived.utf8Names[id.index].c_str());
+        if (widget.focusable) {
+            accesskit_node_builder_add_action(builder, ACCESSKIT_ACTION_FOCUS);
+        }
+        if (widget.role == WidgetRole::Button) {
+            accesskit_node_builder_set_default_action_verb(builder, ACCESSKIT_DEFAULT_ACTION_VERB_CLICK);
+        }
+        if (widget.role == WidgetRole::ProgressBar) {
+            accesskit_node_builder_set_numeric_value(builder, widget.value);
+            accesskit_node_builder_set_min_numeric_value(builder, widget.minimum);
+            accesskit_node_builder_set_max_numeric_value(builder, widget.maximum);
+        }
+        for (WidgetId child : widget.children) {
+            accesskit_node_builder_push_child(builder, nodeIdOf(child));
+        }
         return accesskit_node_builder_build(builder);
     }
 
     accesskit_tree_update* buildInitialTree() {
         accesskit_node* root = buildRoot();
-        accesskit_node* navbarNode = navbar->build();
-        accesskit_tree_update* update = accesskit_tree_update_with_capacity_and_focus(5, focus);
+        size_t staticNodes = layout.size > 0 ? layout.size - 1 : 0;
+        accesskit_tree_update* update = accesskit_tree_update_with_capacity_and_focus(1 + staticNodes + model.GetWidgets().size(), focus);
         accesskit_tree* tree = accesskit_tree_new(WINDOW_ID);
         accesskit_tree_set_app_name(tree, "Hello World");
         accesskit_tree_update_set_tree(update, tree);
         accesskit_tree_update_push_node(update, WINDOW_ID, root);
-        accesskit_tree_update_push_node(update, NAVBAR_ID, navbarNode);
-        for (const auto& button : buttons) {
-            accesskit_tree_update_push_node(update, button->id, button->build());
+        for (uint32_t index = 1; index < layout.size; index++) {
+            accesskit_tree_update_push_node(update, layout.nodes[index].id, buildStaticNode(index));
+        }
+
+        // Widget nodes are built into a table by slot, then pushed in id
+        // order so the update is the same however the work was split. With
+        // other threads to help, each task is a run of whole subtrees;
+        // alone, storage order reads memory in sequence. The tree sent here
+        // is the baseline for later diffs, hashed while its run is in cache.
+        const DerivedData& derived = model.GetDerived();
+        std::vector<accesskit_node*> built(model.GetWidgets().slotCount(), nullptr);
+        WorkStealingPool& threads = workPool();
+        treeDiff.BeginSeed(model);
+        if (threads.GetThreadCount() > 1) {
+            SplitIntoSubtrees(derived, NODES_PER_TASK, &runs);
+            threads.ForEach(runs.size(), [&](size_t run, size_t) {
+                for (uint32_t p = runs[run].first; p < runs[run].second; p++) {
+                    WidgetId widget = derived.preorder[p];
+                    built[widget.index] = buildWidgetNode(widget, derived);
+                }
+                treeDiff.SeedRun(model, derived, runs[run].first, runs[run].second, NODES_PER_TASK);
+            });
+            treeDiff.EndSeed(derived, NODES_PER_TASK);
+        }
+        else {
+            for (size_t i = 0; i < model.GetWidgets().size(); i++) {
+                WidgetId widget = model.GetWidgets().handleAt(i);
+                built[widget.index] = buildWidgetNode(widget, derived);
+            }
+            uint32_t count = static_cast<uint32_t>(derived.preorder.size());
+            treeDiff.SeedRun(model, derived, 0, count, count);
+            treeDiff.EndSeed(derived, count);
+        }
+        for (size_t slot = 0; slot < built.size(); slot++) {
+            if (built[slot] != nullptr) {
+                accesskit_tree_update_push_node(update, static_cast<accesskit_node_id>(layout.size + slot), built[slot]);
+            }
         }
         return update;
     }
 
-    void draw(HDC hdc) {
-        if (navbar) {
-            navbar->draw(hdc);
+    accesskit_node* buildNode(accesskit_node_id id) {
+        if (id == WINDOW_ID) {
+            return buildRoot();
+        }
+        if (layout.find(id) != nullptr) {
+            return buildStaticNode(layout.indexOf(id));
+        }
+        WidgetId widget = widgetOf(id);
+        return model.Contains(widget) ? buildWidgetNode(widget, model.GetDerived()) : nullptr;
+    }
+
+    // The focus and the nodes changed in the frame being committed.
+    accesskit_tree_update* buildFrameUpdate() {
+        accesskit_tree_update* update = accesskit_tree_update_with_capacity_and_focus(frameNodes.size(), focus);
+        for (accesskit_node_id id : frameNodes) {
+            accesskit_node* node = buildNode(id);
+            if (node != nullptr) {
+                accesskit_tree_update_push_node(update, id, node);
+            }
+        }
+        return update;
+    }
+
+    void draw(Renderer& renderer) {
+        // Breadth-first order paints containers before their children
+        for (uint32_t index = 1; index < layout.size; index++) {
+            const StaticNode& node = layout.nodes[index];
+            WidgetRect rect = { (int32_t)node.rect.x0, (int32_t)node.rect.y0, (int32_t)node.rect.x1, (int32_t)node.rect.y1 };
+            renderer.FillRect(rect, node.color);
+            if (node.role == ACCESSKIT_ROLE_BUTTON) {
+                renderer.DrawLabel(rect, staticLabels[index], kDefaultFont, 0x000000);
+            }
+        }
+
+        for (WidgetId root : model.GetRoots()) {
+            PaintWidgetTree(renderer, model, root);
         }
     }
 };
@@ -131,22 +305,72 @@ void windowStateFree(WindowState* state) {
     delete state;
 }
 
-void windowStateSetFocus(WindowState* state, accesskit_node_id focus) {
-    state->focus = focus;
-    accesskit_windows_queued_events* events =
-        accesskit_windows_adapter_update_if_active(state->adapter, [](void* userdata) {
-        WindowState* state = static_cast<WindowState*>(userdata);
-        accesskit_tree_update* update = accesskit_tree_update_with_focus(state->focus);
-        return update;
-            }, state);
-    if (events != NULL) {
-        accesskit_windows_queued_events_raise(events);
+// Applies everything changed since the last frame: one layout pass, one
+// accessibility update and one repaint.
+void windowStateCommit(HWND hwnd, WindowState* state) {
+    state->scheduler.Commit(GetTickCount64(), [&](const FrameChanges& changes) {
+        state->model.GetDerived();
+        std::vector<accesskit_node_id>& nodes = state->frameNodes;
+        nodes.assign(changes.nodes.begin(), changes.nodes.end());
+        if (changes.layoutChanged) {
+            // Any widget may have changed; send only those whose node differs
+            state->treeDiff.Diff(state->model, state->workPool(), &state->diffChanged, &state->diffRemoved);
+            for (WidgetId widget : state->diffChanged) {
+                nodes.push_back(state->nodeIdOf(widget));
+            }
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        }
+        if (changes.focusChanged || !nodes.empty()) {
+            accesskit_windows_queued_events* events =
+                accesskit_windows_adapter_update_if_active(state->adapter, [](void* userdata) {
+                return static_cast<WindowState*>(userdata)->buildFrameUpdate();
+                    }, state);
+            if (events != NULL) {
+                accesskit_windows_queued_events_raise(events);
+            }
+        }
+        if (changes.repaintAll) {
+            InvalidateRect(hwnd, NULL, TRUE);
+        }
+        else if (changes.repaint) {
+            RECT rect = { changes.dirtyRect.left, changes.dirtyRect.top, changes.dirtyRect.right, changes.dirtyRect.bottom };
+            InvalidateRect(hwnd, &rect, TRUE);
+        }
+    });
+}
+
+// Called after recording changes: commits at once if the oldest one has
+// waited out the delay budget, otherwise leaves it to the frame timer.
+void windowStateScheduleFrame(HWND hwnd, WindowState* state) {
+    if (state->scheduler.IsOverdue(GetTickCount64())) {
+        windowStateCommit(hwnd, state);
+    }
+    uint64_t due = state->scheduler.GetNextDue(GetTickCount64());
+    if (due == FrameScheduler::kNothingPending) {
+        KillTimer(hwnd, FRAME_TIMER);
+    }
+    else {
+        SetTimer(hwnd, FRAME_TIMER, static_cast<UINT>(due), NULL);
     }
 }
 
+void windowStateSetFocus(HWND hwnd, WindowState* state, accesskit_node_id focus) {
+    uint64_t now = GetTickCount64();
+    state->focus = focus;
+    state->scheduler.FocusChanged(now);
+    state->scheduler.InvalidateAll(now);
+    windowStateScheduleFrame(hwnd, state);
+}
+
 void windowStatePressButton(WindowState* state, accesskit_node_id id) {
+    const char* name = state->buttonName(id);
+    if (name == nullptr) {
+        return;
+    }
     // Your custom logic here
-    MessageBox(NULL, (id == BUTTON_1_ID ? L"Button 1 pressed" : (id == BUTTON_2_ID ? L"Button 2 pressed" : L"Button 3 pressed")), L"Button Pressed", MB_OK);
+    std::string message = std::string(name) + " pressed";
+    MessageBoxA(NULL, message.c_str(), "Button Pressed", MB_OK);
 }
 
 WindowState* getWindowState(HWND window) {
@@ -168,7 +392,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 }
                 accesskit_action_request_free(request);
                 }, hwnd),
-            *initialFocus);
+            *initialFocus, LAYOUT.view());
         SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(state));
         return DefWindowProc(hwnd, msg, wParam, lParam);
     }
@@ -177,11 +401,16 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         HDC hdc = BeginPaint(hwnd, &ps);
         WindowState* state = getWindowState(hwnd);
         if (state) {
-            state->draw(hdc);
+            state->textCache.BeginFrame();
+            GdiRenderer renderer(hdc, &state->textCache);
+            state->draw(state->drawBatch);
+            state->drawBatch.Flush(renderer);
+            state->textCache.EndFrame();
         }
         EndPaint(hwnd, &ps);
     }
     else if (msg == WM_DESTROY) {
+        KillTimer(hwnd, FRAME_TIMER);
         LONG_PTR ptr = SetWindowLongPtr(hwnd, GWLP_USERDATA, 0);
         if (ptr != 0) {
             WindowState* state = reinterpret_cast<WindowState*>(ptr);
@@ -224,22 +453,12 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     else if (msg == WM_KEYDOWN) {
         WindowState* state = getWindowState(hwnd);
         if (wParam == VK_TAB) {
-            accesskit_node_id newFocus;
-            if (state->focus == BUTTON_1_ID) {
-                newFocus = BUTTON_2_ID;
-            }
-            else if (state->focus == BUTTON_2_ID) {
-                newFocus = BUTTON_3_ID;
-            }
-            else {
-                newFocus = BUTTON_1_ID;
-            }
-            windowStateSetFocus(state, newFocus);
-            InvalidateRect(hwnd, NULL, TRUE);
+            windowStateSetFocus(hwnd, state, state->nextFocus(state->focus));
         }
         else if (wParam == VK_SPACE) {
             windowStatePressButton(state, state->focus);
-            InvalidateRect(hwnd, NULL, TRUE);
+            state->scheduler.InvalidateAll(GetTickCount64());
+            windowStateScheduleFrame(hwnd, state);
         }
         else {
             return DefWindowProc(hwnd, msg, wParam, lParam);
@@ -247,13 +466,27 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     }
     else if (msg == SET_FOCUS_MSG) {
         accesskit_node_id id = static_cast<accesskit_node_id>(lParam);
-        windowStateSetFocus(getWindowState(hwnd), id);
-        InvalidateRect(hwnd, NULL, TRUE);
+        windowStateSetFocus(hwnd, getWindowState(hwnd), id);
     }
     else if (msg == DO_DEFAULT_ACTION_MSG) {
+        WindowState* state = getWindowState(hwnd);
         accesskit_node_id id = static_cast<accesskit_node_id>(lParam);
-        windowStatePressButton(getWindowState(hwnd), id);
-        InvalidateRect(hwnd, NULL, TRUE);
+        windowStatePressButton(state, id);
+        state->scheduler.InvalidateAll(GetTickCount64());
+        windowStateScheduleFrame(hwnd, state);
+    }
+    else if (msg == WM_SETTINGCHANGE || msg == WM_THEMECHANGED) {
+        // Theme and locale switches can reach any widget
+        WindowState* state = getWindowState(hwnd);
+        state->scheduler.LayoutChanged(GetTickCount64());
+        state->scheduler.InvalidateAll(GetTickCount64());
+        windowStateScheduleFrame(hwnd, state);
+        return DefWindowProc(hwnd, msg, wParam, lParam);
+    }
+    else if (msg == WM_TIMER && wParam == FRAME_TIMER) {
+        WindowState* state = getWindowState(hwnd);
+        windowStateCommit(hwnd, state);
+        windowStateScheduleFrame(hwnd, state);
     }
     else {
         return DefWindowProc(hwnd, msg, wParam, lParam);
@@ -295,17 +528,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         return 0;
     }
 
-    std::shared_ptr<Button> button1 = std::make_shared<Button>(BUTTON_1_ID, "Button 1", BUTTON_1_RECT, RGB(200, 200, 200));
-    std::shared_ptr<Button> button2 = std::make_shared<Button>(BUTTON_2_ID, "Button 2", BUTTON_2_RECT, RGB(200, 200, 200));
-    std::shared_ptr<Button> button3 = std::make_shared<Button>(BUTTON_3_ID, "Button 3", BUTTON_3_RECT, RGB(200, 200, 200));
-    std::vector<std::shared_ptr<Button>> buttons = { button1, button2, button3 };
-    std::shared_ptr<Navbar> navbar = std::make_shared<Navbar>(NAVBAR_ID, NAVBAR_RECT, buttons, RGB(0, 0, 255));
-    WindowState* state = getWindowState(hwnd);
-    state->addNavbar(navbar);
-    state->addButton(button1);
-    state->addButton(button2);
-    state->addButton(button3);
-
     ShowWindow(hwnd, nCmdShow);
     UpdateWindow(hwnd);
 
@@ -1,59 +1,222 @@
 #include <windows.h>
 #include <oleacc.h>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <string>
+#include "../Shared/WidgetModel.h"
+#include "../Shared/AllocationCounter.h"
+#include "../Shared/DrawBatch.h"
+#include "../Shared/GdiRenderer.h"
+#include "../Shared/SelectionSet.h"
+#include "../Shared/WidgetPainter.h"
+#include "../Shared/ValueNotifier.h"
+#include "../Shared/ValueSlots.h"
+#include "../Shared/Win32ScreenTransform.h"
 
 // Define STATE_SYSTEM_NORMAL if not defined
 #ifndef STATE_SYSTEM_NORMAL
 #define STATE_SYSTEM_NORMAL 0x00000000
 #endif
 
-class Box // Move the Box class definition here
+inline long RoleOf(WidgetRole role)
+{
+    switch (role)
+    {
+    case WidgetRole::Window:
+        return ROLE_SYSTEM_WINDOW;
+    case WidgetRole::Toolbar:
+        return ROLE_SYSTEM_TOOLBAR;
+    case WidgetRole::ProgressBar:
+        return ROLE_SYSTEM_PROGRESSBAR;
+    default:
+        return ROLE_SYSTEM_PUSHBUTTON;
+    }
+}
+
+inline long StateOf(const Widget* widget)
+{
+    return widget && widget->role == WidgetRole::ProgressBar ? STATE_SYSTEM_READONLY : STATE_SYSTEM_NORMAL;
+}
+
+// State of the item at index in a container whose children can be selected.
+inline long StateOf(const Widget* widget, const SelectionSet* selection, size_t index)
+{
+    long state = StateOf(widget);
+    if (selection)
+    {
+        state |= STATE_SYSTEM_SELECTABLE;
+        if (selection->IsSelected(index))
+        {
+            state |= STATE_SYSTEM_SELECTED;
+        }
+    }
+    return state;
+}
+
+// Applies accSelect flags to the child at index. Taking the selection cannot
+// be combined with adding, removing or extending, and adding cannot be
+// combined with removing.
+inline HRESULT SelectChild(WidgetModel* model, WidgetId child, SelectionSet* selection, size_t index, long flags)
+{
+    const long kSelectionFlags = SELFLAG_TAKESELECTION | SELFLAG_EXTENDSELECTION | SELFLAG_ADDSELECTION | SELFLAG_REMOVESELECTION;
+    if ((flags & ~(kSelectionFlags | SELFLAG_TAKEFOCUS)) ||
+        ((flags & SELFLAG_TAKESELECTION) && (flags & (SELFLAG_EXTENDSELECTION | SELFLAG_ADDSELECTION | SELFLAG_REMOVESELECTION))) ||
+        ((flags & SELFLAG_ADDSELECTION) && (flags & SELFLAG_REMOVESELECTION)))
+    {
+        return E_INVALIDARG;
+    }
+    if ((flags & kSelectionFlags) && (!selection || index >= selection->GetItemCount()))
+    {
+        return S_FALSE;
+    }
+
+    if (flags & SELFLAG_TAKEFOCUS)
+    {
+        model->SetFocus(child);
+    }
+    if (flags & SELFLAG_TAKESELECTION)
+    {
+        selection->SelectOnly(index);
+    }
+    else if (flags & SELFLAG_EXTENDSELECTION)
+    {
+        // Without add or remove the range takes on the anchor's state
+        bool selected = flags & SELFLAG_ADDSELECTION ? true
+            : flags & SELFLAG_REMOVESELECTION ? false
+            : selection->GetAnchor() == SelectionSet::kNoItem || selection->IsSelected(selection->GetAnchor());
+        selection->ExtendTo(index, selected);
+    }
+    else if (flags & (SELFLAG_ADDSELECTION | SELFLAG_REMOVESELECTION))
+    {
+        if (flags & SELFLAG_ADDSELECTION)
+        {
+            selection->Select(index);
+        }
+        else
+        {
+            selection->Deselect(index);
+        }
+        selection->SetAnchor(index);
+    }
+    return S_OK;
+}
+
+// Enumerates the selected children as VT_I4 child ids straight from the
+// bitset, so get_accSelection does not copy the selection however large it
+// is. The set must outlive the enumerator.
+class SelectionEnumerator : public IEnumVARIANT
 {
 public:
-    Box(RECT rect, const std::wstring& text) : rect(rect), text(text) {}
+    SelectionEnumerator(const SelectionSet* selection, size_t position) : refCount(1), selection(selection), position(position) {}
 
-    void Draw(HDC hdc)
+    // IUnknown methods
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
     {
-        // Create a white brush for the boxes
-        HBRUSH hBrush = CreateSolidBrush(RGB(255, 255, 255));
-        FillRect(hdc, &rect, hBrush);
-        DeleteObject(hBrush);
+        if (riid == IID_IUnknown || riid == IID_IEnumVARIANT)
+        {
+            *ppvObject = static_cast<IEnumVARIANT*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
 
-        // Create a font for the text
-        HFONT hFont = CreateFont(18, 0, 0, 0, FW_BOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, VARIABLE_PITCH, TEXT("Arial"));
-        HFONT hOldFont = (HFONT)SelectObject(hdc, hFont);
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return InterlockedIncrement(&refCount);
+    }
 
-        // Set text color to black
-        SetTextColor(hdc, RGB(0, 0, 0));
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG count = InterlockedDecrement(&refCount);
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
 
-        // Draw the text in the center of the box
-        DrawText(hdc, text.c_str(), -1, &rect, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+    // IEnumVARIANT methods
+    HRESULT STDMETHODCALLTYPE Next(ULONG celt, VARIANT* rgVar, ULONG* pCeltFetched) override
+    {
+        ULONG fetched = 0;
+        for (; fetched < celt; fetched++)
+        {
+            position = selection->NextSelected(position);
+            if (position == SelectionSet::kNoItem)
+            {
+                break;
+            }
+            rgVar[fetched].vt = VT_I4;
+            rgVar[fetched].lVal = static_cast<long>(position) + 1;
+            position++;
+        }
+        if (pCeltFetched)
+        {
+            *pCeltFetched = fetched;
+        }
+        return fetched == celt ? S_OK : S_FALSE;
+    }
 
-        // Restore the old font
-        SelectObject(hdc, hOldFont);
-        DeleteObject(hFont);
+    HRESULT STDMETHODCALLTYPE Skip(ULONG celt) override
+    {
+        for (ULONG i = 0; i < celt; i++)
+        {
+            position = selection->NextSelected(position);
+            if (position == SelectionSet::kNoItem)
+            {
+                return S_FALSE;
+            }
+            position++;
+        }
+        return S_OK;
     }
 
-    RECT GetRect() const
+    HRESULT STDMETHODCALLTYPE Reset() override
     {
-        return rect;
+        position = 0;
+        return S_OK;
     }
 
-    std::wstring GetText() const
+    HRESULT STDMETHODCALLTYPE Clone(IEnumVARIANT** ppEnum) override
     {
-        return text;
+        *ppEnum = new SelectionEnumerator(selection, position);
+        return S_OK;
     }
 
 private:
-    RECT rect;
-    std::wstring text;
+    ULONG refCount;
+    const SelectionSet* selection;
+    size_t position;
 };
 
+// Child index a trace records for a child id: kTraceSelf for the element
+// itself, since child ids are 1-based positions.
+inline int64_t TraceChildIndex(const VARIANT& varChild)
+{
+    return varChild.vt == VT_I4 && varChild.lVal != CHILDID_SELF ? varChild.lVal - 1 : kTraceSelf;
+}
+
+// Only range widgets have a value; the rest keep reporting E_NOTIMPL.
+inline HRESULT GetValueOf(const Widget* widget, BSTR* pszValue)
+{
+    *pszValue = NULL;
+    if (!widget || widget->role != WidgetRole::ProgressBar)
+    {
+        return E_NOTIMPL;
+    }
+    *pszValue = SysAllocString(GetValueText(*widget).c_str());
+    return *pszValue ? S_OK : E_OUTOFMEMORY;
+}
+
 class AccessibleBox : public IAccessible
 {
 public:
-    AccessibleBox(Box* box) : refCount(1), box(box)
+    // selection holds the selection state of the box and its siblings, or is
+    // null when the parent does not support selection.
+    AccessibleBox(WidgetModel* model, WidgetId id, SelectionSet* selection) : refCount(1), model(model), id(id), selection(selection)
     {
         CoInitialize(NULL);
     }
@@ -92,29 +255,30 @@ public:
     }
 
     // IAccessible methods
-    HRESULT STDMETHODCALLTYPE get_accParent(IDispatch** ppdispParent) override
-    {
-        *ppdispParent = NULL;
-        return S_FALSE;
-    }
+    // Defined after AccessibleNavbar, which represents the parent
+    HRESULT STDMETHODCALLTYPE get_accParent(IDispatch** ppdispParent) override;
 
     HRESULT STDMETHODCALLTYPE get_accChildCount(long* pcountChildren) override
     {
+        CallScope call(TraceEvent::AccChildCount, { id.index, kTraceSelf });
         *pcountChildren = 0;
         return S_OK;
     }
 
     HRESULT STDMETHODCALLTYPE get_accChild(VARIANT varChild, IDispatch** ppdispChild) override
     {
+        CallScope call(TraceEvent::AccChild, { id.index, TraceChildIndex(varChild) });
         *ppdispChild = NULL;
         return E_INVALIDARG;
     }
 
     HRESULT STDMETHODCALLTYPE get_accName(VARIANT varChild, BSTR* pszName) override
     {
+        CallScope call(TraceEvent::AccName, { id.index, TraceChildIndex(varChild) });
         if (varChild.vt == VT_I4 && varChild.lVal == CHILDID_SELF)
         {
-            *pszName = SysAllocString(L"Box");
+            const Widget* widget = model->Get(id);
+            *pszName = SysAllocString(widget ? widget->name.c_str() : L"Box");
             return S_OK;
         }
         return E_INVALIDARG;
@@ -122,8 +286,13 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accValue(VARIANT varChild, BSTR* pszValue) override
     {
+        CallScope call(TraceEvent::AccValue, { id.index, TraceChildIndex(varChild) });
+        if (varChild.vt == VT_I4 && varChild.lVal == CHILDID_SELF)
+        {
+            return GetValueOf(model->Get(id), pszValue);
+        }
         *pszValue = NULL;
-        return E_NOTIMPL;
+        return E_INVALIDARG;
     }
 
     HRESULT STDMETHODCALLTYPE get_accDescription(VARIANT varChild, BSTR* pszDescription) override
@@ -134,10 +303,12 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accRole(VARIANT varChild, VARIANT* pvarRole) override
     {
+        CallScope call(TraceEvent::AccRole, { id.index, TraceChildIndex(varChild) });
         if (varChild.vt == VT_I4 && varChild.lVal == CHILDID_SELF)
         {
+            const Widget* widget = model->Get(id);
             pvarRole->vt = VT_I4;
-            pvarRole->lVal = ROLE_SYSTEM_PUSHBUTTON;
+            pvarRole->lVal = widget ? RoleOf(widget->role) : ROLE_SYSTEM_PUSHBUTTON;
             return S_OK;
         }
         return E_INVALIDARG;
@@ -145,10 +316,11 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accState(VARIANT varChild, VARIANT* pvarState) override
     {
+        CallScope call(TraceEvent::AccState, { id.index, TraceChildIndex(varChild) });
         if (varChild.vt == VT_I4 && varChild.lVal == CHILDID_SELF)
         {
             pvarState->vt = VT_I4;
-            pvarState->lVal = STATE_SYSTEM_NORMAL;
+            pvarState->lVal = StateOf(model->Get(id), selection, GetIndex());
             return S_OK;
         }
         return E_INVALIDARG;
@@ -174,12 +346,14 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accFocus(VARIANT* pvarChild) override
     {
+        CallScope call(TraceEvent::AccFocus, { id.index, kTraceSelf });
         pvarChild->vt = VT_EMPTY;
         return S_FALSE;
     }
 
     HRESULT STDMETHODCALLTYPE get_accSelection(VARIANT* pvarChildren) override
     {
+        CallScope call(TraceEvent::AccSelection, { id.index, kTraceSelf });
         pvarChildren->vt = VT_EMPTY;
         return S_FALSE;
     }
@@ -192,17 +366,24 @@ public:
 
     HRESULT STDMETHODCALLTYPE accSelect(long flagsSelect, VARIANT varChild) override
     {
-        return E_NOTIMPL;
+        CallScope call(TraceEvent::AccSelect, { id.index, TraceChildIndex(varChild), flagsSelect });
+        if (varChild.vt == VT_I4 && varChild.lVal == CHILDID_SELF && model->Contains(id))
+        {
+            return SelectChild(model, id, selection, GetIndex(), flagsSelect);
+        }
+        return E_INVALIDARG;
     }
 
     HRESULT STDMETHODCALLTYPE accLocation(long* pxLeft, long* pyTop, long* pcxWidth, long* pcyHeight, VARIANT varChild) override
     {
-        if (varChild.vt == VT_I4 && varChild.lVal == CHILDID_SELF)
+        CallScope call(TraceEvent::AccLocation, { id.index, TraceChildIndex(varChild) });
+        if (varChild.vt == VT_I4 && varChild.lVal == CHILDID_SELF && model->Contains(id))
         {
-            *pxLeft = box->GetRect().left;
-            *pyTop = box->GetRect().top;
-            *pcxWidth = box->GetRect().right - box->GetRect().left;
-            *pcyHeight = box->GetRect().bottom - box->GetRect().top;
+            const WidgetRect& rect = model->GetDerived().screenRects[id.index];
+            *pxLeft = rect.left;
+            *pyTop = rect.top;
+            *pcxWidth = rect.right - rect.left;
+            *pcyHeight = rect.bottom - rect.top;
             return S_OK;
         }
         return E_INVALIDARG;
@@ -210,12 +391,14 @@ public:
 
     HRESULT STDMETHODCALLTYPE accNavigate(long navDir, VARIANT varStart, VARIANT* pvarEndUpAt) override
     {
+        CallScope call(TraceEvent::AccNavigate, { id.index, TraceChildIndex(varStart), navDir });
         pvarEndUpAt->vt = VT_EMPTY;
         return S_FALSE;
     }
 
     HRESULT STDMETHODCALLTYPE accHitTest(long xLeft, long yTop, VARIANT* pvarChild) override
     {
+        CallScope call(TraceEvent::AccHitTest, { id.index, kTraceSelf, xLeft, yTop });
         pvarChild->vt = VT_EMPTY;
         return S_FALSE;
     }
@@ -258,49 +441,23 @@ public:
     }
 
 private:
-    ULONG refCount;
-    Box* box;
-};
-
-class Navbar
-{
-public:
-    Navbar(RECT rect) : rect(rect) {}
-
-    void AddBox(const Box& box)
-    {
-        boxes.push_back(box);
-    }
-
-    void Draw(HDC hdc)
-    {
-        // Create a blue brush for the navbar
-        HBRUSH hBrush = CreateSolidBrush(RGB(0, 0, 255));
-        FillRect(hdc, &rect, hBrush);
-        DeleteObject(hBrush);
-
-        // Draw each box
-        for (auto& box : boxes)
-        {
-            box.Draw(hdc);
-        }
-    }
-
-    std::vector<Box>& GetBoxes() // Ensure this returns a reference
+    size_t GetIndex() const
     {
-        return boxes;
+        return model->GetDerived().childIndex[id.index];
     }
 
-public:
-    RECT rect;
-private:
-    std::vector<Box> boxes;
+    ULONG refCount;
+    WidgetModel* model;
+    WidgetId id;
+    SelectionSet* selection;
 };
 
 class AccessibleNavbar : public IAccessible
 {
 public:
-    AccessibleNavbar(Navbar* navbar) : refCount(1), navbar(navbar)
+    // selection holds the selection state of the navbar's children, or is
+    // null when they cannot be selected.
+    AccessibleNavbar(WidgetModel* model, WidgetId id, SelectionSet* selection) : refCount(1), model(model), id(id), selection(selection)
     {
         CoInitialize(NULL);
     }
@@ -341,21 +498,38 @@ public:
     // IAccessible methods
     HRESULT STDMETHODCALLTYPE get_accParent(IDispatch** ppdispParent) override
     {
+        const Widget* widget = model->Get(id);
+        if (widget && model->Contains(widget->parent))
+        {
+            *ppdispParent = new AccessibleNavbar(model, widget->parent, nullptr);
+            return S_OK;
+        }
         *ppdispParent = NULL;
         return S_FALSE;
     }
 
     HRESULT STDMETHODCALLTYPE get_accChildCount(long* pcountChildren) override
     {
-        *pcountChildren = static_cast<long>(navbar->GetBoxes().size());
+        CallScope call(TraceEvent::AccChildCount, { id.index, kTraceSelf });
+        *pcountChildren = GetChildCount();
         return S_OK;
     }
 
     HRESULT STDMETHODCALLTYPE get_accChild(VARIANT varChild, IDispatch** ppdispChild) override
     {
-        if (varChild.vt == VT_I4 && varChild.lVal > 0 && varChild.lVal <= static_cast<long>(navbar->GetBoxes().size()))
+        CallScope call(TraceEvent::AccChild, { id.index, TraceChildIndex(varChild) });
+        if (varChild.vt == VT_I4 && varChild.lVal > 0 && varChild.lVal <= GetChildCount())
         {
-            *ppdispChild = new AccessibleBox(&navbar->GetBoxes()[varChild.lVal - 1]);
+            WidgetId child = model->GetChild(id, varChild.lVal - 1);
+            WidgetRole role = model->Get(child)->role;
+            if (role == WidgetRole::Button || role == WidgetRole::ProgressBar)
+            {
+                *ppdispChild = new AccessibleBox(model, child, selection);
+            }
+            else
+            {
+                *ppdispChild = new AccessibleNavbar(model, child, nullptr); // A nested container
+            }
             return S_OK;
         }
         *ppdispChild = NULL;
@@ -364,16 +538,17 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accName(VARIANT varChild, BSTR* pszName) override
     {
+        CallScope call(TraceEvent::AccName, { id.index, TraceChildIndex(varChild) });
         if (varChild.vt == VT_I4)
         {
             if (varChild.lVal == CHILDID_SELF)
             {
-                *pszName = SysAllocString(L"Navbar");
+                *pszName = SysAllocString(model->Get(id)->name.c_str());
                 return S_OK;
             }
-            else if (varChild.lVal > 0 && varChild.lVal <= static_cast<long>(navbar->GetBoxes().size()))
+            else if (varChild.lVal > 0 && varChild.lVal <= GetChildCount())
             {
-                *pszName = SysAllocString(navbar->GetBoxes()[varChild.lVal - 1].GetText().c_str());
+                *pszName = SysAllocString(model->Get(model->GetChild(id, varChild.lVal - 1))->name.c_str());
                 return S_OK;
             }
         }
@@ -382,8 +557,20 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accValue(VARIANT varChild, BSTR* pszValue) override
     {
+        CallScope call(TraceEvent::AccValue, { id.index, TraceChildIndex(varChild) });
+        if (varChild.vt == VT_I4)
+        {
+            if (varChild.lVal == CHILDID_SELF)
+            {
+                return GetValueOf(model->Get(id), pszValue);
+            }
+            else if (varChild.lVal > 0 && varChild.lVal <= GetChildCount())
+            {
+                return GetValueOf(model->Get(model->GetChild(id, varChild.lVal - 1)), pszValue);
+            }
+        }
         *pszValue = NULL;
-        return E_NOTIMPL;
+        return E_INVALIDARG;
     }
 
     HRESULT STDMETHODCALLTYPE get_accDescription(VARIANT varChild, BSTR* pszDescription) override
@@ -394,16 +581,17 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accRole(VARIANT varChild, VARIANT* pvarRole) override
     {
+        CallScope call(TraceEvent::AccRole, { id.index, TraceChildIndex(varChild) });
         if (varChild.vt == VT_I4)
         {
             pvarRole->vt = VT_I4;
             if (varChild.lVal == CHILDID_SELF)
             {
-                pvarRole->lVal = ROLE_SYSTEM_TOOLBAR;
+                pvarRole->lVal = RoleOf(model->Get(id)->role);
             }
-            else if (varChild.lVal > 0 && varChild.lVal <= static_cast<long>(navbar->GetBoxes().size()))
+            else if (varChild.lVal > 0 && varChild.lVal <= GetChildCount())
             {
-                pvarRole->lVal = ROLE_SYSTEM_PUSHBUTTON;
+                pvarRole->lVal = RoleOf(model->Get(model->GetChild(id, varChild.lVal - 1))->role);
             }
             else
             {
@@ -416,10 +604,22 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accState(VARIANT varChild, VARIANT* pvarState) override
     {
+        CallScope call(TraceEvent::AccState, { id.index, TraceChildIndex(varChild) });
         if (varChild.vt == VT_I4)
         {
             pvarState->vt = VT_I4;
-            pvarState->lVal = STATE_SYSTEM_NORMAL;
+            if (varChild.lVal == CHILDID_SELF)
+            {
+                pvarState->lVal = StateOf(model->Get(id));
+            }
+            else if (varChild.lVal > 0 && varChild.lVal <= GetChildCount())
+            {
+                pvarState->lVal = StateOf(model->Get(model->GetChild(id, varChild.lVal - 1)), selection, varChild.lVal - 1);
+            }
+            else
+            {
+                return E_INVALIDARG;
+            }
             return S_OK;
         }
         return E_INVALIDARG;
@@ -445,14 +645,29 @@ public:
 
     HRESULT STDMETHODCALLTYPE get_accFocus(VARIANT* pvarChild) override
     {
+        CallScope call(TraceEvent::AccFocus, { id.index, kTraceSelf });
         pvarChild->vt = VT_EMPTY;
         return S_FALSE;
     }
 
     HRESULT STDMETHODCALLTYPE get_accSelection(VARIANT* pvarChildren) override
     {
-        pvarChildren->vt = VT_EMPTY;
-        return S_FALSE;
+        CallScope call(TraceEvent::AccSelection, { id.index, kTraceSelf });
+        size_t count = selection ? selection->GetSelectedCount() : 0;
+        if (count == 0)
+        {
+            pvarChildren->vt = VT_EMPTY;
+            return S_FALSE;
+        }
+        if (count == 1)
+        {
+            pvarChildren->vt = VT_I4;
+            pvarChildren->lVal = static_cast<long>(selection->NextSelected(0)) + 1;
+            return S_OK;
+        }
+        pvarChildren->vt = VT_UNKNOWN;
+        pvarChildren->punkVal = new SelectionEnumerator(selection, 0);
+        return S_OK;
     }
 
     HRESULT STDMETHODCALLTYPE get_accDefaultAction(VARIANT varChild, BSTR* pszDefaultAction) override
@@ -463,24 +678,31 @@ public:
 
     HRESULT STDMETHODCALLTYPE accSelect(long flagsSelect, VARIANT varChild) override
     {
-        return E_NOTIMPL;
+        CallScope call(TraceEvent::AccSelect, { id.index, TraceChildIndex(varChild), flagsSelect });
+        if (varChild.vt == VT_I4 && varChild.lVal > 0 && varChild.lVal <= GetChildCount())
+        {
+            return SelectChild(model, model->GetChild(id, varChild.lVal - 1), selection, varChild.lVal - 1, flagsSelect);
+        }
+        return E_INVALIDARG;
     }
 
     HRESULT STDMETHODCALLTYPE accLocation(long* pxLeft, long* pyTop, long* pcxWidth, long* pcyHeight, VARIANT varChild) override
     {
+        CallScope call(TraceEvent::AccLocation, { id.index, TraceChildIndex(varChild) });
         if (varChild.vt == VT_I4)
         {
             if (varChild.lVal == CHILDID_SELF)
             {
-                *pxLeft = navbar->rect.left;
-                *pyTop = navbar->rect.top;
-                *pcxWidth = navbar->rect.right - navbar->rect.left;
-                *pcyHeight = navbar->rect.bottom - navbar->rect.top;
+                const WidgetRect& rect = model->GetDerived().screenRects[id.index];
+                *pxLeft = rect.left;
+                *pyTop = rect.top;
+                *pcxWidth = rect.right - rect.left;
+                *pcyHeight = rect.bottom - rect.top;
                 return S_OK;
             }
-            else if (varChild.lVal > 0 && varChild.lVal <= static_cast<long>(navbar->GetBoxes().size()))
+            else if (varChild.lVal > 0 && varChild.lVal <= GetChildCount())
             {
-                RECT boxRect = navbar->GetBoxes()[varChild.lVal - 1].GetRect();
+                const WidgetRect& boxRect = model->GetDerived().screenRects[model->GetChild(id, varChild.lVal - 1).index];
                 *pxLeft = boxRect.left;
                 *pyTop = boxRect.top;
                 *pcxWidth = boxRect.right - boxRect.left;
@@ -493,12 +715,14 @@ public:
 
     HRESULT STDMETHODCALLTYPE accNavigate(long navDir, VARIANT varStart, VARIANT* pvarEndUpAt) override
     {
+        CallScope call(TraceEvent::AccNavigate, { id.index, TraceChildIndex(varStart), navDir });
         pvarEndUpAt->vt = VT_EMPTY;
         return S_FALSE;
     }
 
     HRESULT STDMETHODCALLTYPE accHitTest(long xLeft, long yTop, VARIANT* pvarChild) override
     {
+        CallScope call(TraceEvent::AccHitTest, { id.index, kTraceSelf, xLeft, yTop });
         pvarChild->vt = VT_EMPTY;
         return S_FALSE;
     }
@@ -541,56 +765,271 @@ public:
     }
 
 private:
+    long GetChildCount() const
+    {
+        return static_cast<long>(model->GetChildCount(id));
+    }
+
     ULONG refCount;
-    Navbar* navbar;
+    WidgetModel* model;
+    WidgetId id;
+    SelectionSet* selection;
 };
 
-Navbar* gNavbar;
+HRESULT STDMETHODCALLTYPE AccessibleBox::get_accParent(IDispatch** ppdispParent)
+{
+    const Widget* widget = model->Get(id);
+    if (widget && model->Contains(widget->parent))
+    {
+        *ppdispParent = new AccessibleNavbar(model, widget->parent, selection);
+        return S_OK;
+    }
+    *ppdispParent = NULL;
+    return S_FALSE;
+}
+
+WidgetModel* gModel;
+QueryTraceWriter gTrace;
+TextLayoutCache gTextCache;
+DrawBatch gDrawBatch;
+WidgetId gNavbar = kNoWidget;
+
+// Dashboard demo: a worker thread produces progress samples far faster than
+// an AT should hear about them. It writes them to a value slot; the window
+// samples the slots once per frame, and value change events go through a
+// per-widget throttle.
+const UINT_PTR kFrameTimer = 1;
+const UINT_PTR kNotifyTimer = 2;
+const UINT kFrameInterval = 16;
+WidgetId gProgress = kNoWidget;
+ValueNotifier gNotifier(10);
+ValueSlots gValueSlots(1);
+std::vector<WidgetId> gSlotWidgets;
+std::vector<WidgetRect> gInvalidRects;
+std::thread gWorker;
+std::atomic<bool> gStopWorker(false);
+std::vector<WidgetEvent> gModelEvents;
+
+void ProduceProgress()
+{
+    double value = 0;
+    while (!gStopWorker.load(std::memory_order_relaxed))
+    {
+        value = value >= 100 ? 0 : value + 0.05;
+        gValueSlots.Write(0, value);
+        Sleep(1);
+    }
+}
+
+// Sends the value change events that are due and arms a timer for the rest,
+// so the final value is announced even after the samples stop.
+void FlushValueEvents(HWND hwnd)
+{
+    gNotifier.Flush(GetTickCount64(), [hwnd](WidgetId widget)
+    {
+        // Child ids are 1-based positions under the navbar
+        LONG childId = static_cast<LONG>(gModel->GetDerived().childIndex[widget.index]) + 1;
+        NotifyWinEvent(EVENT_OBJECT_VALUECHANGE, hwnd, OBJID_CLIENT, childId);
+    });
+
+    uint64_t due = gNotifier.GetNextDue(GetTickCount64());
+    if (due == ValueNotifier::kNothingPending)
+    {
+        KillTimer(hwnd, kNotifyTimer);
+    }
+    else
+    {
+        SetTimer(hwnd, kNotifyTimer, static_cast<UINT>((std::max)(due, (uint64_t)USER_TIMER_MINIMUM)), NULL);
+    }
+}
+
+// WinEvent clients hook event ranges for the whole desktop instead of
+// subscribing to an element, so the model builds the events whose hooks are
+// installed. Checking a hook is cheap enough to do every frame.
+void SyncWinEventHooks(EventSubscriptions& subscriptions)
+{
+    subscriptions.SetSubscribed(WidgetEventKind::Focus, IsWinEventHookInstalled(EVENT_OBJECT_FOCUS) != FALSE);
+    subscriptions.SetSubscribed(WidgetEventKind::NameChanged, IsWinEventHookInstalled(EVENT_OBJECT_NAMECHANGE) != FALSE);
+    subscriptions.SetSubscribed(WidgetEventKind::BoundsChanged, IsWinEventHookInstalled(EVENT_OBJECT_LOCATIONCHANGE) != FALSE);
+    subscriptions.SetSubscribed(WidgetEventKind::EnabledChanged, IsWinEventHookInstalled(EVENT_OBJECT_STATECHANGE) != FALSE);
+    subscriptions.SetSubscribed(WidgetEventKind::ValueChanged, IsWinEventHookInstalled(EVENT_OBJECT_VALUECHANGE) != FALSE);
+    subscriptions.SetSubscribed(WidgetEventKind::StructureChanged, IsWinEventHookInstalled(EVENT_OBJECT_REORDER) != FALSE);
+}
+
+// Sends WinEvents for the model changes queued since the last frame. Value
+// changes go through the throttle instead.
+void RaiseModelEvents(HWND hwnd)
+{
+    gModel->TakeEvents(&gModelEvents);
+    for (const WidgetEvent& event : gModelEvents)
+    {
+        if (event.kind == WidgetEventKind::ValueChanged)
+        {
+            gNotifier.Changed(event.widget);
+            continue;
+        }
+        // Structure changes are sent on the parent, whose children reordered
+        if (event.kind == WidgetEventKind::StructureChanged)
+        {
+            if (event.widget == gNavbar)
+            {
+                NotifyWinEvent(EVENT_OBJECT_REORDER, hwnd, OBJID_CLIENT, CHILDID_SELF);
+            }
+            continue;
+        }
+        const Widget* widget = gModel->Get(event.widget);
+        if (!widget || (event.widget != gNavbar && widget->parent != gNavbar))
+        {
+            continue;
+        }
+        // Child ids are 1-based positions under the navbar
+        LONG childId = event.widget == gNavbar ? CHILDID_SELF : static_cast<LONG>(gModel->GetDerived().childIndex[event.widget.index]) + 1;
+        DWORD winEvent = event.kind == WidgetEventKind::Focus ? EVENT_OBJECT_FOCUS
+            : event.kind == WidgetEventKind::NameChanged ? EVENT_OBJECT_NAMECHANGE
+            : event.kind == WidgetEventKind::BoundsChanged ? EVENT_OBJECT_LOCATIONCHANGE
+            : EVENT_OBJECT_STATECHANGE;
+        NotifyWinEvent(winEvent, hwnd, OBJID_CLIENT, childId);
+    }
+}
+
+// Selection state of the navbar's items, changed by clicks and by ATs
+// through accSelect.
+SelectionSet gSelection;
+
+// Sends the events for selection changes made since the last call and
+// repaints the navbar if there were any. A bulk change such as select-all is
+// one EVENT_OBJECT_SELECTIONWITHIN, however many items it touched.
+void FlushSelectionEvents(HWND hwnd)
+{
+    if (!gSelection.HasChanges())
+    {
+        return;
+    }
+    gSelection.DispatchChanges([hwnd](SelectionEvent event, size_t index)
+    {
+        LONG childId = static_cast<LONG>(index) + 1;
+        switch (event)
+        {
+        case SelectionEvent::Invalidated:
+            NotifyWinEvent(EVENT_OBJECT_SELECTIONWITHIN, hwnd, OBJID_CLIENT, CHILDID_SELF);
+            break;
+        case SelectionEvent::Selected:
+            NotifyWinEvent(EVENT_OBJECT_SELECTION, hwnd, OBJID_CLIENT, childId);
+            break;
+        case SelectionEvent::Added:
+            NotifyWinEvent(EVENT_OBJECT_SELECTIONADD, hwnd, OBJID_CLIENT, childId);
+            break;
+        case SelectionEvent::Removed:
+            NotifyWinEvent(EVENT_OBJECT_SELECTIONREMOVE, hwnd, OBJID_CLIENT, childId);
+            break;
+        }
+    });
+    RECT rect = ToRect(gModel->Get(gNavbar)->rect);
+    InvalidateRect(hwnd, &rect, FALSE);
+}
 
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
+    // accLocation is served from the model's cached screen rects
+    if (gModel && ChangesScreenTransform(uMsg))
+    {
+        gModel->SetScreenTransform(QueryScreenTransform(hwnd));
+    }
+
     switch (uMsg)
     {
     case WM_CREATE:
     {
-        RECT navbarRect = { 0, 0, 800, 50 };
-        gNavbar = new Navbar(navbarRect);
-
-        RECT box1Rect = { 10, 10, 110, 40 };
-        RECT box2Rect = { 120, 10, 220, 40 };
-        RECT box3Rect = { 230, 10, 330, 40 };
+        gModel = new WidgetModel();
+        gNavbar = gModel->AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, 800, 50 }, L"Navbar", RGB(0, 0, 255));
 
-        Box box1(box1Rect, L"Box 1");
-        Box box2(box2Rect, L"Box 2");
-        Box box3(box3Rect, L"Box 3");
-
-        gNavbar->AddBox(box1);
-        gNavbar->AddBox(box2);
-        gNavbar->AddBox(box3);
+        gModel->AddWidget(gNavbar, WidgetRole::Button, { 10, 10, 110, 40 }, L"Box 1", RGB(255, 255, 255));
+        gModel->AddWidget(gNavbar, WidgetRole::Button, { 120, 10, 220, 40 }, L"Box 2", RGB(255, 255, 255));
+        gModel->AddWidget(gNavbar, WidgetRole::Button, { 230, 10, 330, 40 }, L"Box 3", RGB(255, 255, 255));
+        gProgress = gModel->AddWidget(gNavbar, WidgetRole::ProgressBar, { 340, 15, 540, 35 }, L"Progress", RGB(255, 255, 255));
+        gModel->SetScreenTransform(QueryScreenTransform(hwnd));
+        gSelection.SetTraceSlot(gNavbar.index);
+        gSelection.Resize(gModel->GetChildCount(gNavbar));
+        gSlotWidgets.assign(1, gProgress);
+        gWorker = std::thread(ProduceProgress);
+        SetTimer(hwnd, kFrameTimer, kFrameInterval, NULL);
     }
     break;
+    case WM_TIMER:
+        if (wParam == kFrameTimer && gModel)
+        {
+            // Pick up whatever the worker wrote since the last frame
+            SyncWinEventHooks(gModel->GetEventSubscriptions());
+            gInvalidRects.clear();
+            SampleValueSlots(gValueSlots, gSlotWidgets, *gModel, &gInvalidRects);
+            for (const WidgetRect& invalid : gInvalidRects)
+            {
+                RECT rect = ToRect(invalid);
+                InvalidateRect(hwnd, &rect, FALSE);
+            }
+        }
+        if (gModel)
+        {
+            RaiseModelEvents(hwnd);
+            FlushValueEvents(hwnd);
+            FlushSelectionEvents(hwnd); // Picks up accSelect calls since the last frame
+        }
+        break;
+    case WM_LBUTTONDOWN:
+        if (gModel)
+        {
+            POINT pt = ClientToLayout(gModel->GetScreenTransform(), { (short)LOWORD(lParam), (short)HIWORD(lParam) });
+            for (size_t i = 0; i < gModel->GetChildCount(gNavbar); i++)
+            {
+                const WidgetRect& rect = gModel->Get(gModel->GetChild(gNavbar, i))->rect;
+                if (pt.x >= rect.left && pt.x < rect.right && pt.y >= rect.top && pt.y < rect.bottom)
+                {
+                    gSelection.Click(i, (wParam & MK_CONTROL) != 0, (wParam & MK_SHIFT) != 0);
+                    FlushSelectionEvents(hwnd);
+                    break;
+                }
+            }
+        }
+        break;
     case WM_PAINT:
     {
         PAINTSTRUCT ps;
         HDC hdc = BeginPaint(hwnd, &ps);
 
-        if (gNavbar)
+        if (gModel)
         {
-            gNavbar->Draw(hdc);
+            gTextCache.BeginFrame();
+            GdiRenderer renderer(hdc, &gTextCache, gModel->GetScreenTransform().dpi);
+            PaintWidgetTree(gDrawBatch, *gModel, gNavbar, &gSelection);
+            gDrawBatch.Flush(renderer);
+            gTextCache.EndFrame();
         }
 
         EndPaint(hwnd, &ps);
     }
     break;
+    case WM_DPICHANGED:
+        ApplySuggestedDpiRect(hwnd, lParam);
+        InvalidateRect(hwnd, NULL, FALSE);
+        return 0;
     case WM_DESTROY:
+        KillTimer(hwnd, kFrameTimer);
+        KillTimer(hwnd, kNotifyTimer);
+        gStopWorker = true;
+        if (gWorker.joinable())
+        {
+            gWorker.join();
+        }
         PostQuitMessage(0);
-        delete gNavbar;
-        gNavbar = nullptr;
+        ActiveTrace() = nullptr;
+        gTrace.Close();
+        delete gModel;
+        gModel = nullptr;
         break;
     case WM_GETOBJECT:
     if (lParam == static_cast<LPARAM>(OBJID_CLIENT))
     {
-        IAccessible* pAccessible = static_cast<IAccessible*>(new AccessibleNavbar(gNavbar));
+        IAccessible* pAccessible = static_cast<IAccessible*>(new AccessibleNavbar(gModel, gNavbar, &gSelection));
         LRESULT lResult = LresultFromObject(IID_IAccessible, wParam, static_cast<IAccessible*>(pAccessible));
         pAccessible->Release();
         return lResult;
@@ -606,6 +1045,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
 {
     CoInitialize(NULL); // Initialize COM
+    EnablePerMonitorDpiAwareness();
 
     const wchar_t CLASS_NAME[] = L"Sample Window Class";
     WNDCLASS wc = { };
@@ -634,6 +1074,16 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
         return 0;
     }
 
+    // --trace=<path> records the model and every call made on it, for
+    // TraceReplay; the model exists once the window is created
+    const wchar_t* traceArg = lpCmdLine ? wcsstr(lpCmdLine, L"--trace=") : NULL;
+    if (traceArg && gTrace.Open(WideToUtf8(std::wstring(traceArg + 8, wcscspn(traceArg + 8, L" "))).c_str()))
+    {
+        gModel->TraceSnapshot(&gTrace);
+        gSelection.TraceSnapshot(&gTrace);
+        ActiveTrace() = &gTrace;
+    }
+
     ShowWindow(hwnd, nCmdShow);
 
     MSG msg = { };
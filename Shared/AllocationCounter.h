@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include "QueryTrace.h"
+
+// Heap allocations made by the current thread. Nothing counts them until a
+// program installs the counting allocator (CountingAllocator.h) or, for COM
+// task memory such as BSTRs and SAFEARRAYs, a malloc spy (Win32MallocSpy.h).
+struct AllocationCounts
+{
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+inline AllocationCounts& GetThreadAllocations()
+{
+    static thread_local AllocationCounts counts = {};
+    return counts;
+}
+
+// Set by the counting allocator when it is linked in, so entry points only
+// pay for per-call accounting when there is something to account.
+inline bool& AllocationCountingEnabled()
+{
+    static bool enabled = false;
+    return enabled;
+}
+
+inline void CountAllocation(size_t bytes)
+{
+    AllocationCounts& counts = GetThreadAllocations();
+    counts.allocations++;
+    counts.bytes += bytes;
+}
+
+// Allocations made on this thread since construction.
+class AllocationScope
+{
+public:
+    AllocationScope() : start(GetThreadAllocations()) {}
+
+    uint64_t GetAllocations() const { return GetThreadAllocations().allocations - start.allocations; }
+    uint64_t GetBytes() const { return GetThreadAllocations().bytes - start.bytes; }
+
+private:
+    AllocationCounts start;
+};
+
+// Allocations per kind of provider call, summed over calls. A call's count
+// includes the calls it makes on other providers.
+struct CallAllocations
+{
+    uint64_t calls;
+    uint64_t allocations;
+    uint64_t bytes;
+    // Most allocations made by one call
+    uint64_t maxAllocations;
+};
+
+inline CallAllocations* GetCallAllocations()
+{
+    static CallAllocations stats[static_cast<size_t>(TraceEvent::Count)] = {};
+    return stats;
+}
+
+inline void ResetCallAllocations()
+{
+    for (size_t i = 0; i < static_cast<size_t>(TraceEvent::Count); i++)
+    {
+        GetCallAllocations()[i] = CallAllocations();
+    }
+}
+
+// Put at the top of a provider entry point: records the call to the active
+// trace, if any, and what it allocates to GetCallAllocations().
+class CallScope
+{
+public:
+    CallScope(TraceEvent event, std::initializer_list<int64_t> ints) : event(event), start(GetThreadAllocations())
+    {
+        TraceCall(event, ints);
+    }
+
+    // For calls that write their own trace record.
+    explicit CallScope(TraceEvent event) : event(event), start(GetThreadAllocations()) {}
+
+    ~CallScope()
+    {
+        if (!AllocationCountingEnabled())
+        {
+            return;
+        }
+        const AllocationCounts& now = GetThreadAllocations();
+        CallAllocations& stats = GetCallAllocations()[static_cast<size_t>(event)];
+        uint64_t allocations = now.allocations - start.allocations;
+        stats.calls++;
+        stats.allocations += allocations;
+        stats.bytes += now.bytes - start.bytes;
+        stats.maxAllocations = allocations > stats.maxAllocations ? allocations : stats.maxAllocations;
+    }
+
+    CallScope(const CallScope&) = delete;
+    CallScope& operator=(const CallScope&) = delete;
+
+private:
+    TraceEvent event;
+    AllocationCounts start;
+};
+
+// Most allocations a steady-state call of a kind may make, once whatever it
+// creates lazily exists.
+struct AllocationBudget
+{
+    TraceEvent event;
+    uint64_t maxAllocations;
+};
+
+// Calls report(event, worst, limit) for every kind whose worst call since the
+// last reset went over its budget, and returns how many did. Kinds that were
+// not called pass.
+template <typename Report>
+size_t CheckAllocationBudgets(std::initializer_list<AllocationBudget> budgets, Report report)
+{
+    size_t over = 0;
+    for (const AllocationBudget& budget : budgets)
+    {
+        const CallAllocations& stats = GetCallAllocations()[static_cast<size_t>(budget.event)];
+        if (stats.maxAllocations > budget.maxAllocations)
+        {
+            report(budget.event, stats.maxAllocations, budget.maxAllocations);
+            over++;
+        }
+    }
+    return over;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit; bits must not be zero.
+inline size_t LowestBit(uint64_t bits)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#elif defined(__GNUC__)
+    return static_cast<size_t>(__builtin_ctzll(bits));
+#else
+    size_t index = 0;
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Number of set bits.
+inline size_t CountBits(uint64_t bits)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<size_t>(__popcnt64(bits));
+#elif defined(__GNUC__)
+    return static_cast<size_t>(__builtin_popcountll(bits));
+#else
+    bits = bits - ((bits >> 1) & 0x5555555555555555ull);
+    bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<size_t>((bits * 0x0101010101010101ull) >> 56);
+#endif
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "MemoryUsage.h"
+#include "WidgetModel.h"
+
+// A read-only copy of a widget model packed for size, for trees that are kept
+// around but rarely changed, such as large static layouts or snapshots.
+// Nodes are numbered in document order and stored as columns:
+//  - structure is a parent offset and a subtree size,
+//  - rects are relative to the parent and quantized to 16 bits, with the few
+//    that do not fit kept exactly in a side table,
+//  - names are ids into a table of distinct UTF-8 strings,
+//  - role and flags share one byte and colors are ids into a palette,
+//  - range values are only stored for widgets that are not at the defaults.
+// A node costs about 23 bytes plus its share of the distinct names, against
+// a few hundred for a live widget with its derived data and index entries.
+class CompactWidgetTree
+{
+public:
+    static const uint32_t kNoNode = UINT32_MAX;
+
+    CompactWidgetTree() {}
+
+    explicit CompactWidgetTree(WidgetModel& model)
+    {
+        Encode(model);
+    }
+
+    void Encode(WidgetModel& model)
+    {
+        *this = CompactWidgetTree();
+        const DerivedData& data = model.GetDerived();
+        size_t count = data.preorder.size();
+        parentOffsets.resize(count);
+        subtreeSizes.assign(data.subtreeSize.begin(), data.subtreeSize.end());
+        rects.resize(count);
+        nameIds.resize(count);
+        flags.resize(count);
+        colorIds.resize(count);
+
+        std::unordered_map<std::string, uint32_t> nameOfText;
+        std::unordered_map<uint32_t, uint16_t> colorOfValue;
+        nameStarts.push_back(0);
+        for (uint32_t p = 0; p < count; p++)
+        {
+            const Widget& widget = *model.Get(data.preorder[p]);
+            uint32_t parent = widget.parent == kNoWidget ? kNoNode : data.preorderPosition[widget.parent.index];
+            parentOffsets[p] = parent == kNoNode ? 0 : p - parent;
+
+            WidgetRect origin = parent == kNoNode ? WidgetRect{ 0, 0, 0, 0 } : model.Get(widget.parent)->rect;
+            WidgetRect relative = { widget.rect.left - origin.left, widget.rect.top - origin.top, widget.rect.right - widget.rect.left, widget.rect.bottom - widget.rect.top };
+            uint8_t bits = static_cast<uint8_t>(widget.role) | (widget.enabled ? kEnabled : 0) | (widget.focusable ? kFocusable : 0);
+            if (FitsInt16(relative))
+            {
+                rects[p] = { static_cast<int16_t>(relative.left), static_cast<int16_t>(relative.top), static_cast<int16_t>(relative.right), static_cast<int16_t>(relative.bottom) };
+            }
+            else
+            {
+                bits |= kWideRect;
+                wideRects.push_back({ p, relative });
+            }
+
+            auto name = nameOfText.emplace(WideToUtf8(widget.name), static_cast<uint32_t>(nameStarts.size() - 1));
+            if (name.second)
+            {
+                namePool.insert(namePool.end(), name.first->first.begin(), name.first->first.end());
+                nameStarts.push_back(static_cast<uint32_t>(namePool.size()));
+            }
+            nameIds[p] = name.first->second;
+
+            auto color = colorOfValue.find(widget.color);
+            if (color != colorOfValue.end())
+            {
+                colorIds[p] = color->second;
+            }
+            else if (palette.size() < kWideColor)
+            {
+                colorIds[p] = static_cast<uint16_t>(palette.size());
+                colorOfValue.emplace(widget.color, colorIds[p]);
+                palette.push_back(widget.color);
+            }
+            else
+            {
+                colorIds[p] = kWideColor;
+                wideColors.push_back({ p, widget.color });
+            }
+
+            if (widget.value != 0 || widget.minimum != 0 || widget.maximum != 100)
+            {
+                bits |= kHasRange;
+                ranges.push_back({ p, { widget.value, widget.minimum, widget.maximum } });
+            }
+            flags[p] = bits;
+        }
+    }
+
+    // Adds the encoded widgets to model under parent, or as roots for
+    // kNoWidget. Returns the new widgets in document order.
+    std::vector<WidgetId> Decode(WidgetModel* model, WidgetId parent = kNoWidget) const
+    {
+        std::vector<WidgetId> ids(GetNodeCount());
+        // Parents come before their children, so each rect is its parent's
+        // corner plus its own offset rather than a walk to the root
+        std::vector<WidgetRect> absolute(GetNodeCount());
+        for (uint32_t p = 0; p < GetNodeCount(); p++)
+        {
+            uint32_t up = GetParent(p);
+            WidgetRect relative = GetRelativeRect(p);
+            int32_t x = relative.left + (up == kNoNode ? 0 : absolute[up].left);
+            int32_t y = relative.top + (up == kNoNode ? 0 : absolute[up].top);
+            absolute[p] = { x, y, x + relative.right, y + relative.bottom };
+            WidgetId id = model->AddWidget(up == kNoNode ? parent : ids[up], GetRole(p), absolute[p], GetName(p), GetColor(p));
+            if (!IsEnabled(p))
+            {
+                model->SetEnabled(id, false);
+            }
+            if (flags[p] & kHasRange)
+            {
+                const Range& range = Find(ranges, p);
+                model->SetRange(id, range.minimum, range.maximum);
+                model->SetValue(id, range.value);
+            }
+            ids[p] = id;
+        }
+        return ids;
+    }
+
+    size_t GetNodeCount() const { return flags.size(); }
+
+    uint32_t GetParent(uint32_t node) const { return parentOffsets[node] ? node - parentOffsets[node] : kNoNode; }
+
+    // The subtree of node is [node, node + GetSubtreeSize(node)); its first
+    // child, if any, is node + 1 and each child's next sibling follows its
+    // subtree.
+    uint32_t GetSubtreeSize(uint32_t node) const { return subtreeSizes[node]; }
+
+    WidgetRole GetRole(uint32_t node) const { return static_cast<WidgetRole>(flags[node] & kRoleMask); }
+    bool IsEnabled(uint32_t node) const { return (flags[node] & kEnabled) != 0; }
+    bool IsFocusable(uint32_t node) const { return (flags[node] & kFocusable) != 0; }
+    uint32_t GetColor(uint32_t node) const { return colorIds[node] == kWideColor ? Find(wideColors, node) : palette[colorIds[node]]; }
+
+    std::wstring GetName(uint32_t node) const
+    {
+        uint32_t id = nameIds[node];
+        return Utf8ToWide(namePool.data() + nameStarts[id], nameStarts[id + 1] - nameStarts[id]);
+    }
+
+    // Rect in the model's coordinates, rebuilt from the offsets along the
+    // path to the root.
+    WidgetRect GetRect(uint32_t node) const
+    {
+        int32_t x = 0;
+        int32_t y = 0;
+        int32_t width = 0;
+        int32_t height = 0;
+        for (uint32_t p = node; p != kNoNode; p = GetParent(p))
+        {
+            WidgetRect relative = GetRelativeRect(p);
+            x += relative.left;
+            y += relative.top;
+            if (p == node)
+            {
+                width = relative.right;
+                height = relative.bottom;
+            }
+        }
+        return { x, y, x + width, y + height };
+    }
+
+    double GetValue(uint32_t node) const { return flags[node] & kHasRange ? Find(ranges, node).value : 0; }
+    double GetMinimum(uint32_t node) const { return flags[node] & kHasRange ? Find(ranges, node).minimum : 0; }
+    double GetMaximum(uint32_t node) const { return flags[node] & kHasRange ? Find(ranges, node).maximum : 100; }
+
+    size_t GetDistinctNameCount() const { return nameStarts.size() - 1; }
+
+    MemoryUsage GetMemoryUsage() const
+    {
+        MemoryUsage usage;
+        usage.nodes = GetNodeCount();
+        usage.Add(MemoryCategory::Structure, HeapBytes(parentOffsets) + HeapBytes(subtreeSizes));
+        usage.Add(MemoryCategory::Geometry, HeapBytes(rects) + HeapBytes(wideRects));
+        usage.Add(MemoryCategory::Names, HeapBytes(nameIds) + HeapBytes(nameStarts) + HeapBytes(namePool));
+        usage.Add(MemoryCategory::State, HeapBytes(flags) + HeapBytes(colorIds) + HeapBytes(palette) + HeapBytes(wideColors));
+        usage.Add(MemoryCategory::Values, HeapBytes(ranges));
+        return usage;
+    }
+
+private:
+    static const uint8_t kRoleMask = 0x07;
+    static const uint8_t kEnabled = 0x08;
+    static const uint8_t kFocusable = 0x10;
+    static const uint8_t kWideRect = 0x20;
+    static const uint8_t kHasRange = 0x40;
+    static const uint16_t kWideColor = UINT16_MAX;
+
+    // Offset from the parent's top-left corner, then width and height
+    struct PackedRect
+    {
+        int16_t x;
+        int16_t y;
+        int16_t width;
+        int16_t height;
+    };
+
+    struct Range
+    {
+        double value;
+        double minimum;
+        double maximum;
+    };
+
+    static bool FitsInt16(const WidgetRect& rect)
+    {
+        return rect.left >= INT16_MIN && rect.left <= INT16_MAX && rect.top >= INT16_MIN && rect.top <= INT16_MAX
+            && rect.right >= INT16_MIN && rect.right <= INT16_MAX && rect.bottom >= INT16_MIN && rect.bottom <= INT16_MAX;
+    }
+
+    // Looks up a node in a side table, which is sorted since nodes are
+    // encoded in order. The node must be in it.
+    template <typename T>
+    static const T& Find(const std::vector<std::pair<uint32_t, T>>& table, uint32_t node)
+    {
+        auto it = std::lower_bound(table.begin(), table.end(), node, [](const std::pair<uint32_t, T>& entry, uint32_t value) { return entry.first < value; });
+        return it->second;
+    }
+
+    // As encoded: offset from the parent in left and top, size in right and bottom
+    WidgetRect GetRelativeRect(uint32_t node) const
+    {
+        if (flags[node] & kWideRect)
+        {
+            return Find(wideRects, node);
+        }
+        const PackedRect& rect = rects[node];
+        return { rect.x, rect.y, rect.width, rect.height };
+    }
+
+    std::vector<uint32_t> parentOffsets;
+    std::vector<uint32_t> subtreeSizes;
+    std::vector<PackedRect> rects;
+    std::vector<std::pair<uint32_t, WidgetRect>> wideRects;
+    std::vector<uint32_t> nameIds;
+    // Name id i is namePool[nameStarts[i], nameStarts[i + 1])
+    std::vector<uint32_t> nameStarts;
+    std::vector<char> namePool;
+    std::vector<uint8_t> flags;
+    std::vector<uint16_t> colorIds;
+    std::vector<uint32_t> palette;
+    std::vector<std::pair<uint32_t, uint32_t>> wideColors;
+    std::vector<std::pair<uint32_t, Range>> ranges;
+};
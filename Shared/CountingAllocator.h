@@ -0,0 +1,61 @@
+#pragma once
+
+// Replaces the global operator new and delete with ones that count every
+// allocation to the calling thread's AllocationCounts, for the allocation
+// report and budgets. Replacement functions cannot be inline, so include this
+// from exactly one translation unit, and only in builds that want counting
+// (the samples do it under A11Y_COUNT_ALLOCATIONS, as does
+// tests/AllocationBudgetTest). The array, nothrow and sized forms default to
+// calling these, so they are counted too.
+
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+namespace CountingAllocator
+{
+    // Switches per-call accounting on before main, so calls made while
+    // statics are constructed are counted too
+    static const bool kEnabled = (AllocationCountingEnabled() = true);
+}
+
+void* operator new(std::size_t size)
+{
+    CountAllocation(size);
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    CountAllocation(size);
+    size_t align = static_cast<size_t>(alignment);
+    size_t rounded = (size + align - 1) / align * align;
+#ifdef _WIN32
+    void* p = _aligned_malloc(rounded ? rounded : align, align);
+#else
+    void* p = std::aligned_alloc(align, rounded ? rounded : align);
+#endif
+    if (p)
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Renderer.h"
+
+struct BatchStats
+{
+    // Primitives recorded this frame.
+    uint64_t commands;
+    // Calls made on the target renderer by Flush.
+    uint64_t submittedCalls;
+    // Brush or font changes between consecutive submitted calls.
+    uint64_t stateSwitches;
+    // Fills that were folded into another fill of the same color.
+    uint64_t mergedFills;
+};
+
+// Collects a frame's primitives and submits them grouped by state. Commands
+// are first assigned to layers: a command goes one layer above the highest
+// earlier command it overlaps, so reordering within a layer never changes
+// what ends up on top. Earlier commands are found through a coarse grid, so
+// a row of items side by side costs each one only its neighbours. Each layer
+// is then sorted by kind, color and font, and runs of equal state go out as
+// one FillRects or DrawLabels call.
+class DrawBatch : public Renderer
+{
+public:
+    DrawBatch() : layerCount(0), labelCount(0), stats(), lastFrame() {}
+
+    void FillRect(const WidgetRect& rect, uint32_t color) override
+    {
+        Add(Command::Fill, rect, color, 255, kDefaultFont, nullptr);
+    }
+
+    void BlendRect(const WidgetRect& rect, uint32_t color, uint8_t alpha) override
+    {
+        Add(alpha == 255 ? Command::Fill : Command::Blend, rect, color, alpha, kDefaultFont, nullptr);
+    }
+
+    void DrawLabel(const WidgetRect& rect, const std::wstring& text, const FontDesc& font, uint32_t color) override
+    {
+        Add(Command::Label, rect, color, 255, font, &text);
+    }
+
+    // Submits everything recorded since the last flush, then starts a new frame.
+    void Flush(Renderer& target)
+    {
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return Less(commands[a], commands[b]); });
+
+        const Command* previous = nullptr;
+        size_t i = 0;
+        while (i < order.size())
+        {
+            const Command& first = commands[order[i]];
+            size_t end = i + 1;
+            while (end < order.size() && first.kind != Command::Blend && SameRun(first, commands[order[end]]))
+            {
+                end++;
+            }
+
+            if (previous && !SameState(*previous, first))
+            {
+                stats.stateSwitches++;
+            }
+            Submit(target, i, end);
+            previous = &first;
+            i = end;
+        }
+
+        commands.clear();
+        order.clear();
+        wide.clear();
+        // Keep the cells' storage for the next frame, unless most of them
+        // went unused in this one because the layout moved
+        size_t unused = 0;
+        for (auto& cell : cells)
+        {
+            unused += cell.second.empty();
+            cell.second.clear();
+        }
+        if (unused > cells.size() / 2)
+        {
+            cells.clear();
+        }
+        layerCount = 0;
+        labelCount = 0;
+        lastFrame = stats;
+        stats = BatchStats();
+    }
+
+    // Counters for the most recently flushed frame.
+    const BatchStats& GetStats() const { return lastFrame; }
+
+private:
+    struct Command
+    {
+        enum Kind : uint8_t
+        {
+            Fill,
+            Blend,
+            Label,
+        };
+
+        Kind kind;
+        uint8_t alpha;
+        uint32_t layer;
+        uint32_t color;
+        uint32_t text;
+        WidgetRect rect;
+        FontDesc font;
+    };
+
+    // Cells are 64 pixels square. Commands touching more cells than
+    // kMaxCellsPerCommand, such as backgrounds, go in one list instead.
+    static const int kCellShift = 6;
+    static const int64_t kMaxCellsPerCommand = 64;
+
+    struct CellRange
+    {
+        int32_t left;
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+
+        int64_t Count() const { return (static_cast<int64_t>(right) - left + 1) * (static_cast<int64_t>(bottom) - top + 1); }
+    };
+
+    static CellRange CellsOf(const WidgetRect& rect)
+    {
+        return { rect.left >> kCellShift, rect.top >> kCellShift, (rect.right - 1) >> kCellShift, (rect.bottom - 1) >> kCellShift };
+    }
+
+    static uint64_t CellKey(int32_t x, int32_t y)
+    {
+        return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y);
+    }
+
+    static bool Intersects(const WidgetRect& a, const WidgetRect& b)
+    {
+        return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+    }
+
+    static bool SameState(const Command& a, const Command& b)
+    {
+        return a.kind == b.kind && a.color == b.color && (a.kind != Command::Label || SameFont(a.font, b.font));
+    }
+
+    static bool SameRun(const Command& a, const Command& b)
+    {
+        return a.layer == b.layer && SameState(a, b);
+    }
+
+    static bool Less(const Command& a, const Command& b)
+    {
+        if (a.layer != b.layer)
+        {
+            return a.layer < b.layer;
+        }
+        if (a.kind != b.kind)
+        {
+            return a.kind < b.kind;
+        }
+        if (a.color != b.color)
+        {
+            return a.color < b.color;
+        }
+        if (a.font.height != b.font.height)
+        {
+            return a.font.height < b.font.height;
+        }
+        if (a.font.bold != b.font.bold)
+        {
+            return b.font.bold;
+        }
+        if (a.font.face != b.font.face)
+        {
+            return std::less<const wchar_t*>()(a.font.face, b.font.face);
+        }
+        return a.text < b.text;
+    }
+
+    void Add(Command::Kind kind, const WidgetRect& rect, uint32_t color, uint8_t alpha, const FontDesc& font, const std::wstring* text)
+    {
+        if (rect.left >= rect.right || rect.top >= rect.bottom)
+        {
+            return;
+        }
+
+        Command command = { kind, alpha, 0, color, 0, rect, font };
+        if (text)
+        {
+            // Keep a copy, reusing the string storage from earlier frames
+            if (labelCount == labelTexts.size())
+            {
+                labelTexts.emplace_back();
+            }
+            labelTexts[labelCount].assign(*text);
+            command.text = static_cast<uint32_t>(labelCount++);
+        }
+
+        uint32_t index = static_cast<uint32_t>(commands.size());
+        command.layer = LayerAbove(rect);
+        layerCount = (std::max)(layerCount, command.layer + 1);
+        order.push_back(index);
+        commands.push_back(command);
+        stats.commands++;
+
+        CellRange range = CellsOf(rect);
+        if (range.Count() > kMaxCellsPerCommand)
+        {
+            wide.push_back(index);
+            return;
+        }
+        for (int32_t y = range.top; y <= range.bottom; y++)
+        {
+            for (int32_t x = range.left; x <= range.right; x++)
+            {
+                cells[CellKey(x, y)].push_back(index);
+            }
+        }
+    }
+
+    // One above the highest earlier command that rect overlaps, or 0
+    uint32_t LayerAbove(const WidgetRect& rect) const
+    {
+        uint32_t layer = 0;
+        CellRange range = CellsOf(rect);
+        if (range.Count() > static_cast<int64_t>(commands.size()))
+        {
+            // Covers more cells than there are commands to check
+            for (const Command& earlier : commands)
+            {
+                if (earlier.layer >= layer && Intersects(earlier.rect, rect))
+                {
+                    layer = earlier.layer + 1;
+                }
+            }
+            return layer;
+        }
+
+        for (uint32_t index : wide)
+        {
+            if (commands[index].layer >= layer && Intersects(commands[index].rect, rect))
+            {
+                layer = commands[index].layer + 1;
+            }
+        }
+        for (int32_t y = range.top; y <= range.bottom && layer < layerCount; y++)
+        {
+            for (int32_t x = range.left; x <= range.right && layer < layerCount; x++)
+            {
+                auto cell = cells.find(CellKey(x, y));
+                if (cell == cells.end())
+                {
+                    continue;
+                }
+                for (uint32_t index : cell->second)
+                {
+                    if (commands[index].layer >= layer && Intersects(commands[index].rect, rect))
+                    {
+                        layer = commands[index].layer + 1;
+                    }
+                }
+            }
+        }
+        return layer;
+    }
+
+    void Submit(Renderer& target, size_t begin, size_t end)
+    {
+        const Command& first = commands[order[begin]];
+        stats.submittedCalls++;
+        if (first.kind == Command::Blend)
+        {
+            target.BlendRect(first.rect, first.color, first.alpha);
+        }
+        else if (first.kind == Command::Fill)
+        {
+            rects.clear();
+            for (size_t i = begin; i < end; i++)
+            {
+                rects.push_back(commands[order[i]].rect);
+            }
+            stats.mergedFills += end - begin - 1;
+            target.FillRects(rects.data(), rects.size(), first.color);
+        }
+        else
+        {
+            labels.clear();
+            for (size_t i = begin; i < end; i++)
+            {
+                const Command& command = commands[order[i]];
+                labels.push_back({ command.rect, &labelTexts[command.text] });
+            }
+            target.DrawLabels(labels.data(), labels.size(), first.font, first.color);
+        }
+    }
+
+    std::vector<Command> commands;
+    std::vector<uint32_t> order;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    std::vector<uint32_t> wide;
+    uint32_t layerCount;
+    std::vector<std::wstring> labelTexts;
+    size_t labelCount;
+    std::vector<WidgetRect> rects;
+    std::vector<LabelRun> labels;
+    BatchStats stats;
+    BatchStats lastFrame;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "QueryTrace.h"
+
+// Kinds of event an AT can listen for. Property changes are split by the
+// property, since clients usually listen for a few of them.
+enum class WidgetEventKind : uint8_t
+{
+    Focus,
+    NameChanged,
+    BoundsChanged,
+    EnabledChanged,
+    ValueChanged,
+    StructureChanged,
+    Notification,
+    Count,
+};
+
+// Which kinds of event have listeners, so that the model and the platform
+// layer can skip building events nobody will receive. Listeners are counted
+// per kind, as UIA adds and removes them one at a time; platforms that can
+// only be asked whether anyone listens set the kind directly. Changes to a
+// count are traced, so a replayed model builds the same events.
+class EventSubscriptions
+{
+public:
+    EventSubscriptions() : counts(), mask(0) {}
+
+    void Add(WidgetEventKind kind) { SetCount(kind, counts[Index(kind)] + 1); }
+
+    void Remove(WidgetEventKind kind)
+    {
+        if (counts[Index(kind)] > 0)
+        {
+            SetCount(kind, counts[Index(kind)] - 1);
+        }
+    }
+
+    void SetSubscribed(WidgetEventKind kind, bool subscribed) { SetCount(kind, subscribed ? 1 : 0); }
+
+    // Sets how many listeners a kind has, as a trace replays it.
+    void SetCount(WidgetEventKind kind, uint32_t count)
+    {
+        if (counts[Index(kind)] == count)
+        {
+            return;
+        }
+        counts[Index(kind)] = count;
+        mask = count ? mask | Bit(kind) : mask & ~Bit(kind);
+        TraceCall(TraceEvent::Subscribe, { static_cast<int64_t>(kind), count });
+    }
+
+    // Listen for everything, for hosts that cannot tell what clients want.
+    void SubscribeAll()
+    {
+        for (size_t i = 0; i < static_cast<size_t>(WidgetEventKind::Count); i++)
+        {
+            SetSubscribed(static_cast<WidgetEventKind>(i), true);
+        }
+    }
+
+    bool IsSubscribed(WidgetEventKind kind) const { return (mask & Bit(kind)) != 0; }
+    bool IsAnySubscribed() const { return mask != 0; }
+    uint32_t GetMask() const { return mask; }
+    uint32_t GetCount(WidgetEventKind kind) const { return counts[Index(kind)]; }
+
+private:
+    static size_t Index(WidgetEventKind kind) { return static_cast<size_t>(kind); }
+    static uint32_t Bit(WidgetEventKind kind) { return 1u << static_cast<uint32_t>(kind); }
+
+    uint32_t counts[static_cast<size_t>(WidgetEventKind::Count)];
+    uint32_t mask;
+};
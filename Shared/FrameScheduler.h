@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "WidgetRect.h"
+
+struct SchedulerStats
+{
+    // Changes recorded and commits that applied them.
+    uint64_t mutations;
+    uint64_t commits;
+    // Commits forced by the delay budget because the frame timer did not
+    // fire in time.
+    uint64_t overdueCommits;
+    uint64_t maxMutationsPerCommit;
+    // Milliseconds from the first change of a commit to the commit.
+    uint64_t totalLatency;
+    uint64_t maxLatency;
+
+    double GetMutationsPerCommit() const { return commits ? double(mutations) / commits : 0; }
+    double GetAverageLatency() const { return commits ? double(totalLatency) / commits : 0; }
+};
+
+// Everything a commit has to apply, gathered since the previous one.
+struct FrameChanges
+{
+    // Accessibility nodes to rebuild, each once, in ascending order
+    std::vector<uint64_t> nodes;
+    bool focusChanged = false;
+    // Whether derived layout has to be recomputed before anything is read
+    bool layoutChanged = false;
+    // Area to repaint, the union of every invalidation; meaningless unless
+    // repaint is set. repaintAll covers the whole window.
+    WidgetRect dirtyRect = { 0, 0, 0, 0 };
+    bool repaint = false;
+    bool repaintAll = false;
+    size_t mutations = 0;
+};
+
+// Collects model changes and applies them once per frame instead of once per
+// change: every node update, invalidation and layout change made while
+// handling a burst of messages goes out as one accessibility update, one
+// repaint region and one layout pass. Callers commit from a frame timer armed
+// with GetNextDue. A commit is due one frame interval after the previous one,
+// or as soon as the timer fires after a quiet period, so the first change is
+// not held back. A timer only fires once the message queue is empty, so a
+// caller also commits when a change finds the scheduler overdue, so a busy
+// loop holds changes back no longer than the delay budget plus the gap to its
+// next change. Times are in milliseconds from any steady clock.
+class FrameScheduler
+{
+public:
+    static const uint64_t kNothingPending = UINT64_MAX;
+
+    explicit FrameScheduler(uint32_t frameInterval = 16, uint32_t maxDelay = 100)
+        : frameInterval(frameInterval), maxDelay((std::max)(maxDelay, frameInterval)), firstChange(0), lastCommit(0), committed(false), stats()
+    {
+    }
+
+    void NodeChanged(uint64_t node, uint64_t now)
+    {
+        Record(now);
+        pending.nodes.push_back(node);
+    }
+
+    void FocusChanged(uint64_t now)
+    {
+        Record(now);
+        pending.focusChanged = true;
+    }
+
+    void LayoutChanged(uint64_t now)
+    {
+        Record(now);
+        pending.layoutChanged = true;
+    }
+
+    void Invalidate(const WidgetRect& rect, uint64_t now)
+    {
+        Record(now);
+        if (!pending.repaint)
+        {
+            pending.dirtyRect = rect;
+        }
+        else
+        {
+            pending.dirtyRect.left = (std::min)(pending.dirtyRect.left, rect.left);
+            pending.dirtyRect.top = (std::min)(pending.dirtyRect.top, rect.top);
+            pending.dirtyRect.right = (std::max)(pending.dirtyRect.right, rect.right);
+            pending.dirtyRect.bottom = (std::max)(pending.dirtyRect.bottom, rect.bottom);
+        }
+        pending.repaint = true;
+    }
+
+    void InvalidateAll(uint64_t now)
+    {
+        Record(now);
+        pending.repaint = true;
+        pending.repaintAll = true;
+    }
+
+    bool HasPending() const { return pending.mutations > 0; }
+
+    // Milliseconds until Commit has something to apply, or kNothingPending.
+    // Zero means a commit is due now; callers arm their frame timer with
+    // anything else.
+    uint64_t GetNextDue(uint64_t now) const
+    {
+        if (!HasPending())
+        {
+            return kNothingPending;
+        }
+        uint64_t due = committed ? (std::max)(lastCommit + frameInterval, firstChange) : firstChange;
+        due = (std::min)(due, firstChange + maxDelay);
+        return due > now ? due - now : 0;
+    }
+
+    bool IsOverdue(uint64_t now) const { return HasPending() && now >= firstChange + maxDelay; }
+
+    // Calls apply(changes) with everything pending if a commit is due, and
+    // returns whether it did.
+    template <typename Apply>
+    bool Commit(uint64_t now, Apply apply)
+    {
+        if (GetNextDue(now) != 0)
+        {
+            return false;
+        }
+
+        bool overdue = IsOverdue(now);
+        FrameChanges changes = std::move(pending);
+        pending = FrameChanges();
+        std::sort(changes.nodes.begin(), changes.nodes.end());
+        changes.nodes.erase(std::unique(changes.nodes.begin(), changes.nodes.end()), changes.nodes.end());
+
+        uint64_t latency = now - firstChange;
+        stats.commits++;
+        stats.overdueCommits += overdue ? 1 : 0;
+        stats.maxMutationsPerCommit = (std::max)(stats.maxMutationsPerCommit, static_cast<uint64_t>(changes.mutations));
+        stats.totalLatency += latency;
+        stats.maxLatency = (std::max)(stats.maxLatency, latency);
+        lastCommit = now;
+        committed = true;
+
+        apply(changes);
+        return true;
+    }
+
+    const SchedulerStats& GetStats() const { return stats; }
+
+private:
+    void Record(uint64_t now)
+    {
+        if (!HasPending())
+        {
+            firstChange = now;
+        }
+        pending.mutations++;
+        stats.mutations++;
+    }
+
+    uint32_t frameInterval;
+    uint32_t maxDelay;
+    uint64_t firstChange;
+    uint64_t lastCommit;
+    bool committed;
+    FrameChanges pending;
+    SchedulerStats stats;
+};
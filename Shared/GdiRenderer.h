@@ -0,0 +1,158 @@
+#pragma once
+
+#include <windows.h>
+#include "Renderer.h"
+#include "ScreenTransform.h"
+#include "TextLayoutCache.h"
+
+#pragma comment(lib, "Msimg32.lib")
+
+inline RECT ToRect(const WidgetRect& rect)
+{
+    return { rect.left, rect.top, rect.right, rect.bottom };
+}
+
+inline WidgetRect ToWidgetRect(const RECT& rect)
+{
+    return { static_cast<int32_t>(rect.left), static_cast<int32_t>(rect.top), static_cast<int32_t>(rect.right), static_cast<int32_t>(rect.bottom) };
+}
+
+// Renderer that draws straight to a GDI device context. With a text cache,
+// labels are measured once and drawn with ExtTextOut at the cached position
+// instead of being laid out again by DrawText on every paint. Widget rects are
+// at 96 DPI; for any other dpi the DC's mapping mode scales them, matching the
+// bounds reported through ScreenTransform.
+class GdiRenderer : public Renderer, public TextMeasurer
+{
+public:
+    GdiRenderer(HDC hdc, TextLayoutCache* textCache = nullptr, uint32_t dpi = ScreenTransform::kDefaultDpi)
+        : hdc(hdc), textCache(textCache), savedState(0)
+    {
+        if (dpi != ScreenTransform::kDefaultDpi)
+        {
+            savedState = SaveDC(hdc);
+            SetMapMode(hdc, MM_ANISOTROPIC);
+            SetWindowExtEx(hdc, ScreenTransform::kDefaultDpi, ScreenTransform::kDefaultDpi, NULL);
+            SetViewportExtEx(hdc, dpi, dpi, NULL);
+        }
+    }
+
+    ~GdiRenderer()
+    {
+        if (savedState)
+        {
+            RestoreDC(hdc, savedState);
+        }
+    }
+
+    void FillRect(const WidgetRect& rect, uint32_t color) override
+    {
+        RECT rectToDraw = ToRect(rect);
+        HBRUSH hBrush = CreateSolidBrush(color);
+        ::FillRect(hdc, &rectToDraw, hBrush);
+        DeleteObject(hBrush);
+    }
+
+    void BlendRect(const WidgetRect& rect, uint32_t color, uint8_t alpha) override
+    {
+        if (alpha == 255)
+        {
+            FillRect(rect, color);
+            return;
+        }
+
+        // Stretch a one pixel bitmap of the color over the rect
+        HDC memDC = CreateCompatibleDC(hdc);
+        HBITMAP bitmap = CreateCompatibleBitmap(hdc, 1, 1);
+        HBITMAP oldBitmap = (HBITMAP)SelectObject(memDC, bitmap);
+        SetPixel(memDC, 0, 0, color);
+
+        BLENDFUNCTION blend = { AC_SRC_OVER, 0, alpha, 0 };
+        AlphaBlend(hdc, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, memDC, 0, 0, 1, 1, blend);
+
+        SelectObject(memDC, oldBitmap);
+        DeleteObject(bitmap);
+        DeleteDC(memDC);
+    }
+
+    void DrawLabel(const WidgetRect& rect, const std::wstring& text, const FontDesc& font, uint32_t color) override
+    {
+        LabelRun label = { rect, &text };
+        DrawLabels(&label, 1, font, color);
+    }
+
+    // One brush for every rect
+    void FillRects(const WidgetRect* rects, size_t count, uint32_t color) override
+    {
+        HBRUSH hBrush = CreateSolidBrush(color);
+        for (size_t i = 0; i < count; i++)
+        {
+            RECT rectToDraw = ToRect(rects[i]);
+            ::FillRect(hdc, &rectToDraw, hBrush);
+        }
+        DeleteObject(hBrush);
+    }
+
+    // One font and text color for every label
+    void DrawLabels(const LabelRun* labels, size_t count, const FontDesc& font, uint32_t color) override
+    {
+        HFONT hFont = NULL;
+        HFONT hOldFont = NULL;
+        if (font.face)
+        {
+            hFont = CreateFontW(font.height, 0, 0, 0, font.bold ? FW_BOLD : FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, VARIABLE_PITCH, font.face);
+            hOldFont = (HFONT)SelectObject(hdc, hFont);
+        }
+
+        SetTextColor(hdc, color);
+        SetBkMode(hdc, TRANSPARENT);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const WidgetRect& rect = labels[i].rect;
+            const std::wstring& text = *labels[i].text;
+            RECT rectToDraw = ToRect(rect);
+            if (textCache)
+            {
+                const TextLayout& layout = textCache->GetLayout(text, font, rect.right - rect.left, rect.bottom - rect.top, *this);
+                ExtTextOutW(hdc, rect.left + layout.x, rect.top + layout.y, ETO_CLIPPED, &rectToDraw, text.c_str(), (UINT)text.size(), layout.advances.data());
+            }
+            else
+            {
+                DrawTextW(hdc, text.c_str(), -1, &rectToDraw, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+            }
+        }
+
+        if (hFont)
+        {
+            SelectObject(hdc, hOldFont);
+            DeleteObject(hFont);
+        }
+    }
+
+    // Measures with whatever font is selected into the DC.
+    int32_t MeasureText(const std::wstring& text, const FontDesc& font, std::vector<int32_t>* advances) override
+    {
+        advances->assign(text.size(), 0);
+        SIZE size = { 0, 0 };
+        if (!text.empty())
+        {
+            // Partial extents are cumulative; turn them into per-character advances
+            std::vector<INT> extents(text.size());
+            GetTextExtentExPointW(hdc, text.c_str(), (int)text.size(), 0, NULL, extents.data(), &size);
+            for (size_t i = 0; i < text.size(); i++)
+            {
+                (*advances)[i] = extents[i] - (i > 0 ? extents[i - 1] : 0);
+            }
+        }
+
+        TEXTMETRICW metrics;
+        GetTextMetricsW(hdc, &metrics);
+        return metrics.tmHeight;
+    }
+
+private:
+    HDC hdc;
+    TextLayoutCache* textCache;
+    int savedState;
+};
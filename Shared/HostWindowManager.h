@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "WidgetModel.h"
+
+typedef void* HostHandle;
+
+// Window operations the host manager needs, so it can run against real child
+// windows or a mock that only counts what it is asked to do.
+class WindowSystem
+{
+public:
+    virtual ~WindowSystem() {}
+
+    // Creates a visible host window with the given bounds and accessible name.
+    virtual HostHandle CreateHost(const WidgetRect& rect, const std::wstring& name) = 0;
+    virtual void DestroyHost(HostHandle host) = 0;
+    virtual void SetHostText(HostHandle host, const std::wstring& name) = 0;
+
+    // Moves are submitted as one batch of count MoveHost calls.
+    virtual void BeginMoves(size_t count) = 0;
+    virtual void MoveHost(HostHandle host, const WidgetRect& rect, bool visible) = 0;
+    virtual void EndMoves() = 0;
+};
+
+// Keeps one host window per widget of a subtree, outside the paint path.
+// Sync brings the hosts in line with the model: new widgets reuse hidden
+// hosts from a pool before any are created, removed widgets return theirs to
+// the pool, and every move, show and hide goes out in one deferred batch.
+class HostWindowManager
+{
+public:
+    static const size_t kMaxPooled = 64;
+
+    HostWindowManager(WindowSystem* windows) : windows(windows), pass(0) {}
+
+    ~HostWindowManager()
+    {
+        DestroyAll();
+    }
+
+    void Sync(const WidgetModel& model, WidgetId root)
+    {
+        pass++;
+        wanted.clear();
+        Collect(model, root);
+
+        // Claim slots for the widgets that should have hosts
+        for (WidgetId widget : wanted)
+        {
+            if (widget.index >= hosts.size())
+            {
+                hosts.resize(widget.index + 1);
+            }
+            Host& host = hosts[widget.index];
+            if (host.handle && host.widget != widget)
+            {
+                Release(host); // The slot now belongs to a different widget
+            }
+            host.seen = pass;
+        }
+        for (Host& host : hosts)
+        {
+            if (host.handle && host.seen != pass)
+            {
+                Release(host);
+            }
+        }
+
+        for (WidgetId widget : wanted)
+        {
+            const Widget& data = *model.Get(widget);
+            Host& host = hosts[widget.index];
+            if (!host.handle && (!released.empty() || !pool.empty()))
+            {
+                // Prefer a host released in this pass: it is still visible
+                std::vector<HostHandle>& source = released.empty() ? pool : released;
+                host.handle = source.back();
+                source.pop_back();
+                host.widget = widget;
+                host.name = data.name;
+                windows->SetHostText(host.handle, host.name);
+                moves.push_back({ host.handle, data.rect, true });
+                host.rect = data.rect;
+            }
+            else if (!host.handle)
+            {
+                host.handle = windows->CreateHost(data.rect, data.name);
+                host.widget = widget;
+                host.rect = data.rect;
+                host.name = data.name;
+            }
+            else
+            {
+                if (!SameRect(host.rect, data.rect))
+                {
+                    moves.push_back({ host.handle, data.rect, true });
+                    host.rect = data.rect;
+                }
+                if (host.name != data.name)
+                {
+                    host.name = data.name;
+                    windows->SetHostText(host.handle, host.name);
+                }
+            }
+        }
+
+        for (HostHandle handle : released)
+        {
+            moves.push_back({ handle, { 0, 0, 0, 0 }, false });
+            pool.push_back(handle);
+        }
+        released.clear();
+
+        FlushMoves();
+        TrimPool();
+    }
+
+    // Creates hidden hosts ahead of time so later Syncs only move them.
+    void Reserve(size_t count)
+    {
+        while (pool.size() < count)
+        {
+            HostHandle handle = windows->CreateHost({ 0, 0, 0, 0 }, std::wstring());
+            moves.push_back({ handle, { 0, 0, 0, 0 }, false });
+            pool.push_back(handle);
+        }
+        FlushMoves();
+    }
+
+    void DestroyAll()
+    {
+        for (Host& host : hosts)
+        {
+            if (host.handle)
+            {
+                windows->DestroyHost(host.handle);
+                host.handle = nullptr;
+            }
+        }
+        for (HostHandle handle : pool)
+        {
+            windows->DestroyHost(handle);
+        }
+        pool.clear();
+    }
+
+    HostHandle GetHost(WidgetId widget) const
+    {
+        return widget.index < hosts.size() && hosts[widget.index].widget == widget ? hosts[widget.index].handle : nullptr;
+    }
+
+    size_t GetPooledCount() const { return pool.size(); }
+
+private:
+    struct Host
+    {
+        HostHandle handle = nullptr;
+        WidgetId widget = kNoWidget;
+        WidgetRect rect = { 0, 0, 0, 0 };
+        std::wstring name;
+        uint64_t seen = 0;
+    };
+
+    struct Move
+    {
+        HostHandle handle;
+        WidgetRect rect;
+        bool visible;
+    };
+
+    static bool SameRect(const WidgetRect& a, const WidgetRect& b)
+    {
+        return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+    }
+
+    void Collect(const WidgetModel& model, WidgetId id)
+    {
+        const Widget* widget = model.Get(id);
+        if (!widget)
+        {
+            return;
+        }
+        wanted.push_back(id);
+        for (WidgetId child : widget->children)
+        {
+            Collect(model, child);
+        }
+    }
+
+    // Frees the host for the next widget that needs one; it is hidden at the
+    // end of the pass if nothing takes it.
+    void Release(Host& host)
+    {
+        released.push_back(host.handle);
+        host.handle = nullptr;
+        host.widget = kNoWidget;
+    }
+
+    void FlushMoves()
+    {
+        if (moves.empty())
+        {
+            return;
+        }
+        windows->BeginMoves(moves.size());
+        for (const Move& move : moves)
+        {
+            windows->MoveHost(move.handle, move.rect, move.visible);
+        }
+        windows->EndMoves();
+        moves.clear();
+    }
+
+    void TrimPool()
+    {
+        while (pool.size() > kMaxPooled)
+        {
+            windows->DestroyHost(pool.back());
+            pool.pop_back();
+        }
+    }
+
+    WindowSystem* windows;
+    std::vector<Host> hosts;
+    std::vector<HostHandle> pool;
+    std::vector<HostHandle> released;
+    std::vector<WidgetId> wanted;
+    std::vector<Move> moves;
+    uint64_t pass;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// What the bytes of a widget store are spent on.
+enum class MemoryCategory
+{
+    // Parent and child links, handles and slot bookkeeping
+    Structure,
+    Geometry,
+    Names,
+    // Role, flags and color
+    State,
+    // Range values of progress bars
+    Values,
+    // Tables computed from the widgets, such as UTF-8 names and pre-order columns
+    Derived,
+    // Name and role lookup
+    Index,
+    Count,
+};
+
+// Bytes held by a widget store, by category, counting allocated capacity
+// rather than what is in use since that is what the process pays for.
+struct MemoryUsage
+{
+    static const size_t kCategoryCount = static_cast<size_t>(MemoryCategory::Count);
+
+    size_t nodes = 0;
+    size_t bytes[kCategoryCount] = {};
+
+    void Add(MemoryCategory category, size_t count) { bytes[static_cast<size_t>(category)] += count; }
+    size_t Get(MemoryCategory category) const { return bytes[static_cast<size_t>(category)]; }
+
+    size_t GetTotal() const
+    {
+        size_t total = 0;
+        for (size_t count : bytes)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    double GetPerNode(MemoryCategory category) const { return nodes ? double(Get(category)) / nodes : 0; }
+    double GetTotalPerNode() const { return nodes ? double(GetTotal()) / nodes : 0; }
+
+    static const char* GetCategoryName(MemoryCategory category)
+    {
+        static const char* const names[kCategoryCount] = { "structure", "geometry", "names", "state", "values", "derived", "index" };
+        return names[static_cast<size_t>(category)];
+    }
+};
+
+// Heap bytes behind a vector; the vector object itself is counted with
+// whatever holds it.
+template <typename T>
+inline size_t HeapBytes(const std::vector<T>& values)
+{
+    return values.capacity() * sizeof(T);
+}
+
+// Heap bytes behind a string, zero while it fits in the small-string buffer.
+template <typename Char>
+inline size_t HeapBytes(const std::basic_string<Char>& text)
+{
+    static const size_t inlineCapacity = std::basic_string<Char>().capacity();
+    return text.capacity() > inlineCapacity ? (text.capacity() + 1) * sizeof(Char) : 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "HostWindowManager.h"
+
+// WindowSystem that keeps hosts in memory and counts every operation, so host
+// management can be checked without a real windowing system.
+class MockWindowSystem : public WindowSystem
+{
+public:
+    struct HostState
+    {
+        WidgetRect rect;
+        bool visible;
+        std::wstring name;
+    };
+
+    struct Counters
+    {
+        uint64_t creates;
+        uint64_t destroys;
+        uint64_t moves;
+        uint64_t moveBatches;
+        uint64_t textChanges;
+    };
+
+    MockWindowSystem() : nextHandle(1), counters(), inBatch(false) {}
+
+    HostHandle CreateHost(const WidgetRect& rect, const std::wstring& name) override
+    {
+        HostHandle host = reinterpret_cast<HostHandle>(nextHandle++);
+        hosts[host] = { rect, true, name };
+        counters.creates++;
+        return host;
+    }
+
+    void DestroyHost(HostHandle host) override
+    {
+        hosts.erase(host);
+        counters.destroys++;
+    }
+
+    void SetHostText(HostHandle host, const std::wstring& name) override
+    {
+        hosts[host].name = name;
+        counters.textChanges++;
+    }
+
+    void BeginMoves(size_t) override
+    {
+        inBatch = true;
+        counters.moveBatches++;
+    }
+
+    void MoveHost(HostHandle host, const WidgetRect& rect, bool visible) override
+    {
+        HostState& state = hosts[host];
+        state.rect = rect;
+        state.visible = visible;
+        counters.moves++;
+        if (!inBatch)
+        {
+            counters.moveBatches++; // A move outside a batch is a batch of its own
+        }
+    }
+
+    void EndMoves() override
+    {
+        inBatch = false;
+    }
+
+    const HostState* Find(HostHandle host) const
+    {
+        auto it = hosts.find(host);
+        return it != hosts.end() ? &it->second : nullptr;
+    }
+
+    size_t GetLiveCount() const { return hosts.size(); }
+    const Counters& GetCounters() const { return counters; }
+    void ResetCounters() { counters = Counters(); }
+
+private:
+    uintptr_t nextHandle;
+    std::unordered_map<HostHandle, HostState> hosts;
+    Counters counters;
+    bool inBatch;
+};
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MemoryUsage.h"
+#include "SlotMap.h"
+
+// Finds elements by name and by category without looking at the elements.
+// Names are case-folded into a compressed trie: a node per branching point
+// rather than per character, so walking a subtree costs about as much as the
+// matches it holds. Each node where a name ends holds the posting list of the
+// elements with that name, and each category keeps its own posting list.
+// Exact lookups walk the name once, prefix lookups walk the prefix and then
+// only the matching subtree, and every update touches one path of the trie,
+// so none of them depends on how many elements are indexed. Results come in
+// no particular order.
+class NameIndex
+{
+public:
+    NameIndex() : nodes(1), freeNode(kNone) {}
+
+    void Add(SlotHandle handle, uint8_t category, const std::wstring& name)
+    {
+        if (handle.index >= entries.size())
+        {
+            entries.resize(handle.index + 1);
+        }
+        Entry& entry = entries[handle.index];
+        entry.handle = handle;
+        entry.category = category;
+        if (category >= categories.size())
+        {
+            categories.resize(category + 1);
+        }
+        entry.categoryPosition = static_cast<uint32_t>(categories[category].size());
+        categories[category].push_back(handle);
+        Link(handle, Fold(name));
+    }
+
+    void Rename(SlotHandle handle, const std::wstring& name)
+    {
+        if (!Contains(handle))
+        {
+            return;
+        }
+        Unlink(handle);
+        Link(handle, Fold(name));
+    }
+
+    void Remove(SlotHandle handle)
+    {
+        if (!Contains(handle))
+        {
+            return;
+        }
+        Unlink(handle);
+        Entry& entry = entries[handle.index];
+        std::vector<SlotHandle>& list = categories[entry.category];
+        SlotHandle moved = list.back();
+        list[entry.categoryPosition] = moved;
+        entries[moved.index].categoryPosition = entry.categoryPosition;
+        list.pop_back();
+        entry = Entry();
+    }
+
+    bool Contains(SlotHandle handle) const
+    {
+        return handle.index < entries.size() && entries[handle.index].handle == handle;
+    }
+
+    // Elements whose name equals name, ignoring case.
+    const std::vector<SlotHandle>& GetByName(const std::wstring& name) const
+    {
+        size_t remaining = 0;
+        uint32_t node = Descend(Fold(name), &remaining);
+        return node != kNone && remaining == 0 ? nodes[node].postings : noPostings;
+    }
+
+    const std::vector<SlotHandle>& GetByCategory(uint8_t category) const
+    {
+        return category < categories.size() ? categories[category] : noPostings;
+    }
+
+    // Number of elements whose name starts with prefix, ignoring case.
+    size_t CountPrefix(const std::wstring& prefix) const
+    {
+        size_t remaining = 0;
+        uint32_t node = Descend(Fold(prefix), &remaining);
+        return node == kNone ? 0 : nodes[node].count;
+    }
+
+    // Calls visit(handle) for every element whose name starts with prefix,
+    // ignoring case.
+    template <typename Visit>
+    void VisitPrefix(const std::wstring& prefix, Visit visit) const
+    {
+        size_t remaining = 0;
+        uint32_t node = Descend(Fold(prefix), &remaining);
+        if (node != kNone)
+        {
+            VisitSubtree(node, visit);
+        }
+    }
+
+    // The same, restricted to one category. Whichever of the two posting sets
+    // is smaller is the one walked: the prefix subtree with a category check,
+    // or the category list with a check that the name is under the prefix.
+    template <typename Visit>
+    void VisitPrefix(const std::wstring& prefix, uint8_t category, Visit visit) const
+    {
+        size_t remaining = 0;
+        uint32_t node = Descend(Fold(prefix), &remaining);
+        if (node == kNone)
+        {
+            return;
+        }
+        const std::vector<SlotHandle>& list = GetByCategory(category);
+        if (nodes[node].count <= list.size())
+        {
+            VisitSubtree(node, [&](SlotHandle handle)
+            {
+                if (entries[handle.index].category == category)
+                {
+                    visit(handle);
+                }
+            });
+            return;
+        }
+        for (SlotHandle handle : list)
+        {
+            if (IsUnder(entries[handle.index].node, node))
+            {
+                visit(handle);
+            }
+        }
+    }
+
+    size_t GetNodeCount() const { return nodes.size(); }
+
+    // Heap bytes held by the trie, the postings and the per-element entries.
+    size_t GetMemoryBytes() const
+    {
+        size_t bytes = HeapBytes(nodes) + HeapBytes(entries) + HeapBytes(categories);
+        for (const Node& node : nodes)
+        {
+            bytes += HeapBytes(node.label) + HeapBytes(node.children) + HeapBytes(node.postings);
+        }
+        for (const std::vector<SlotHandle>& list : categories)
+        {
+            bytes += HeapBytes(list);
+        }
+        return bytes;
+    }
+
+private:
+    static const uint32_t kNone = UINT32_MAX;
+
+    struct Node
+    {
+        // Characters on the edge from the parent; empty only for the root
+        std::wstring label;
+        uint32_t parent = kNone;
+        // Elements with a name in this subtree
+        uint32_t count = 0;
+        // Sorted by first character of the child's label
+        std::vector<std::pair<wchar_t, uint32_t>> children;
+        std::vector<SlotHandle> postings;
+    };
+
+    struct Entry
+    {
+        SlotHandle handle = INVALID_SLOT_HANDLE;
+        uint8_t category = 0;
+        uint32_t node = kNone;
+        uint32_t postingPosition = 0;
+        uint32_t categoryPosition = 0;
+    };
+
+    static std::wstring Fold(const std::wstring& text)
+    {
+        std::wstring folded(text);
+        for (wchar_t& c : folded)
+        {
+            c = static_cast<wchar_t>(std::towlower(c));
+        }
+        return folded;
+    }
+
+    // Follows key from the root. Returns the node at or below which every
+    // name starting with key lies, with *remaining set to how much of that
+    // node's label is beyond the key, or kNone if no name starts with key.
+    uint32_t Descend(const std::wstring& key, size_t* remaining) const
+    {
+        uint32_t node = 0;
+        size_t i = 0;
+        while (i < key.size())
+        {
+            uint32_t child = FindChild(node, key[i]);
+            if (child == kNone)
+            {
+                return kNone;
+            }
+            const std::wstring& label = nodes[child].label;
+            size_t common = CommonPrefix(label, key, i);
+            if (common < label.size() && i + common < key.size())
+            {
+                return kNone;
+            }
+            node = child;
+            i += common;
+            *remaining = label.size() - common;
+        }
+        return node;
+    }
+
+    static size_t CommonPrefix(const std::wstring& label, const std::wstring& key, size_t offset)
+    {
+        size_t n = 0;
+        while (n < label.size() && offset + n < key.size() && label[n] == key[offset + n])
+        {
+            n++;
+        }
+        return n;
+    }
+
+    uint32_t FindChild(uint32_t node, wchar_t c) const
+    {
+        const auto& children = nodes[node].children;
+        auto it = std::lower_bound(children.begin(), children.end(), c, [](const std::pair<wchar_t, uint32_t>& child, wchar_t value) { return child.first < value; });
+        return it != children.end() && it->first == c ? it->second : kNone;
+    }
+
+    void SetChild(uint32_t node, uint32_t child)
+    {
+        auto& children = nodes[node].children;
+        wchar_t c = nodes[child].label[0];
+        auto it = std::lower_bound(children.begin(), children.end(), c, [](const std::pair<wchar_t, uint32_t>& entry, wchar_t value) { return entry.first < value; });
+        if (it != children.end() && it->first == c)
+        {
+            it->second = child;
+        }
+        else
+        {
+            children.insert(it, { c, child });
+        }
+        nodes[child].parent = node;
+    }
+
+    void RemoveChild(uint32_t node, wchar_t c)
+    {
+        auto& children = nodes[node].children;
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            if (children[i].first == c)
+            {
+                children.erase(children.begin() + i);
+                return;
+            }
+        }
+    }
+
+    uint32_t NewNode(std::wstring label)
+    {
+        uint32_t node;
+        if (freeNode != kNone)
+        {
+            node = freeNode;
+            freeNode = nodes[node].parent;
+            nodes[node] = Node();
+        }
+        else
+        {
+            node = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+        }
+        nodes[node].label = std::move(label);
+        return node;
+    }
+
+    void FreeNode(uint32_t node)
+    {
+        nodes[node] = Node();
+        nodes[node].parent = freeNode;
+        freeNode = node;
+    }
+
+    // Inserts key into the trie, splitting an edge where the key leaves it,
+    // and adds handle to the postings of the node where the key ends.
+    void Link(SlotHandle handle, const std::wstring& key)
+    {
+        uint32_t node = 0;
+        size_t i = 0;
+        for (;;)
+        {
+            nodes[node].count++;
+            if (i == key.size())
+            {
+                break;
+            }
+            uint32_t child = FindChild(node, key[i]);
+            if (child == kNone)
+            {
+                uint32_t leaf = NewNode(key.substr(i));
+                SetChild(node, leaf);
+                nodes[leaf].count++;
+                node = leaf;
+                break;
+            }
+            size_t common = CommonPrefix(nodes[child].label, key, i);
+            if (common < nodes[child].label.size())
+            {
+                uint32_t middle = NewNode(nodes[child].label.substr(0, common));
+                nodes[middle].count = nodes[child].count;
+                nodes[child].label.erase(0, common);
+                SetChild(node, middle);
+                SetChild(middle, child);
+                child = middle;
+            }
+            node = child;
+            i += common;
+        }
+
+        Entry& entry = entries[handle.index];
+        entry.node = node;
+        entry.postingPosition = static_cast<uint32_t>(nodes[node].postings.size());
+        nodes[node].postings.push_back(handle);
+    }
+
+    // Takes handle out of its node's postings, then prunes nodes left with no
+    // postings and fewer than two children so the trie stays compressed.
+    void Unlink(SlotHandle handle)
+    {
+        Entry& entry = entries[handle.index];
+        uint32_t node = entry.node;
+        std::vector<SlotHandle>& postings = nodes[node].postings;
+        SlotHandle moved = postings.back();
+        postings[entry.postingPosition] = moved;
+        entries[moved.index].postingPosition = entry.postingPosition;
+        postings.pop_back();
+        entry.node = kNone;
+
+        for (uint32_t up = node; up != kNone; up = nodes[up].parent)
+        {
+            nodes[up].count--;
+        }
+
+        while (node != 0 && nodes[node].postings.empty() && nodes[node].children.size() < 2)
+        {
+            uint32_t parent = nodes[node].parent;
+            if (nodes[node].children.empty())
+            {
+                RemoveChild(parent, nodes[node].label[0]);
+                FreeNode(node);
+                node = parent;
+                continue;
+            }
+            // One child: fold this node's label into it
+            uint32_t child = nodes[node].children[0].second;
+            nodes[child].label.insert(0, nodes[node].label);
+            SetChild(parent, child);
+            FreeNode(node);
+            break;
+        }
+    }
+
+    bool IsUnder(uint32_t node, uint32_t ancestor) const
+    {
+        for (; node != kNone; node = nodes[node].parent)
+        {
+            if (node == ancestor)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Visit>
+    void VisitSubtree(uint32_t root, Visit visit) const
+    {
+        std::vector<uint32_t> pending(1, root);
+        while (!pending.empty())
+        {
+            const Node& node = nodes[pending.back()];
+            pending.pop_back();
+            for (SlotHandle handle : node.postings)
+            {
+                visit(handle);
+            }
+            for (const auto& child : node.children)
+            {
+                pending.push_back(child.second);
+            }
+        }
+    }
+
+    std::vector<Node> nodes;
+    uint32_t freeNode;
+    std::vector<Entry> entries;
+    std::vector<std::vector<SlotHandle>> categories;
+    std::vector<SlotHandle> noPostings;
+};
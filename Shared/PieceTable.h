@@ -0,0 +1,395 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Text storage for large documents. The text is a sequence of pieces, each a
+// span of either the original buffer or an append-only buffer of inserted
+// text, kept in a treap ordered by position. Every node carries the length
+// and line break count of its subtree, so finding an offset, the start of a
+// line or the line of an offset costs O(log pieces), and edits only split or
+// join pieces instead of moving text.
+class PieceTable
+{
+public:
+    PieceTable() : root(kNil), seed(0x9E3779B9u) {}
+
+    explicit PieceTable(const std::wstring& text) : PieceTable()
+    {
+        Assign(text);
+    }
+
+    // Replaces the whole text, dropping the edit history.
+    void Assign(const std::wstring& text)
+    {
+        nodes.clear();
+        freeNodes.clear();
+        root = kNil;
+        for (Buffer& buffer : buffers)
+        {
+            buffer.text.clear();
+            buffer.lineBreaks.clear();
+        }
+        Append(buffers[kOriginal], text);
+        if (!text.empty())
+        {
+            root = NewNode(kOriginal, 0, text.size());
+        }
+    }
+
+    size_t GetLength() const { return Length(root); }
+    size_t GetLineCount() const { return Breaks(root) + 1; }
+    size_t GetPieceCount() const { return nodes.size() - freeNodes.size(); }
+
+    wchar_t CharAt(size_t offset) const
+    {
+        uint32_t node = root;
+        while (node != kNil)
+        {
+            const Node& n = nodes[node];
+            size_t left = Length(n.left);
+            if (offset < left)
+            {
+                node = n.left;
+            }
+            else if (offset < left + n.length)
+            {
+                return buffers[n.buffer].text[n.start + offset - left];
+            }
+            else
+            {
+                offset -= left + n.length;
+                node = n.right;
+            }
+        }
+        return 0;
+    }
+
+    // Copies up to count characters starting at offset.
+    std::wstring GetText(size_t offset, size_t count) const
+    {
+        std::wstring text;
+        GetText(offset, count, &text);
+        return text;
+    }
+
+    void GetText(size_t offset, size_t count, std::wstring* text) const
+    {
+        text->clear();
+        size_t length = GetLength();
+        if (offset >= length)
+        {
+            return;
+        }
+        count = (std::min)(count, length - offset);
+        text->reserve(count);
+        Collect(root, offset, offset + count, 0, text);
+    }
+
+    // Offset of the first character of a line; lines past the end map to the length.
+    size_t GetLineStart(size_t line) const
+    {
+        if (line == 0)
+        {
+            return 0;
+        }
+        if (line > Breaks(root))
+        {
+            return GetLength();
+        }
+
+        // Find the line-th break and return the offset just after it
+        size_t remaining = line;
+        size_t base = 0;
+        uint32_t node = root;
+        while (node != kNil)
+        {
+            const Node& n = nodes[node];
+            size_t left = Breaks(n.left);
+            if (remaining <= left)
+            {
+                node = n.left;
+                continue;
+            }
+            remaining -= left;
+            base += Length(n.left);
+            if (remaining <= n.breaks)
+            {
+                const std::vector<uint32_t>& breaks = buffers[n.buffer].lineBreaks;
+                size_t first = std::lower_bound(breaks.begin(), breaks.end(), static_cast<uint32_t>(n.start)) - breaks.begin();
+                return base + breaks[first + remaining - 1] - n.start + 1;
+            }
+            remaining -= n.breaks;
+            base += n.length;
+            node = n.right;
+        }
+        return GetLength();
+    }
+
+    // Line holding the character at offset; the length maps to the last line.
+    size_t GetLineOfOffset(size_t offset) const
+    {
+        size_t line = 0;
+        uint32_t node = root;
+        while (node != kNil)
+        {
+            const Node& n = nodes[node];
+            size_t left = Length(n.left);
+            if (offset <= left)
+            {
+                node = n.left;
+                continue;
+            }
+            line += Breaks(n.left);
+            offset -= left;
+            if (offset <= n.length)
+            {
+                return line + BreaksIn(n.buffer, n.start, n.start + offset);
+            }
+            line += n.breaks;
+            offset -= n.length;
+            node = n.right;
+        }
+        return line;
+    }
+
+    void Insert(size_t offset, const std::wstring& text)
+    {
+        if (text.empty())
+        {
+            return;
+        }
+        offset = (std::min)(offset, GetLength());
+        Buffer& added = buffers[kAdded];
+        size_t start = added.text.size();
+        Append(added, text);
+
+        uint32_t left, right;
+        Split(root, offset, &left, &right);
+
+        // Typing extends the piece that ends at the previous insertion
+        uint32_t last = Rightmost(left);
+        if (last != kNil && nodes[last].buffer == kAdded && nodes[last].start + nodes[last].length == start)
+        {
+            uint32_t grown;
+            Split(left, offset - nodes[last].length, &left, &grown);
+            Node& piece = nodes[grown];
+            piece.length += text.size();
+            piece.breaks = BreaksIn(kAdded, piece.start, piece.start + piece.length);
+            Update(grown);
+            root = Merge(Merge(left, grown), right);
+            return;
+        }
+        root = Merge(Merge(left, NewNode(kAdded, start, text.size())), right);
+    }
+
+    void Erase(size_t offset, size_t count)
+    {
+        uint32_t left, middle, right;
+        Split(root, offset, &left, &middle);
+        Split(middle, count, &middle, &right);
+        FreeTree(middle);
+        root = Merge(left, right);
+    }
+
+private:
+    static const uint32_t kNil = 0xFFFFFFFFu;
+    static const uint8_t kOriginal = 0;
+    static const uint8_t kAdded = 1;
+
+    struct Buffer
+    {
+        std::wstring text;
+        // Sorted offsets of every '\n' in text.
+        std::vector<uint32_t> lineBreaks;
+    };
+
+    struct Node
+    {
+        size_t start;
+        size_t length;
+        size_t breaks;
+        // Subtree totals, including this piece.
+        size_t totalLength;
+        size_t totalBreaks;
+        uint32_t left;
+        uint32_t right;
+        uint32_t priority;
+        uint8_t buffer;
+    };
+
+    static void Append(Buffer& buffer, const std::wstring& text)
+    {
+        size_t base = buffer.text.size();
+        buffer.text.append(text);
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == L'\n')
+            {
+                buffer.lineBreaks.push_back(static_cast<uint32_t>(base + i));
+            }
+        }
+    }
+
+    size_t Length(uint32_t node) const { return node == kNil ? 0 : nodes[node].totalLength; }
+    size_t Breaks(uint32_t node) const { return node == kNil ? 0 : nodes[node].totalBreaks; }
+
+    // Line breaks in buffer[begin, end).
+    size_t BreaksIn(uint8_t buffer, size_t begin, size_t end) const
+    {
+        const std::vector<uint32_t>& breaks = buffers[buffer].lineBreaks;
+        return std::lower_bound(breaks.begin(), breaks.end(), static_cast<uint32_t>(end)) - std::lower_bound(breaks.begin(), breaks.end(), static_cast<uint32_t>(begin));
+    }
+
+    uint32_t NewNode(uint8_t buffer, size_t start, size_t length)
+    {
+        uint32_t index;
+        if (!freeNodes.empty())
+        {
+            index = freeNodes.back();
+            freeNodes.pop_back();
+        }
+        else
+        {
+            index = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+        }
+
+        // xorshift keeps the treap balanced in expectation
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        Node& node = nodes[index];
+        node.buffer = buffer;
+        node.start = start;
+        node.length = length;
+        node.breaks = BreaksIn(buffer, start, start + length);
+        node.left = kNil;
+        node.right = kNil;
+        node.priority = seed;
+        Update(index);
+        return index;
+    }
+
+    void FreeTree(uint32_t node)
+    {
+        if (node == kNil)
+        {
+            return;
+        }
+        FreeTree(nodes[node].left);
+        FreeTree(nodes[node].right);
+        freeNodes.push_back(node);
+    }
+
+    void Update(uint32_t index)
+    {
+        Node& node = nodes[index];
+        node.totalLength = Length(node.left) + node.length + Length(node.right);
+        node.totalBreaks = Breaks(node.left) + node.breaks + Breaks(node.right);
+    }
+
+    uint32_t Rightmost(uint32_t node) const
+    {
+        while (node != kNil && nodes[node].right != kNil)
+        {
+            node = nodes[node].right;
+        }
+        return node;
+    }
+
+    // Splits the tree at node into the first offset characters and the rest,
+    // cutting a piece in two when the split falls inside it.
+    void Split(uint32_t node, size_t offset, uint32_t* left, uint32_t* right)
+    {
+        if (node == kNil)
+        {
+            *left = *right = kNil;
+            return;
+        }
+
+        size_t before = Length(nodes[node].left);
+        if (offset <= before)
+        {
+            uint32_t child;
+            Split(nodes[node].left, offset, left, &child);
+            nodes[node].left = child;
+            Update(node);
+            *right = node;
+        }
+        else if (offset >= before + nodes[node].length)
+        {
+            uint32_t child;
+            Split(nodes[node].right, offset - before - nodes[node].length, &child, right);
+            nodes[node].right = child;
+            Update(node);
+            *left = node;
+        }
+        else
+        {
+            size_t cut = offset - before;
+            uint32_t tail = NewNode(nodes[node].buffer, nodes[node].start + cut, nodes[node].length - cut);
+            Node& head = nodes[node];
+            nodes[tail].right = head.right;
+            head.right = kNil;
+            head.length = cut;
+            head.breaks = BreaksIn(head.buffer, head.start, head.start + cut);
+            Update(tail);
+            Update(node);
+            *left = node;
+            *right = tail;
+        }
+    }
+
+    uint32_t Merge(uint32_t left, uint32_t right)
+    {
+        if (left == kNil)
+        {
+            return right;
+        }
+        if (right == kNil)
+        {
+            return left;
+        }
+        if (nodes[left].priority > nodes[right].priority)
+        {
+            uint32_t child = Merge(nodes[left].right, right);
+            nodes[left].right = child;
+            Update(left);
+            return left;
+        }
+        uint32_t child = Merge(left, nodes[right].left);
+        nodes[right].left = child;
+        Update(right);
+        return right;
+    }
+
+    // Appends the part of [begin, end) that lies in the subtree at node,
+    // where base is the offset of the subtree's first character.
+    void Collect(uint32_t node, size_t begin, size_t end, size_t base, std::wstring* text) const
+    {
+        if (node == kNil || begin >= base + Length(node) || end <= base)
+        {
+            return;
+        }
+        const Node& n = nodes[node];
+        size_t start = base + Length(n.left);
+        Collect(n.left, begin, end, base, text);
+        size_t from = (std::max)(begin, start);
+        size_t to = (std::min)(end, start + n.length);
+        if (from < to)
+        {
+            text->append(buffers[n.buffer].text, n.start + from - start, to - from);
+        }
+        Collect(n.right, begin, end, start + n.length, text);
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    Buffer buffers[2];
+    uint32_t root;
+    uint32_t seed;
+};
@@ -0,0 +1,542 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// What a trace record stands for and what its ints hold. Entry points name
+// their element by a container widget's slot and a child index under it,
+// kTraceSelf for the container itself, followed by the call's own arguments.
+// Mutations start with the slot of the widget they change, or of the
+// container whose selection they change.
+enum class TraceEvent : uint8_t
+{
+    // UI Automation
+    GetPropertyValue,   // element, property id
+    Navigate,           // element, direction
+    GetBoundingRectangle, // element
+    ElementFromPoint,   // element, x, y in screen coordinates
+    GetFocus,           // element
+    FindItem,           // element, index searched after or -1, TraceFind, value; text for a name
+    Prefetch,           // element, QueryScope, property count
+    GetRuntimeId,       // element
+    FocusElement,       // element
+    Realize,            // element
+    SelectItem,         // element, TraceSelect
+    GetValue,           // element
+    GetSelection,       // element
+    AdviseEvent,        // element, event id, 1 when added or 0 when removed
+    TextCall,           // TraceText, range start, range end, then the call's arguments; text for FindText
+
+    // IAccessible
+    AccChildCount,      // element
+    AccChild,           // element
+    AccName,            // element
+    AccValue,           // element
+    AccRole,            // element
+    AccState,           // element
+    AccLocation,        // element
+    AccNavigate,        // element, direction
+    AccHitTest,         // element, x, y in screen coordinates
+    AccFocus,           // element
+    AccSelect,          // element, SELFLAG flags
+    AccSelection,       // element
+
+    // Model mutations
+    AddWidget,          // slot, parent slot or -1, role, color, left, top, right, bottom; text is the name
+    RemoveWidget,       // slot
+    MoveWidget,         // slot, parent slot or -1, index
+    SetName,            // slot; text
+    SetRect,            // slot, left, top, right, bottom
+    SetEnabled,         // slot, enabled
+    SetValue,           // slot; number
+    SetRange,           // slot; minimum, maximum
+    SetFocus,           // slot or -1
+    SetScreenTransform, // origin x, origin y, dpi
+    Subscribe,          // WidgetEventKind, listener count
+    ResizeSelection,    // container slot, item count
+    SetSelected,        // container slot, first, last, selected
+    SetSelectionAnchor, // container slot, item or -1
+    SetDocumentText,    // char width, line height; text
+    EditText,           // offset, erased count; inserted text
+    SetTextSelection,   // start, end
+    SetTextViewport,    // left, top, right, bottom
+    ScrollText,         // first visible line
+
+    Count,
+};
+
+// Child index of a record's element that stands for the container itself,
+// as CHILDID_SELF does for IAccessible.
+const int64_t kTraceSelf = -1;
+
+// What a FindItem record searched for.
+enum class TraceFind : uint8_t
+{
+    Any,
+    Name,
+    Enabled,
+    Role,
+};
+
+// Which selection item call a SelectItem record stands for.
+enum class TraceSelect : uint8_t
+{
+    Select,
+    AddToSelection,
+    RemoveFromSelection,
+};
+
+// Which text pattern call a TextCall record stands for. Calls on the text
+// provider itself have an empty range; the arguments after the range are:
+//  - RangeFromPoint: x, y in client coordinates
+//  - GetPropertyValue, GetPatternProvider: the property or pattern id
+//  - Compare, CompareEndpoints, MoveEndpointByRange: the other range's
+//    start and end, then for the last two this and its endpoint, 0 for start
+//  - ExpandToEnclosingUnit: TextUnitKind
+//  - FindAttribute: the attribute id, whether backward
+//  - FindText: whether backward, whether ignoring case
+//  - GetAttributeValue: the attribute id
+//  - GetText: the maximum length or -1
+//  - Move: TextUnitKind, count
+//  - MoveEndpointByUnit: endpoint, TextUnitKind, count
+//  - ScrollIntoView: whether aligned to the top
+enum class TraceText : uint8_t
+{
+    GetProviderOptions,
+    GetPatternProvider,
+    GetPropertyValue,
+    GetHostProvider,
+    GetSelection,
+    GetVisibleRanges,
+    RangeFromChild,
+    RangeFromPoint,
+    GetDocumentRange,
+    GetSupportedSelection,
+    Clone,
+    Compare,
+    CompareEndpoints,
+    ExpandToEnclosingUnit,
+    FindAttribute,
+    FindText,
+    GetAttributeValue,
+    GetBoundingRectangles,
+    GetEnclosingElement,
+    GetText,
+    Move,
+    MoveEndpointByUnit,
+    MoveEndpointByRange,
+    Select,
+    AddToSelection,
+    RemoveFromSelection,
+    ScrollIntoView,
+    GetChildren,
+    Count,
+};
+
+inline bool IsMutation(TraceEvent event)
+{
+    return event >= TraceEvent::AddWidget && event < TraceEvent::Count;
+}
+
+inline const char* TraceEventName(TraceEvent event)
+{
+    static const char* const names[] = {
+        "GetPropertyValue", "Navigate", "GetBoundingRectangle", "ElementFromPoint", "GetFocus", "FindItem", "Prefetch",
+        "GetRuntimeId", "FocusElement", "Realize", "SelectItem", "GetValue", "GetSelection", "AdviseEvent", "TextCall",
+        "AccChildCount", "AccChild", "AccName", "AccValue", "AccRole", "AccState", "AccLocation", "AccNavigate", "AccHitTest", "AccFocus",
+        "AccSelect", "AccSelection",
+        "AddWidget", "RemoveWidget", "MoveWidget", "SetName", "SetRect", "SetEnabled", "SetValue", "SetRange", "SetFocus", "SetScreenTransform",
+        "Subscribe", "ResizeSelection", "SetSelected", "SetSelectionAnchor",
+        "SetDocumentText", "EditText", "SetTextSelection", "SetTextViewport", "ScrollText",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(TraceEvent::Count), "a name per event");
+    return event < TraceEvent::Count ? names[static_cast<size_t>(event)] : "?";
+}
+
+// One decoded record. text points into the trace data and is not terminated.
+struct TraceRecord
+{
+    static const size_t kMaxInts = 8;
+    static const size_t kMaxNumbers = 2;
+
+    // Microseconds since recording started
+    uint64_t time;
+    TraceEvent event;
+    uint8_t intCount;
+    uint8_t numberCount;
+    int64_t ints[kMaxInts];
+    double numbers[kMaxNumbers];
+    const char* text;
+    size_t textLength;
+
+    int64_t Int(size_t i) const { return i < intCount ? ints[i] : 0; }
+    double Number(size_t i) const { return i < numberCount ? numbers[i] : 0; }
+};
+
+// Trace files start with this, then hold one record after another:
+//  - the time since the previous record in microseconds, as a varint,
+//  - the event, one byte,
+//  - a layout byte: the int count in the low four bits, the number count in
+//    the next two and whether there is text in the one above,
+//  - the ints as zigzag varints, the numbers as 8 raw bytes each and the
+//    text as a varint length and UTF-8 bytes.
+// Most records come to 4 to 8 bytes. The last byte of the magic is the
+// format version, bumped whenever events are added or renumbered.
+const char kTraceMagic[8] = { 'A', '1', '1', 'Y', 'T', 'R', 'C', 2 };
+
+// Records provider entry points and model mutations to a file, so a session
+// can be replayed away from the machine and the AT that produced it. Records
+// are buffered and written in large blocks. Calls must come from one thread,
+// as they do from providers on the UI thread.
+class QueryTraceWriter
+{
+public:
+    QueryTraceWriter() : file(nullptr), lastTime(0), records(0), bytes(0) {}
+    ~QueryTraceWriter() { Close(); }
+
+    QueryTraceWriter(const QueryTraceWriter&) = delete;
+    QueryTraceWriter& operator=(const QueryTraceWriter&) = delete;
+
+    bool Open(const char* path)
+    {
+        Close();
+#ifdef _MSC_VER
+        if (fopen_s(&file, path, "wb") != 0)
+        {
+            file = nullptr;
+        }
+#else
+        file = fopen(path, "wb");
+#endif
+        if (!file)
+        {
+            return false;
+        }
+        start = std::chrono::steady_clock::now();
+        lastTime = 0;
+        records = 0;
+        bytes = 0;
+        buffer.assign(kTraceMagic, kTraceMagic + sizeof(kTraceMagic));
+        return true;
+    }
+
+    void Close()
+    {
+        if (file)
+        {
+            Flush();
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    bool IsOpen() const { return file != nullptr; }
+
+    // Appends a record stamped with the time since Open.
+    void Write(TraceEvent event, std::initializer_list<int64_t> ints, std::initializer_list<double> numbers = {}, const std::string* text = nullptr)
+    {
+        if (!file)
+        {
+            return;
+        }
+        uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        size_t intCount = ints.size() < TraceRecord::kMaxInts ? ints.size() : TraceRecord::kMaxInts;
+        size_t numberCount = numbers.size() < TraceRecord::kMaxNumbers ? numbers.size() : TraceRecord::kMaxNumbers;
+
+        PutVarint(now - lastTime);
+        lastTime = now;
+        buffer.push_back(static_cast<uint8_t>(event));
+        buffer.push_back(static_cast<uint8_t>(intCount | numberCount << 4 | (text ? 0x40 : 0)));
+        const int64_t* value = ints.begin();
+        for (size_t i = 0; i < intCount; i++)
+        {
+            PutVarint(static_cast<uint64_t>(value[i]) << 1 ^ static_cast<uint64_t>(value[i] >> 63));
+        }
+        const double* number = numbers.begin();
+        for (size_t i = 0; i < numberCount; i++)
+        {
+            uint8_t raw[sizeof(double)];
+            memcpy(raw, &number[i], sizeof(raw));
+            buffer.insert(buffer.end(), raw, raw + sizeof(raw));
+        }
+        if (text)
+        {
+            PutVarint(text->size());
+            buffer.insert(buffer.end(), text->begin(), text->end());
+        }
+        records++;
+        if (buffer.size() >= kFlushSize)
+        {
+            Flush();
+        }
+    }
+
+    uint64_t GetRecordCount() const { return records; }
+    uint64_t GetByteCount() const { return bytes + buffer.size(); }
+
+private:
+    static const size_t kFlushSize = 64 * 1024;
+
+    void PutVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            buffer.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<uint8_t>(value));
+    }
+
+    void Flush()
+    {
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        bytes += buffer.size();
+        buffer.clear();
+    }
+
+    FILE* file;
+    std::chrono::steady_clock::time_point start;
+    uint64_t lastTime;
+    uint64_t records;
+    uint64_t bytes;
+    std::vector<uint8_t> buffer;
+};
+
+// The trace that providers and models record to, or null when nothing is
+// being recorded, which costs each entry point one test.
+inline QueryTraceWriter*& ActiveTrace()
+{
+    static QueryTraceWriter* trace = nullptr;
+    return trace;
+}
+
+inline void TraceCall(TraceEvent event, std::initializer_list<int64_t> ints)
+{
+    if (QueryTraceWriter* trace = ActiveTrace())
+    {
+        trace->Write(event, ints);
+    }
+}
+
+// Decodes a trace held in memory, usually a MappedFile, without copying it.
+class QueryTraceReader
+{
+public:
+    QueryTraceReader(const uint8_t* data, size_t size) : data(data), size(size), position(sizeof(kTraceMagic)), time(0), corrupt(false)
+    {
+        valid = data && size >= sizeof(kTraceMagic) && memcmp(data, kTraceMagic, sizeof(kTraceMagic)) == 0;
+    }
+
+    bool IsValid() const { return valid; }
+
+    // Decodes the next record. Returns false at the end of the trace or at a
+    // truncated or corrupt record, which ends it too.
+    bool Next(TraceRecord* record)
+    {
+        if (!valid || corrupt || position >= size)
+        {
+            return false;
+        }
+        uint64_t delta;
+        if (!GetVarint(&delta) || size - position < 2)
+        {
+            return Corrupt();
+        }
+        uint8_t event = data[position++];
+        uint8_t layout = data[position++];
+        if (event >= static_cast<uint8_t>(TraceEvent::Count) || (layout & 0x0F) > TraceRecord::kMaxInts || (layout >> 4 & 0x03) > TraceRecord::kMaxNumbers)
+        {
+            return Corrupt();
+        }
+        time += delta;
+        record->time = time;
+        record->event = static_cast<TraceEvent>(event);
+        record->intCount = layout & 0x0F;
+        record->numberCount = layout >> 4 & 0x03;
+        for (size_t i = 0; i < record->intCount; i++)
+        {
+            uint64_t value;
+            if (!GetVarint(&value))
+            {
+                return Corrupt();
+            }
+            record->ints[i] = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+        for (size_t i = 0; i < record->numberCount; i++)
+        {
+            if (size - position < sizeof(double))
+            {
+                return Corrupt();
+            }
+            memcpy(&record->numbers[i], data + position, sizeof(double));
+            position += sizeof(double);
+        }
+        record->text = nullptr;
+        record->textLength = 0;
+        if (layout & 0x40)
+        {
+            uint64_t length;
+            if (!GetVarint(&length) || size - position < length)
+            {
+                return Corrupt();
+            }
+            record->text = reinterpret_cast<const char*>(data + position);
+            record->textLength = static_cast<size_t>(length);
+            position += static_cast<size_t>(length);
+        }
+        return true;
+    }
+
+    void Rewind()
+    {
+        position = sizeof(kTraceMagic);
+        time = 0;
+        corrupt = false;
+    }
+
+    // Whether reading stopped at a bad record rather than the end.
+    bool IsCorrupt() const { return corrupt; }
+
+private:
+    bool GetVarint(uint64_t* value)
+    {
+        *value = 0;
+        for (unsigned shift = 0; shift < 64 && position < size; shift += 7)
+        {
+            uint8_t byte = data[position++];
+            *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Corrupt()
+    {
+        corrupt = true;
+        return false;
+    }
+
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+    uint64_t time;
+    // Whether the data starts like a trace
+    bool valid;
+    // Whether reading stopped at a bad record; cleared by Rewind
+    bool corrupt;
+};
+
+// A read-only view of a whole file, paged in by the system as it is read.
+class MappedFile
+{
+public:
+    MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+    {
+    }
+
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const char* path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (!view)
+        {
+            Close();
+            return false;
+        }
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = open(path, O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED)
+        {
+            return false;
+        }
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+        {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const uint8_t* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Renderer.h"
+
+// Renderer that draws nothing and records every call it receives, so the
+// calls and state changes a paint produces can be inspected on any platform.
+class RecordingRenderer : public Renderer
+{
+public:
+    struct Call
+    {
+        enum Kind : uint8_t
+        {
+            FillRect,
+            BlendRect,
+            DrawLabel,
+            FillRects,
+            DrawLabels,
+        };
+
+        Kind kind;
+        uint32_t color;
+        FontDesc font;
+        // Primitives drawn by the call.
+        size_t count;
+    };
+
+    RecordingRenderer() : stateSwitches(0), primitives(0) {}
+
+    void FillRect(const WidgetRect&, uint32_t color) override
+    {
+        Record(Call::FillRect, color, kDefaultFont, 1);
+    }
+
+    void BlendRect(const WidgetRect&, uint32_t color, uint8_t) override
+    {
+        Record(Call::BlendRect, color, kDefaultFont, 1);
+    }
+
+    void DrawLabel(const WidgetRect&, const std::wstring&, const FontDesc& font, uint32_t color) override
+    {
+        Record(Call::DrawLabel, color, font, 1);
+    }
+
+    void FillRects(const WidgetRect*, size_t count, uint32_t color) override
+    {
+        Record(Call::FillRects, color, kDefaultFont, count);
+    }
+
+    void DrawLabels(const LabelRun*, size_t count, const FontDesc& font, uint32_t color) override
+    {
+        Record(Call::DrawLabels, color, font, count);
+    }
+
+    void Clear()
+    {
+        calls.clear();
+        stateSwitches = 0;
+        primitives = 0;
+    }
+
+    const std::vector<Call>& GetCalls() const { return calls; }
+    size_t GetCallCount() const { return calls.size(); }
+    // Brush changes between fills, and font or text color changes between labels.
+    uint64_t GetStateSwitches() const { return stateSwitches; }
+    uint64_t GetPrimitiveCount() const { return primitives; }
+
+private:
+    static bool IsText(Call::Kind kind)
+    {
+        return kind == Call::DrawLabel || kind == Call::DrawLabels;
+    }
+
+    void Record(Call::Kind kind, uint32_t color, const FontDesc& font, size_t count)
+    {
+        if (!calls.empty())
+        {
+            const Call& last = calls.back();
+            if (IsText(last.kind) != IsText(kind) || last.color != color || (IsText(kind) && !SameFont(last.font, font)))
+            {
+                stateSwitches++;
+            }
+        }
+        calls.push_back({ kind, color, font, count });
+        primitives += count;
+    }
+
+    std::vector<Call> calls;
+    uint64_t stateSwitches;
+    uint64_t primitives;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cwchar>
+#include <string>
+#include "WidgetModel.h"
+
+// Font used for a label. A null face means the target's default font.
+struct FontDesc
+{
+    int32_t height;
+    bool bold;
+    const wchar_t* face;
+};
+
+const FontDesc kLabelFont = { 18, true, L"Arial" };
+const FontDesc kDefaultFont = { 0, false, nullptr };
+
+inline bool SameFont(const FontDesc& a, const FontDesc& b)
+{
+    if (a.height != b.height || a.bold != b.bold || !a.face != !b.face)
+    {
+        return false;
+    }
+    return a.face == b.face || std::wcscmp(a.face, b.face) == 0;
+}
+
+// One label in a run of labels that share a font and color.
+struct LabelRun
+{
+    WidgetRect rect;
+    const std::wstring* text;
+};
+
+// Drawing operations the painters need, so the same paint code can target GDI
+// on Windows or an in-memory framebuffer anywhere. Colors are 0x00BBGGRR, as
+// COLORREF.
+class Renderer
+{
+public:
+    virtual ~Renderer() {}
+
+    virtual void FillRect(const WidgetRect& rect, uint32_t color) = 0;
+
+    // Composites color over what is already drawn; alpha 255 is opaque.
+    virtual void BlendRect(const WidgetRect& rect, uint32_t color, uint8_t alpha) = 0;
+
+    // Draws a single line of text centered in rect and clipped to it.
+    virtual void DrawLabel(const WidgetRect& rect, const std::wstring& text, const FontDesc& font, uint32_t color) = 0;
+
+    // Batched forms, so a backend can set up a brush or font once for many
+    // primitives. By default they fall back to the single calls.
+    virtual void FillRects(const WidgetRect* rects, size_t count, uint32_t color)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            FillRect(rects[i], color);
+        }
+    }
+
+    virtual void DrawLabels(const LabelRun* labels, size_t count, const FontDesc& font, uint32_t color)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            DrawLabel(labels[i].rect, *labels[i].text, font, color);
+        }
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include "WidgetRect.h"
+
+// Defining SCREEN_TRANSFORM_NO_SSE2 keeps TransformRects to the scalar Apply,
+// so it can be tested on machines that have SSE2.
+#if !defined(SCREEN_TRANSFORM_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SCREEN_TRANSFORM_SSE2 1
+#endif
+
+// Maps widget rectangles, laid out at 96 DPI relative to the client area, to
+// the screen: scale by the window's DPI, then offset by where the client area
+// starts on screen. Both change only when the window moves, resizes or
+// changes monitor, so a transform is captured once and applied to every rect.
+struct ScreenTransform
+{
+    static const uint32_t kDefaultDpi = 96;
+
+    int32_t originX;
+    int32_t originY;
+    uint32_t dpi;
+
+    float GetScale() const { return static_cast<float>(dpi) / kDefaultDpi; }
+
+    bool operator==(const ScreenTransform& other) const
+    {
+        return originX == other.originX && originY == other.originY && dpi == other.dpi;
+    }
+    bool operator!=(const ScreenTransform& other) const { return !(*this == other); }
+
+    // Rounds to nearest, ties to even, the same as the vector path.
+    WidgetRect Apply(const WidgetRect& rect) const
+    {
+        if (dpi == kDefaultDpi)
+        {
+            return { rect.left + originX, rect.top + originY, rect.right + originX, rect.bottom + originY };
+        }
+        float scale = GetScale();
+        return {
+            static_cast<int32_t>(std::nearbyint(rect.left * scale)) + originX,
+            static_cast<int32_t>(std::nearbyint(rect.top * scale)) + originY,
+            static_cast<int32_t>(std::nearbyint(rect.right * scale)) + originX,
+            static_cast<int32_t>(std::nearbyint(rect.bottom * scale)) + originY,
+        };
+    }
+
+    // Maps a screen point back to layout coordinates, for hit testing against
+    // widget rects: the result is the layout pixel whose scaled span, rounded
+    // as Apply rounds it, holds the point. So a point lands in a widget exactly
+    // when it is inside the widget's screen rect.
+    void ToLayout(int32_t screenX, int32_t screenY, int32_t* x, int32_t* y) const
+    {
+        *x = ToLayout(screenX - originX);
+        *y = ToLayout(screenY - originY);
+    }
+
+private:
+    int32_t ToLayout(int32_t pixel) const
+    {
+        if (dpi == kDefaultDpi)
+        {
+            return pixel;
+        }
+        float scale = GetScale();
+        int32_t layout = static_cast<int32_t>(std::floor((pixel + 0.5f) / scale));
+        while (static_cast<int32_t>(std::nearbyint(layout * scale)) > pixel)
+        {
+            layout--;
+        }
+        while (static_cast<int32_t>(std::nearbyint((layout + 1) * scale)) <= pixel)
+        {
+            layout++;
+        }
+        return layout;
+    }
+};
+
+const ScreenTransform kIdentityTransform = { 0, 0, ScreenTransform::kDefaultDpi };
+
+// Transforms count rects from in to out, one rect per SSE2 register when
+// available. in and out may be the same array.
+inline void TransformRects(const ScreenTransform& transform, const WidgetRect* in, WidgetRect* out, size_t count)
+{
+    static_assert(sizeof(WidgetRect) == 4 * sizeof(int32_t), "WidgetRect must be four packed int32s");
+    size_t i = 0;
+#ifdef SCREEN_TRANSFORM_SSE2
+    const __m128i offset = _mm_setr_epi32(transform.originX, transform.originY, transform.originX, transform.originY);
+    const __m128 scale = _mm_set1_ps(transform.GetScale());
+    const bool scaled = transform.dpi != ScreenTransform::kDefaultDpi;
+    for (; i < count; i++)
+    {
+        __m128i rect = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if (scaled)
+        {
+            rect = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(rect), scale));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(rect, offset));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        out[i] = transform.Apply(in[i]);
+    }
+}
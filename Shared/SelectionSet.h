@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "BitOps.h"
+#include "QueryTrace.h"
+
+// A run of consecutive items, [first, last), whose selection flipped the
+// same way.
+struct SelectionChange
+{
+    size_t first;
+    size_t last;
+    bool selected;
+};
+
+// The selection changes made since the front-end last asked, as runs in the
+// order they happened. Once there are more runs than a front-end would send
+// events for, only the counts are kept.
+struct SelectionSummary
+{
+    // Above this many changed items ATs expect one bulk event on the container
+    // instead of one per item, the same limit UIA and MSAA document.
+    static const size_t kMaxItemEvents = 20;
+
+    std::vector<SelectionChange> runs;
+    size_t added = 0;
+    size_t removed = 0;
+    bool overflowed = false;
+
+    bool IsEmpty() const { return added == 0 && removed == 0; }
+    bool IsBulk() const { return overflowed || added + removed > kMaxItemEvents; }
+};
+
+// What a front-end announces for a batch of selection changes.
+enum class SelectionEvent
+{
+    // Many items changed; one event on the container
+    Invalidated,
+    // The item became the only selected one
+    Selected,
+    Added,
+    Removed,
+};
+
+// Selection state of a container's items, one bit per item, so a list of a
+// million items costs 125 KB however many are selected. Range operations
+// touch a 64-item word at a time and counts come from popcount; the number
+// selected is kept up to date, so it is never recounted. A set given the slot
+// of its container traces the items it actually flips, the anchor and its
+// size, so a replayed session ends on the same selection.
+class SelectionSet
+{
+public:
+    static const size_t kNoItem = SIZE_MAX;
+
+    SelectionSet() : itemCount(0), selectedCount(0), anchor(kNoItem), traceSlot(-1) {}
+
+    // Slot of the widget whose items these are, or -1 to trace nothing.
+    void SetTraceSlot(int64_t slot) { traceSlot = slot; }
+
+    // Items past the new count are dropped without being reported, since
+    // they no longer exist.
+    void Resize(size_t count)
+    {
+        if (traceSlot >= 0)
+        {
+            TraceCall(TraceEvent::ResizeSelection, { traceSlot, static_cast<int64_t>(count) });
+        }
+        for (size_t i = count; i < itemCount && i % 64; i++)
+        {
+            if (IsSelected(i))
+            {
+                words[i / 64] &= ~(uint64_t(1) << (i % 64));
+                selectedCount--;
+            }
+        }
+        for (size_t w = (count + 63) / 64; w < words.size(); w++)
+        {
+            selectedCount -= CountBits(words[w]);
+        }
+        words.resize((count + 63) / 64, 0);
+        itemCount = count;
+        if (anchor != kNoItem && anchor >= count)
+        {
+            anchor = kNoItem;
+        }
+    }
+
+    size_t GetItemCount() const { return itemCount; }
+    size_t GetSelectedCount() const { return selectedCount; }
+
+    bool IsSelected(size_t index) const
+    {
+        return index < itemCount && (words[index / 64] >> (index % 64)) & 1;
+    }
+
+    void Select(size_t index) { SetRange(index, index + 1, true); }
+    void Deselect(size_t index) { SetRange(index, index + 1, false); }
+    void Toggle(size_t index) { SetRange(index, index + 1, !IsSelected(index)); }
+    void SelectRange(size_t first, size_t last) { SetRange(first, last, true); }
+    void DeselectRange(size_t first, size_t last) { SetRange(first, last, false); }
+    void SelectAll() { SetRange(0, itemCount, true); }
+    void Clear() { SetRange(0, itemCount, false); }
+
+    // Makes index the only selected item and the anchor.
+    void SelectOnly(size_t index)
+    {
+        if (index >= itemCount)
+        {
+            return;
+        }
+        SetRange(0, index, false);
+        SetRange(index + 1, itemCount, false);
+        SetRange(index, index + 1, true);
+        MoveAnchor(index);
+    }
+
+    // Drops every item and pending change, as for a new list of count items.
+    void Reset(size_t count)
+    {
+        Resize(0);
+        changes = SelectionSummary();
+        Resize(count);
+    }
+
+    // The item range operations extend from, e.g. with shift+click.
+    size_t GetAnchor() const { return anchor; }
+    void SetAnchor(size_t index) { MoveAnchor(index < itemCount ? index : kNoItem); }
+
+    // Sets every item between the anchor and index, inclusive, to selected.
+    // Without an anchor only index is changed.
+    void ExtendTo(size_t index, bool selected)
+    {
+        if (index >= itemCount)
+        {
+            return;
+        }
+        size_t from = anchor == kNoItem ? index : anchor;
+        SetRange((std::min)(from, index), (std::max)(from, index) + 1, selected);
+    }
+
+    // A click on an item in a list: a plain click selects only the item, with
+    // toggle it flips the item, and with extend the items from the anchor to
+    // it replace the selection. The anchor moves except when extending.
+    void Click(size_t index, bool toggle, bool extend)
+    {
+        if (index >= itemCount)
+        {
+            return;
+        }
+        if (extend && anchor != kNoItem)
+        {
+            size_t first = (std::min)(anchor, index);
+            size_t last = (std::max)(anchor, index) + 1;
+            SetRange(0, first, false);
+            SetRange(last, itemCount, false);
+            SetRange(first, last, true);
+        }
+        else if (toggle)
+        {
+            Toggle(index);
+            MoveAnchor(index);
+        }
+        else
+        {
+            SelectOnly(index);
+        }
+    }
+
+    // Returns the first selected item at or after from, or kNoItem.
+    size_t NextSelected(size_t from) const
+    {
+        if (from >= itemCount)
+        {
+            return kNoItem;
+        }
+        size_t w = from / 64;
+        uint64_t bits = words[w] & (~uint64_t(0) << (from % 64));
+        while (!bits)
+        {
+            if (++w == words.size())
+            {
+                return kNoItem;
+            }
+            bits = words[w];
+        }
+        return w * 64 + LowestBit(bits);
+    }
+
+    bool HasChanges() const { return !changes.IsEmpty(); }
+
+    // Hands over the changes made since the last call.
+    void TakeChanges(SelectionSummary* summary)
+    {
+        *summary = std::move(changes);
+        changes = SelectionSummary();
+    }
+
+    // Takes the pending changes and calls raise(event, index) for what a
+    // front-end should announce: a single Invalidated for a bulk change such
+    // as select-all, however many items it touched, a single Selected when
+    // one item replaced the selection, and otherwise Added or Removed per
+    // changed item. index is kNoItem for Invalidated.
+    template <typename Raise>
+    void DispatchChanges(Raise raise)
+    {
+        if (!HasChanges())
+        {
+            return;
+        }
+        SelectionSummary summary;
+        TakeChanges(&summary);
+
+        if (summary.IsBulk())
+        {
+            raise(SelectionEvent::Invalidated, kNoItem);
+            return;
+        }
+        if (summary.added == 1 && selectedCount == 1)
+        {
+            for (const SelectionChange& run : summary.runs)
+            {
+                if (run.selected && IsSelected(run.first))
+                {
+                    raise(SelectionEvent::Selected, run.first);
+                    return;
+                }
+            }
+        }
+        for (const SelectionChange& run : summary.runs)
+        {
+            for (size_t i = run.first; i < run.last; i++)
+            {
+                raise(run.selected ? SelectionEvent::Added : SelectionEvent::Removed, i);
+            }
+        }
+    }
+
+    // Writes the selection as it stands as mutations that rebuild it, a
+    // record per run of selected items.
+    void TraceSnapshot(QueryTraceWriter* trace) const
+    {
+        trace->Write(TraceEvent::ResizeSelection, { traceSlot, static_cast<int64_t>(itemCount) });
+        for (size_t first = NextSelected(0); first != kNoItem; )
+        {
+            size_t last = first + 1;
+            while (IsSelected(last))
+            {
+                last++;
+            }
+            trace->Write(TraceEvent::SetSelected, { traceSlot, static_cast<int64_t>(first), static_cast<int64_t>(last), 1 });
+            first = NextSelected(last);
+        }
+        trace->Write(TraceEvent::SetSelectionAnchor, { traceSlot, anchor == kNoItem ? -1 : static_cast<int64_t>(anchor) });
+    }
+
+private:
+    void MoveAnchor(size_t index)
+    {
+        if (index != anchor && traceSlot >= 0)
+        {
+            TraceCall(TraceEvent::SetSelectionAnchor, { traceSlot, index == kNoItem ? -1 : static_cast<int64_t>(index) });
+        }
+        anchor = index;
+    }
+
+    void SetRange(size_t first, size_t last, bool selected)
+    {
+        last = (std::min)(last, itemCount);
+        if (first >= last)
+        {
+            return;
+        }
+
+        size_t firstWord = first / 64;
+        size_t lastWord = (last - 1) / 64;
+        size_t changed = 0;
+        for (size_t w = firstWord; w <= lastWord; w++)
+        {
+            uint64_t mask = ~uint64_t(0);
+            if (w == firstWord)
+            {
+                mask &= ~uint64_t(0) << (first % 64);
+            }
+            if (w == lastWord)
+            {
+                mask &= ~uint64_t(0) >> (63 - (last - 1) % 64);
+            }
+            uint64_t flipped = (selected ? ~words[w] : words[w]) & mask;
+            if (!flipped)
+            {
+                continue;
+            }
+            words[w] ^= flipped;
+            changed += CountBits(flipped);
+            if (!changes.overflowed)
+            {
+                RecordRuns(w, flipped, selected);
+            }
+        }
+
+        if (changed && traceSlot >= 0)
+        {
+            TraceCall(TraceEvent::SetSelected, { traceSlot, static_cast<int64_t>(first), static_cast<int64_t>(last), selected });
+        }
+        if (selected)
+        {
+            selectedCount += changed;
+            changes.added += changed;
+        }
+        else
+        {
+            selectedCount -= changed;
+            changes.removed += changed;
+        }
+    }
+
+    // Splits the flipped bits of one word into runs, joining a run to the
+    // previous one when it carries on where that one ended.
+    void RecordRuns(size_t w, uint64_t flipped, bool selected)
+    {
+        while (flipped)
+        {
+            size_t start = LowestBit(flipped);
+            uint64_t rest = ~(flipped >> start);
+            size_t length = rest ? LowestBit(rest) : 64 - start;
+            size_t first = w * 64 + start;
+
+            std::vector<SelectionChange>& runs = changes.runs;
+            if (!runs.empty() && runs.back().selected == selected && runs.back().last == first)
+            {
+                runs.back().last = first + length;
+            }
+            else if (runs.size() < SelectionSummary::kMaxItemEvents)
+            {
+                runs.push_back({ first, first + length, selected });
+            }
+            else
+            {
+                // More runs than items a front-end would announce one by one
+                changes.overflowed = true;
+                runs.clear();
+                return;
+            }
+
+            if (start + length == 64)
+            {
+                break;
+            }
+            flipped &= ~uint64_t(0) << (start + length);
+        }
+    }
+
+    std::vector<uint64_t> words;
+    size_t itemCount;
+    size_t selectedCount;
+    size_t anchor;
+    int64_t traceSlot;
+    SelectionSummary changes;
+};
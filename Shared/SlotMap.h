@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Generational handle into a SlotMap. A handle whose element was erased stops
+// resolving even if its slot has been reused since.
+struct SlotHandle {
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator==(const SlotHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const SlotHandle& other) const {
+        return !(*this == other);
+    }
+};
+
+const SlotHandle INVALID_SLOT_HANDLE = { UINT32_MAX, 0 };
+
+// Stores values contiguously so they can be iterated without pointer chasing,
+// while handles stay stable across insertions and removals. Lookup, insert and
+// erase are O(1); erase moves the last value into the hole.
+template <typename T>
+class SlotMap {
+public:
+    SlotHandle insert(T value) {
+        uint32_t slotIndex;
+        if (freeHead != UINT32_MAX) {
+            slotIndex = freeHead;
+            freeHead = slots[slotIndex].denseIndex;
+        }
+        else {
+            slotIndex = static_cast<uint32_t>(slots.size());
+            slots.push_back({ 0, 1 });
+        }
+        slots[slotIndex].denseIndex = static_cast<uint32_t>(values.size());
+        values.push_back(std::move(value));
+        denseToSlot.push_back(slotIndex);
+        return { slotIndex, slots[slotIndex].generation };
+    }
+
+    bool erase(SlotHandle handle) {
+        if (!contains(handle)) {
+            return false;
+        }
+        uint32_t denseIndex = slots[handle.index].denseIndex;
+        uint32_t lastIndex = static_cast<uint32_t>(values.size() - 1);
+        if (denseIndex != lastIndex) {
+            values[denseIndex] = std::move(values[lastIndex]);
+            denseToSlot[denseIndex] = denseToSlot[lastIndex];
+            slots[denseToSlot[denseIndex]].denseIndex = denseIndex;
+        }
+        values.pop_back();
+        denseToSlot.pop_back();
+
+        Slot& slot = slots[handle.index];
+        slot.generation++;
+        slot.denseIndex = freeHead;
+        freeHead = handle.index;
+        return true;
+    }
+
+    bool contains(SlotHandle handle) const {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    }
+
+    T* get(SlotHandle handle) {
+        return contains(handle) ? &values[slots[handle.index].denseIndex] : nullptr;
+    }
+
+    const T* get(SlotHandle handle) const {
+        return contains(handle) ? &values[slots[handle.index].denseIndex] : nullptr;
+    }
+
+    // Position of a value in iteration order, or size() for a stale handle.
+    size_t denseIndexOf(SlotHandle handle) const {
+        return contains(handle) ? slots[handle.index].denseIndex : values.size();
+    }
+
+    SlotHandle handleAt(size_t denseIndex) const {
+        uint32_t slotIndex = denseToSlot[denseIndex];
+        return { slotIndex, slots[slotIndex].generation };
+    }
+
+    // Current handle for a slot, or INVALID_SLOT_HANDLE if the slot is free.
+    SlotHandle handleAtSlot(uint32_t slotIndex) const {
+        if (slotIndex >= slots.size()) {
+            return INVALID_SLOT_HANDLE;
+        }
+        uint32_t denseIndex = slots[slotIndex].denseIndex;
+        if (denseIndex >= values.size() || denseToSlot[denseIndex] != slotIndex) {
+            return INVALID_SLOT_HANDLE;
+        }
+        return { slotIndex, slots[slotIndex].generation };
+    }
+
+    // Upper bound on handle indices, for tables indexed by SlotHandle::index.
+    size_t slotCount() const { return slots.size(); }
+
+    void reserve(size_t capacity) {
+        values.reserve(capacity);
+        denseToSlot.reserve(capacity);
+        slots.reserve(capacity);
+    }
+
+    // Heap bytes held for values and slot bookkeeping, by capacity. Memory
+    // the values themselves own is not included.
+    size_t memoryBytes() const {
+        return values.capacity() * sizeof(T) + denseToSlot.capacity() * sizeof(uint32_t) + slots.capacity() * sizeof(Slot);
+    }
+
+    size_t size() const { return values.size(); }
+    bool empty() const { return values.empty(); }
+
+    T& operator[](size_t denseIndex) { return values[denseIndex]; }
+    const T& operator[](size_t denseIndex) const { return values[denseIndex]; }
+
+    typename std::vector<T>::iterator begin() { return values.begin(); }
+    typename std::vector<T>::iterator end() { return values.end(); }
+    typename std::vector<T>::const_iterator begin() const { return values.begin(); }
+    typename std::vector<T>::const_iterator end() const { return values.end(); }
+
+private:
+    struct Slot {
+        // Index into values while occupied, next free slot once erased.
+        uint32_t denseIndex;
+        uint32_t generation;
+    };
+
+    std::vector<T> values;
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    uint32_t freeHead = UINT32_MAX;
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Renderer.h"
+#include "TextLayoutCache.h"
+
+// Defining SOFTWARE_RENDERER_NO_SSE2 keeps to the scalar spans, so they can
+// be tested on machines that have SSE2.
+#if !defined(SOFTWARE_RENDERER_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SOFTWARE_RENDERER_SSE2 1
+#endif
+
+// In-memory 32-bit framebuffer. Pixels are 0xAARRGGBB, which is BGRA byte
+// order in memory, the same layout as a top-down Win32 DIB section.
+struct Framebuffer
+{
+    int32_t width;
+    int32_t height;
+    std::vector<uint32_t> pixels;
+
+    Framebuffer(int32_t width, int32_t height) : width(width), height(height), pixels(static_cast<size_t>(width) * height, 0xFF000000) {}
+
+    uint32_t* Row(int32_t y) { return &pixels[static_cast<size_t>(y) * width]; }
+    uint32_t Pixel(int32_t x, int32_t y) const { return pixels[static_cast<size_t>(y) * width + x]; }
+
+    void Clear(uint32_t pixel)
+    {
+        std::fill(pixels.begin(), pixels.end(), pixel);
+    }
+
+    // FNV-1a over the pixels, for comparing output across changes.
+    uint64_t Checksum() const
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (uint32_t pixel : pixels)
+        {
+            hash = (hash ^ pixel) * 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+
+// Converts a COLORREF (0x00BBGGRR) to an opaque framebuffer pixel.
+inline uint32_t ColorToPixel(uint32_t color)
+{
+    uint32_t r = color & 0xFF;
+    uint32_t g = (color >> 8) & 0xFF;
+    uint32_t b = (color >> 16) & 0xFF;
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+// (src * alpha + dst * (255 - alpha)) / 255 per channel, rounded. The SSE2 path
+// uses the same arithmetic so both produce identical pixels.
+inline uint32_t BlendPixel(uint32_t dst, uint32_t src, uint32_t alpha)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t t = ((src >> shift) & 0xFF) * alpha + ((dst >> shift) & 0xFF) * (255 - alpha) + 128;
+        result |= (((t + (t >> 8)) >> 8) & 0xFF) << shift;
+    }
+    return result;
+}
+
+// The headless backend has no font engine. Each code point is stamped as a
+// fixed 5x7 pattern, so label placement and clipping still show up in the
+// pixels and can be compared between runs.
+inline uint64_t GlyphPattern(wchar_t c)
+{
+    if (c == L' ')
+    {
+        return 0;
+    }
+    uint64_t x = static_cast<uint64_t>(c) + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return (x & ((1ULL << 35) - 1)) | 1;
+}
+
+const int32_t kGlyphWidth = 5;
+const int32_t kGlyphHeight = 7;
+
+struct GlyphAtlasStats
+{
+    uint64_t lookups;
+    uint64_t glyphsRasterized;
+};
+
+// 8-bit coverage texture holding every glyph drawn so far, packed into
+// shelves. Each glyph is rasterized once per size and then copied by row.
+class GlyphAtlas
+{
+public:
+    static const int32_t kWidth = 256;
+
+    struct Glyph
+    {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    GlyphAtlas() : height(0), shelfX(0), shelfY(0), shelfHeight(0), stats() {}
+
+    const Glyph& GetGlyph(wchar_t c, int32_t scale, bool bold)
+    {
+        stats.lookups++;
+        uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(c)) | static_cast<uint64_t>(scale) << 32 | (bold ? 1ULL << 48 : 0);
+        auto it = glyphs.find(key);
+        if (it != glyphs.end())
+        {
+            return it->second;
+        }
+        return glyphs[key] = Rasterize(GlyphPattern(c), scale, bold);
+    }
+
+    const uint8_t* Row(int32_t y) const { return &coverage[static_cast<size_t>(y) * kWidth]; }
+    int32_t GetHeight() const { return height; }
+    const GlyphAtlasStats& GetStats() const { return stats; }
+
+private:
+    Glyph Rasterize(uint64_t pattern, int32_t scale, bool bold)
+    {
+        Glyph glyph = { 0, 0, 0, 0 };
+        if (pattern == 0)
+        {
+            return glyph;
+        }
+        // Bold widens each dot by one pixel
+        glyph.width = kGlyphWidth * scale + (bold ? 1 : 0);
+        glyph.height = kGlyphHeight * scale;
+        if (shelfX + glyph.width > kWidth)
+        {
+            shelfX = 0;
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+        }
+        glyph.x = shelfX;
+        glyph.y = shelfY;
+        shelfX += glyph.width;
+        shelfHeight = (std::max)(shelfHeight, glyph.height);
+        if (shelfY + shelfHeight > height)
+        {
+            height = shelfY + shelfHeight;
+            coverage.resize(static_cast<size_t>(height) * kWidth, 0);
+        }
+
+        for (int32_t row = 0; row < kGlyphHeight; row++)
+        {
+            for (int32_t column = 0; column < kGlyphWidth; column++)
+            {
+                if (!(pattern >> (row * kGlyphWidth + column) & 1))
+                {
+                    continue;
+                }
+                for (int32_t y = row * scale; y < (row + 1) * scale; y++)
+                {
+                    uint8_t* dst = &coverage[static_cast<size_t>(glyph.y + y) * kWidth + glyph.x];
+                    for (int32_t x = column * scale; x < (column + 1) * scale + (bold ? 1 : 0); x++)
+                    {
+                        dst[x] = 255;
+                    }
+                }
+            }
+        }
+        stats.glyphsRasterized++;
+        return glyph;
+    }
+
+    std::unordered_map<uint64_t, Glyph> glyphs;
+    std::vector<uint8_t> coverage;
+    int32_t height;
+    int32_t shelfX;
+    int32_t shelfY;
+    int32_t shelfHeight;
+    GlyphAtlasStats stats;
+};
+
+// Renderer that rasterizes into a Framebuffer on the CPU.
+class SoftwareRenderer : public Renderer, public TextMeasurer
+{
+public:
+    SoftwareRenderer(Framebuffer* target) : target(target) {}
+
+    void FillRect(const WidgetRect& rect, uint32_t color) override
+    {
+        WidgetRect clipped;
+        if (!Clip(rect, &clipped))
+        {
+            return;
+        }
+        uint32_t pixel = ColorToPixel(color);
+        for (int32_t y = clipped.top; y < clipped.bottom; y++)
+        {
+            FillSpan(target->Row(y) + clipped.left, clipped.right - clipped.left, pixel);
+        }
+    }
+
+    void BlendRect(const WidgetRect& rect, uint32_t color, uint8_t alpha) override
+    {
+        if (alpha == 255)
+        {
+            FillRect(rect, color);
+            return;
+        }
+        WidgetRect clipped;
+        if (alpha == 0 || !Clip(rect, &clipped))
+        {
+            return;
+        }
+        uint32_t pixel = ColorToPixel(color);
+        for (int32_t y = clipped.top; y < clipped.bottom; y++)
+        {
+            BlendSpan(target->Row(y) + clipped.left, clipped.right - clipped.left, pixel, alpha);
+        }
+    }
+
+    void DrawLabel(const WidgetRect& rect, const std::wstring& text, const FontDesc& font, uint32_t color) override
+    {
+        WidgetRect clip;
+        if (!Clip(rect, &clip))
+        {
+            return;
+        }
+        const TextLayout& layout = textCache.GetLayout(text, font, rect.right - rect.left, rect.bottom - rect.top, *this);
+        int32_t scale = GlyphScale(font);
+        int32_t x = rect.left + layout.x;
+        int32_t y = rect.top + layout.y;
+        uint32_t pixel = ColorToPixel(color);
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            DrawGlyph(atlas.GetGlyph(text[i], scale, font.bold), x, y, pixel, clip);
+            x += layout.advances[i];
+        }
+    }
+
+    int32_t MeasureText(const std::wstring& text, const FontDesc& font, std::vector<int32_t>* advances) override
+    {
+        int32_t scale = GlyphScale(font);
+        advances->assign(text.size(), (kGlyphWidth + 1) * scale);
+        if (!advances->empty())
+        {
+            // No spacing after the last character
+            advances->back() = kGlyphWidth * scale;
+        }
+        return kGlyphHeight * scale;
+    }
+
+    void SetTarget(Framebuffer* framebuffer) { target = framebuffer; }
+    TextLayoutCache& GetTextCache() { return textCache; }
+    const GlyphAtlas& GetGlyphAtlas() const { return atlas; }
+
+    // Size of one glyph cell in pixels for a font.
+    static int32_t GlyphScale(const FontDesc& font)
+    {
+        return font.height > 0 ? (std::max)(1, font.height / 8) : 2;
+    }
+
+private:
+    bool Clip(const WidgetRect& rect, WidgetRect* clipped) const
+    {
+        clipped->left = (std::max)(rect.left, 0);
+        clipped->top = (std::max)(rect.top, 0);
+        clipped->right = (std::min)(rect.right, target->width);
+        clipped->bottom = (std::min)(rect.bottom, target->height);
+        return clipped->left < clipped->right && clipped->top < clipped->bottom;
+    }
+
+    void DrawGlyph(const GlyphAtlas::Glyph& glyph, int32_t x, int32_t y, uint32_t pixel, const WidgetRect& clip)
+    {
+        int32_t left = (std::max)(x, clip.left);
+        int32_t top = (std::max)(y, clip.top);
+        int32_t right = (std::min)(x + glyph.width, clip.right);
+        int32_t bottom = (std::min)(y + glyph.height, clip.bottom);
+        for (int32_t py = top; py < bottom; py++)
+        {
+            const uint8_t* src = atlas.Row(glyph.y + py - y) + glyph.x;
+            uint32_t* dst = target->Row(py);
+            for (int32_t px = left; px < right; px++)
+            {
+                if (src[px - x])
+                {
+                    dst[px] = pixel;
+                }
+            }
+        }
+    }
+
+    static void FillSpan(uint32_t* dst, int32_t count, uint32_t pixel)
+    {
+        int32_t i = 0;
+#ifdef SOFTWARE_RENDERER_SSE2
+        __m128i value = _mm_set1_epi32(static_cast<int>(pixel));
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), value);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = pixel;
+        }
+    }
+
+    static void BlendSpan(uint32_t* dst, int32_t count, uint32_t pixel, uint32_t alpha)
+    {
+        int32_t i = 0;
+#ifdef SOFTWARE_RENDERER_SSE2
+        // Two pixels per 16-bit lane group; the source term is the same for all
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i inverse = _mm_set1_epi16(static_cast<short>(255 - alpha));
+        const __m128i round = _mm_set1_epi16(128);
+        __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(pixel)), zero);
+        src = _mm_add_epi16(_mm_mullo_epi16(src, _mm_set1_epi16(static_cast<short>(alpha))), round);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inverse), src);
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inverse), src);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = BlendPixel(dst[i], pixel, alpha);
+        }
+    }
+
+    Framebuffer* target;
+    TextLayoutCache textCache;
+    GlyphAtlas atlas;
+};
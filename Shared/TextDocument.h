@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PieceTable.h"
+#include "WidgetModel.h"
+
+enum class TextUnitKind
+{
+    Character,
+    Word,
+    Line,
+    Page,
+    Document,
+};
+
+// A scrollable plain text view over a piece table: fixed-pitch layout with
+// one line per text line, a single selection, and the unit boundaries a text
+// pattern moves by. Lines come from the piece table's line index, so a
+// position or rectangle anywhere in a large document is found in
+// logarithmic time; words are found by scanning outward from a position.
+// Changes to the text, selection and view are traced like model mutations.
+class TextDocument
+{
+public:
+    TextDocument(int32_t charWidth, int32_t lineHeight)
+        : charWidth(charWidth), lineHeight(lineHeight), viewport({ 0, 0, 0, 0 }), firstVisibleLine(0), selectionStart(0), selectionEnd(0), version(0)
+    {
+    }
+
+    const PieceTable& GetText() const { return text; }
+    size_t GetLength() const { return text.GetLength(); }
+    uint64_t GetVersion() const { return version; }
+
+    void SetText(const std::wstring& value)
+    {
+        text.Assign(value);
+        firstVisibleLine = 0;
+        selectionStart = selectionEnd = 0;
+        version++;
+        if (QueryTraceWriter* trace = ActiveTrace())
+        {
+            std::string utf8 = WideToUtf8(value);
+            trace->Write(TraceEvent::SetDocumentText, { charWidth, lineHeight }, {}, &utf8);
+        }
+    }
+
+    // Edits keep the selection on the same text: positions at or after an
+    // insertion move past it, and positions inside an erased span collapse
+    // to its start.
+    void Insert(size_t offset, const std::wstring& value)
+    {
+        offset = (std::min)(offset, GetLength());
+        text.Insert(offset, value);
+        selectionStart = ShiftForInsert(selectionStart, offset, value.size());
+        selectionEnd = ShiftForInsert(selectionEnd, offset, value.size());
+        version++;
+        if (QueryTraceWriter* trace = ActiveTrace())
+        {
+            std::string utf8 = WideToUtf8(value);
+            trace->Write(TraceEvent::EditText, { static_cast<int64_t>(offset), 0 }, {}, &utf8);
+        }
+    }
+
+    void Erase(size_t offset, size_t count)
+    {
+        offset = (std::min)(offset, GetLength());
+        count = (std::min)(count, GetLength() - offset);
+        text.Erase(offset, count);
+        selectionStart = ShiftForErase(selectionStart, offset, count);
+        selectionEnd = ShiftForErase(selectionEnd, offset, count);
+        version++;
+        TraceCall(TraceEvent::EditText, { static_cast<int64_t>(offset), static_cast<int64_t>(count) });
+    }
+
+    // Client area the text is laid out in.
+    void SetViewport(const WidgetRect& rect)
+    {
+        viewport = rect;
+        TraceCall(TraceEvent::SetTextViewport, { rect.left, rect.top, rect.right, rect.bottom });
+    }
+    const WidgetRect& GetViewport() const { return viewport; }
+    int32_t GetCharWidth() const { return charWidth; }
+    int32_t GetLineHeight() const { return lineHeight; }
+
+    size_t GetFirstVisibleLine() const { return firstVisibleLine; }
+    size_t GetVisibleLineCount() const
+    {
+        return (std::max)(1, (viewport.bottom - viewport.top) / lineHeight);
+    }
+
+    void ScrollToLine(size_t line)
+    {
+        size_t last = text.GetLineCount() - 1;
+        line = (std::min)(line, last);
+        if (line != firstVisibleLine)
+        {
+            firstVisibleLine = line;
+            TraceCall(TraceEvent::ScrollText, { static_cast<int64_t>(line) });
+        }
+    }
+
+    void ScrollBy(int lines)
+    {
+        if (lines < 0 && static_cast<size_t>(-lines) > firstVisibleLine)
+        {
+            ScrollToLine(0);
+        }
+        else
+        {
+            ScrollToLine(firstVisibleLine + lines);
+        }
+    }
+
+    // Scrolls the least distance that brings the line of offset into view,
+    // aligning it to the top or bottom edge.
+    void ScrollIntoView(size_t offset, bool alignToTop)
+    {
+        size_t line = text.GetLineOfOffset(offset);
+        size_t visible = GetVisibleLineCount();
+        if (alignToTop || line < firstVisibleLine)
+        {
+            ScrollToLine(line);
+        }
+        else if (line >= firstVisibleLine + visible)
+        {
+            ScrollToLine(line - visible + 1);
+        }
+    }
+
+    void SetSelection(size_t start, size_t end)
+    {
+        start = (std::min)(start, GetLength());
+        end = (std::min)((std::max)(start, end), GetLength());
+        if (start != selectionStart || end != selectionEnd)
+        {
+            selectionStart = start;
+            selectionEnd = end;
+            TraceCall(TraceEvent::SetTextSelection, { static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        }
+    }
+    size_t GetSelectionStart() const { return selectionStart; }
+    size_t GetSelectionEnd() const { return selectionEnd; }
+
+    // Writes the document as it stands as mutations that rebuild it.
+    void TraceSnapshot(QueryTraceWriter* trace) const
+    {
+        std::string utf8 = WideToUtf8(text.GetText(0, GetLength()));
+        trace->Write(TraceEvent::SetDocumentText, { charWidth, lineHeight }, {}, &utf8);
+        trace->Write(TraceEvent::SetTextViewport, { viewport.left, viewport.top, viewport.right, viewport.bottom });
+        trace->Write(TraceEvent::ScrollText, { static_cast<int64_t>(firstVisibleLine) });
+        trace->Write(TraceEvent::SetTextSelection, { static_cast<int64_t>(selectionStart), static_cast<int64_t>(selectionEnd) });
+    }
+
+    // Start of the unit that holds offset.
+    size_t UnitStart(size_t offset, TextUnitKind unit) const
+    {
+        offset = (std::min)(offset, GetLength());
+        switch (unit)
+        {
+        case TextUnitKind::Character:
+            return offset;
+        case TextUnitKind::Word:
+            return IsWordStart(offset) ? offset : PreviousWordStart(offset);
+        case TextUnitKind::Line:
+            return text.GetLineStart(text.GetLineOfOffset(offset));
+        case TextUnitKind::Page:
+        {
+            size_t line = text.GetLineOfOffset(offset);
+            return text.GetLineStart(line - line % GetVisibleLineCount());
+        }
+        default:
+            return 0;
+        }
+    }
+
+    // First unit boundary after offset, or the length at the end of the text.
+    size_t NextBoundary(size_t offset, TextUnitKind unit) const
+    {
+        size_t length = GetLength();
+        if (offset >= length)
+        {
+            return length;
+        }
+        switch (unit)
+        {
+        case TextUnitKind::Character:
+            return offset + 1;
+        case TextUnitKind::Word:
+            return NextWordStart(offset);
+        case TextUnitKind::Line:
+            return text.GetLineStart(text.GetLineOfOffset(offset) + 1);
+        case TextUnitKind::Page:
+        {
+            size_t page = GetVisibleLineCount();
+            size_t line = text.GetLineOfOffset(offset);
+            return text.GetLineStart(line - line % page + page);
+        }
+        default:
+            return length;
+        }
+    }
+
+    // Last unit boundary before offset, or 0 at the start of the text.
+    size_t PreviousBoundary(size_t offset, TextUnitKind unit) const
+    {
+        offset = (std::min)(offset, GetLength());
+        if (offset == 0)
+        {
+            return 0;
+        }
+        return UnitStart(offset - 1, unit);
+    }
+
+    // Rectangles covering [start, end) on the visible lines, in client
+    // coordinates. A degenerate range yields a caret-width rectangle.
+    void GetRangeRects(size_t start, size_t end, std::vector<WidgetRect>* rects) const
+    {
+        rects->clear();
+        size_t firstLine = (std::max)(text.GetLineOfOffset(start), firstVisibleLine);
+        size_t lastLine = (std::min)(text.GetLineOfOffset(end), firstVisibleLine + GetVisibleLineCount() - 1);
+        for (size_t line = firstLine; line <= lastLine; line++)
+        {
+            size_t lineStart = text.GetLineStart(line);
+            size_t lineEnd = LineEnd(line);
+            size_t from = (std::max)(start, lineStart);
+            size_t to = (std::min)(end, lineEnd);
+            if (from > to || (from == to && start != end))
+            {
+                continue;
+            }
+            int32_t top = viewport.top + static_cast<int32_t>(line - firstVisibleLine) * lineHeight;
+            int32_t left = viewport.left + static_cast<int32_t>(from - lineStart) * charWidth;
+            int32_t right = viewport.left + static_cast<int32_t>(to - lineStart) * charWidth;
+            rects->push_back({ left, top, (std::max)(right, left + 1), top + lineHeight });
+        }
+    }
+
+    // Nearest offset to a client point.
+    size_t OffsetFromPoint(int32_t x, int32_t y) const
+    {
+        int32_t row = (std::max)(0, (y - viewport.top) / lineHeight);
+        size_t line = (std::min)(firstVisibleLine + row, text.GetLineCount() - 1);
+        size_t lineStart = text.GetLineStart(line);
+        size_t column = static_cast<size_t>((std::max)(0, (x - viewport.left + charWidth / 2) / charWidth));
+        return lineStart + (std::min)(column, LineEnd(line) - lineStart);
+    }
+
+    // End of a line's text, before its line break.
+    size_t LineEnd(size_t line) const
+    {
+        size_t next = text.GetLineStart(line + 1);
+        return line + 1 < text.GetLineCount() ? next - 1 : next;
+    }
+
+private:
+    enum class CharClass
+    {
+        Space,
+        Break,
+        Word,
+        Punctuation,
+    };
+
+    static const size_t kScanChunk = 256;
+
+    static size_t ShiftForInsert(size_t position, size_t offset, size_t count)
+    {
+        return position >= offset ? position + count : position;
+    }
+
+    static size_t ShiftForErase(size_t position, size_t offset, size_t count)
+    {
+        if (position <= offset)
+        {
+            return position;
+        }
+        return position >= offset + count ? position - count : offset;
+    }
+
+    static CharClass Classify(wchar_t c)
+    {
+        if (c == L'\n')
+        {
+            return CharClass::Break;
+        }
+        if (c == L' ' || c == L'\t' || c == L'\r')
+        {
+            return CharClass::Space;
+        }
+        if ((c >= L'0' && c <= L'9') || (c >= L'A' && c <= L'Z') || (c >= L'a' && c <= L'z') || c == L'_' || c > 0x7F)
+        {
+            return CharClass::Word;
+        }
+        return CharClass::Punctuation;
+    }
+
+    // A word starts where a run of word or punctuation characters begins, and
+    // at the start of every line.
+    static bool IsWordStart(CharClass previous, CharClass current)
+    {
+        return previous == CharClass::Break || (current != CharClass::Space && current != CharClass::Break && current != previous);
+    }
+
+    bool IsWordStart(size_t offset) const
+    {
+        return offset == 0 || offset >= GetLength() || IsWordStart(Classify(text.CharAt(offset - 1)), Classify(text.CharAt(offset)));
+    }
+
+    size_t NextWordStart(size_t offset) const
+    {
+        size_t length = GetLength();
+        CharClass previous = Classify(text.CharAt(offset));
+        for (size_t chunk = offset + 1; chunk < length; chunk += kScanChunk)
+        {
+            text.GetText(chunk, kScanChunk, &scan);
+            for (size_t i = 0; i < scan.size(); i++)
+            {
+                CharClass current = Classify(scan[i]);
+                if (IsWordStart(previous, current))
+                {
+                    return chunk + i;
+                }
+                previous = current;
+            }
+        }
+        return length;
+    }
+
+    size_t PreviousWordStart(size_t offset) const
+    {
+        // offset is not itself a word start, so some earlier position is
+        CharClass current = Classify(text.CharAt(offset));
+        size_t position = offset;
+        while (position > 0)
+        {
+            size_t chunk = position > kScanChunk ? position - kScanChunk : 0;
+            text.GetText(chunk, position - chunk, &scan);
+            for (size_t i = scan.size(); i > 0; i--)
+            {
+                CharClass previous = Classify(scan[i - 1]);
+                if (IsWordStart(previous, current))
+                {
+                    return chunk + i;
+                }
+                current = previous;
+            }
+            position = chunk;
+        }
+        return 0;
+    }
+
+    PieceTable text;
+    int32_t charWidth;
+    int32_t lineHeight;
+    WidgetRect viewport;
+    size_t firstVisibleLine;
+    size_t selectionStart;
+    size_t selectionEnd;
+    uint64_t version;
+    mutable std::wstring scan;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <cwchar>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Renderer.h"
+
+// A single line of text measured and centered in a box. Offsets are relative
+// to the top-left corner of the box.
+struct TextLayout
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    // Distance from each character to the next.
+    std::vector<int32_t> advances;
+};
+
+// Backend hook that measures text in a given font.
+class TextMeasurer
+{
+public:
+    virtual ~TextMeasurer() {}
+
+    // Fills advances with the width of each character and returns the line height.
+    virtual int32_t MeasureText(const std::wstring& text, const FontDesc& font, std::vector<int32_t>* advances) = 0;
+};
+
+struct TextCacheStats
+{
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// Remembers centered label layouts keyed by text, font and box size, so an
+// unchanged label is measured once rather than on every paint. A change to any
+// part of the key is a new entry; entries that go unused for kIdleFrames frames
+// are dropped. Lookups borrow the caller's strings; only a miss copies them.
+class TextLayoutCache
+{
+public:
+    static const uint64_t kIdleFrames = 60;
+
+    TextLayoutCache() : frame(0), total(), frameStats() {}
+
+    const TextLayout& GetLayout(const std::wstring& text, const FontDesc& font, int32_t width, int32_t height, TextMeasurer& measurer)
+    {
+        const wchar_t* face = font.face ? font.face : L"";
+        Key key = { text.c_str(), text.size(), face, wcslen(face), font.height, font.bold, width, height };
+        total.lookups++;
+        frameStats.lookups++;
+
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            total.hits++;
+            frameStats.hits++;
+            it->second.lastUsed = frame;
+            return it->second.layout;
+        }
+
+        total.misses++;
+        frameStats.misses++;
+        Entry entry;
+        entry.lastUsed = frame;
+        Layout(text, font, width, height, measurer, &entry.layout);
+
+        // The stored key points into the entry's own copy of both strings,
+        // which stays put when the entry moves into the map
+        entry.chars.reset(new wchar_t[key.textLength + key.faceLength]);
+        wmemcpy(entry.chars.get(), key.text, key.textLength);
+        wmemcpy(entry.chars.get() + key.textLength, key.face, key.faceLength);
+        key.text = entry.chars.get();
+        key.face = entry.chars.get() + key.textLength;
+        return entries.emplace(key, std::move(entry)).first->second.layout;
+    }
+
+    // Starts counting a new frame.
+    void BeginFrame()
+    {
+        frame++;
+        frameStats = TextCacheStats();
+    }
+
+    // Drops layouts that have not been drawn for a while.
+    void EndFrame()
+    {
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (frame - it->second.lastUsed > kIdleFrames)
+            {
+                it = entries.erase(it);
+                total.evictions++;
+                frameStats.evictions++;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    void Clear()
+    {
+        entries.clear();
+    }
+
+    size_t GetSize() const { return entries.size(); }
+    const TextCacheStats& GetStats() const { return total; }
+    const TextCacheStats& GetFrameStats() const { return frameStats; }
+
+private:
+    // Strings are borrowed: from the caller while looking up, from the
+    // entry's chars once stored
+    struct Key
+    {
+        const wchar_t* text;
+        size_t textLength;
+        const wchar_t* face;
+        size_t faceLength;
+        int32_t fontHeight;
+        bool bold;
+        int32_t width;
+        int32_t height;
+
+        bool operator==(const Key& other) const
+        {
+            return width == other.width && height == other.height && fontHeight == other.fontHeight && bold == other.bold &&
+                textLength == other.textLength && faceLength == other.faceLength &&
+                wmemcmp(text, other.text, textLength) == 0 && wmemcmp(face, other.face, faceLength) == 0;
+        }
+    };
+
+    struct KeyHash
+    {
+        // FNV-1a over the characters
+        static size_t HashChars(const wchar_t* chars, size_t length, size_t hash)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                hash = static_cast<size_t>((hash ^ static_cast<size_t>(chars[i])) * 1099511628211ull);
+            }
+            return hash;
+        }
+
+        size_t operator()(const Key& key) const
+        {
+            size_t hash = HashChars(key.text, key.textLength, static_cast<size_t>(14695981039346656037ull));
+            hash = HashChars(key.face, key.faceLength, hash * 31);
+            hash = hash * 31 + static_cast<size_t>(key.fontHeight) * 2 + (key.bold ? 1 : 0);
+            hash = hash * 31 + static_cast<size_t>(key.width);
+            hash = hash * 31 + static_cast<size_t>(key.height);
+            return hash;
+        }
+    };
+
+    struct Entry
+    {
+        TextLayout layout;
+        uint64_t lastUsed;
+        // Text followed by face, which the stored key points into
+        std::unique_ptr<wchar_t[]> chars;
+    };
+
+    void Layout(const std::wstring& text, const FontDesc& font, int32_t width, int32_t height, TextMeasurer& measurer, TextLayout* layout)
+    {
+        layout->advances.clear();
+        layout->height = measurer.MeasureText(text, font, &layout->advances);
+        layout->advances.resize(text.size(), 0);
+        layout->width = 0;
+        for (int32_t advance : layout->advances)
+        {
+            layout->width += advance;
+        }
+        layout->x = (width - layout->width) / 2;
+        layout->y = (height - layout->height) / 2;
+    }
+
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    uint64_t frame;
+    TextCacheStats total;
+    TextCacheStats frameStats;
+};
@@ -0,0 +1,658 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "QueryTrace.h"
+#include "SelectionSet.h"
+#include "TextDocument.h"
+#include "WidgetModel.h"
+#include "WidgetQuery.h"
+
+enum class ReplaySpeed
+{
+    // Keeps the recorded gaps between records, to reproduce timing-dependent
+    // behavior such as throttling
+    Original,
+    // Runs records back to back, to profile the work they cause
+    Maximum,
+};
+
+struct ReplayStats
+{
+    uint64_t records;
+    // Records the target could not apply, such as calls on widgets that no
+    // longer exist
+    uint64_t failed;
+    // Per event: how many were replayed and the nanoseconds spent in them
+    uint64_t counts[static_cast<size_t>(TraceEvent::Count)];
+    uint64_t nanoseconds[static_cast<size_t>(TraceEvent::Count)];
+    uint64_t totalNanoseconds;
+    // Whether reading stopped at a corrupt record rather than the end
+    bool corrupt;
+};
+
+// Drives target.Apply(record) with every record of a trace, timing each one.
+// Apply returns whether the record could be applied.
+template <typename Target>
+ReplayStats ReplayTrace(QueryTraceReader& reader, Target& target, ReplaySpeed speed)
+{
+    typedef std::chrono::steady_clock Clock;
+    ReplayStats stats = {};
+    TraceRecord record;
+    Clock::time_point start = Clock::now();
+    while (reader.Next(&record))
+    {
+        if (speed == ReplaySpeed::Original)
+        {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(record.time));
+        }
+        Clock::time_point before = Clock::now();
+        bool applied = target.Apply(record);
+        uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+        size_t event = static_cast<size_t>(record.event);
+        stats.records++;
+        stats.failed += applied ? 0 : 1;
+        stats.counts[event]++;
+        stats.nanoseconds[event] += elapsed;
+        stats.totalNanoseconds += elapsed;
+    }
+    stats.corrupt = reader.IsCorrupt();
+    return stats;
+}
+
+// Replays a trace against a widget model with no window or COM, so a session
+// recorded on Windows can be reproduced and profiled anywhere. Mutations are
+// applied as recorded, to the model, to the selection of the container they
+// name and to the text document. Events the model queues are taken after
+// each one, as a frame would. Entry points do the model work their provider does:
+// the same derived data, lookups, queries and string copies, without building
+// COM results. Widgets are matched to the recorded ones by the order they were
+// added, since slots need not come out the same. Virtualized items that were
+// not realized yet have no widget; the mutations that realized them replay
+// the work done. A trace may come from anywhere, so decoded values that would
+// be out of range for the model, such as unknown roles or scopes, fail their
+// record instead of reaching it.
+class ModelReplayTarget
+{
+public:
+    // The samples' metrics, until a trace sets the document's own
+    ModelReplayTarget() : document(8, 16), sink(0) {}
+
+    bool Apply(const TraceRecord& record)
+    {
+        if (IsMutation(record.event))
+        {
+            bool applied = ApplyMutation(record);
+            model.TakeEvents(&events);
+            sink += events.size();
+            return applied;
+        }
+        if (record.event == TraceEvent::TextCall)
+        {
+            return ApplyText(record);
+        }
+        if (record.event == TraceEvent::Realize || record.event == TraceEvent::SelectItem)
+        {
+            // The item need not be realized yet; the mutations that realize
+            // or select it follow the record
+            if (!model.Contains(WidgetOf(record.Int(0))) || record.Int(1) < 0
+                || (record.event == TraceEvent::SelectItem && (record.Int(2) < 0 || record.Int(2) > static_cast<int64_t>(TraceSelect::RemoveFromSelection))))
+            {
+                return false;
+            }
+            const SelectionSet* selection = GetSelection(record.Int(0));
+            sink += selection && selection->IsSelected(static_cast<size_t>(record.Int(1)));
+            return true;
+        }
+
+        WidgetId widget = Resolve(record.Int(0), record.Int(1));
+        if (widget == kNoWidget)
+        {
+            return false;
+        }
+        const DerivedData& derived = model.GetDerived();
+        switch (record.event)
+        {
+        case TraceEvent::GetPropertyValue:
+        case TraceEvent::AccName:
+        case TraceEvent::GetValue:
+        case TraceEvent::AccValue:
+        case TraceEvent::AccRole:
+        case TraceEvent::AccState:
+            ReadProperties(widget, record.event);
+            return true;
+        case TraceEvent::GetBoundingRectangle:
+        case TraceEvent::AccLocation:
+            sink += derived.screenRects[widget.index].left;
+            return true;
+        case TraceEvent::Navigate:
+        case TraceEvent::AccNavigate:
+        case TraceEvent::AccChild:
+        case TraceEvent::AccChildCount:
+        {
+            const Widget* item = model.Get(widget);
+            sink += item->children.size() + derived.childIndex[widget.index] + model.GetChildCount(item->parent);
+            return true;
+        }
+        case TraceEvent::ElementFromPoint:
+        case TraceEvent::AccHitTest:
+        {
+            if (!IsCoordinate(record.Int(2)) || !IsCoordinate(record.Int(3)))
+            {
+                return false;
+            }
+            // The child under the point, checked rect by rect as the
+            // navbar's ItemFromPoint does
+            int32_t x = static_cast<int32_t>(record.Int(2));
+            int32_t y = static_cast<int32_t>(record.Int(3));
+            for (WidgetId child : model.Get(widget)->children)
+            {
+                const WidgetRect& rect = derived.screenRects[child.index];
+                if (x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom)
+                {
+                    sink += child.index;
+                    break;
+                }
+            }
+            return true;
+        }
+        case TraceEvent::GetFocus:
+        case TraceEvent::AccFocus:
+            sink += derived.focusPosition[widget.index] + model.GetFocus().index;
+            return true;
+        case TraceEvent::FindItem:
+            return Find(widget, record);
+        case TraceEvent::GetSelection:
+        case TraceEvent::AccSelection:
+        {
+            // The provider walks the selected items, skipping unselected
+            // words; a container without a selection has none
+            if (const SelectionSet* selection = GetSelection(record.Int(0)))
+            {
+                for (size_t i = selection->NextSelected(0); i != SelectionSet::kNoItem; i = selection->NextSelected(i + 1))
+                {
+                    sink += i;
+                }
+            }
+            return true;
+        }
+        case TraceEvent::GetRuntimeId:
+        case TraceEvent::FocusElement:
+        case TraceEvent::AdviseEvent:
+        case TraceEvent::AccSelect:
+            // What these change is traced as mutations of its own
+            sink += widget.index;
+            return true;
+        case TraceEvent::Prefetch:
+        {
+            if (!IsScope(record.Int(2)) || record.Int(3) < 0 || record.Int(3) > kMaxPrefetchProperties)
+            {
+                return false;
+            }
+            // One pass over the scope, reading every requested property
+            std::vector<WidgetId> found;
+            WidgetQuery(WidgetCondition::Always()).FindAll(model, widget, static_cast<QueryScope>(record.Int(2)), &found);
+            for (WidgetId item : found)
+            {
+                for (int64_t i = 0; i < record.Int(3); i++)
+                {
+                    ReadProperties(item, TraceEvent::GetPropertyValue);
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    WidgetModel& GetModel() { return model; }
+    const TextDocument& GetDocument() const { return document; }
+
+    // Selection of the container at a recorded slot, or null if the trace
+    // gave it none.
+    const SelectionSet* GetSelection(int64_t slot) const
+    {
+        auto found = selections.find(slot);
+        return found == selections.end() ? nullptr : &found->second;
+    }
+
+    // Folds in what the replayed calls read, so none of it is optimized away.
+    uint64_t GetChecksum() const { return sink; }
+
+private:
+    // More properties than UIA defines, so no real request has more
+    static const int64_t kMaxPrefetchProperties = 1024;
+    // Slots are handed out lowest free first, so a new slot far past every
+    // one seen so far is not from a real session. The gap allows for slots
+    // freed before recording started.
+    static const int64_t kMaxSlotGap = 1 << 20;
+
+    static bool IsRole(int64_t value) { return value >= 0 && value <= static_cast<int64_t>(WidgetRole::ProgressBar); }
+    static bool IsScope(int64_t value) { return value >= 0 && value <= static_cast<int64_t>(QueryScope::Subtree); }
+    // Far past any screen, but small enough that scaling and offsetting
+    // rects cannot overflow
+    static const int64_t kMaxCoordinate = 1 << 24;
+    static const int64_t kMaxDpi = ScreenTransform::kDefaultDpi * 16;
+    // A selection over this many items takes 2 MB, far more than any list
+    // the samples show
+    static const int64_t kMaxSelectionItems = 1 << 24;
+    // Text pattern counts are ints
+    static const int64_t kMaxUnitCount = INT32_MAX;
+
+    static bool IsCoordinate(int64_t value) { return value >= -kMaxCoordinate && value <= kMaxCoordinate; }
+    static bool IsRect(const TraceRecord& record, size_t first)
+    {
+        return IsCoordinate(record.Int(first)) && IsCoordinate(record.Int(first + 1)) && IsCoordinate(record.Int(first + 2)) && IsCoordinate(record.Int(first + 3));
+    }
+
+    WidgetId WidgetOf(int64_t slot) const
+    {
+        return slot >= 0 && static_cast<uint64_t>(slot) < widgetOfSlot.size() ? widgetOfSlot[static_cast<size_t>(slot)] : kNoWidget;
+    }
+
+    // The element a call was made on: the container, or its child at index.
+    WidgetId Resolve(int64_t slot, int64_t index)
+    {
+        WidgetId container = WidgetOf(slot);
+        if (!model.Contains(container))
+        {
+            return kNoWidget;
+        }
+        if (index == kTraceSelf)
+        {
+            return container;
+        }
+        return index >= 0 ? model.GetChild(container, static_cast<size_t>(index)) : kNoWidget;
+    }
+
+    bool ApplyMutation(const TraceRecord& record)
+    {
+        switch (record.event)
+        {
+        case TraceEvent::Subscribe:
+            if (record.Int(0) < 0 || record.Int(0) >= static_cast<int64_t>(WidgetEventKind::Count) || record.Int(1) < 0 || record.Int(1) > UINT32_MAX)
+            {
+                return false;
+            }
+            model.GetEventSubscriptions().SetCount(static_cast<WidgetEventKind>(record.Int(0)), static_cast<uint32_t>(record.Int(1)));
+            return true;
+        case TraceEvent::ResizeSelection:
+        case TraceEvent::SetSelected:
+        case TraceEvent::SetSelectionAnchor:
+            return ApplySelection(record);
+        case TraceEvent::SetDocumentText:
+        case TraceEvent::EditText:
+        case TraceEvent::SetTextSelection:
+        case TraceEvent::SetTextViewport:
+        case TraceEvent::ScrollText:
+            return ApplyDocument(record);
+        default:
+            break;
+        }
+
+        if (record.event == TraceEvent::AddWidget)
+        {
+            int64_t slot = record.Int(0);
+            if (slot < 0 || slot > static_cast<int64_t>(widgetOfSlot.size()) + kMaxSlotGap || record.intCount < 8 || !IsRole(record.ints[2]) || !IsRect(record, 4))
+            {
+                return false;
+            }
+            if (static_cast<uint64_t>(slot) >= widgetOfSlot.size())
+            {
+                widgetOfSlot.resize(static_cast<size_t>(slot) + 1, kNoWidget);
+            }
+            WidgetRect rect = { static_cast<int32_t>(record.ints[4]), static_cast<int32_t>(record.ints[5]), static_cast<int32_t>(record.ints[6]), static_cast<int32_t>(record.ints[7]) };
+            widgetOfSlot[static_cast<size_t>(slot)] = model.AddWidget(WidgetOf(record.ints[1]), static_cast<WidgetRole>(record.ints[2]), rect,
+                Utf8ToWide(record.text, record.textLength), static_cast<uint32_t>(record.ints[3]));
+            return true;
+        }
+        if (record.event == TraceEvent::SetScreenTransform)
+        {
+            if (!IsCoordinate(record.Int(0)) || !IsCoordinate(record.Int(1)) || record.Int(2) <= 0 || record.Int(2) > kMaxDpi)
+            {
+                return false;
+            }
+            model.SetScreenTransform({ static_cast<int32_t>(record.Int(0)), static_cast<int32_t>(record.Int(1)), static_cast<uint32_t>(record.Int(2)) });
+            return true;
+        }
+        if (record.event == TraceEvent::SetFocus)
+        {
+            model.SetFocus(WidgetOf(record.Int(0)));
+            return true;
+        }
+
+        WidgetId widget = WidgetOf(record.Int(0));
+        if (!model.Contains(widget))
+        {
+            return false;
+        }
+        switch (record.event)
+        {
+        case TraceEvent::RemoveWidget:
+            model.RemoveWidget(widget);
+            return true;
+        case TraceEvent::MoveWidget:
+            return model.MoveWidget(widget, WidgetOf(record.Int(1)), static_cast<size_t>(record.Int(2)));
+        case TraceEvent::SetName:
+            model.SetName(widget, Utf8ToWide(record.text, record.textLength));
+            return true;
+        case TraceEvent::SetRect:
+            if (!IsRect(record, 1))
+            {
+                return false;
+            }
+            model.SetRect(widget, { static_cast<int32_t>(record.Int(1)), static_cast<int32_t>(record.Int(2)), static_cast<int32_t>(record.Int(3)), static_cast<int32_t>(record.Int(4)) });
+            return true;
+        case TraceEvent::SetEnabled:
+            model.SetEnabled(widget, record.Int(1) != 0);
+            return true;
+        case TraceEvent::SetValue:
+            model.SetValue(widget, record.Number(0));
+            return true;
+        case TraceEvent::SetRange:
+            model.SetRange(widget, record.Number(0), record.Number(1));
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Selections belong to a container that exists, so a corrupt slot cannot
+    // make one; after each change the front-end's events are worked out.
+    bool ApplySelection(const TraceRecord& record)
+    {
+        int64_t slot = record.Int(0);
+        if (record.event == TraceEvent::ResizeSelection)
+        {
+            if (!model.Contains(WidgetOf(slot)) || record.Int(1) < 0 || record.Int(1) > kMaxSelectionItems)
+            {
+                return false;
+            }
+            selections[slot].Resize(static_cast<size_t>(record.Int(1)));
+            return true;
+        }
+        auto found = selections.find(slot);
+        if (found == selections.end())
+        {
+            return false;
+        }
+        SelectionSet& selection = found->second;
+        if (record.event == TraceEvent::SetSelected)
+        {
+            if (record.Int(1) < 0 || record.Int(2) < record.Int(1))
+            {
+                return false;
+            }
+            size_t first = static_cast<size_t>(record.Int(1));
+            size_t last = static_cast<size_t>(record.Int(2));
+            if (record.Int(3))
+            {
+                selection.SelectRange(first, last);
+            }
+            else
+            {
+                selection.DeselectRange(first, last);
+            }
+        }
+        else
+        {
+            if (record.Int(1) < -1)
+            {
+                return false;
+            }
+            selection.SetAnchor(record.Int(1) == -1 ? SelectionSet::kNoItem : static_cast<size_t>(record.Int(1)));
+        }
+        selection.DispatchChanges([this](SelectionEvent event, size_t index)
+        {
+            sink += static_cast<uint64_t>(event) + index;
+        });
+        return true;
+    }
+
+    // The document clamps offsets itself; metrics are checked, since the
+    // layout divides by the line height.
+    bool ApplyDocument(const TraceRecord& record)
+    {
+        switch (record.event)
+        {
+        case TraceEvent::SetDocumentText:
+        {
+            if (record.Int(0) <= 0 || record.Int(0) > kMaxCoordinate || record.Int(1) <= 0 || record.Int(1) > kMaxCoordinate)
+            {
+                return false;
+            }
+            WidgetRect viewport = document.GetViewport();
+            document = TextDocument(static_cast<int32_t>(record.Int(0)), static_cast<int32_t>(record.Int(1)));
+            document.SetViewport(viewport);
+            document.SetText(Utf8ToWide(record.text, record.textLength));
+            return true;
+        }
+        case TraceEvent::EditText:
+            if (record.Int(0) < 0 || record.Int(1) < 0)
+            {
+                return false;
+            }
+            if (record.text)
+            {
+                document.Insert(static_cast<size_t>(record.Int(0)), Utf8ToWide(record.text, record.textLength));
+            }
+            else
+            {
+                document.Erase(static_cast<size_t>(record.Int(0)), static_cast<size_t>(record.Int(1)));
+            }
+            return true;
+        case TraceEvent::SetTextSelection:
+            if (record.Int(0) < 0 || record.Int(1) < 0)
+            {
+                return false;
+            }
+            document.SetSelection(static_cast<size_t>(record.Int(0)), static_cast<size_t>(record.Int(1)));
+            return true;
+        case TraceEvent::SetTextViewport:
+            if (!IsRect(record, 0))
+            {
+                return false;
+            }
+            document.SetViewport({ static_cast<int32_t>(record.Int(0)), static_cast<int32_t>(record.Int(1)), static_cast<int32_t>(record.Int(2)), static_cast<int32_t>(record.Int(3)) });
+            return true;
+        case TraceEvent::ScrollText:
+            if (record.Int(0) < 0)
+            {
+                return false;
+            }
+            document.ScrollToLine(static_cast<size_t>(record.Int(0)));
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Does the document work of a text pattern call: the lookups, scans and
+    // copies the provider makes, on the range it was made on, clamped as the
+    // provider clamps it. Selecting and scrolling are traced as mutations.
+    bool ApplyText(const TraceRecord& record)
+    {
+        if (record.Int(0) < 0 || record.Int(0) >= static_cast<int64_t>(TraceText::Count) || record.Int(1) < 0 || record.Int(2) < 0)
+        {
+            return false;
+        }
+        size_t length = document.GetLength();
+        size_t start = (std::min)(static_cast<size_t>(record.Int(1)), length);
+        size_t end = (std::min)((std::max)(start, static_cast<size_t>(record.Int(2))), length);
+        switch (static_cast<TraceText>(record.Int(0)))
+        {
+        case TraceText::GetSelection:
+            sink += document.GetSelectionEnd() - document.GetSelectionStart();
+            return true;
+        case TraceText::GetVisibleRanges:
+        {
+            const PieceTable& text = document.GetText();
+            size_t first = document.GetFirstVisibleLine();
+            size_t last = (std::min)(first + document.GetVisibleLineCount(), text.GetLineCount()) - 1;
+            sink += text.GetLineStart(first) + document.LineEnd(last);
+            return true;
+        }
+        case TraceText::RangeFromPoint:
+            if (!IsCoordinate(record.Int(3)) || !IsCoordinate(record.Int(4)))
+            {
+                return false;
+            }
+            sink += document.OffsetFromPoint(static_cast<int32_t>(record.Int(3)), static_cast<int32_t>(record.Int(4)));
+            return true;
+        case TraceText::ExpandToEnclosingUnit:
+        {
+            if (!IsUnit(record.Int(3)))
+            {
+                return false;
+            }
+            TextUnitKind kind = static_cast<TextUnitKind>(record.Int(3));
+            size_t first = document.UnitStart(start, kind);
+            sink += kind == TextUnitKind::Document ? length : document.NextBoundary(first, kind);
+            return true;
+        }
+        case TraceText::FindText:
+        {
+            std::wstring needle = Utf8ToWide(record.text, record.textLength);
+            if (needle.empty())
+            {
+                return true;
+            }
+            std::wstring haystack = document.GetText().GetText(start, end - start);
+            if (record.Int(4))
+            {
+                std::transform(haystack.begin(), haystack.end(), haystack.begin(), ::towlower);
+                std::transform(needle.begin(), needle.end(), needle.begin(), ::towlower);
+            }
+            sink += record.Int(3) ? haystack.rfind(needle) : haystack.find(needle);
+            return true;
+        }
+        case TraceText::GetBoundingRectangles:
+        {
+            std::vector<WidgetRect> rects;
+            document.GetRangeRects(start, end, &rects);
+            sink += rects.size();
+            return true;
+        }
+        case TraceText::GetText:
+        {
+            size_t count = end - start;
+            if (record.Int(3) >= 0)
+            {
+                count = (std::min)(count, static_cast<size_t>(record.Int(3)));
+            }
+            sink += document.GetText().GetText(start, count).size();
+            return true;
+        }
+        case TraceText::Move:
+        case TraceText::MoveEndpointByUnit:
+        {
+            bool move = static_cast<TraceText>(record.Int(0)) == TraceText::Move;
+            int64_t unit = move ? record.Int(3) : record.Int(4);
+            int64_t count = move ? record.Int(4) : record.Int(5);
+            if (!IsUnit(unit) || count < -kMaxUnitCount || count > kMaxUnitCount)
+            {
+                return false;
+            }
+            TextUnitKind kind = static_cast<TextUnitKind>(unit);
+            size_t position = !move ? (record.Int(3) == 0 ? start : end) : start == end ? start : document.UnitStart(start, kind);
+            sink += StepBoundaries(&position, kind, count) + position;
+            return true;
+        }
+        default:
+            // Calls answered from the range or constants alone
+            sink += start + end;
+            return true;
+        }
+    }
+
+    static bool IsUnit(int64_t value) { return value >= 0 && value <= static_cast<int64_t>(TextUnitKind::Document); }
+
+    // Steps count unit boundaries forward or back, as a text range moves.
+    int64_t StepBoundaries(size_t* position, TextUnitKind kind, int64_t count) const
+    {
+        int64_t moved = 0;
+        while (moved < count)
+        {
+            size_t next = document.NextBoundary(*position, kind);
+            if (next == *position)
+            {
+                break;
+            }
+            *position = next;
+            moved++;
+        }
+        while (moved > count && *position > 0)
+        {
+            *position = document.PreviousBoundary(*position, kind);
+            moved--;
+        }
+        return moved;
+    }
+
+    // A property read copies the name or value text out, as a BSTR would,
+    // and reads the state columns the answer is made from. Roles and states
+    // go back as numbers, with no text to copy.
+    void ReadProperties(WidgetId id, TraceEvent event)
+    {
+        const DerivedData& derived = model.GetDerived();
+        const Widget& widget = *model.Get(id);
+        if (event == TraceEvent::AccValue || event == TraceEvent::GetValue)
+        {
+            sink += GetValueText(widget).size();
+            return;
+        }
+        if (event == TraceEvent::AccRole || event == TraceEvent::AccState)
+        {
+            sink += static_cast<uint64_t>(widget.role) + widget.enabled + derived.focusPosition[id.index];
+            return;
+        }
+        std::wstring name = widget.name;
+        sink += name.size() + static_cast<uint64_t>(widget.role) + derived.focusPosition[id.index] + derived.screenRects[id.index].right;
+    }
+
+    // Runs the search a container's FindItemByProperty does over its children.
+    bool Find(WidgetId container, const TraceRecord& record)
+    {
+        int64_t value = record.Int(4);
+        if (record.Int(2) < -1 || record.Int(2) >= INT32_MAX || record.Int(3) < 0 || record.Int(3) > static_cast<int64_t>(TraceFind::Role)
+            || (record.Int(3) == static_cast<int64_t>(TraceFind::Role) && value > static_cast<int64_t>(WidgetRole::ProgressBar)))
+        {
+            return false;
+        }
+        int64_t start = record.Int(2) + 1;
+        TraceFind kind = static_cast<TraceFind>(record.Int(3));
+        WidgetCondition condition = kind == TraceFind::Name ? WidgetCondition::NameIs(Utf8ToWide(record.text, record.textLength))
+            : kind == TraceFind::Enabled ? WidgetCondition::IsEnabled(value != 0)
+            : kind == TraceFind::Role && value >= 0 ? WidgetCondition::RoleIs(static_cast<WidgetRole>(value))
+            : kind == TraceFind::Role ? WidgetCondition::Never()
+            : WidgetCondition::Always();
+        const DerivedData& derived = model.GetDerived();
+        WidgetQuery query(condition);
+        query.Run(model, container, QueryScope::Children, [&](WidgetId match)
+        {
+            if (derived.childIndex[match.index] < start)
+            {
+                return true;
+            }
+            sink += match.index;
+            return false;
+        });
+        return true;
+    }
+
+    WidgetModel model;
+    // Replay widget for each recorded slot
+    std::vector<WidgetId> widgetOfSlot;
+    // Selection of each container that has one, by its recorded slot
+    std::unordered_map<int64_t, SelectionSet> selections;
+    TextDocument document;
+    std::vector<WidgetEvent> events;
+    uint64_t sink;
+};
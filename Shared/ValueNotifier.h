@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "WidgetModel.h"
+
+struct NotifierStats
+{
+    // Value changes reported to the notifier.
+    uint64_t changes;
+    // Notifications handed to the front-end.
+    uint64_t delivered;
+    // Changes folded into a notification that was already pending.
+    uint64_t coalesced;
+};
+
+// Throttles value change notifications per widget. Changes only mark the
+// widget pending; Flush delivers a pending widget once at least the minimum
+// interval has passed since its last notification. The first change after a
+// quiet period goes out on the next Flush, later ones wait for the interval,
+// and because delivery reads the model at that point the last value set is
+// always the one announced. Times are in milliseconds from any steady clock.
+class ValueNotifier
+{
+public:
+    static const uint64_t kNothingPending = UINT64_MAX;
+
+    explicit ValueNotifier(uint32_t maxPerSecond = 10) : interval(0), stats()
+    {
+        SetMaxRate(maxPerSecond);
+    }
+
+    // Caps notifications per widget; 0 removes the cap.
+    void SetMaxRate(uint32_t maxPerSecond)
+    {
+        interval = maxPerSecond ? 1000 / maxPerSecond : 0;
+    }
+
+    void Changed(WidgetId id)
+    {
+        stats.changes++;
+        if (id.index >= entries.size())
+        {
+            entries.resize(id.index + 1);
+        }
+        Entry& entry = entries[id.index];
+        if (entry.widget != id)
+        {
+            // First change for this widget, or its slot was reused
+            entry = Entry();
+            entry.widget = id;
+        }
+        if (entry.pending)
+        {
+            stats.coalesced++;
+            return;
+        }
+        entry.pending = true;
+        pending.push_back(id);
+    }
+
+    // Drops a widget's state, e.g. when it is removed from the model.
+    void Forget(WidgetId id)
+    {
+        if (id.index < entries.size() && entries[id.index].widget == id)
+        {
+            entries[id.index] = Entry();
+        }
+    }
+
+    // Calls deliver(id) for every pending widget that is due and returns how
+    // many were delivered.
+    template <typename Deliver>
+    size_t Flush(uint64_t now, Deliver deliver)
+    {
+        size_t delivered = 0;
+        size_t kept = 0;
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            WidgetId id = pending[i];
+            Entry& entry = entries[id.index];
+            if (entry.widget != id || !entry.pending)
+            {
+                continue;
+            }
+            if (entry.sent && now - entry.lastSent < interval)
+            {
+                pending[kept++] = id;
+                continue;
+            }
+            entry.pending = false;
+            entry.sent = true;
+            entry.lastSent = now;
+            deliver(id);
+            delivered++;
+        }
+        pending.resize(kept);
+        stats.delivered += delivered;
+        return delivered;
+    }
+
+    // Milliseconds until the next Flush has something to deliver, or
+    // kNothingPending.
+    uint64_t GetNextDue(uint64_t now) const
+    {
+        uint64_t next = kNothingPending;
+        for (WidgetId id : pending)
+        {
+            const Entry& entry = entries[id.index];
+            if (entry.widget != id || !entry.pending)
+            {
+                continue;
+            }
+            uint64_t due = entry.sent ? entry.lastSent + interval : now;
+            next = (std::min)(next, due > now ? due - now : 0);
+        }
+        return next;
+    }
+
+    bool HasPending() const { return !pending.empty(); }
+    const NotifierStats& GetStats() const { return stats; }
+
+private:
+    struct Entry
+    {
+        WidgetId widget = kNoWidget;
+        bool pending = false;
+        bool sent = false;
+        uint64_t lastSent = 0;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<WidgetId> pending;
+    uint64_t interval;
+    NotifierStats stats;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "BitOps.h"
+#include "WidgetModel.h"
+
+// Values written by worker threads and picked up by the UI thread. A write
+// stores the value and sets the slot's bit in a dirty mask, with no lock and
+// no window message; the UI thread calls Sample once per frame and sees each
+// changed slot once with its latest value, however many writes it took. The
+// UI-side cost is one pass over the dirty mask plus the slots that changed,
+// independent of the write rate.
+class ValueSlots
+{
+public:
+    explicit ValueSlots(size_t capacity)
+        : capacity(capacity), slots(new Slot[capacity]), dirty(new std::atomic<uint64_t>[(capacity + 63) / 64])
+    {
+        for (size_t i = 0; i < capacity; i++)
+        {
+            slots[i].bits.store(0, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < GetMaskWords(); i++)
+        {
+            dirty[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t GetCapacity() const { return capacity; }
+
+    // Safe from any thread. The dirty bit is only set if it is clear, so a
+    // slot written faster than it is sampled does not keep contending on the
+    // shared mask word.
+    void Write(size_t slot, double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        slots[slot].bits.store(bits, std::memory_order_seq_cst);
+
+        // Ordered after the store: either the sampler has not yet taken the
+        // bit and will read this value, or the bit is clear and is set again
+        std::atomic<uint64_t>& word = dirty[slot / 64];
+        uint64_t mask = uint64_t(1) << (slot % 64);
+        if (!(word.load(std::memory_order_seq_cst) & mask))
+        {
+            word.fetch_or(mask, std::memory_order_seq_cst);
+        }
+    }
+
+    // UI thread only. Calls apply(slot, value) for every slot written since
+    // the previous call and returns how many there were.
+    template <typename Apply>
+    size_t Sample(Apply apply)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < GetMaskWords(); i++)
+        {
+            if (!dirty[i].load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+            uint64_t bits = dirty[i].exchange(0, std::memory_order_seq_cst);
+            while (bits)
+            {
+                size_t slot = i * 64 + LowestBit(bits);
+                bits &= bits - 1;
+                uint64_t raw = slots[slot].bits.load(std::memory_order_seq_cst);
+                double value;
+                std::memcpy(&value, &raw, sizeof(value));
+                apply(slot, value);
+                count++;
+            }
+        }
+        return count;
+    }
+
+private:
+    // One cache line per slot, so writers of neighbouring slots do not share lines.
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> bits;
+    };
+
+    size_t GetMaskWords() const { return (capacity + 63) / 64; }
+
+    size_t capacity;
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<std::atomic<uint64_t>[]> dirty;
+};
+
+// Applies the slots written since the last frame to the widgets bound to
+// them: the model takes the new value, queuing a value event if anyone
+// listens, and the widget's rectangle is added to the area to repaint. Slots
+// bound to kNoWidget are dropped.
+inline size_t SampleValueSlots(ValueSlots& slots, const std::vector<WidgetId>& widgets, WidgetModel& model, std::vector<WidgetRect>* invalid)
+{
+    return slots.Sample([&](size_t slot, double value)
+    {
+        WidgetId widget = slot < widgets.size() ? widgets[slot] : kNoWidget;
+        const Widget* data = model.Get(widget);
+        if (!data)
+        {
+            return;
+        }
+        model.SetValue(widget, value);
+        invalid->push_back(data->rect);
+    });
+}
@@ -0,0 +1,1016 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "EventSubscriptions.h"
+#include "MemoryUsage.h"
+#include "NameIndex.h"
+#include "QueryTrace.h"
+#include "ScreenTransform.h"
+#include "SlotMap.h"
+#include "WidgetRect.h"
+
+// Shared widget model. Every accessibility front-end (UIA, IAccessible,
+// AccessKit) and the painters read this one model, and data derived from it is
+// computed once no matter how many front-ends ask for it.
+
+typedef SlotHandle WidgetId;
+const WidgetId kNoWidget = INVALID_SLOT_HANDLE;
+
+enum class WidgetRole : uint8_t
+{
+    Window,
+    Toolbar,
+    Button,
+    ProgressBar,
+};
+
+struct Widget
+{
+    WidgetId parent;
+    WidgetRole role;
+    bool enabled;
+    bool focusable;
+    // 0x00BBGGRR, as COLORREF
+    uint32_t color;
+    WidgetRect rect;
+    std::wstring name;
+    std::vector<WidgetId> children;
+    // Current value of a range widget, kept within [minimum, maximum].
+    double value;
+    double minimum;
+    double maximum;
+};
+
+// Value as read out by ATs: a progress bar reports its percentage.
+inline std::wstring GetValueText(const Widget& widget)
+{
+    if (widget.role != WidgetRole::ProgressBar)
+    {
+        return std::wstring();
+    }
+    double span = widget.maximum - widget.minimum;
+    double percent = span > 0 ? (widget.value - widget.minimum) * 100 / span : 0;
+    return std::to_wstring(static_cast<int>(percent + 0.5)) + L"%";
+}
+
+// Converts a wide string (UTF-16 on Windows, UTF-32 elsewhere) to UTF-8.
+inline std::string WideToUtf8(const std::wstring& text)
+{
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        uint32_t c = static_cast<uint32_t>(text[i]);
+        if (c >= 0xD800 && c <= 0xDBFF && i + 1 < text.size())
+        {
+            uint32_t low = static_cast<uint32_t>(text[i + 1]);
+            if (low >= 0xDC00 && low <= 0xDFFF)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+        }
+        if (c < 0x80)
+        {
+            result += static_cast<char>(c);
+        }
+        else if (c < 0x800)
+        {
+            result += static_cast<char>(0xC0 | (c >> 6));
+            result += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            result += static_cast<char>(0xE0 | (c >> 12));
+            result += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            result += static_cast<char>(0xF0 | (c >> 18));
+            result += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            result += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return result;
+}
+
+// Converts UTF-8 back to a wide string, as surrogate pairs where wchar_t is
+// 16 bits. Input is assumed to be well formed, as WideToUtf8 produces.
+inline std::wstring Utf8ToWide(const char* text, size_t length)
+{
+    std::wstring result;
+    result.reserve(length);
+    for (size_t i = 0; i < length;)
+    {
+        uint32_t c = static_cast<uint8_t>(text[i]);
+        size_t extra = c < 0x80 ? 0 : c < 0xE0 ? 1 : c < 0xF0 ? 2 : 3;
+        c &= extra == 0 ? 0x7F : 0x3F >> extra;
+        for (size_t k = 1; k <= extra && i + k < length; k++)
+        {
+            c = (c << 6) | (static_cast<uint8_t>(text[i + k]) & 0x3F);
+        }
+        i += extra + 1;
+        if (c >= 0x10000 && sizeof(wchar_t) == 2)
+        {
+            result += static_cast<wchar_t>(0xD800 + ((c - 0x10000) >> 10));
+            result += static_cast<wchar_t>(0xDC00 + ((c - 0x10000) & 0x3FF));
+        }
+        else
+        {
+            result += static_cast<wchar_t>(c);
+        }
+    }
+    return result;
+}
+
+// Values computed from the model on demand. Per-widget tables are indexed by
+// WidgetId::index; the hierarchy tables are indexed by pre-order position.
+struct DerivedData
+{
+    static const uint32_t kNotFocusable = UINT32_MAX;
+
+    std::vector<std::string> utf8Names;
+    std::vector<WidgetRect> screenRects;
+    std::vector<uint32_t> childIndex;
+    std::vector<uint32_t> focusPosition;
+    std::vector<WidgetId> focusOrder;
+
+    // Every widget in document order, roots one after another. The subtree of
+    // the widget at position p is [p, p + subtreeSize[p]).
+    std::vector<WidgetId> preorder;
+    std::vector<uint32_t> subtreeSize;
+    std::vector<uint32_t> depth;
+    std::vector<uint32_t> preorderPosition;
+
+    // Widget fields as columns in pre-order, so a subtree's values are one
+    // contiguous run that queries can scan without touching the widgets.
+    static const uint8_t kStateEnabled = 1;
+    static const uint8_t kStateFocusable = 2;
+    std::vector<WidgetRole> roles;
+    std::vector<uint8_t> states;
+    std::vector<WidgetRect> bounds;
+
+    size_t GetMemoryBytes() const
+    {
+        size_t bytes = HeapBytes(utf8Names) + HeapBytes(screenRects) + HeapBytes(childIndex) + HeapBytes(focusPosition) + HeapBytes(focusOrder)
+            + HeapBytes(preorder) + HeapBytes(subtreeSize) + HeapBytes(depth) + HeapBytes(preorderPosition) + HeapBytes(roles) + HeapBytes(states) + HeapBytes(bounds);
+        for (const std::string& name : utf8Names)
+        {
+            bytes += HeapBytes(name);
+        }
+        return bytes;
+    }
+};
+
+// Cuts the pre-order positions into consecutive runs of about target widgets
+// each, for spreading per-widget work over threads. Runs are made of whole
+// subtrees; a subtree bigger than target is split below its root, which goes
+// in the current run while its children's subtrees are placed like any others.
+inline void SplitIntoSubtrees(const DerivedData& data, size_t target, std::vector<std::pair<uint32_t, uint32_t>>* runs)
+{
+    runs->clear();
+    uint32_t count = static_cast<uint32_t>(data.preorder.size());
+    uint32_t p = 0;
+    while (p < count)
+    {
+        uint32_t begin = p;
+        while (p < count && p - begin < target)
+        {
+            uint32_t size = data.subtreeSize[p];
+            if (size > target)
+            {
+                p++;
+            }
+            else if (p > begin && p - begin + size > target)
+            {
+                break;
+            }
+            else
+            {
+                p += size;
+            }
+        }
+        runs->push_back({ begin, p });
+    }
+}
+
+// How the children of a StructureChanged event's widget changed. A move is
+// a removal from the old parent and an addition to the new one.
+enum class StructureChange : uint8_t
+{
+    ChildAdded,
+    ChildRemoved,
+};
+
+// A change for the platform layer to raise. For a structure change widget is
+// the parent, or kNoWidget for the roots, and child the widget added or
+// removed. Property changes carry the value before the change, in the field
+// for their kind; bounds are in screen coordinates.
+struct WidgetEvent
+{
+    WidgetEventKind kind;
+    WidgetId widget;
+    StructureChange change;
+    WidgetId child;
+    std::wstring oldName;
+    WidgetRect oldBounds;
+    bool oldEnabled;
+    double oldValue;
+};
+
+// Events queued for listeners, and changes that had no listener to build an
+// event for.
+struct EventStats
+{
+    uint64_t queued;
+    uint64_t skipped;
+};
+
+// How much derived work has been done, to compare update costs.
+struct DerivedStats
+{
+    uint64_t refreshes;
+    uint64_t namesConverted;
+    uint64_t rectsTransformed;
+    uint64_t structureRebuilds;
+    uint64_t structurePatches;
+};
+
+class WidgetModel
+{
+public:
+    WidgetModel() : focus(kNoWidget), transform(kIdentityTransform), version(0), eventStats(), layoutDirty(false), structureDirty(false), focusDirty(false), stats() {}
+
+    WidgetId AddWidget(WidgetId parent, WidgetRole role, WidgetRect rect, const std::wstring& name, uint32_t color)
+    {
+        // A parent that is gone files the widget as a root, and it must not
+        // keep the stale handle that ancestor walks would follow
+        if (!widgets.contains(parent))
+        {
+            parent = kNoWidget;
+        }
+        Widget widget;
+        widget.parent = parent;
+        widget.role = role;
+        widget.enabled = true;
+        widget.focusable = role == WidgetRole::Button;
+        widget.color = color;
+        widget.rect = rect;
+        widget.name = name;
+        widget.value = 0;
+        widget.minimum = 0;
+        widget.maximum = 100;
+        WidgetId id = widgets.insert(std::move(widget));
+
+        if (Widget* parentWidget = widgets.get(parent))
+        {
+            parentWidget->children.push_back(id);
+        }
+        else
+        {
+            roots.push_back(id);
+        }
+        if (Wants(WidgetEventKind::StructureChanged))
+        {
+            QueueStructureEvent(parent, StructureChange::ChildAdded, id);
+        }
+        searchIndex.Add(id, static_cast<uint8_t>(role), name);
+        dirtyNames.push_back(id.index);
+        dirtyRects.push_back(id.index);
+        structureDirty = true;
+        version++;
+        if (QueryTraceWriter* trace = ActiveTrace())
+        {
+            TraceAdd(trace, id);
+        }
+        return id;
+    }
+
+    // Removes a widget and everything below it.
+    void RemoveWidget(WidgetId id)
+    {
+        const Widget* widget = widgets.get(id);
+        if (!widget)
+        {
+            return;
+        }
+        std::vector<WidgetId>& siblings = widgets.contains(widget->parent) ? widgets.get(widget->parent)->children : roots;
+        for (size_t i = 0; i < siblings.size(); i++)
+        {
+            if (siblings[i] == id)
+            {
+                siblings.erase(siblings.begin() + i);
+                break;
+            }
+        }
+        if (Wants(WidgetEventKind::StructureChanged))
+        {
+            QueueStructureEvent(widget->parent, StructureChange::ChildRemoved, id);
+        }
+        TraceCall(TraceEvent::RemoveWidget, { id.index });
+        RemoveSubtree(id);
+        structureDirty = true;
+        version++;
+    }
+
+    // Moves a widget and its subtree to position index among the children of
+    // newParent, or among the roots for kNoWidget. Fails if newParent is inside
+    // the subtree. When the hierarchy tables are current they are patched in
+    // place, touching only the span between the old and new positions.
+    bool MoveWidget(WidgetId id, WidgetId newParent, size_t index)
+    {
+        Widget* widget = widgets.get(id);
+        if (!widget || (newParent != kNoWidget && !widgets.contains(newParent)))
+        {
+            return false;
+        }
+        for (WidgetId ancestor = newParent; widgets.contains(ancestor); ancestor = widgets.get(ancestor)->parent)
+        {
+            if (ancestor == id)
+            {
+                return false;
+            }
+        }
+
+        WidgetId oldParent = widget->parent;
+        std::vector<WidgetId>& oldSiblings = SiblingsOf(oldParent);
+        size_t oldIndex = 0;
+        while (oldSiblings[oldIndex] != id)
+        {
+            oldIndex++;
+        }
+        oldSiblings.erase(oldSiblings.begin() + oldIndex);
+
+        std::vector<WidgetId>& newSiblings = SiblingsOf(newParent);
+        if (index > newSiblings.size())
+        {
+            index = newSiblings.size();
+        }
+        bool patch = !structureDirty && !derived.preorder.empty();
+        uint32_t target = 0;
+        if (patch)
+        {
+            // Insertion point in the current order
+            if (index < newSiblings.size())
+            {
+                target = derived.preorderPosition[newSiblings[index].index];
+            }
+            else if (newParent != kNoWidget)
+            {
+                uint32_t parentPosition = derived.preorderPosition[newParent.index];
+                target = parentPosition + derived.subtreeSize[parentPosition];
+            }
+            else
+            {
+                target = static_cast<uint32_t>(derived.preorder.size());
+            }
+        }
+        newSiblings.insert(newSiblings.begin() + index, id);
+        widget->parent = newParent;
+        if (Wants(WidgetEventKind::StructureChanged))
+        {
+            QueueStructureEvent(oldParent, StructureChange::ChildRemoved, id);
+            QueueStructureEvent(newParent, StructureChange::ChildAdded, id);
+        }
+        TraceCall(TraceEvent::MoveWidget, { id.index, TraceSlot(newParent), static_cast<int64_t>(index) });
+
+        if (patch)
+        {
+            PatchMove(id, oldParent, target);
+            UpdateChildIndices(oldSiblings, oldIndex);
+            UpdateChildIndices(newSiblings, index);
+        }
+        else
+        {
+            structureDirty = true;
+        }
+        version++;
+        return true;
+    }
+
+    void SetName(WidgetId id, const std::wstring& name)
+    {
+        if (Widget* widget = widgets.get(id))
+        {
+            if (Wants(WidgetEventKind::NameChanged) && widget->name != name)
+            {
+                QueueEvent(WidgetEventKind::NameChanged, id).oldName = widget->name;
+            }
+            widget->name = name;
+            searchIndex.Rename(id, name);
+            dirtyNames.push_back(id.index);
+            version++;
+            if (QueryTraceWriter* trace = ActiveTrace())
+            {
+                std::string text = WideToUtf8(name);
+                trace->Write(TraceEvent::SetName, { id.index }, {}, &text);
+            }
+        }
+    }
+
+    void SetRect(WidgetId id, WidgetRect rect)
+    {
+        if (Widget* widget = widgets.get(id))
+        {
+            if (Wants(WidgetEventKind::BoundsChanged) && !SameRect(widget->rect, rect))
+            {
+                QueueEvent(WidgetEventKind::BoundsChanged, id).oldBounds = transform.Apply(widget->rect);
+            }
+            widget->rect = rect;
+            dirtyRects.push_back(id.index);
+            version++;
+            TraceCall(TraceEvent::SetRect, { id.index, rect.left, rect.top, rect.right, rect.bottom });
+        }
+    }
+
+    void SetEnabled(WidgetId id, bool enabled)
+    {
+        if (Widget* widget = widgets.get(id))
+        {
+            if (Wants(WidgetEventKind::EnabledChanged) && widget->enabled != enabled)
+            {
+                QueueEvent(WidgetEventKind::EnabledChanged, id).oldEnabled = widget->enabled;
+            }
+            widget->enabled = enabled;
+            focusDirty = true;
+            version++;
+            TraceCall(TraceEvent::SetEnabled, { id.index, enabled ? 1 : 0 });
+        }
+    }
+
+    // Value updates touch nothing derived, so they are cheap enough to make on
+    // every sample; the caller throttles the events they queue.
+    void SetValue(WidgetId id, double value)
+    {
+        if (Widget* widget = widgets.get(id))
+        {
+            double oldValue = widget->value;
+            widget->value = (std::min)((std::max)(value, widget->minimum), widget->maximum);
+            if (Wants(WidgetEventKind::ValueChanged) && widget->value != oldValue)
+            {
+                QueueEvent(WidgetEventKind::ValueChanged, id).oldValue = oldValue;
+            }
+            version++;
+            if (QueryTraceWriter* trace = ActiveTrace())
+            {
+                trace->Write(TraceEvent::SetValue, { id.index }, { value });
+            }
+        }
+    }
+
+    void SetRange(WidgetId id, double minimum, double maximum)
+    {
+        if (Widget* widget = widgets.get(id))
+        {
+            double oldValue = widget->value;
+            widget->minimum = minimum;
+            widget->maximum = (std::max)(minimum, maximum);
+            widget->value = (std::min)((std::max)(widget->value, widget->minimum), widget->maximum);
+            if (Wants(WidgetEventKind::ValueChanged) && widget->value != oldValue)
+            {
+                QueueEvent(WidgetEventKind::ValueChanged, id).oldValue = oldValue;
+            }
+            version++;
+            if (QueryTraceWriter* trace = ActiveTrace())
+            {
+                trace->Write(TraceEvent::SetRange, { id.index }, { minimum, maximum });
+            }
+        }
+    }
+
+    void SetFocus(WidgetId id)
+    {
+        if (Wants(WidgetEventKind::Focus) && id != focus)
+        {
+            QueueEvent(WidgetEventKind::Focus, id);
+        }
+        focus = id;
+        version++;
+        TraceCall(TraceEvent::SetFocus, { TraceSlot(id) });
+    }
+
+    // Client-to-screen mapping of the hosting window. Changing it
+    // retransforms every rect in one pass on the next GetDerived.
+    void SetScreenTransform(const ScreenTransform& value)
+    {
+        if (value != transform)
+        {
+            transform = value;
+            layoutDirty = true;
+            TraceCall(TraceEvent::SetScreenTransform, { value.originX, value.originY, value.dpi });
+        }
+    }
+
+    void SetScreenOrigin(int32_t x, int32_t y)
+    {
+        SetScreenTransform({ x, y, transform.dpi });
+    }
+
+    const ScreenTransform& GetScreenTransform() const { return transform; }
+
+    bool Contains(WidgetId id) const { return widgets.contains(id); }
+    const Widget* Get(WidgetId id) const { return widgets.get(id); }
+    WidgetId GetFocus() const { return widgets.contains(focus) ? focus : kNoWidget; }
+    const std::vector<WidgetId>& GetRoots() const { return roots; }
+    const SlotMap<Widget>& GetWidgets() const { return widgets; }
+    uint64_t GetVersion() const { return version; }
+
+    size_t GetChildCount(WidgetId id) const
+    {
+        const Widget* widget = widgets.get(id);
+        return widget ? widget->children.size() : 0;
+    }
+
+    WidgetId GetChild(WidgetId id, size_t index) const
+    {
+        const Widget* widget = widgets.get(id);
+        return widget && index < widget->children.size() ? widget->children[index] : kNoWidget;
+    }
+
+    // Brings the derived data up to date with every change made so far.
+    const DerivedData& GetDerived()
+    {
+        if (!dirtyNames.empty() || !dirtyRects.empty() || layoutDirty || structureDirty || focusDirty)
+        {
+            Refresh();
+        }
+        return derived;
+    }
+
+    // Hierarchy queries; each is a constant number of table lookups once the
+    // derived data is current.
+    bool IsAncestor(WidgetId ancestor, WidgetId id)
+    {
+        if (!widgets.contains(ancestor) || !widgets.contains(id))
+        {
+            return false;
+        }
+        const DerivedData& data = GetDerived();
+        uint32_t a = data.preorderPosition[ancestor.index];
+        uint32_t b = data.preorderPosition[id.index];
+        return a < b && b < a + data.subtreeSize[a];
+    }
+
+    uint32_t GetDepth(WidgetId id)
+    {
+        if (!widgets.contains(id))
+        {
+            return 0;
+        }
+        const DerivedData& data = GetDerived();
+        return data.depth[data.preorderPosition[id.index]];
+    }
+
+    size_t GetDescendantCount(WidgetId id)
+    {
+        if (!widgets.contains(id))
+        {
+            return 0;
+        }
+        const DerivedData& data = GetDerived();
+        return data.subtreeSize[data.preorderPosition[id.index]] - 1;
+    }
+
+    // Pre-order positions [begin, end) of the widget and its descendants.
+    void GetSubtreeRange(WidgetId id, size_t* begin, size_t* end)
+    {
+        *begin = *end = 0;
+        if (widgets.contains(id))
+        {
+            const DerivedData& data = GetDerived();
+            *begin = data.preorderPosition[id.index];
+            *end = *begin + data.subtreeSize[*begin];
+        }
+    }
+
+    // Name and role lookups, answered from an index that every change keeps
+    // current rather than by walking the widgets. Results are in no
+    // particular order.
+    void FindByName(const std::wstring& name, bool ignoreCase, std::vector<WidgetId>* found) const
+    {
+        for (WidgetId id : searchIndex.GetByName(name))
+        {
+            if (ignoreCase || widgets.get(id)->name == name)
+            {
+                found->push_back(id);
+            }
+        }
+    }
+
+    // Prefix matches ignore case, as in type-ahead search.
+    void FindByNamePrefix(const std::wstring& prefix, std::vector<WidgetId>* found) const
+    {
+        searchIndex.VisitPrefix(prefix, [found](WidgetId id) { found->push_back(id); });
+    }
+
+    void FindByNamePrefix(const std::wstring& prefix, WidgetRole role, std::vector<WidgetId>* found) const
+    {
+        searchIndex.VisitPrefix(prefix, static_cast<uint8_t>(role), [found](WidgetId id) { found->push_back(id); });
+    }
+
+    size_t CountByNamePrefix(const std::wstring& prefix) const { return searchIndex.CountPrefix(prefix); }
+    const std::vector<WidgetId>& FindByRole(WidgetRole role) const { return searchIndex.GetByCategory(static_cast<uint8_t>(role)); }
+
+    const DerivedStats& GetDerivedStats() const { return stats; }
+
+    // Which events have listeners. Changes queue an event, and work out what
+    // it carries, only for the kinds subscribed here; the platform layer
+    // keeps it current and raises what TakeEvents returns.
+    EventSubscriptions& GetEventSubscriptions() { return subscriptions; }
+    const EventStats& GetEventStats() const { return eventStats; }
+
+    // Moves the queued events to out, oldest first. Widgets they name may
+    // have been removed since.
+    void TakeEvents(std::vector<WidgetEvent>* out)
+    {
+        out->clear();
+        out->swap(events);
+    }
+
+    // Bytes the model holds, by what they are spent on. Each widget's fields
+    // are attributed to their category, and slot bookkeeping, padding and
+    // spare capacity to structure.
+    MemoryUsage GetMemoryUsage() const
+    {
+        MemoryUsage usage;
+        usage.nodes = widgets.size();
+        size_t fieldBytes = 0;
+        for (const Widget& widget : widgets)
+        {
+            size_t geometry = sizeof(widget.rect);
+            size_t state = sizeof(widget.role) + sizeof(widget.enabled) + sizeof(widget.focusable) + sizeof(widget.color);
+            size_t values = sizeof(widget.value) + sizeof(widget.minimum) + sizeof(widget.maximum);
+            usage.Add(MemoryCategory::Geometry, geometry);
+            usage.Add(MemoryCategory::State, state);
+            usage.Add(MemoryCategory::Values, values);
+            usage.Add(MemoryCategory::Names, sizeof(widget.name) + HeapBytes(widget.name));
+            usage.Add(MemoryCategory::Structure, HeapBytes(widget.children));
+            fieldBytes += geometry + state + values + sizeof(widget.name);
+        }
+        usage.Add(MemoryCategory::Structure, widgets.memoryBytes() - fieldBytes + HeapBytes(roots));
+        usage.Add(MemoryCategory::Derived, derived.GetMemoryBytes() + HeapBytes(rectColumn) + HeapBytes(dirtyNames) + HeapBytes(dirtyRects) + HeapBytes(stack));
+        usage.Add(MemoryCategory::Index, searchIndex.GetMemoryBytes());
+        return usage;
+    }
+
+    // Writes the model as it stands as mutations that rebuild it, so a trace
+    // started now replays from the same state. Widgets go in document order,
+    // followed by the event subscriptions.
+    void TraceSnapshot(QueryTraceWriter* trace) const
+    {
+        std::vector<WidgetId> pending(roots.rbegin(), roots.rend());
+        while (!pending.empty())
+        {
+            WidgetId id = pending.back();
+            pending.pop_back();
+            TraceAdd(trace, id);
+            const Widget& widget = *widgets.get(id);
+            if (!widget.enabled)
+            {
+                trace->Write(TraceEvent::SetEnabled, { id.index, 0 });
+            }
+            if (widget.minimum != 0 || widget.maximum != 100)
+            {
+                trace->Write(TraceEvent::SetRange, { id.index }, { widget.minimum, widget.maximum });
+            }
+            if (widget.value != 0)
+            {
+                trace->Write(TraceEvent::SetValue, { id.index }, { widget.value });
+            }
+            pending.insert(pending.end(), widget.children.rbegin(), widget.children.rend());
+        }
+        trace->Write(TraceEvent::SetScreenTransform, { transform.originX, transform.originY, transform.dpi });
+        trace->Write(TraceEvent::SetFocus, { TraceSlot(GetFocus()) });
+        for (size_t kind = 0; kind < static_cast<size_t>(WidgetEventKind::Count); kind++)
+        {
+            if (uint32_t count = subscriptions.GetCount(static_cast<WidgetEventKind>(kind)))
+            {
+                trace->Write(TraceEvent::Subscribe, { static_cast<int64_t>(kind), count });
+            }
+        }
+    }
+
+private:
+    // Whether an event of kind would be heard; callers build one only if so.
+    bool Wants(WidgetEventKind kind)
+    {
+        if (subscriptions.IsSubscribed(kind))
+        {
+            return true;
+        }
+        eventStats.skipped++;
+        return false;
+    }
+
+    WidgetEvent& QueueEvent(WidgetEventKind kind, WidgetId id)
+    {
+        eventStats.queued++;
+        events.emplace_back();
+        WidgetEvent& event = events.back();
+        event.kind = kind;
+        event.widget = id;
+        event.change = StructureChange::ChildAdded;
+        event.child = kNoWidget;
+        event.oldBounds = WidgetRect();
+        event.oldEnabled = false;
+        event.oldValue = 0;
+        return event;
+    }
+
+    void QueueStructureEvent(WidgetId parent, StructureChange change, WidgetId child)
+    {
+        WidgetEvent& event = QueueEvent(WidgetEventKind::StructureChanged, parent);
+        event.change = change;
+        event.child = child;
+    }
+
+    static bool SameRect(const WidgetRect& a, const WidgetRect& b)
+    {
+        return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+    }
+
+    static int64_t TraceSlot(WidgetId id)
+    {
+        return id == kNoWidget ? -1 : static_cast<int64_t>(id.index);
+    }
+
+    void TraceAdd(QueryTraceWriter* trace, WidgetId id) const
+    {
+        const Widget& widget = *widgets.get(id);
+        std::string name = WideToUtf8(widget.name);
+        trace->Write(TraceEvent::AddWidget, { id.index, TraceSlot(widget.parent), static_cast<int64_t>(widget.role), widget.color,
+            widget.rect.left, widget.rect.top, widget.rect.right, widget.rect.bottom }, {}, &name);
+    }
+
+    // Walks the subtree with an explicit stack, so deep trees do not recurse.
+    void RemoveSubtree(WidgetId id)
+    {
+        stack.assign(1, id);
+        while (!stack.empty())
+        {
+            WidgetId next = stack.back();
+            stack.pop_back();
+            const std::vector<WidgetId>& children = widgets.get(next)->children;
+            stack.insert(stack.end(), children.begin(), children.end());
+            if (focus == next)
+            {
+                focus = kNoWidget;
+            }
+            searchIndex.Remove(next);
+            widgets.erase(next);
+        }
+    }
+
+    void Refresh()
+    {
+        size_t slots = widgets.slotCount();
+        derived.utf8Names.resize(slots);
+        derived.screenRects.resize(slots);
+        derived.childIndex.resize(slots);
+        derived.focusPosition.resize(slots);
+
+        for (uint32_t slot : dirtyNames)
+        {
+            if (const Widget* widget = widgets.get(widgets.handleAtSlot(slot)))
+            {
+                derived.utf8Names[slot] = WideToUtf8(widget->name);
+                stats.namesConverted++;
+            }
+        }
+        dirtyNames.clear();
+
+        if (layoutDirty)
+        {
+            // Gather the rects into one column, transform it in a single
+            // vector pass, then scatter the results to their slots
+            size_t count = widgets.size();
+            rectColumn.resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                rectColumn[i] = widgets[i].rect;
+            }
+            TransformRects(transform, rectColumn.data(), rectColumn.data(), count);
+            for (size_t i = 0; i < count; i++)
+            {
+                derived.screenRects[widgets.handleAt(i).index] = rectColumn[i];
+            }
+            stats.rectsTransformed += count;
+            if (!structureDirty)
+            {
+                for (size_t p = 0; p < derived.preorder.size(); p++)
+                {
+                    derived.bounds[p] = derived.screenRects[derived.preorder[p].index];
+                }
+            }
+            layoutDirty = false;
+        }
+        else
+        {
+            for (uint32_t slot : dirtyRects)
+            {
+                if (const Widget* widget = widgets.get(widgets.handleAtSlot(slot)))
+                {
+                    derived.screenRects[slot] = transform.Apply(widget->rect);
+                    stats.rectsTransformed++;
+                    if (!structureDirty)
+                    {
+                        derived.bounds[derived.preorderPosition[slot]] = derived.screenRects[slot];
+                    }
+                }
+            }
+        }
+        dirtyRects.clear();
+
+        if (structureDirty)
+        {
+            RebuildStructure();
+            stats.structureRebuilds++;
+            structureDirty = false;
+            focusDirty = true;
+        }
+
+        if (focusDirty)
+        {
+            // Tab order is document order, so it falls out of the pre-order table
+            derived.focusOrder.clear();
+            for (size_t p = 0; p < derived.preorder.size(); p++)
+            {
+                WidgetId id = derived.preorder[p];
+                const Widget* widget = widgets.get(id);
+                derived.states[p] = (widget->enabled ? DerivedData::kStateEnabled : 0) | (widget->focusable ? DerivedData::kStateFocusable : 0);
+                if (widget->focusable && widget->enabled)
+                {
+                    derived.focusPosition[id.index] = static_cast<uint32_t>(derived.focusOrder.size());
+                    derived.focusOrder.push_back(id);
+                }
+                else
+                {
+                    derived.focusPosition[id.index] = DerivedData::kNotFocusable;
+                }
+            }
+            focusDirty = false;
+        }
+        stats.refreshes++;
+    }
+
+    std::vector<WidgetId>& SiblingsOf(WidgetId parent)
+    {
+        Widget* widget = widgets.get(parent);
+        return widget ? widget->children : roots;
+    }
+
+    void UpdateChildIndices(const std::vector<WidgetId>& siblings, size_t from)
+    {
+        for (size_t i = from; i < siblings.size(); i++)
+        {
+            derived.childIndex[siblings[i].index] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // Lays the forest out in pre-order without recursion, so deep trees are fine.
+    void RebuildStructure()
+    {
+        size_t slots = widgets.slotCount();
+        derived.preorderPosition.resize(slots);
+        derived.preorder.clear();
+        derived.preorder.reserve(widgets.size());
+
+        stack.assign(roots.rbegin(), roots.rend());
+        while (!stack.empty())
+        {
+            WidgetId id = stack.back();
+            stack.pop_back();
+            derived.preorderPosition[id.index] = static_cast<uint32_t>(derived.preorder.size());
+            derived.preorder.push_back(id);
+            const std::vector<WidgetId>& children = widgets.get(id)->children;
+            stack.insert(stack.end(), children.rbegin(), children.rend());
+        }
+
+        size_t count = derived.preorder.size();
+        derived.subtreeSize.assign(count, 0);
+        derived.depth.assign(count, 0);
+        derived.roles.resize(count);
+        derived.states.resize(count);
+        derived.bounds.resize(count);
+        for (size_t p = 0; p < count; p++)
+        {
+            const Widget* widget = widgets.get(derived.preorder[p]);
+            derived.roles[p] = widget->role;
+            derived.bounds[p] = derived.screenRects[derived.preorder[p].index];
+            WidgetId parent = widget->parent;
+            if (parent != kNoWidget)
+            {
+                derived.depth[p] = derived.depth[derived.preorderPosition[parent.index]] + 1;
+            }
+        }
+        // Children come after their parent, so a reverse pass sees every
+        // subtree complete before adding it to its parent
+        for (size_t p = count; p > 0; p--)
+        {
+            derived.subtreeSize[p - 1]++;
+            WidgetId parent = widgets.get(derived.preorder[p - 1])->parent;
+            if (parent != kNoWidget)
+            {
+                derived.subtreeSize[derived.preorderPosition[parent.index]] += derived.subtreeSize[p - 1];
+            }
+        }
+
+        UpdateChildIndices(roots, 0);
+        for (WidgetId id : derived.preorder)
+        {
+            UpdateChildIndices(widgets.get(id)->children, 0);
+        }
+    }
+
+    // Moves the subtree of id, already reparented in the model, to target
+    // (a position in the order before the move) by rotating the tables.
+    void PatchMove(WidgetId id, WidgetId oldParent, uint32_t target)
+    {
+        uint32_t begin = derived.preorderPosition[id.index];
+        uint32_t size = derived.subtreeSize[begin];
+        uint32_t end = begin + size;
+
+        // Old ancestors lose the subtree and new ancestors gain it; positions
+        // are still the old ones here, and the size table moves with them below
+        for (WidgetId ancestor = oldParent; ancestor != kNoWidget; ancestor = widgets.get(ancestor)->parent)
+        {
+            derived.subtreeSize[derived.preorderPosition[ancestor.index]] -= size;
+        }
+        WidgetId newParent = widgets.get(id)->parent;
+        for (WidgetId ancestor = newParent; widgets.contains(ancestor); ancestor = widgets.get(ancestor)->parent)
+        {
+            derived.subtreeSize[derived.preorderPosition[ancestor.index]] += size;
+        }
+
+        uint32_t newDepth = newParent != kNoWidget ? derived.depth[derived.preorderPosition[newParent.index]] + 1 : 0;
+        uint32_t oldDepth = derived.depth[begin];
+        for (uint32_t p = begin; p < end; p++)
+        {
+            derived.depth[p] = derived.depth[p] - oldDepth + newDepth;
+        }
+
+        // A target at either edge of the subtree leaves the order unchanged
+        uint32_t first = target < begin ? target : begin;
+        uint32_t middle = target < begin ? begin : end;
+        uint32_t last = target < begin ? end : (target > end ? target : end);
+        std::rotate(derived.preorder.begin() + first, derived.preorder.begin() + middle, derived.preorder.begin() + last);
+        std::rotate(derived.subtreeSize.begin() + first, derived.subtreeSize.begin() + middle, derived.subtreeSize.begin() + last);
+        std::rotate(derived.depth.begin() + first, derived.depth.begin() + middle, derived.depth.begin() + last);
+        std::rotate(derived.roles.begin() + first, derived.roles.begin() + middle, derived.roles.begin() + last);
+        std::rotate(derived.states.begin() + first, derived.states.begin() + middle, derived.states.begin() + last);
+        std::rotate(derived.bounds.begin() + first, derived.bounds.begin() + middle, derived.bounds.begin() + last);
+        for (uint32_t p = first; p < last; p++)
+        {
+            derived.preorderPosition[derived.preorder[p].index] = p;
+        }
+
+        // Tab order is document order, so the focusable widgets in the span
+        // keep the same stretch of it, reordered as the span was
+        if (!focusDirty)
+        {
+            uint32_t next = DerivedData::kNotFocusable;
+            for (uint32_t p = first; p < last; p++)
+            {
+                next = (std::min)(next, derived.focusPosition[derived.preorder[p].index]);
+            }
+            for (uint32_t p = first; p < last && next != DerivedData::kNotFocusable; p++)
+            {
+                WidgetId moved = derived.preorder[p];
+                if (derived.focusPosition[moved.index] != DerivedData::kNotFocusable)
+                {
+                    derived.focusOrder[next] = moved;
+                    derived.focusPosition[moved.index] = next++;
+                }
+            }
+        }
+
+        stats.structurePatches++;
+    }
+
+    SlotMap<Widget> widgets;
+    std::vector<WidgetId> roots;
+    WidgetId focus;
+    ScreenTransform transform;
+    uint64_t version;
+    NameIndex searchIndex;
+    EventSubscriptions subscriptions;
+    std::vector<WidgetEvent> events;
+    EventStats eventStats;
+
+    std::vector<uint32_t> dirtyNames;
+    // Slots whose rect changed since the last refresh; layoutDirty covers all.
+    std::vector<uint32_t> dirtyRects;
+    std::vector<WidgetRect> rectColumn;
+    bool layoutDirty;
+    bool structureDirty;
+    bool focusDirty;
+    DerivedData derived;
+    std::vector<WidgetId> stack;
+    DerivedStats stats;
+};
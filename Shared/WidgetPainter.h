@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Renderer.h"
+#include "SelectionSet.h"
+#include "WidgetModel.h"
+
+const uint32_t kSelectedColor = 0xFFCC99;
+
+// Paints one widget: a filled rectangle, highlighted when the widget is
+// selected, plus a centered label for buttons and the filled part of the
+// track for progress bars.
+inline void PaintWidget(Renderer& renderer, const Widget& widget, bool selected = false)
+{
+    renderer.FillRect(widget.rect, selected ? kSelectedColor : widget.color);
+    if (widget.role == WidgetRole::ProgressBar && widget.maximum > widget.minimum)
+    {
+        WidgetRect filled = widget.rect;
+        double fraction = (widget.value - widget.minimum) / (widget.maximum - widget.minimum);
+        filled.right = filled.left + static_cast<int32_t>((widget.rect.right - widget.rect.left) * fraction);
+        renderer.FillRect(filled, 0x00B000);
+    }
+    else if (widget.role == WidgetRole::Button)
+    {
+        // Black text in the center of the box
+        renderer.DrawLabel(widget.rect, widget.name, kLabelFont, 0x000000);
+    }
+}
+
+// Paints a widget and everything below it, parents first. selection, if
+// given, holds the selection state of the widget's children.
+inline void PaintWidgetTree(Renderer& renderer, const WidgetModel& model, WidgetId id, const SelectionSet* selection = nullptr, bool selected = false)
+{
+    const Widget* widget = model.Get(id);
+    if (!widget)
+    {
+        return;
+    }
+    PaintWidget(renderer, *widget, selected);
+    for (size_t i = 0; i < widget->children.size(); i++)
+    {
+        PaintWidgetTree(renderer, model, widget->children[i], nullptr, selection && selection->IsSelected(i));
+    }
+}
@@ -0,0 +1,586 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BitOps.h"
+#include "WidgetModel.h"
+
+// Defining WIDGET_QUERY_NO_SSE2 keeps to the scalar loops, so they can be
+// tested on machines that have SSE2.
+#if !defined(WIDGET_QUERY_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define WIDGET_QUERY_SSE2 1
+#endif
+
+// Which widgets relative to the root a query looks at, as in UIA's TreeScope.
+enum class QueryScope
+{
+    Element,
+    Children,
+    Descendants,
+    Subtree,
+};
+
+enum class QueryOp : uint8_t
+{
+    Always,
+    Never,
+    // Role is one of the roles in the bit set
+    RoleIn,
+    // (state & stateMask) == stateValue, with DerivedData::kState* bits
+    StateIs,
+    // Screen bounds overlap rect
+    BoundsIntersect,
+    // Name equals, or starts with, strings[operand]; answered from the name index
+    NameIs,
+    NameIsIgnoreCase,
+    NameStartsWith,
+    And,
+    Or,
+    Not,
+};
+
+// One step of a condition in postfix order: leaves push a match mask, the
+// combinators pop their operands and push the result.
+struct QueryInstruction
+{
+    QueryOp op;
+    uint8_t roles;
+    uint8_t stateMask;
+    uint8_t stateValue;
+    uint32_t operand;
+    WidgetRect rect;
+};
+
+// A condition on widgets, built from the factories below the way UIA
+// conditions are: property tests combined with And, Or and Not. It is stored
+// as a flat postfix program from the start, so building one allocates a
+// vector rather than a tree of nodes.
+class WidgetCondition
+{
+public:
+    static WidgetCondition Always() { return Leaf(QueryOp::Always); }
+    static WidgetCondition Never() { return Leaf(QueryOp::Never); }
+
+    static WidgetCondition RoleIs(WidgetRole role) { return RoleIn({ role }); }
+
+    static WidgetCondition RoleIn(std::initializer_list<WidgetRole> roles)
+    {
+        WidgetCondition condition = Leaf(QueryOp::RoleIn);
+        for (WidgetRole role : roles)
+        {
+            condition.code[0].roles |= RoleBit(role);
+        }
+        return condition;
+    }
+
+    static WidgetCondition IsEnabled(bool enabled) { return State(DerivedData::kStateEnabled, enabled); }
+    static WidgetCondition IsFocusable(bool focusable) { return State(DerivedData::kStateFocusable, focusable); }
+
+    // rect is in screen coordinates, like the bounds UIA reports.
+    static WidgetCondition BoundsIntersect(const WidgetRect& rect)
+    {
+        WidgetCondition condition = Leaf(QueryOp::BoundsIntersect);
+        condition.code[0].rect = rect;
+        return condition;
+    }
+
+    static WidgetCondition NameIs(const std::wstring& name, bool ignoreCase = false)
+    {
+        return Text(ignoreCase ? QueryOp::NameIsIgnoreCase : QueryOp::NameIs, name);
+    }
+
+    // Ignores case, as in type-ahead search.
+    static WidgetCondition NameStartsWith(const std::wstring& prefix) { return Text(QueryOp::NameStartsWith, prefix); }
+
+    static WidgetCondition And(const WidgetCondition& a, const WidgetCondition& b) { return Combine(a, b, QueryOp::And); }
+    static WidgetCondition Or(const WidgetCondition& a, const WidgetCondition& b) { return Combine(a, b, QueryOp::Or); }
+
+    static WidgetCondition Not(const WidgetCondition& a)
+    {
+        WidgetCondition condition = a;
+        condition.code.push_back(Instruction(QueryOp::Not));
+        return condition;
+    }
+
+    const std::vector<QueryInstruction>& GetCode() const { return code; }
+    const std::vector<std::wstring>& GetStrings() const { return strings; }
+
+    static uint8_t RoleBit(WidgetRole role) { return static_cast<uint8_t>(1u << static_cast<uint8_t>(role)); }
+    static bool IsText(QueryOp op) { return op == QueryOp::NameIs || op == QueryOp::NameIsIgnoreCase || op == QueryOp::NameStartsWith; }
+    static const uint8_t kAllRoles = (1u << (static_cast<uint8_t>(WidgetRole::ProgressBar) + 1)) - 1;
+
+private:
+    static QueryInstruction Instruction(QueryOp op)
+    {
+        QueryInstruction instruction = {};
+        instruction.op = op;
+        return instruction;
+    }
+
+    static WidgetCondition Leaf(QueryOp op)
+    {
+        WidgetCondition condition;
+        condition.code.push_back(Instruction(op));
+        return condition;
+    }
+
+    static WidgetCondition State(uint8_t bit, bool set)
+    {
+        WidgetCondition condition = Leaf(QueryOp::StateIs);
+        condition.code[0].stateMask = bit;
+        condition.code[0].stateValue = set ? bit : 0;
+        return condition;
+    }
+
+    static WidgetCondition Text(QueryOp op, const std::wstring& text)
+    {
+        WidgetCondition condition = Leaf(op);
+        condition.strings.push_back(text);
+        return condition;
+    }
+
+    // Appends b after a, renumbering b's strings.
+    static WidgetCondition Combine(const WidgetCondition& a, const WidgetCondition& b, QueryOp op)
+    {
+        WidgetCondition condition = a;
+        uint32_t base = static_cast<uint32_t>(condition.strings.size());
+        for (QueryInstruction instruction : b.code)
+        {
+            if (IsText(instruction.op))
+            {
+                instruction.operand += base;
+            }
+            condition.code.push_back(instruction);
+        }
+        condition.strings.insert(condition.strings.end(), b.strings.begin(), b.strings.end());
+        condition.code.push_back(Instruction(op));
+        return condition;
+    }
+
+    std::vector<QueryInstruction> code;
+    std::vector<std::wstring> strings;
+};
+
+// A condition compiled for evaluation. Compiling folds constants, merges role
+// and state tests that share an And or Or into one test, and works out how
+// deep the evaluation stack gets. Running the query evaluates the program a
+// block of 1024 widgets at a time over the model's pre-order columns, each
+// leaf a vector compare over a column and each combinator a pass over 16
+// mask words, so no per-widget calls are made and a scope is one contiguous
+// range. Name tests are looked up in the model's name index first and enter
+// the program as precomputed masks. Matches come in document order.
+//
+// A query holds scratch space for evaluation, so one instance should not be
+// run from two threads at once.
+class WidgetQuery
+{
+public:
+    explicit WidgetQuery(const WidgetCondition& condition) : strings(condition.GetStrings()), depth(0)
+    {
+        Compile(condition.GetCode());
+    }
+
+    const std::vector<QueryInstruction>& GetProgram() const { return program; }
+
+    WidgetId FindFirst(WidgetModel& model, WidgetId root, QueryScope scope)
+    {
+        WidgetId found = kNoWidget;
+        Run(model, root, scope, [&found](WidgetId id)
+        {
+            found = id;
+            return false;
+        });
+        return found;
+    }
+
+    void FindAll(WidgetModel& model, WidgetId root, QueryScope scope, std::vector<WidgetId>* found)
+    {
+        Run(model, root, scope, [found](WidgetId id)
+        {
+            found->push_back(id);
+            return true;
+        });
+    }
+
+    size_t Count(WidgetModel& model, WidgetId root, QueryScope scope)
+    {
+        size_t count = 0;
+        Run(model, root, scope, [&count](WidgetId)
+        {
+            count++;
+            return true;
+        });
+        return count;
+    }
+
+    // Calls visit(id) for each match in document order until it returns false.
+    template <typename Visit>
+    void Run(WidgetModel& model, WidgetId root, QueryScope scope, Visit visit)
+    {
+        if (!model.Contains(root) || program.empty() || program[0].op == QueryOp::Never)
+        {
+            return;
+        }
+        const DerivedData& data = model.GetDerived();
+        size_t position = data.preorderPosition[root.index];
+        size_t begin = scope == QueryScope::Element || scope == QueryScope::Subtree ? position : position + 1;
+        size_t end = scope == QueryScope::Element ? position + 1 : position + data.subtreeSize[position];
+        uint32_t childDepth = data.depth[position] + 1;
+        if (begin >= end)
+        {
+            return;
+        }
+
+        ResolveNames(model, data, begin, end);
+
+        stack.resize(depth * kBlockWords);
+        for (size_t blockStart = begin & ~size_t(63); blockStart < end; blockStart += kBlockSize)
+        {
+            size_t blockEnd = (std::min)(blockStart + kBlockSize, end);
+            const uint64_t* result = EvaluateBlock(data, blockStart, blockEnd);
+            for (size_t w = 0; w < kBlockWords && blockStart + w * 64 < blockEnd; w++)
+            {
+                uint64_t bits = result[w] & RangeMask(blockStart + w * 64, begin, blockEnd);
+                while (bits)
+                {
+                    size_t p = blockStart + w * 64 + LowestBit(bits);
+                    bits &= bits - 1;
+                    if (scope == QueryScope::Children && data.depth[p] != childDepth)
+                    {
+                        continue;
+                    }
+                    if (!visit(data.preorder[p]))
+                    {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static const size_t kBlockSize = 1024;
+    static const size_t kBlockWords = kBlockSize / 64;
+
+    // An operand on the compile stack: its code, and whether it is a lone
+    // leaf that can be merged with another.
+    struct Fragment
+    {
+        std::vector<QueryInstruction> code;
+
+        bool Is(QueryOp op) const { return code.size() == 1 && code[0].op == op; }
+    };
+
+    void Compile(const std::vector<QueryInstruction>& code)
+    {
+        std::vector<Fragment> fragments;
+        for (const QueryInstruction& instruction : code)
+        {
+            if (instruction.op == QueryOp::Not)
+            {
+                Negate(fragments.back());
+            }
+            else if (instruction.op == QueryOp::And || instruction.op == QueryOp::Or)
+            {
+                Fragment b = std::move(fragments.back());
+                fragments.pop_back();
+                Merge(fragments.back(), b, instruction.op);
+            }
+            else
+            {
+                fragments.push_back({ { instruction } });
+            }
+        }
+        program = fragments.empty() ? std::vector<QueryInstruction>() : std::move(fragments.back().code);
+
+        size_t height = 0;
+        for (const QueryInstruction& instruction : program)
+        {
+            if (instruction.op == QueryOp::And || instruction.op == QueryOp::Or)
+            {
+                height--;
+            }
+            else if (instruction.op != QueryOp::Not)
+            {
+                height++;
+            }
+            depth = (std::max)(depth, height);
+        }
+        nameMasks.resize(strings.size());
+    }
+
+    static void Negate(Fragment& a)
+    {
+        QueryInstruction& first = a.code[0];
+        if (a.Is(QueryOp::Always) || a.Is(QueryOp::Never))
+        {
+            first.op = first.op == QueryOp::Always ? QueryOp::Never : QueryOp::Always;
+        }
+        else if (a.Is(QueryOp::RoleIn))
+        {
+            first.roles = static_cast<uint8_t>(~first.roles & WidgetCondition::kAllRoles);
+        }
+        else if (a.Is(QueryOp::StateIs) && CountBits(first.stateMask) == 1)
+        {
+            first.stateValue ^= first.stateMask;
+        }
+        else if (a.code.back().op == QueryOp::Not)
+        {
+            a.code.pop_back();
+        }
+        else
+        {
+            QueryInstruction instruction = {};
+            instruction.op = QueryOp::Not;
+            a.code.push_back(instruction);
+        }
+    }
+
+    static void Merge(Fragment& a, Fragment& b, QueryOp op)
+    {
+        QueryOp absorbing = op == QueryOp::And ? QueryOp::Never : QueryOp::Always;
+        QueryOp identity = op == QueryOp::And ? QueryOp::Always : QueryOp::Never;
+        if (a.Is(absorbing) || b.Is(identity))
+        {
+            return;
+        }
+        if (b.Is(absorbing) || a.Is(identity))
+        {
+            a = std::move(b);
+            return;
+        }
+        if (a.Is(QueryOp::RoleIn) && b.Is(QueryOp::RoleIn))
+        {
+            a.code[0].roles = op == QueryOp::And ? a.code[0].roles & b.code[0].roles : a.code[0].roles | b.code[0].roles;
+            return;
+        }
+        if (op == QueryOp::And && a.Is(QueryOp::StateIs) && b.Is(QueryOp::StateIs))
+        {
+            QueryInstruction& x = a.code[0];
+            const QueryInstruction& y = b.code[0];
+            uint8_t shared = x.stateMask & y.stateMask;
+            if ((x.stateValue & shared) != (y.stateValue & shared))
+            {
+                x.op = QueryOp::Never;
+                return;
+            }
+            x.stateMask |= y.stateMask;
+            x.stateValue |= y.stateValue;
+            return;
+        }
+        a.code.insert(a.code.end(), b.code.begin(), b.code.end());
+        QueryInstruction instruction = {};
+        instruction.op = op;
+        a.code.push_back(instruction);
+    }
+
+    // Sets the bits of positions in [begin, end) whose names match, with words
+    // aligned to absolute positions like the blocks.
+    void ResolveNames(WidgetModel& model, const DerivedData& data, size_t begin, size_t end)
+    {
+        for (const QueryInstruction& instruction : program)
+        {
+            if (!WidgetCondition::IsText(instruction.op))
+            {
+                continue;
+            }
+            std::vector<uint64_t>& mask = nameMasks[instruction.operand];
+            mask.assign((end + 63) / 64, 0);
+            const std::wstring& text = strings[instruction.operand];
+            auto mark = [&](WidgetId id)
+            {
+                size_t p = data.preorderPosition[id.index];
+                if (p >= begin && p < end)
+                {
+                    mask[p / 64] |= uint64_t(1) << (p % 64);
+                }
+            };
+            matches.clear();
+            if (instruction.op == QueryOp::NameStartsWith)
+            {
+                model.FindByNamePrefix(text, &matches);
+            }
+            else
+            {
+                model.FindByName(text, instruction.op == QueryOp::NameIsIgnoreCase, &matches);
+            }
+            for (WidgetId id : matches)
+            {
+                mark(id);
+            }
+        }
+    }
+
+    static uint64_t RangeMask(size_t wordStart, size_t begin, size_t end)
+    {
+        uint64_t mask = ~uint64_t(0);
+        if (begin > wordStart)
+        {
+            mask = begin - wordStart >= 64 ? 0 : mask << (begin - wordStart);
+        }
+        if (end < wordStart + 64)
+        {
+            mask &= end <= wordStart ? 0 : ~uint64_t(0) >> (64 - (end - wordStart));
+        }
+        return mask;
+    }
+
+    // Runs the program over positions [blockStart, blockEnd) and returns the
+    // result mask; bits past blockEnd are undefined.
+    const uint64_t* EvaluateBlock(const DerivedData& data, size_t blockStart, size_t blockEnd)
+    {
+        size_t top = 0;
+        size_t words = (blockEnd - blockStart + 63) / 64;
+        for (const QueryInstruction& instruction : program)
+        {
+            uint64_t* out = &stack[top * kBlockWords];
+            switch (instruction.op)
+            {
+            case QueryOp::Always:
+            case QueryOp::Never:
+                std::fill(out, out + words, instruction.op == QueryOp::Always ? ~uint64_t(0) : 0);
+                top++;
+                break;
+            case QueryOp::RoleIn:
+                MatchRoles(data, instruction.roles, blockStart, blockEnd, out);
+                top++;
+                break;
+            case QueryOp::StateIs:
+                MatchStates(data, instruction.stateMask, instruction.stateValue, blockStart, blockEnd, out);
+                top++;
+                break;
+            case QueryOp::BoundsIntersect:
+                MatchBounds(data, instruction.rect, blockStart, blockEnd, out);
+                top++;
+                break;
+            case QueryOp::NameIs:
+            case QueryOp::NameIsIgnoreCase:
+            case QueryOp::NameStartsWith:
+                std::copy(&nameMasks[instruction.operand][blockStart / 64], &nameMasks[instruction.operand][blockStart / 64] + words, out);
+                top++;
+                break;
+            case QueryOp::And:
+            case QueryOp::Or:
+            {
+                uint64_t* a = &stack[(top - 2) * kBlockWords];
+                const uint64_t* b = &stack[(top - 1) * kBlockWords];
+                for (size_t w = 0; w < words; w++)
+                {
+                    a[w] = instruction.op == QueryOp::And ? a[w] & b[w] : a[w] | b[w];
+                }
+                top--;
+                break;
+            }
+            case QueryOp::Not:
+            {
+                uint64_t* a = &stack[(top - 1) * kBlockWords];
+                for (size_t w = 0; w < words; w++)
+                {
+                    a[w] = ~a[w];
+                }
+                break;
+            }
+            }
+        }
+        return &stack[0];
+    }
+
+    static void MatchRoles(const DerivedData& data, uint8_t roles, size_t blockStart, size_t blockEnd, uint64_t* out)
+    {
+        std::fill(out, out + kBlockWords, 0);
+        const uint8_t* column = reinterpret_cast<const uint8_t*>(data.roles.data());
+        size_t p = blockStart;
+#ifdef WIDGET_QUERY_SSE2
+        for (; p + 16 <= blockEnd; p += 16)
+        {
+            __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + p));
+            __m128i hits = _mm_setzero_si128();
+            for (uint8_t set = roles; set; set &= set - 1)
+            {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(values, _mm_set1_epi8(static_cast<char>(LowestBit(set)))));
+            }
+            SetBits(out, p - blockStart, static_cast<uint32_t>(_mm_movemask_epi8(hits)));
+        }
+#endif
+        for (; p < blockEnd; p++)
+        {
+            if ((roles >> column[p]) & 1)
+            {
+                SetBits(out, p - blockStart, 1);
+            }
+        }
+    }
+
+    static void MatchStates(const DerivedData& data, uint8_t mask, uint8_t value, size_t blockStart, size_t blockEnd, uint64_t* out)
+    {
+        std::fill(out, out + kBlockWords, 0);
+        const uint8_t* column = data.states.data();
+        size_t p = blockStart;
+#ifdef WIDGET_QUERY_SSE2
+        const __m128i masks = _mm_set1_epi8(static_cast<char>(mask));
+        const __m128i values = _mm_set1_epi8(static_cast<char>(value));
+        for (; p + 16 <= blockEnd; p += 16)
+        {
+            __m128i states = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(column + p)), masks);
+            SetBits(out, p - blockStart, static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(states, values))));
+        }
+#endif
+        for (; p < blockEnd; p++)
+        {
+            if ((column[p] & mask) == value)
+            {
+                SetBits(out, p - blockStart, 1);
+            }
+        }
+    }
+
+    static void MatchBounds(const DerivedData& data, const WidgetRect& rect, size_t blockStart, size_t blockEnd, uint64_t* out)
+    {
+        std::fill(out, out + kBlockWords, 0);
+        const WidgetRect* column = data.bounds.data();
+        size_t p = blockStart;
+#ifdef WIDGET_QUERY_SSE2
+        // Lanes are left, top, right, bottom: the first two must be below the
+        // query's right and bottom, the last two above its left and top
+        const __m128i upper = _mm_setr_epi32(rect.right, rect.bottom, 0, 0);
+        const __m128i lower = _mm_setr_epi32(0, 0, rect.left, rect.top);
+        for (; p < blockEnd; p++)
+        {
+            __m128i bounds = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + p));
+            int below = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(bounds, upper)));
+            int above = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(bounds, lower)));
+            if (((below & 0x3) | (above & 0xC)) == 0xF)
+            {
+                SetBits(out, p - blockStart, 1);
+            }
+        }
+#endif
+        for (; p < blockEnd; p++)
+        {
+            const WidgetRect& bounds = column[p];
+            if (bounds.left < rect.right && bounds.top < rect.bottom && bounds.right > rect.left && bounds.bottom > rect.top)
+            {
+                SetBits(out, p - blockStart, 1);
+            }
+        }
+    }
+
+    // ORs bits into the mask starting at offset; offset is a multiple of the
+    // number of bits, so they never straddle two words.
+    static void SetBits(uint64_t* out, size_t offset, uint32_t bits)
+    {
+        out[offset / 64] |= static_cast<uint64_t>(bits) << (offset % 64);
+    }
+
+    std::vector<QueryInstruction> program;
+    std::vector<std::wstring> strings;
+    size_t depth;
+    std::vector<uint64_t> stack;
+    std::vector<std::vector<uint64_t>> nameMasks;
+    std::vector<WidgetId> matches;
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+// Client coordinates, laid out like a Win32 RECT.
+struct WidgetRect
+{
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+};
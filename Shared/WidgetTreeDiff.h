@@ -0,0 +1,317 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "WidgetModel.h"
+#include "WorkStealingPool.h"
+
+struct TreeDiffStats
+{
+    uint64_t diffs;
+    uint64_t nodesHashed;
+    // Subtrees found unchanged by their hash, whose widgets were not compared
+    uint64_t subtreesSkipped;
+    uint64_t nodesCompared;
+    uint64_t nodesChanged;
+    uint64_t nodesRemoved;
+};
+
+// Finds the widgets whose accessibility node has to be sent again after a
+// change that may have touched any of them, such as a relayout or a theme or
+// locale switch. Each widget is hashed over what its node is built from: its
+// handle, role, state, screen rect, name, children and, for a progress bar,
+// range. Color is left out, since it only affects painting. Each subtree is also hashed over its
+// widgets' hashes. The hashes are kept by slot from one diff to the next, and
+// a subtree whose hash has not changed is skipped whole.
+//
+// Both passes run on a pool, with a run of whole subtrees per task (see
+// SplitIntoSubtrees). Each task has its own change list and each thread its
+// own counters, so there are no locks. The lists are joined in run order, so
+// results are in document order whatever the thread count.
+class WidgetTreeDiff
+{
+public:
+    explicit WidgetTreeDiff(size_t nodesPerTask = 4096) : nodesPerTask(nodesPerTask), keptCount(0), stats() {}
+
+    // Compares the model with its state at the previous call, or with an
+    // empty tree the first time, then keeps the current state for the next
+    // call. changed gets the widgets that are new or whose node differs, in
+    // document order. removed gets the handles of widgets that are gone
+    // without their slot being reused.
+    void Diff(WidgetModel& model, WorkStealingPool& pool, std::vector<WidgetId>* changed, std::vector<WidgetId>* removed)
+    {
+        const DerivedData& derived = model.GetDerived();
+        const SlotMap<Widget>& widgets = model.GetWidgets();
+        size_t count = derived.preorder.size();
+        entries.resize(widgets.slotCount());
+        nodeHashes.resize(count);
+        subtreeHashes.resize(count);
+        SplitIntoSubtrees(derived, nodesPerTask, &runs);
+        if (taskLists.size() < runs.size())
+        {
+            taskLists.resize(runs.size());
+        }
+        threadCounts.assign(pool.GetThreadCount(), Counts());
+
+        // Hash every widget, and every subtree that lies inside one run, from
+        // the back so that children come before their parents
+        pool.ForEach(runs.size(), [&](size_t run, size_t thread) {
+            uint32_t begin = runs[run].first;
+            for (uint32_t p = runs[run].second; p-- > begin;)
+            {
+                nodeHashes[p] = HashNode(model, derived, p);
+                if (derived.subtreeSize[p] <= nodesPerTask)
+                {
+                    subtreeHashes[p] = HashSubtree(derived, p);
+                }
+            }
+            threadCounts[thread].hashed += runs[run].second - begin;
+        });
+        // Roots split across runs are few and their children are all done
+        for (size_t run = runs.size(); run-- > 0;)
+        {
+            for (uint32_t p = runs[run].second; p-- > runs[run].first;)
+            {
+                if (derived.subtreeSize[p] > nodesPerTask)
+                {
+                    subtreeHashes[p] = HashSubtree(derived, p);
+                }
+            }
+        }
+
+        // Compare against the kept hashes, replacing them as we go. Each slot
+        // belongs to one position, so tasks never write the same entry.
+        pool.ForEach(runs.size(), [&](size_t run, size_t thread) {
+            std::vector<WidgetId>& list = taskLists[run];
+            list.clear();
+            Counts& counts = threadCounts[thread];
+            uint32_t end = runs[run].second;
+            for (uint32_t p = runs[run].first; p < end;)
+            {
+                WidgetId id = derived.preorder[p];
+                Entry& entry = entries[id.index];
+                if (entry.generation == id.generation && entry.subtree == subtreeHashes[p])
+                {
+                    counts.skipped++;
+                    p += derived.subtreeSize[p];
+                    continue;
+                }
+                counts.compared++;
+                counts.added += entry.generation == 0 ? 1 : 0;
+                if (entry.generation != id.generation || entry.node != nodeHashes[p])
+                {
+                    list.push_back(id);
+                }
+                entry = { id.generation, nodeHashes[p], subtreeHashes[p] };
+                p++;
+            }
+        });
+
+        changed->clear();
+        for (size_t run = 0; run < runs.size(); run++)
+        {
+            changed->insert(changed->end(), taskLists[run].begin(), taskLists[run].end());
+        }
+
+        for (const Counts& counts : threadCounts)
+        {
+            keptCount += counts.added;
+            stats.nodesHashed += counts.hashed;
+            stats.subtreesSkipped += counts.skipped;
+            stats.nodesCompared += counts.compared;
+        }
+
+        // Slots that held a widget last time and are free now; every other
+        // kept entry is a live widget, so the scan only runs after removals
+        removed->clear();
+        for (uint32_t slot = 0; keptCount > widgets.size() && slot < entries.size(); slot++)
+        {
+            if (entries[slot].generation != 0 && widgets.handleAtSlot(slot) == INVALID_SLOT_HANDLE)
+            {
+                removed->push_back({ slot, entries[slot].generation });
+                entries[slot] = Entry();
+                keptCount--;
+            }
+        }
+
+        stats.nodesChanged += changed->size();
+        stats.nodesRemoved += removed->size();
+        stats.diffs++;
+    }
+
+    // Keeps the current tree as the state the next diff compares with, for a
+    // tree that was just sent whole, hashing it inside the pass that built
+    // its nodes rather than in a pass of its own. Call BeginSeed, then
+    // SeedRun for every run of SplitIntoSubtrees(derived, target, ...), from
+    // any thread, then EndSeed once they are all done.
+    void BeginSeed(WidgetModel& model)
+    {
+        const DerivedData& derived = model.GetDerived();
+        entries.assign(model.GetWidgets().slotCount(), Entry());
+        nodeHashes.resize(derived.preorder.size());
+        subtreeHashes.resize(derived.preorder.size());
+        keptCount = 0;
+    }
+
+    void SeedRun(const WidgetModel& model, const DerivedData& derived, uint32_t begin, uint32_t end, size_t target)
+    {
+        for (uint32_t p = end; p-- > begin;)
+        {
+            nodeHashes[p] = HashNode(model, derived, p);
+            if (derived.subtreeSize[p] <= target)
+            {
+                Keep(derived, p);
+            }
+        }
+    }
+
+    // Finishes the roots that were split across runs, whose children are
+    // all done by now.
+    void EndSeed(const DerivedData& derived, size_t target)
+    {
+        for (uint32_t p = static_cast<uint32_t>(derived.preorder.size()); p-- > 0;)
+        {
+            if (derived.subtreeSize[p] > target)
+            {
+                Keep(derived, p);
+            }
+        }
+        keptCount = derived.preorder.size();
+        stats.nodesHashed += derived.preorder.size();
+    }
+
+    // Forgets the kept state, so the next diff reports every widget.
+    void Reset()
+    {
+        entries.clear();
+        keptCount = 0;
+    }
+
+    const TreeDiffStats& GetStats() const { return stats; }
+
+private:
+    struct Entry
+    {
+        // Zero for a slot with nothing kept; live handles start at one
+        uint32_t generation = 0;
+        uint64_t node = 0;
+        uint64_t subtree = 0;
+    };
+
+    // Per-thread counters, padded so threads do not share a cache line
+    struct alignas(64) Counts
+    {
+        uint64_t hashed = 0;
+        uint64_t skipped = 0;
+        uint64_t compared = 0;
+        uint64_t added = 0;
+    };
+
+    // One multiply per word, so a widget's fields hash in a short dependency
+    // chain; Finish spreads every input bit over the result.
+    static uint64_t Step(uint64_t hash, uint64_t value)
+    {
+        return ((hash << 23 | hash >> 41) ^ value) * 0x9E3779B97F4A7C15ull;
+    }
+
+    static uint64_t Finish(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        return hash ^ (hash >> 33);
+    }
+
+    static uint64_t Pack(int32_t high, int32_t low)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(high)) << 32) | static_cast<uint32_t>(low);
+    }
+
+    static uint64_t Bits(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // Reads the pre-order columns rather than the widget, which is only
+    // touched for the range of a progress bar.
+    static uint64_t HashNode(const WidgetModel& model, const DerivedData& derived, uint32_t p)
+    {
+        WidgetId id = derived.preorder[p];
+        const WidgetRect& rect = derived.bounds[p];
+        uint64_t hash = Step(0, Pack(id.index, id.generation));
+        hash = Step(hash, static_cast<uint64_t>(derived.roles[p]) << 8 | derived.states[p]);
+        hash = Step(hash, Pack(rect.left, rect.top));
+        hash = Step(hash, Pack(rect.right, rect.bottom));
+        if (derived.roles[p] == WidgetRole::ProgressBar)
+        {
+            const Widget& widget = *model.Get(id);
+            hash = Step(hash, Bits(widget.value));
+            hash = Step(hash, Bits(widget.minimum));
+            hash = Step(hash, Bits(widget.maximum));
+        }
+
+        // The name from the UTF-8 column, eight bytes per word
+        const std::string& name = derived.utf8Names[id.index];
+        hash = Step(hash, name.size());
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= name.size(); i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, name.data() + i, sizeof(word));
+            hash = Step(hash, word);
+        }
+        if (i < name.size())
+        {
+            uint64_t word = 0;
+            memcpy(&word, name.data() + i, name.size() - i);
+            hash = Step(hash, word);
+        }
+
+        // Children are the subtrees that follow p
+        uint32_t end = p + derived.subtreeSize[p];
+        for (uint32_t child = p + 1; child < end; child += derived.subtreeSize[child])
+        {
+            hash = Step(hash, Pack(derived.preorder[child].index, derived.preorder[child].generation));
+        }
+        return Finish(hash);
+    }
+
+    void Keep(const DerivedData& derived, uint32_t p)
+    {
+        subtreeHashes[p] = HashSubtree(derived, p);
+        WidgetId id = derived.preorder[p];
+        entries[id.index] = { id.generation, nodeHashes[p], subtreeHashes[p] };
+    }
+
+    // Combines the widget at p with its children's subtree hashes, which
+    // must already be set; children's subtrees follow each other after p.
+    uint64_t HashSubtree(const DerivedData& derived, uint32_t p) const
+    {
+        uint64_t hash = nodeHashes[p];
+        uint32_t end = p + derived.subtreeSize[p];
+        for (uint32_t child = p + 1; child < end; child += derived.subtreeSize[child])
+        {
+            hash = Step(hash, subtreeHashes[child]);
+        }
+        return Finish(hash);
+    }
+
+    size_t nodesPerTask;
+    // Kept state, by slot
+    std::vector<Entry> entries;
+    // Entries with a generation set
+    size_t keptCount;
+    // This diff's hashes, by pre-order position
+    std::vector<uint64_t> nodeHashes;
+    std::vector<uint64_t> subtreeHashes;
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    std::vector<std::vector<WidgetId>> taskLists;
+    std::vector<Counts> threadCounts;
+    TreeDiffStats stats;
+};
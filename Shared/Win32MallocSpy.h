@@ -0,0 +1,77 @@
+#pragma once
+
+#include <windows.h>
+#include <objbase.h>
+#include "AllocationCounter.h"
+
+// Counts COM task memory to the calling thread's AllocationCounts: the BSTRs,
+// SAFEARRAYs and VARIANT contents providers hand to clients, which do not go
+// through operator new. Register after CoInitialize with Register() and
+// revoke before CoUninitialize. OLE keeps a cache of freed BSTRs that skips
+// the allocator; run with OANOCACHE=1 so every BSTR is counted.
+class MallocSpy : public IMallocSpy
+{
+public:
+    MallocSpy() : refCount(1), registered(false) {}
+
+    bool Register()
+    {
+        registered = SUCCEEDED(CoRegisterMallocSpy(this));
+        return registered;
+    }
+
+    void Revoke()
+    {
+        if (registered)
+        {
+            CoRevokeMallocSpy();
+            registered = false;
+        }
+    }
+
+    // IUnknown methods
+    ULONG STDMETHODCALLTYPE AddRef() { return InterlockedIncrement(&refCount); }
+    ULONG STDMETHODCALLTYPE Release()
+    {
+        // Lives as long as the program; COM only borrows it
+        return InterlockedDecrement(&refCount);
+    }
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppInterface)
+    {
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IMallocSpy))
+        {
+            *ppInterface = static_cast<IMallocSpy*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppInterface = NULL;
+        return E_NOINTERFACE;
+    }
+
+    // IMallocSpy methods; only allocations are counted, the rest pass through
+    SIZE_T STDMETHODCALLTYPE PreAlloc(SIZE_T cbRequest)
+    {
+        CountAllocation(cbRequest);
+        return cbRequest;
+    }
+    void* STDMETHODCALLTYPE PostAlloc(void* pActual) { return pActual; }
+    void* STDMETHODCALLTYPE PreFree(void* pRequest, BOOL fSpyed) { return pRequest; }
+    void STDMETHODCALLTYPE PostFree(BOOL fSpyed) {}
+    SIZE_T STDMETHODCALLTYPE PreRealloc(void* pRequest, SIZE_T cbRequest, void** ppNewRequest, BOOL fSpyed)
+    {
+        CountAllocation(cbRequest);
+        *ppNewRequest = pRequest;
+        return cbRequest;
+    }
+    void* STDMETHODCALLTYPE PostRealloc(void* pActual, BOOL fSpyed) { return pActual; }
+    void* STDMETHODCALLTYPE PreGetSize(void* pRequest, BOOL fSpyed) { return pRequest; }
+    SIZE_T STDMETHODCALLTYPE PostGetSize(SIZE_T cbActual, BOOL fSpyed) { return cbActual; }
+    void* STDMETHODCALLTYPE PreDidAlloc(void* pRequest, BOOL fSpyed) { return pRequest; }
+    int STDMETHODCALLTYPE PostDidAlloc(void* pRequest, BOOL fSpyed, int fActual) { return fActual; }
+    void STDMETHODCALLTYPE PreHeapMinimize() {}
+    void STDMETHODCALLTYPE PostHeapMinimize() {}
+
+private:
+    LONG refCount;
+    bool registered;
+};
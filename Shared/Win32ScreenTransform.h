@@ -0,0 +1,49 @@
+#pragma once
+
+#include <windows.h>
+#include "ScreenTransform.h"
+
+// Reads the client-to-screen mapping of a window. Hosts refresh the model's
+// copy when ChangesScreenTransform says a message may have moved it.
+inline ScreenTransform QueryScreenTransform(HWND hwnd)
+{
+    POINT origin = { 0, 0 };
+    ClientToScreen(hwnd, &origin);
+    return { static_cast<int32_t>(origin.x), static_cast<int32_t>(origin.y), GetDpiForWindow(hwnd) };
+}
+
+// Maps a screen point, as UIA and MSAA hit tests pass it, to layout coordinates.
+inline POINT ScreenToLayout(const ScreenTransform& transform, POINT pt)
+{
+    int32_t x, y;
+    transform.ToLayout(pt.x, pt.y, &x, &y);
+    return { x, y };
+}
+
+// Maps a client point, as mouse messages carry it, to layout coordinates.
+inline POINT ClientToLayout(const ScreenTransform& transform, POINT pt)
+{
+    return ScreenToLayout(transform, { pt.x + transform.originX, pt.y + transform.originY });
+}
+
+// Declares per-monitor DPI awareness, so GetDpiForWindow reports each
+// monitor's DPI and windows get WM_DPICHANGED instead of being bitmap
+// stretched. Call before creating any window.
+inline void EnablePerMonitorDpiAwareness()
+{
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+}
+
+// Resizes a window to the rect Windows suggests with WM_DPICHANGED, keeping
+// its physical size on the new monitor.
+inline void ApplySuggestedDpiRect(HWND hwnd, LPARAM lParam)
+{
+    const RECT* suggested = reinterpret_cast<const RECT*>(lParam);
+    SetWindowPos(hwnd, NULL, suggested->left, suggested->top, suggested->right - suggested->left, suggested->bottom - suggested->top,
+        SWP_NOZORDER | SWP_NOACTIVATE);
+}
+
+inline bool ChangesScreenTransform(UINT msg)
+{
+    return msg == WM_MOVE || msg == WM_SIZE || msg == WM_DPICHANGED;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <windows.h>
+#include "HostWindowManager.h"
+
+// Hosts are transparent STATIC children of a parent window. The window text
+// is what screen readers read as the accessible name.
+class Win32WindowSystem : public WindowSystem
+{
+public:
+    Win32WindowSystem(HWND parent) : parent(parent), deferred(NULL) {}
+
+    HostHandle CreateHost(const WidgetRect& rect, const std::wstring& name) override
+    {
+        HWND hwnd = CreateWindowEx(
+            WS_EX_TRANSPARENT, TEXT("STATIC"), name.c_str(),
+            WS_CHILD | WS_VISIBLE,
+            rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top,
+            parent, NULL, GetModuleHandle(NULL), NULL);
+        return hwnd;
+    }
+
+    void DestroyHost(HostHandle host) override
+    {
+        DestroyWindow(static_cast<HWND>(host));
+    }
+
+    void SetHostText(HostHandle host, const std::wstring& name) override
+    {
+        SetWindowText(static_cast<HWND>(host), name.c_str());
+    }
+
+    void BeginMoves(size_t count) override
+    {
+        deferred = BeginDeferWindowPos(static_cast<int>(count));
+    }
+
+    void MoveHost(HostHandle host, const WidgetRect& rect, bool visible) override
+    {
+        UINT flags = SWP_NOZORDER | SWP_NOACTIVATE | (visible ? SWP_SHOWWINDOW : SWP_HIDEWINDOW);
+        if (deferred)
+        {
+            deferred = DeferWindowPos(deferred, static_cast<HWND>(host), NULL, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, flags);
+        }
+        else
+        {
+            // Either BeginMoves failed or a DeferWindowPos did; fall back to moving directly
+            SetWindowPos(static_cast<HWND>(host), NULL, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, flags);
+        }
+    }
+
+    void EndMoves() override
+    {
+        if (deferred)
+        {
+            EndDeferWindowPos(deferred);
+            deferred = NULL;
+        }
+    }
+
+private:
+    HWND parent;
+    HDWP deferred;
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs batches of independent tasks on a fixed set of threads, the calling
+// thread included. Each batch is dealt out as one contiguous range of task
+// indices per thread; a thread works through its own range from the front
+// and, once it runs dry, steals the back half of the next range that still
+// has work, so uneven tasks such as subtrees of different sizes still keep
+// every thread busy. Ranges are guarded by one small lock each, which is
+// only contended while stealing.
+class WorkStealingPool
+{
+public:
+    // threadCount includes the caller; 0 uses one thread per core.
+    explicit WorkStealingPool(size_t threadCount = 0)
+        : generation(0), finishedWorkers(0), stopping(false), task(nullptr), context(nullptr)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+        }
+        ranges.reset(new Range[threadCount]);
+        this->threadCount = threadCount;
+        for (size_t i = 1; i < threadCount; i++)
+        {
+            workers.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t GetThreadCount() const { return threadCount; }
+
+    // Calls run(index, thread) for every index in [0, count) and returns once
+    // all calls have finished. thread is in [0, GetThreadCount()), so callers
+    // can keep per-thread scratch space without locking.
+    template <typename Run>
+    void ForEach(size_t count, Run run)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < threadCount; i++)
+            {
+                std::lock_guard<std::mutex> rangeLock(ranges[i].mutex);
+                ranges[i].begin = count * i / threadCount;
+                ranges[i].end = count * (i + 1) / threadCount;
+            }
+            context = &run;
+            task = [](void* context, size_t index, size_t thread) { (*static_cast<Run*>(context))(index, thread); };
+            finishedWorkers = 0;
+            generation++;
+        }
+        wake.notify_all();
+
+        Work(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return finishedWorkers == workers.size(); });
+        task = nullptr;
+        context = nullptr;
+    }
+
+private:
+    struct Range
+    {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    typedef void (*Task)(void* context, size_t index, size_t thread);
+
+    void WorkerLoop(size_t self)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                {
+                    return;
+                }
+                seen = generation;
+            }
+            Work(self);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finishedWorkers++;
+            }
+            done.notify_one();
+        }
+    }
+
+    void Work(size_t self)
+    {
+        size_t index;
+        while (TakeOwn(self, &index) || Steal(self, &index))
+        {
+            task(context, index, self);
+        }
+    }
+
+    bool TakeOwn(size_t self, size_t* index)
+    {
+        Range& range = ranges[self];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        if (range.begin == range.end)
+        {
+            return false;
+        }
+        *index = range.begin++;
+        return true;
+    }
+
+    // Moves the back half of another thread's range into this thread's
+    // range and takes the first index of it. Victims are tried starting
+    // after self so thieves spread out.
+    bool Steal(size_t self, size_t* index)
+    {
+        for (size_t k = 1; k < threadCount; k++)
+        {
+            Range& victim = ranges[(self + k) % threadCount];
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                size_t left = victim.end - victim.begin;
+                if (left == 0)
+                {
+                    continue;
+                }
+                begin = victim.end - (left + 1) / 2;
+                end = victim.end;
+                victim.end = begin;
+            }
+            Range& own = ranges[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = begin + 1;
+            own.end = end;
+            *index = begin;
+            return true;
+        }
+        return false;
+    }
+
+    size_t threadCount;
+    std::unique_ptr<Range[]> ranges;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation;
+    size_t finishedWorkers;
+    bool stopping;
+    Task task;
+    void* context;
+};
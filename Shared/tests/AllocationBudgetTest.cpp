@@ -0,0 +1,151 @@
+// Holds the provider query paths to their steady-state allocation budgets.
+// The providers themselves need COM, so this drives the model work they do
+// for each kind of call through ModelReplayTarget, the same work TraceReplay
+// reproduces, under a CallScope per call. A first pass lets anything created
+// lazily come into being; the second is counted and checked.
+//
+// Usage: AllocationBudgetTest [items]
+
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include "../CountingAllocator.h"
+#include "../TraceReplay.h"
+
+// Most allocations one steady-state call of a kind may make. A property read
+// copies out its name or value text, as the provider does into a BSTR, and
+// FindItem compiles its condition into a WidgetQuery; nothing else a screen
+// reader asks for needs the heap.
+static const std::initializer_list<AllocationBudget> kBudgets = {
+    { TraceEvent::GetPropertyValue, 1 },
+    { TraceEvent::Navigate, 0 },
+    { TraceEvent::GetBoundingRectangle, 0 },
+    { TraceEvent::ElementFromPoint, 0 },
+    { TraceEvent::GetFocus, 0 },
+    { TraceEvent::FindItem, 4 },
+    { TraceEvent::AccChildCount, 0 },
+    { TraceEvent::AccChild, 0 },
+    { TraceEvent::AccName, 1 },
+    { TraceEvent::AccValue, 1 },
+    { TraceEvent::AccRole, 0 },
+    { TraceEvent::AccState, 0 },
+    { TraceEvent::AccLocation, 0 },
+    { TraceEvent::AccNavigate, 0 },
+    { TraceEvent::AccHitTest, 0 },
+    { TraceEvent::AccFocus, 0 },
+};
+
+static const int64_t kToolbarSlot = 0;
+static const int64_t kProperty = 30005; // UIA_NamePropertyId
+static const int64_t kNextSibling = 3;  // NavigateDirection_NextSibling
+
+static TraceRecord Record(TraceEvent event, std::initializer_list<int64_t> ints, const std::string* text = nullptr)
+{
+    TraceRecord record = {};
+    record.event = event;
+    for (int64_t value : ints)
+    {
+        record.ints[record.intCount++] = value;
+    }
+    if (text)
+    {
+        record.text = text->data();
+        record.textLength = text->size();
+    }
+    return record;
+}
+
+static bool Call(ModelReplayTarget& target, const TraceRecord& record)
+{
+    CallScope scope(record.event);
+    return target.Apply(record);
+}
+
+// One pass of what a screen reader asks of a toolbar and its items
+static bool ReadToolbar(ModelReplayTarget& target, int64_t items)
+{
+    bool applied = true;
+    const int64_t self = kTraceSelf;
+    applied &= Call(target, Record(TraceEvent::GetBoundingRectangle, { kToolbarSlot, self }));
+    applied &= Call(target, Record(TraceEvent::GetFocus, { kToolbarSlot, self }));
+    applied &= Call(target, Record(TraceEvent::AccFocus, { kToolbarSlot, self }));
+    applied &= Call(target, Record(TraceEvent::AccChildCount, { kToolbarSlot, self }));
+    for (int64_t i = 0; i < items; i++)
+    {
+        applied &= Call(target, Record(TraceEvent::GetPropertyValue, { kToolbarSlot, i, kProperty }));
+        applied &= Call(target, Record(TraceEvent::GetBoundingRectangle, { kToolbarSlot, i }));
+        applied &= Call(target, Record(TraceEvent::Navigate, { kToolbarSlot, i, kNextSibling }));
+        applied &= Call(target, Record(TraceEvent::AccChild, { kToolbarSlot, i }));
+        applied &= Call(target, Record(TraceEvent::AccName, { kToolbarSlot, i }));
+        applied &= Call(target, Record(TraceEvent::AccValue, { kToolbarSlot, i }));
+        applied &= Call(target, Record(TraceEvent::AccRole, { kToolbarSlot, i }));
+        applied &= Call(target, Record(TraceEvent::AccState, { kToolbarSlot, i }));
+        applied &= Call(target, Record(TraceEvent::AccLocation, { kToolbarSlot, i }));
+        applied &= Call(target, Record(TraceEvent::AccNavigate, { kToolbarSlot, i, kNextSibling }));
+
+        int64_t x = i * 40 + 20;
+        applied &= Call(target, Record(TraceEvent::ElementFromPoint, { kToolbarSlot, self, x, 20 }));
+        applied &= Call(target, Record(TraceEvent::AccHitTest, { kToolbarSlot, self, x, 20 }));
+    }
+    applied &= Call(target, Record(TraceEvent::FindItem, { kToolbarSlot, self, -1, static_cast<int64_t>(TraceFind::Role), static_cast<int64_t>(WidgetRole::ProgressBar) }));
+    applied &= Call(target, Record(TraceEvent::FindItem, { kToolbarSlot, self, items / 2, static_cast<int64_t>(TraceFind::Enabled), 1 }));
+    return applied;
+}
+
+int main(int argc, char** argv)
+{
+    int64_t items = argc > 1 ? atoll(argv[1]) : 200;
+
+    // Without the counting allocator linked in, every budget would pass
+    AllocationScope probe;
+    std::string* allocated = new std::string(64, 'x');
+    delete allocated;
+    if (!AllocationCountingEnabled() || probe.GetAllocations() == 0)
+    {
+        fprintf(stderr, "allocations are not being counted\n");
+        return 1;
+    }
+
+    // A toolbar of buttons ending in a progress bar, with names long enough
+    // that copying one needs the heap
+    ModelReplayTarget target;
+    std::string name = "Toolbar";
+    target.Apply(Record(TraceEvent::AddWidget, { kToolbarSlot, -1, static_cast<int64_t>(WidgetRole::Toolbar), 0xFFFFFF, 0, 0, items * 40, 40 }, &name));
+    for (int64_t i = 0; i < items; i++)
+    {
+        name = "Toolbar button number " + std::to_string(i);
+        WidgetRole role = i + 1 == items ? WidgetRole::ProgressBar : WidgetRole::Button;
+        target.Apply(Record(TraceEvent::AddWidget, { i + 1, kToolbarSlot, static_cast<int64_t>(role), 0xC0C0C0, i * 40, 0, i * 40 + 40, 40 }, &name));
+    }
+    target.Apply(Record(TraceEvent::SetFocus, { items / 2 + 1 }));
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        ResetCallAllocations();
+        if (!ReadToolbar(target, items))
+        {
+            fprintf(stderr, "a call on the toolbar could not be applied\n");
+            return 1;
+        }
+    }
+
+    for (const AllocationBudget& budget : kBudgets)
+    {
+        const CallAllocations& stats = GetCallAllocations()[static_cast<size_t>(budget.event)];
+        if (stats.calls == 0)
+        {
+            fprintf(stderr, "%s was never called\n", TraceEventName(budget.event));
+            return 1;
+        }
+        printf("%-22s %6llu calls, %.2f allocations each, at most %llu (budget %llu)\n", TraceEventName(budget.event),
+            static_cast<unsigned long long>(stats.calls), static_cast<double>(stats.allocations) / stats.calls,
+            static_cast<unsigned long long>(stats.maxAllocations), static_cast<unsigned long long>(budget.maxAllocations));
+    }
+    size_t over = CheckAllocationBudgets(kBudgets, [](TraceEvent event, uint64_t worst, uint64_t limit)
+    {
+        fprintf(stderr, "over budget: %s made %llu allocations, budget %llu\n", TraceEventName(event),
+            static_cast<unsigned long long>(worst), static_cast<unsigned long long>(limit));
+    });
+    return over == 0 ? 0 : 1;
+}
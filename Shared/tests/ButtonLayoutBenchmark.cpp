@@ -0,0 +1,343 @@
+// Times the AccessKit sample's window state at a size its three buttons
+// never reach, 100k buttons by default, in three layouts: the original one,
+// with buttons behind shared_ptrs and the navbar holding its own copy of the
+// vector; buttons in a SlotMap with the navbar's children as handles and a
+// node id table; and the shared WidgetModel the sample now uses. For each
+// it times setting up the state, building one stub node per button the way
+// the initial tree does, drawing every button in navbar order into a
+// renderer that only sums what it is given, looking buttons up by node id
+// as the press and focus paths do, and tearing the state down. GDI and
+// AccessKit cost the same in every layout, so they are left out; all three
+// must draw and build the same checksum.
+//
+// Usage: ButtonLayoutBenchmark [buttons] [repetitions] [lookups]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../SlotMap.h"
+#include "../WidgetModel.h"
+#include "../WidgetPainter.h"
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Adds up what it is asked to draw, so the walk cannot be optimized away
+class ChecksumRenderer : public Renderer
+{
+public:
+    uint64_t sum = 0;
+
+    void FillRect(const WidgetRect& rect, uint32_t color) override { sum += rect.left + rect.top + color; }
+    void BlendRect(const WidgetRect& rect, uint32_t color, uint8_t alpha) override { sum += rect.left + color + alpha; }
+    void DrawLabel(const WidgetRect& rect, const std::wstring& text, const FontDesc&, uint32_t) override { sum += rect.right + text.size(); }
+};
+
+// What a node builder is handed for a button
+struct StubNode
+{
+    double bounds[4];
+    std::string name;
+    std::vector<uint64_t> children;
+};
+
+static uint64_t Checksum(const std::vector<StubNode>& nodes)
+{
+    uint64_t sum = 0;
+    for (const StubNode& node : nodes)
+    {
+        sum += static_cast<uint64_t>(node.bounds[0] + node.bounds[3]) + node.name.size() + node.children.size();
+    }
+    return sum;
+}
+
+struct Button
+{
+    uint64_t id;
+    std::string name;
+    std::wstring label;
+    WidgetRect rect;
+    uint32_t color;
+};
+
+static Button MakeButton(size_t i)
+{
+    int32_t x = static_cast<int32_t>(i % 40) * 80;
+    int32_t y = static_cast<int32_t>(i / 40) * 30;
+    std::string name = "Button " + std::to_string(i);
+    return { 2 + i, name, std::wstring(name.begin(), name.end()), { x, y, x + 76, y + 26 }, 0xC8C8C8 };
+}
+
+static void BuildButton(const Button& button, StubNode* node)
+{
+    node->bounds[0] = button.rect.left;
+    node->bounds[1] = button.rect.top;
+    node->bounds[2] = button.rect.right;
+    node->bounds[3] = button.rect.bottom;
+    node->name = button.name;
+}
+
+static void DrawButton(Renderer& renderer, const Button& button)
+{
+    renderer.FillRect(button.rect, button.color);
+    renderer.DrawLabel(button.rect, button.label, kDefaultFont, 0x000000);
+}
+
+struct Times
+{
+    double setup;
+    double build;
+    double draw;
+    double lookup;
+    double teardown;
+    uint64_t buildSum;
+    uint64_t drawSum;
+    uint64_t lookupSum;
+};
+
+// The original layout
+struct SharedNavbar
+{
+    std::vector<std::shared_ptr<Button>> buttons;
+};
+
+struct SharedState
+{
+    std::shared_ptr<SharedNavbar> navbar;
+    std::vector<std::shared_ptr<Button>> buttons;
+};
+
+static void TimeShared(size_t count, const std::vector<uint64_t>& lookups, Times* times)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SharedState* state = new SharedState;
+    for (size_t i = 0; i < count; i++)
+    {
+        state->buttons.push_back(std::make_shared<Button>(MakeButton(i)));
+    }
+    state->navbar = std::make_shared<SharedNavbar>();
+    state->navbar->buttons = state->buttons;
+    times->setup += MillisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<StubNode> nodes(count + 1);
+    for (const std::shared_ptr<Button>& button : state->navbar->buttons)
+    {
+        nodes[0].children.push_back(button->id);
+    }
+    for (size_t i = 0; i < state->buttons.size(); i++)
+    {
+        BuildButton(*state->buttons[i], &nodes[i + 1]);
+    }
+    times->build += MillisecondsSince(start);
+    times->buildSum = Checksum(nodes);
+
+    ChecksumRenderer renderer;
+    start = std::chrono::steady_clock::now();
+    for (const std::shared_ptr<Button>& button : state->navbar->buttons)
+    {
+        DrawButton(renderer, *button);
+    }
+    times->draw += MillisecondsSince(start);
+    times->drawSum = renderer.sum;
+
+    // There was no lookup by id, only a walk of the buttons
+    uint64_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t id : lookups)
+    {
+        for (const std::shared_ptr<Button>& button : state->buttons)
+        {
+            if (button->id == id)
+            {
+                found += button->rect.left;
+                break;
+            }
+        }
+    }
+    times->lookup += MillisecondsSince(start);
+    times->lookupSum = found;
+
+    start = std::chrono::steady_clock::now();
+    delete state;
+    times->teardown += MillisecondsSince(start);
+}
+
+// Dense buttons, handle children and a node id table
+struct SlotNavbar
+{
+    std::vector<SlotHandle> buttons;
+};
+
+struct SlotState
+{
+    SlotMap<Button> buttons;
+    SlotNavbar navbar;
+    std::vector<SlotHandle> byNodeId;
+};
+
+static void TimeSlots(size_t count, const std::vector<uint64_t>& lookups, Times* times)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SlotState* state = new SlotState;
+    state->buttons.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        Button button = MakeButton(i);
+        uint64_t id = button.id;
+        SlotHandle handle = state->buttons.insert(std::move(button));
+        state->navbar.buttons.push_back(handle);
+        if (id >= state->byNodeId.size())
+        {
+            state->byNodeId.resize(id + 1, INVALID_SLOT_HANDLE);
+        }
+        state->byNodeId[id] = handle;
+    }
+    times->setup += MillisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<StubNode> nodes(count + 1);
+    for (SlotHandle handle : state->navbar.buttons)
+    {
+        nodes[0].children.push_back(state->buttons.get(handle)->id);
+    }
+    for (size_t i = 0; i < state->buttons.size(); i++)
+    {
+        BuildButton(state->buttons[i], &nodes[i + 1]);
+    }
+    times->build += MillisecondsSince(start);
+    times->buildSum = Checksum(nodes);
+
+    ChecksumRenderer renderer;
+    start = std::chrono::steady_clock::now();
+    for (SlotHandle handle : state->navbar.buttons)
+    {
+        DrawButton(renderer, *state->buttons.get(handle));
+    }
+    times->draw += MillisecondsSince(start);
+    times->drawSum = renderer.sum;
+
+    uint64_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t id : lookups)
+    {
+        found += state->buttons.get(state->byNodeId[id])->rect.left;
+    }
+    times->lookup += MillisecondsSince(start);
+    times->lookupSum = found;
+
+    start = std::chrono::steady_clock::now();
+    delete state;
+    times->teardown += MillisecondsSince(start);
+}
+
+// The shared model, with node ids following the slot indices as the sample
+// numbers them
+static void TimeModel(size_t count, const std::vector<uint64_t>& lookups, Times* times)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    WidgetModel* model = new WidgetModel;
+    WidgetId navbar = model->AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, 3200, 30000 }, L"Navbar", 0x0000FF);
+    for (size_t i = 0; i < count; i++)
+    {
+        Button button = MakeButton(i);
+        model->AddWidget(navbar, WidgetRole::Button, button.rect, button.label, button.color);
+    }
+    const DerivedData& derived = model->GetDerived();
+    times->setup += MillisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<StubNode> nodes(count + 1);
+    const Widget& bar = *model->Get(navbar);
+    for (WidgetId child : bar.children)
+    {
+        nodes[0].children.push_back(1 + child.index);
+    }
+    for (size_t i = 0; i < bar.children.size(); i++)
+    {
+        WidgetId child = bar.children[i];
+        const WidgetRect& rect = derived.screenRects[child.index];
+        StubNode& node = nodes[i + 1];
+        node.bounds[0] = rect.left;
+        node.bounds[1] = rect.top;
+        node.bounds[2] = rect.right;
+        node.bounds[3] = rect.bottom;
+        node.name = derived.utf8Names[child.index];
+    }
+    times->build += MillisecondsSince(start);
+    times->buildSum = Checksum(nodes);
+
+    // The buttons alone, as the other layouts draw them
+    ChecksumRenderer renderer;
+    start = std::chrono::steady_clock::now();
+    for (WidgetId child : bar.children)
+    {
+        PaintWidget(renderer, *model->Get(child));
+    }
+    times->draw += MillisecondsSince(start);
+    times->drawSum = renderer.sum;
+
+    uint64_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t id : lookups)
+    {
+        found += model->Get(model->GetWidgets().handleAtSlot(static_cast<uint32_t>(id - 1)))->rect.left;
+    }
+    times->lookup += MillisecondsSince(start);
+    times->lookupSum = found;
+
+    start = std::chrono::steady_clock::now();
+    delete model;
+    times->teardown += MillisecondsSince(start);
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t repetitions = argc > 2 ? strtoul(argv[2], nullptr, 10) : 5;
+    size_t lookupCount = argc > 3 ? strtoul(argv[3], nullptr, 10) : 2000;
+    if (count == 0 || repetitions == 0)
+    {
+        fprintf(stderr, "need at least one button and one repetition\n");
+        return 1;
+    }
+
+    // Ids as the sample numbers them: the window and navbar come first
+    std::vector<uint64_t> lookups;
+    for (size_t i = 0; i < lookupCount; i++)
+    {
+        lookups.push_back(2 + (i * 7919) % count);
+    }
+
+    Times shared = {};
+    Times slots = {};
+    Times model = {};
+    for (size_t r = 0; r < repetitions; r++)
+    {
+        TimeShared(count, lookups, &shared);
+        TimeSlots(count, lookups, &slots);
+        TimeModel(count, lookups, &model);
+    }
+    if (slots.buildSum != shared.buildSum || slots.drawSum != shared.drawSum || slots.lookupSum != shared.lookupSum
+        || model.buildSum != shared.buildSum || model.drawSum != shared.drawSum || model.lookupSum != shared.lookupSum)
+    {
+        fprintf(stderr, "the layouts built, drew or found different buttons\n");
+        return 1;
+    }
+
+    printf("%zu buttons, %zu lookups by node id, mean of %zu runs, ms\n", count, lookupCount, repetitions);
+    printf("%-14s %10s %10s %10s %10s %10s\n", "layout", "setup", "build", "draw", "lookup", "teardown");
+    const Times* all[] = { &shared, &slots, &model };
+    const char* names[] = { "shared_ptr", "slot map", "widget model" };
+    for (size_t i = 0; i < 3; i++)
+    {
+        printf("%-14s %10.2f %10.2f %10.2f %10.3f %10.2f\n", names[i], all[i]->setup / repetitions, all[i]->build / repetitions,
+            all[i]->draw / repetitions, all[i]->lookup / repetitions, all[i]->teardown / repetitions);
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Measures what a CompactWidgetTree saves over the live WidgetModel on a
+// large tree, a million widgets by default: bytes per node for each, by
+// category, once with a few names repeated across the tree and once with a
+// name for every widget. Also times Encode, Decode, and reading every rect
+// back with GetRect, which walks to the root, against the single pass Decode
+// makes. The decoded model must encode to the same node count and rects.
+//
+// Usage: CompactWidgetTreeBenchmark [widgets] [spine depth] [seed]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../CompactWidgetTree.h"
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void PrintUsage(const char* what, const MemoryUsage& usage)
+{
+    printf("%-22s %8.1f B/node:", what, usage.GetTotalPerNode());
+    for (size_t c = 0; c < MemoryUsage::kCategoryCount; c++)
+    {
+        MemoryCategory category = static_cast<MemoryCategory>(c);
+        if (usage.Get(category))
+        {
+            printf(" %s %.1f", MemoryUsage::GetCategoryName(category), usage.GetPerNode(category));
+        }
+    }
+    printf("\n");
+}
+
+// A spine of the given depth with the rest attached at random below it,
+// each widget placed a little inside its parent
+static void Build(WidgetModel& model, size_t count, size_t spine, bool uniqueNames, unsigned seed)
+{
+    static const wchar_t* const kNames[] = { L"OK", L"Cancel", L"Apply", L"Item", L"Close", L"Settings", L"Open file", L"Save as" };
+    std::mt19937 random(seed);
+    std::vector<WidgetId> widgets;
+    widgets.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        WidgetId parent = i == 0 ? kNoWidget : i < spine ? widgets.back() : widgets[random() % widgets.size()];
+        WidgetRect origin = parent == kNoWidget ? WidgetRect{ 0, 0, 0, 0 } : model.Get(parent)->rect;
+        int32_t x = origin.left + static_cast<int32_t>(random() % 400);
+        int32_t y = origin.top + static_cast<int32_t>(random() % 300);
+        WidgetRole role = static_cast<WidgetRole>(random() % 4);
+        std::wstring name = uniqueNames ? L"Widget " + std::to_wstring(i) : kNames[random() % 8];
+        WidgetId id = model.AddWidget(parent, role, { x, y, x + 80, y + 24 }, name, random() % 4 == 0 ? 0xFFFFFF : 0xF0F0F0);
+        if (role == WidgetRole::ProgressBar && random() % 2 == 0)
+        {
+            model.SetValue(id, static_cast<double>(random() % 100));
+        }
+        widgets.push_back(id);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t spine = argc > 2 ? strtoul(argv[2], nullptr, 10) : 50;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+    if (spine == 0 || count < spine)
+    {
+        fprintf(stderr, "need a spine at least one deep and no longer than the tree\n");
+        return 1;
+    }
+
+    printf("%zu widgets, spine %zu deep\n", count, spine);
+    for (int unique = 0; unique < 2; unique++)
+    {
+        WidgetModel model;
+        Build(model, count, spine, unique != 0, seed);
+        model.GetDerived();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        CompactWidgetTree tree(model);
+        double encodeMs = MillisecondsSince(start);
+
+        WidgetModel decoded;
+        start = std::chrono::steady_clock::now();
+        tree.Decode(&decoded);
+        double decodeMs = MillisecondsSince(start);
+
+        // What Decode cost when it read each rect with GetRect
+        int64_t sum = 0;
+        start = std::chrono::steady_clock::now();
+        for (uint32_t p = 0; p < tree.GetNodeCount(); p++)
+        {
+            WidgetRect rect = tree.GetRect(p);
+            sum += rect.left + rect.bottom;
+        }
+        double walkMs = MillisecondsSince(start);
+
+        CompactWidgetTree again(decoded);
+        for (uint32_t p = 0; p < tree.GetNodeCount() && again.GetNodeCount() == tree.GetNodeCount(); p++)
+        {
+            WidgetRect a = tree.GetRect(p);
+            WidgetRect b = again.GetRect(p);
+            if (a.left != b.left || a.top != b.top || a.right != b.right || a.bottom != b.bottom)
+            {
+                fprintf(stderr, "node %u decoded to a different rect\n", p);
+                return 1;
+            }
+        }
+        if (again.GetNodeCount() != tree.GetNodeCount())
+        {
+            fprintf(stderr, "decoding gave %zu widgets, expected %zu\n", again.GetNodeCount(), tree.GetNodeCount());
+            return 1;
+        }
+
+        printf("\n%s names, %zu distinct (checksum %lld)\n", unique ? "unique" : "repeated", tree.GetDistinctNameCount(), static_cast<long long>(sum));
+        PrintUsage("live model", model.GetMemoryUsage());
+        PrintUsage("compact tree", tree.GetMemoryUsage());
+        printf("%-22s %8.1f ms\n", "encode", encodeMs);
+        printf("%-22s %8.1f ms\n", "decode", decodeMs);
+        printf("%-22s %8.1f ms\n", "GetRect every node", walkMs);
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Encodes random forests into a CompactWidgetTree and checks that every node
+// reads back as its widget, and that Decode rebuilds the same widgets in the
+// same places, as roots and under an existing widget. The forests have
+// rects too far from their parents for 16 bits, names outside the BMP and
+// repeated names, widgets off their default range, disabled widgets and more
+// colors than the palette holds, so every side table is used. Encoding the
+// decoded model again must give the same tree.
+//
+// Usage: CompactWidgetTreeTest [widgets] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../CompactWidgetTree.h"
+
+static bool SameRect(const WidgetRect& a, const WidgetRect& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+static bool SameWidget(const Widget& a, const Widget& b)
+{
+    return a.role == b.role && SameRect(a.rect, b.rect) && a.name == b.name && a.color == b.color && a.enabled == b.enabled
+        && a.focusable == b.focusable && a.value == b.value && a.minimum == b.minimum && a.maximum == b.maximum;
+}
+
+// Each node of the tree reads back as the widget at its position.
+static bool Matches(const CompactWidgetTree& tree, WidgetModel& model)
+{
+    const DerivedData& data = model.GetDerived();
+    if (tree.GetNodeCount() != data.preorder.size())
+    {
+        fprintf(stderr, "%zu nodes for %zu widgets\n", tree.GetNodeCount(), data.preorder.size());
+        return false;
+    }
+    for (uint32_t p = 0; p < tree.GetNodeCount(); p++)
+    {
+        const Widget& widget = *model.Get(data.preorder[p]);
+        uint32_t parent = widget.parent == kNoWidget ? CompactWidgetTree::kNoNode : data.preorderPosition[widget.parent.index];
+        if (tree.GetParent(p) != parent || tree.GetSubtreeSize(p) != data.subtreeSize[p] || tree.GetRole(p) != widget.role
+            || !SameRect(tree.GetRect(p), widget.rect) || tree.GetName(p) != widget.name || tree.GetColor(p) != widget.color
+            || tree.IsEnabled(p) != widget.enabled || tree.IsFocusable(p) != widget.focusable || tree.GetValue(p) != widget.value
+            || tree.GetMinimum(p) != widget.minimum || tree.GetMaximum(p) != widget.maximum)
+        {
+            fprintf(stderr, "node %u does not read back as widget %u\n", p, data.preorder[p].index);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The widgets under root in a match those under root in b, in order.
+static bool SameSubtree(WidgetModel& a, WidgetId rootA, WidgetModel& b, WidgetId rootB)
+{
+    std::vector<std::pair<WidgetId, WidgetId>> pending = { { rootA, rootB } };
+    while (!pending.empty())
+    {
+        const Widget& widgetA = *a.Get(pending.back().first);
+        const Widget& widgetB = *b.Get(pending.back().second);
+        pending.pop_back();
+        if (!SameWidget(widgetA, widgetB) || widgetA.children.size() != widgetB.children.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < widgetA.children.size(); i++)
+        {
+            pending.push_back({ widgetA.children[i], widgetB.children[i] });
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 70000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], nullptr, 10)) : 1;
+
+    static const wchar_t* const kNames[] = { L"OK", L"Cancel", L"", L"État", L"\U0001F600 smile", L"Item" };
+    std::mt19937 random(seed);
+    WidgetModel model;
+    std::vector<WidgetId> widgets;
+    for (size_t i = 0; i < count; i++)
+    {
+        WidgetId parent = widgets.empty() || random() % 30 == 0 ? kNoWidget : widgets[random() % widgets.size()];
+        WidgetRole role = static_cast<WidgetRole>(random() % 4);
+        // Mostly near the parent, sometimes far beyond 16 bits or negative
+        WidgetRect origin = parent == kNoWidget ? WidgetRect{ 0, 0, 0, 0 } : model.Get(parent)->rect;
+        int32_t spread = random() % 50 == 0 ? 200000 : 2000;
+        int32_t x = origin.left + static_cast<int32_t>(random() % (2 * spread)) - spread;
+        int32_t y = origin.top + static_cast<int32_t>(random() % (2 * spread)) - spread;
+        WidgetRect rect = { x, y, x + static_cast<int32_t>(random() % 500), y + static_cast<int32_t>(random() % 100) };
+        std::wstring name = random() % 3 == 0 ? kNames[random() % 6] + std::to_wstring(i) : kNames[random() % 6];
+        // More distinct colors than fit in the palette
+        uint32_t color = random() % 2 == 0 ? static_cast<uint32_t>(i) : 0xC0C0C0;
+        WidgetId id = model.AddWidget(parent, role, rect, name, color);
+        if (random() % 7 == 0)
+        {
+            model.SetEnabled(id, false);
+        }
+        if (role == WidgetRole::ProgressBar && random() % 2 == 0)
+        {
+            model.SetRange(id, -5, 250.5);
+            model.SetValue(id, static_cast<double>(random() % 256) - 5);
+        }
+        widgets.push_back(id);
+    }
+
+    CompactWidgetTree tree(model);
+    if (!Matches(tree, model))
+    {
+        return 1;
+    }
+
+    // Decoded as roots, the forest comes back whole
+    WidgetModel decoded;
+    std::vector<WidgetId> ids = tree.Decode(&decoded);
+    if (decoded.GetRoots().size() != model.GetRoots().size() || ids.size() != count)
+    {
+        fprintf(stderr, "decoding made %zu roots and %zu widgets, expected %zu and %zu\n", decoded.GetRoots().size(), ids.size(),
+            model.GetRoots().size(), count);
+        return 1;
+    }
+    for (size_t i = 0; i < model.GetRoots().size(); i++)
+    {
+        if (!SameSubtree(model, model.GetRoots()[i], decoded, decoded.GetRoots()[i]))
+        {
+            fprintf(stderr, "root %zu decoded differently\n", i);
+            return 1;
+        }
+    }
+    if (!Matches(CompactWidgetTree(decoded), model))
+    {
+        fprintf(stderr, "encoding the decoded model gave a different tree\n");
+        return 1;
+    }
+
+    // Decoded under a widget, the roots become its children
+    WidgetModel host;
+    WidgetId container = host.AddWidget(kNoWidget, WidgetRole::Window, { 10, 10, 500, 500 }, L"Host", 0);
+    tree.Decode(&host, container);
+    if (host.GetChildCount(container) != model.GetRoots().size()
+        || !SameSubtree(model, model.GetRoots().back(), host, host.GetChild(container, host.GetChildCount(container) - 1)))
+    {
+        fprintf(stderr, "decoding under a widget went wrong\n");
+        return 1;
+    }
+
+    MemoryUsage usage = tree.GetMemoryUsage();
+    printf("%zu widgets round-tripped through %.1f bytes per node, %zu distinct names\n", count, usage.GetTotalPerNode(), tree.GetDistinctNameCount());
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Records random fills, blends and labels in a DrawBatch and checks that the
+// flushed calls draw every primitive once, with each one after every earlier
+// primitive it overlaps. Then times a long row of items side by side, which
+// has to stay linear in the row's length.
+//
+// Usage: DrawBatchTest [primitives] [seed] [row length]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "../DrawBatch.h"
+
+struct Primitive
+{
+    int kind;
+    WidgetRect rect;
+    uint32_t color;
+};
+
+static std::tuple<int, int32_t, int32_t, int32_t, int32_t, uint32_t> KeyOf(const Primitive& primitive)
+{
+    const WidgetRect& r = primitive.rect;
+    return std::make_tuple(primitive.kind, r.left, r.top, r.right, r.bottom, primitive.color);
+}
+
+class RecordingRenderer : public Renderer
+{
+public:
+    void FillRect(const WidgetRect& rect, uint32_t color) override { drawn.push_back({ 0, rect, color }); }
+    void BlendRect(const WidgetRect& rect, uint32_t color, uint8_t) override { drawn.push_back({ 1, rect, color }); }
+    void DrawLabel(const WidgetRect& rect, const std::wstring&, const FontDesc&, uint32_t color) override { drawn.push_back({ 2, rect, color }); }
+
+    std::vector<Primitive> drawn;
+};
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 3000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], nullptr, 10)) : 7;
+    size_t rowLength = argc > 3 ? strtoul(argv[3], nullptr, 10) : 100000;
+
+    // Small rects in a few colors, so runs merge, with the odd large one and
+    // some at negative coordinates; no two are alike, so each call maps back
+    // to one primitive
+    std::mt19937 random(seed);
+    std::vector<Primitive> recorded;
+    std::map<std::tuple<int, int32_t, int32_t, int32_t, int32_t, uint32_t>, size_t> positions;
+    DrawBatch batch;
+    const std::wstring text = L"label";
+    while (recorded.size() < count)
+    {
+        Primitive primitive;
+        primitive.kind = static_cast<int>(random() % 3);
+        int32_t size = random() % 20 == 0 ? 600 : 40;
+        int32_t left = static_cast<int32_t>(random() % 1400) - 200;
+        int32_t top = static_cast<int32_t>(random() % 1000) - 200;
+        primitive.rect = { left, top, left + 1 + static_cast<int32_t>(random() % size), top + 1 + static_cast<int32_t>(random() % size) };
+        primitive.color = random() % 4;
+        if (!positions.emplace(KeyOf(primitive), recorded.size()).second)
+        {
+            continue;
+        }
+        recorded.push_back(primitive);
+        if (primitive.kind == 0)
+        {
+            batch.FillRect(primitive.rect, primitive.color);
+        }
+        else if (primitive.kind == 1)
+        {
+            batch.BlendRect(primitive.rect, primitive.color, 128);
+        }
+        else
+        {
+            batch.DrawLabel(primitive.rect, text, kLabelFont, primitive.color);
+        }
+    }
+
+    RecordingRenderer target;
+    batch.Flush(target);
+    if (target.drawn.size() != recorded.size())
+    {
+        fprintf(stderr, "%zu primitives recorded, %zu drawn\n", recorded.size(), target.drawn.size());
+        return 1;
+    }
+    std::vector<size_t> drawnAt(recorded.size(), SIZE_MAX);
+    for (size_t i = 0; i < target.drawn.size(); i++)
+    {
+        auto found = positions.find(KeyOf(target.drawn[i]));
+        if (found == positions.end() || drawnAt[found->second] != SIZE_MAX)
+        {
+            fprintf(stderr, "call %zu draws a primitive that was not recorded or was drawn already\n", i);
+            return 1;
+        }
+        drawnAt[found->second] = i;
+    }
+    for (size_t a = 0; a < recorded.size(); a++)
+    {
+        for (size_t b = a + 1; b < recorded.size(); b++)
+        {
+            const WidgetRect& ra = recorded[a].rect;
+            const WidgetRect& rb = recorded[b].rect;
+            bool overlap = ra.left < rb.right && rb.left < ra.right && ra.top < rb.bottom && rb.top < ra.bottom;
+            if (overlap && drawnAt[a] > drawnAt[b])
+            {
+                fprintf(stderr, "primitive %zu was drawn under primitive %zu, which it overlaps\n", b, a);
+                return 1;
+            }
+        }
+    }
+    printf("%zu primitives in %llu calls\n", recorded.size(), static_cast<unsigned long long>(batch.GetStats().submittedCalls));
+
+    // A row of items side by side, each a background and a label, over a
+    // fill behind the whole row
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    batch.FillRect({ 0, 0, static_cast<int32_t>(rowLength) * 50, 1080 }, 0xFFFFFF);
+    for (size_t i = 0; i < rowLength; i++)
+    {
+        int32_t left = static_cast<int32_t>(i) * 50;
+        batch.FillRect({ left, 0, left + 48, 40 }, 0xC0C0C0);
+        batch.DrawLabel({ left + 4, 4, left + 44, 36 }, text, kLabelFont, 0);
+    }
+    RecordingRenderer row;
+    batch.Flush(row);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (row.drawn.size() != 2 * rowLength + 1 || batch.GetStats().submittedCalls != 3)
+    {
+        fprintf(stderr, "a row of %zu items went out in %llu calls\n", rowLength, static_cast<unsigned long long>(batch.GetStats().submittedCalls));
+        return 1;
+    }
+    printf("a row of %zu items in %.2f ms\n", rowLength, ms);
+    return 0;
+}
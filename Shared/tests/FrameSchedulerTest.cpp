@@ -0,0 +1,224 @@
+// Drives a FrameScheduler with synthetic timestamps. Fixed scenarios check
+// GetNextDue and IsOverdue around a first change, the frame interval between
+// commits, that the first change after a quiet period is not held back, that
+// Commit hands over each node once in ascending order with the union of the
+// invalidated rects, and the delay budget. Then random bursts are played
+// twice against a model of what each commit should carry: once with a frame
+// timer that fires when GetNextDue says, where no commit may come sooner
+// than a frame after the last or later than a frame after its first change,
+// and once with a busy loop whose timer never fires, so only the delay
+// budget commits and no change waits longer than the budget plus the gap to
+// the next one.
+//
+// Usage: FrameSchedulerTest [changes] [seed]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../FrameScheduler.h"
+
+static bool Expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "%s\n", what);
+    }
+    return condition;
+}
+
+static bool CheckScenarios()
+{
+    FrameScheduler scheduler(16, 100);
+    FrameChanges applied;
+    auto keep = [&applied](FrameChanges& changes) { applied = std::move(changes); };
+
+    bool ok = Expect(scheduler.GetNextDue(0) == FrameScheduler::kNothingPending && !scheduler.IsOverdue(1000) && !scheduler.Commit(0, keep),
+        "an idle scheduler had something due");
+
+    // The very first change goes out on the next commit
+    scheduler.NodeChanged(7, 1000);
+    ok = ok && Expect(scheduler.GetNextDue(1000) == 0 && scheduler.Commit(1000, keep) && applied.nodes == std::vector<uint64_t>{ 7 },
+        "the first change was held back");
+    ok = ok && Expect(!scheduler.HasPending() && scheduler.GetNextDue(1000) == FrameScheduler::kNothingPending, "a commit left changes pending");
+
+    // Later ones wait for the frame interval
+    scheduler.NodeChanged(9, 1005);
+    ok = ok && Expect(scheduler.GetNextDue(1005) == 11 && !scheduler.Commit(1015, keep), "a change went out inside the frame interval");
+    ok = ok && Expect(scheduler.GetNextDue(1015) == 1 && scheduler.Commit(1016, keep), "a change was not committed a frame after the last commit");
+
+    // After a quiet period the first change is due at once
+    scheduler.FocusChanged(2000);
+    ok = ok && Expect(scheduler.GetNextDue(2000) == 0 && scheduler.Commit(2000, keep) && applied.focusChanged && applied.nodes.empty(),
+        "the first change after a quiet period was held back");
+
+    // A burst folds into one commit, each node once and in order
+    scheduler.NodeChanged(5, 2001);
+    scheduler.NodeChanged(3, 2002);
+    scheduler.NodeChanged(5, 2003);
+    scheduler.Invalidate({ 10, 10, 20, 20 }, 2004);
+    scheduler.NodeChanged(3, 2005);
+    scheduler.Invalidate({ -5, 15, 12, 40 }, 2006);
+    scheduler.LayoutChanged(2007);
+    scheduler.NodeChanged(9, 2008);
+    ok = ok && Expect(scheduler.Commit(2016, keep), "the burst was not committed");
+    ok = ok && Expect(applied.nodes == std::vector<uint64_t>{ 3, 5, 9 } && applied.mutations == 8, "the burst's nodes were not deduplicated");
+    ok = ok && Expect(applied.repaint && !applied.repaintAll && applied.layoutChanged && !applied.focusChanged, "the burst's flags were lost");
+    ok = ok && Expect(applied.dirtyRect.left == -5 && applied.dirtyRect.top == 10 && applied.dirtyRect.right == 20 && applied.dirtyRect.bottom == 40,
+        "the dirty rect is not the union of the invalidations");
+    scheduler.InvalidateAll(2020);
+    ok = ok && Expect(scheduler.Commit(2032, keep) && applied.repaint && applied.repaintAll && !applied.layoutChanged, "InvalidateAll was lost");
+
+    // The delay budget: overdue exactly maxDelay after the first change
+    scheduler.NodeChanged(1, 3000);
+    ok = ok && Expect(!scheduler.IsOverdue(3099) && scheduler.IsOverdue(3100), "the delay budget was not kept to");
+    uint64_t overdue = scheduler.GetStats().overdueCommits;
+    ok = ok && Expect(scheduler.Commit(3100, keep) && scheduler.GetStats().overdueCommits == overdue + 1, "an overdue commit was not counted");
+
+    // A budget shorter than a frame is raised to one frame
+    FrameScheduler slow(50, 20);
+    slow.NodeChanged(1, 0);
+    slow.Commit(0, keep);
+    slow.NodeChanged(2, 10);
+    ok = ok && Expect(!slow.IsOverdue(59) && slow.IsOverdue(60) && slow.GetNextDue(10) == 40, "a short delay budget cut a frame short");
+    return ok;
+}
+
+struct Pending
+{
+    std::vector<uint64_t> nodes;
+    WidgetRect dirty = { 0, 0, 0, 0 };
+    bool repaint = false;
+    bool focus = false;
+    size_t mutations = 0;
+    uint64_t firstChange = 0;
+};
+
+// Plays bursts of changes; timer says whether the caller's frame timer fires
+static bool Simulate(size_t changes, bool timer, unsigned seed, uint64_t* commits)
+{
+    const uint32_t interval = 16;
+    const uint32_t maxDelay = 100;
+    FrameScheduler scheduler(interval, maxDelay);
+    std::mt19937 random(seed);
+    Pending expected;
+    uint64_t now = 0;
+    uint64_t lastCommit = 0;
+    uint64_t maxGap = 0;
+    bool anyCommit = false;
+    bool failed = false;
+    auto apply = [&](FrameChanges& applied)
+    {
+        std::sort(expected.nodes.begin(), expected.nodes.end());
+        expected.nodes.erase(std::unique(expected.nodes.begin(), expected.nodes.end()), expected.nodes.end());
+        bool sameRect = !expected.repaint
+            || (applied.dirtyRect.left == expected.dirty.left && applied.dirtyRect.top == expected.dirty.top
+                && applied.dirtyRect.right == expected.dirty.right && applied.dirtyRect.bottom == expected.dirty.bottom);
+        if (applied.nodes != expected.nodes || applied.mutations != expected.mutations || applied.repaint != expected.repaint
+            || applied.focusChanged != expected.focus || !sameRect)
+        {
+            fprintf(stderr, "the commit at %llu does not carry the changes made since the last one\n", static_cast<unsigned long long>(now));
+            failed = true;
+        }
+        uint64_t latency = now - expected.firstChange;
+        if (anyCommit && now - lastCommit < interval)
+        {
+            fprintf(stderr, "commits at %llu and %llu are less than a frame apart\n", static_cast<unsigned long long>(lastCommit),
+                static_cast<unsigned long long>(now));
+            failed = true;
+        }
+        if (timer ? latency > interval : latency < maxDelay || latency > maxDelay + maxGap)
+        {
+            fprintf(stderr, "a change waited %llu ms with the timer %s\n", static_cast<unsigned long long>(latency), timer ? "firing" : "held off");
+            failed = true;
+        }
+        expected = Pending();
+        lastCommit = now;
+        anyCommit = true;
+        (*commits)++;
+    };
+
+    for (size_t c = 0; c < changes && !failed; c++)
+    {
+        // Bursts of messages a few ms apart, with quiet spells between
+        uint64_t gap = random() % 40 == 0 ? 50 + random() % 400 : random() % 6;
+        if (timer)
+        {
+            // The timer fires at the due time if that comes before the next change
+            uint64_t due = scheduler.GetNextDue(now);
+            if (due != FrameScheduler::kNothingPending && due <= gap)
+            {
+                now += due;
+                gap -= due;
+                if (!Expect(scheduler.Commit(now, apply), "the timer fired when GetNextDue said, but nothing was committed"))
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            maxGap = (std::max)(maxGap, gap);
+        }
+        now += gap;
+
+        if (!scheduler.HasPending())
+        {
+            expected.firstChange = now;
+        }
+        expected.mutations++;
+        uint32_t kind = random() % 8;
+        if (kind < 5)
+        {
+            uint64_t node = random() % 20;
+            scheduler.NodeChanged(node, now);
+            expected.nodes.push_back(node);
+        }
+        else if (kind < 7)
+        {
+            int32_t x = static_cast<int32_t>(random() % 500) - 100;
+            int32_t y = static_cast<int32_t>(random() % 500) - 100;
+            WidgetRect rect = { x, y, x + 1 + static_cast<int32_t>(random() % 80), y + 1 + static_cast<int32_t>(random() % 30) };
+            scheduler.Invalidate(rect, now);
+            expected.dirty = expected.repaint ? WidgetRect{ (std::min)(expected.dirty.left, rect.left), (std::min)(expected.dirty.top, rect.top),
+                (std::max)(expected.dirty.right, rect.right), (std::max)(expected.dirty.bottom, rect.bottom) } : rect;
+            expected.repaint = true;
+        }
+        else
+        {
+            scheduler.FocusChanged(now);
+            expected.focus = true;
+        }
+
+        // A change that finds the scheduler overdue commits
+        if (scheduler.IsOverdue(now))
+        {
+            scheduler.Commit(now, apply);
+        }
+        else if (timer && scheduler.GetNextDue(now) == 0)
+        {
+            scheduler.Commit(now, apply);
+        }
+    }
+    return !failed;
+}
+
+int main(int argc, char** argv)
+{
+    size_t changes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], nullptr, 10)) : 1;
+    if (!CheckScenarios())
+    {
+        return 1;
+    }
+    uint64_t timed = 0;
+    uint64_t busy = 0;
+    if (!Simulate(changes, true, seed, &timed) || !Simulate(changes, false, seed, &busy))
+    {
+        return 1;
+    }
+    printf("%zu changes committed in %llu frames with a frame timer and %llu from a busy loop\n", changes, static_cast<unsigned long long>(timed),
+        static_cast<unsigned long long>(busy));
+    return 0;
+}
@@ -0,0 +1,172 @@
+// Compares serving the UIA, MSAA and AccessKit front-ends from one shared
+// WidgetModel with giving each its own copy, as each backend used to keep
+// its own state for the same navbar. Every frame makes the same renames,
+// moves and enabled changes, refreshes the derived data, and lets each
+// front-end read what it needs for the changed widgets: UIA the name and
+// screen rect, MSAA the child index, name and state, AccessKit the UTF-8
+// name and screen rect. Reports the memory held and the time per frame, and
+// how many names and rects were converted. Each copy here is a whole
+// WidgetModel, where the old backends kept smaller structures of their own,
+// so the memory for separate copies is an upper bound.
+//
+// Usage: FrontEndBenchmark [widgets] [frames] [changes per frame] [seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../WidgetModel.h"
+
+static const size_t kFrontEnds = 3;
+
+struct Change
+{
+    uint32_t widget;
+    uint32_t kind;
+    int32_t argument;
+};
+
+static std::vector<WidgetId> Build(WidgetModel& model, size_t count)
+{
+    WidgetId navbar = model.AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, 4000, 4000 }, L"Navbar", 0xF0F0F0);
+    std::vector<WidgetId> widgets;
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t x = static_cast<int32_t>(i % 40) * 100;
+        int32_t y = static_cast<int32_t>(i / 40) * 30;
+        widgets.push_back(model.AddWidget(navbar, WidgetRole::Button, { x, y, x + 96, y + 26 }, L"Item " + std::to_wstring(i), 0xC0C0C0));
+    }
+    model.SetScreenTransform({ 200, 120, 144 });
+    model.GetDerived();
+    return widgets;
+}
+
+static void Apply(WidgetModel& model, const std::vector<WidgetId>& widgets, const Change& change, const std::vector<std::wstring>& names)
+{
+    WidgetId id = widgets[change.widget];
+    if (change.kind == 0)
+    {
+        model.SetName(id, names[change.argument]);
+    }
+    else if (change.kind == 1)
+    {
+        WidgetRect rect = model.Get(id)->rect;
+        model.SetRect(id, { rect.left, change.argument, rect.right, change.argument + 26 });
+    }
+    else
+    {
+        model.SetEnabled(id, change.argument != 0);
+    }
+}
+
+// What each front-end reads for a changed widget
+static uint64_t Read(size_t frontEnd, const WidgetModel& model, const DerivedData& derived, WidgetId id)
+{
+    const Widget& widget = *model.Get(id);
+    const WidgetRect& rect = derived.screenRects[id.index];
+    switch (frontEnd)
+    {
+    case 0:
+        return widget.name.size() + rect.left + rect.bottom;
+    case 1:
+        return derived.childIndex[id.index] + widget.name.size() + widget.enabled;
+    default:
+        return derived.utf8Names[id.index].size() + rect.top + rect.right;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t frames = argc > 2 ? strtoul(argv[2], nullptr, 10) : 200;
+    size_t perFrame = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1000;
+    unsigned seed = argc > 4 ? static_cast<unsigned>(strtoul(argv[4], nullptr, 10)) : 1;
+    if (count == 0)
+    {
+        fprintf(stderr, "need at least one widget\n");
+        return 1;
+    }
+
+    std::vector<std::wstring> names;
+    for (size_t i = 0; i < 64; i++)
+    {
+        names.push_back(L"Renamed item " + std::to_wstring(i));
+    }
+    std::mt19937 random(seed);
+    std::vector<Change> script;
+    for (size_t i = 0; i < frames * perFrame; i++)
+    {
+        uint32_t kind = random() % 3;
+        int32_t argument = kind == 0 ? static_cast<int32_t>(random() % names.size()) : kind == 1 ? static_cast<int32_t>(random() % 3000) : random() % 2;
+        script.push_back({ static_cast<uint32_t>(random() % count), kind, argument });
+    }
+
+    // One model per front-end, then one model for all of them
+    double ms[2] = {};
+    size_t bytes[2] = {};
+    uint64_t converted[2] = {};
+    uint64_t sums[2] = {};
+    for (int shared = 0; shared < 2; shared++)
+    {
+        size_t copies = shared ? 1 : kFrontEnds;
+        std::vector<WidgetModel> models(copies);
+        std::vector<std::vector<WidgetId>> widgets;
+        for (WidgetModel& model : models)
+        {
+            widgets.push_back(Build(model, count));
+        }
+        DerivedStats before[kFrontEnds] = {};
+        for (size_t c = 0; c < copies; c++)
+        {
+            before[c] = models[c].GetDerivedStats();
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t frame = 0; frame < frames; frame++)
+        {
+            const Change* first = script.data() + frame * perFrame;
+            for (size_t c = 0; c < copies; c++)
+            {
+                for (size_t i = 0; i < perFrame; i++)
+                {
+                    Apply(models[c], widgets[c], first[i], names);
+                }
+            }
+            for (size_t frontEnd = 0; frontEnd < kFrontEnds; frontEnd++)
+            {
+                size_t c = shared ? 0 : frontEnd;
+                const DerivedData& derived = models[c].GetDerived();
+                for (size_t i = 0; i < perFrame; i++)
+                {
+                    sums[shared] += Read(frontEnd, models[c], derived, widgets[c][first[i].widget]);
+                }
+            }
+        }
+        ms[shared] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for (size_t c = 0; c < copies; c++)
+        {
+            bytes[shared] += models[c].GetMemoryUsage().GetTotal();
+            const DerivedStats& stats = models[c].GetDerivedStats();
+            converted[shared] += stats.namesConverted - before[c].namesConverted + stats.rectsTransformed - before[c].rectsTransformed;
+        }
+    }
+    if (sums[0] != sums[1])
+    {
+        fprintf(stderr, "the front-ends read different values from a shared model\n");
+        return 1;
+    }
+
+    printf("%zu widgets, %zu frames of %zu changes, %zu front-ends\n", count, frames, perFrame, kFrontEnds);
+    printf("%-18s %10s %12s %14s\n", "model", "MB", "ms/frame", "conversions");
+    const char* labels[] = { "one per front-end", "shared" };
+    for (int shared = 0; shared < 2; shared++)
+    {
+        printf("%-18s %10.1f %12.3f %14llu\n", labels[shared], bytes[shared] / 1048576.0, ms[shared] / (std::max)(frames, static_cast<size_t>(1)),
+            static_cast<unsigned long long>(converted[shared]));
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Times the pre-order hierarchy tables on a large tree: a spine of the given
+// depth with the remaining widgets attached at random below it, a million by
+// default. It times the first build of the tables, IsAncestor and
+// GetSubtreeRange queries, MoveWidget patching the tables in place, both to
+// anywhere in the tree and among the widget's own siblings, and a full
+// rebuild for comparison. A sample of the IsAncestor answers is checked
+// against walking parents.
+//
+// Usage: HierarchyBenchmark [widgets] [spine depth] [queries] [moves] [seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../WidgetModel.h"
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t spine = argc > 2 ? strtoul(argv[2], nullptr, 10) : 50;
+    size_t queries = argc > 3 ? strtoul(argv[3], nullptr, 10) : 10000000;
+    size_t moves = argc > 4 ? strtoul(argv[4], nullptr, 10) : 200;
+    unsigned seed = argc > 5 ? static_cast<unsigned>(strtoul(argv[5], nullptr, 10)) : 1;
+    if (spine == 0 || count < spine)
+    {
+        fprintf(stderr, "need a spine at least one deep and no longer than the tree\n");
+        return 1;
+    }
+
+    std::mt19937 random(seed);
+    WidgetModel model;
+    std::vector<WidgetId> widgets;
+    widgets.reserve(count);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+    {
+        WidgetId parent = i == 0 ? kNoWidget : i < spine ? widgets.back() : widgets[random() % widgets.size()];
+        widgets.push_back(model.AddWidget(parent, WidgetRole::Button, { 0, 0, 10, 10 }, L"w", 0));
+    }
+    double addMs = MillisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    const DerivedData& derived = model.GetDerived();
+    double buildMs = MillisecondsSince(start);
+    uint32_t maxDepth = *std::max_element(derived.depth.begin(), derived.depth.end());
+
+    // Check a sample against the parent chain
+    for (size_t i = 0; i < 10000; i++)
+    {
+        WidgetId id = widgets[random() % count];
+        WidgetId ancestor = i % 2 == 0 ? widgets[random() % spine] : widgets[random() % count];
+        bool expected = false;
+        for (WidgetId up = model.Get(id)->parent; up != kNoWidget && !expected; up = model.Get(up)->parent)
+        {
+            expected = up == ancestor;
+        }
+        if (model.IsAncestor(ancestor, id) != expected)
+        {
+            fprintf(stderr, "IsAncestor(%u, %u) disagrees with the parent chain\n", ancestor.index, id.index);
+            return 1;
+        }
+    }
+
+    // Half the ancestors come from the spine, so about half the answers are yes
+    std::vector<WidgetId> pairs(2 * 4096);
+    for (size_t i = 0; i < pairs.size(); i += 2)
+    {
+        pairs[i] = i % 4 == 0 ? widgets[random() % spine] : widgets[random() % count];
+        pairs[i + 1] = widgets[random() % count];
+    }
+    size_t yes = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++)
+    {
+        size_t p = (i * 2) % pairs.size();
+        yes += model.IsAncestor(pairs[p], pairs[p + 1]);
+    }
+    double ancestorMs = MillisecondsSince(start);
+
+    size_t covered = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++)
+    {
+        size_t begin;
+        size_t end;
+        model.GetSubtreeRange(pairs[(i * 2) % pairs.size()], &begin, &end);
+        covered += end - begin;
+    }
+    double rangeMs = MillisecondsSince(start);
+
+    // Moves of small subtrees, each followed by a query so the patch and
+    // anything else it leaves dirty are paid for: first to random places
+    // anywhere in the tree, then to the front of their own siblings
+    uint64_t patches = model.GetDerivedStats().structurePatches;
+    size_t moved = 0;
+    double moveMs[2];
+    for (int local = 0; local < 2; local++)
+    {
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < moves; i++)
+        {
+            WidgetId id = widgets[spine + random() % (count - spine + (count == spine))];
+            WidgetId parent = local ? model.Get(id)->parent : widgets[random() % count];
+            moved += model.MoveWidget(id, parent, 0);
+            model.GetDepth(id);
+        }
+        moveMs[local] = MillisecondsSince(start);
+    }
+    if (model.GetDerivedStats().structurePatches - patches != moved)
+    {
+        fprintf(stderr, "%zu moves rebuilt the tables instead of patching them\n", moved);
+        return 1;
+    }
+
+    model.RemoveWidget(model.AddWidget(kNoWidget, WidgetRole::Button, { 0, 0, 10, 10 }, L"w", 0));
+    start = std::chrono::steady_clock::now();
+    model.GetDerived();
+    double rebuildMs = MillisecondsSince(start);
+
+    printf("%zu widgets, spine %zu deep, deepest widget at %u\n", count, spine, maxDepth);
+    printf("%-16s %10.1f ms\n", "add widgets", addMs);
+    printf("%-16s %10.1f ms\n", "first build", buildMs);
+    printf("%-16s %10.1f ms %8.2f ns each (%.0f%% yes)\n", "IsAncestor", ancestorMs, ancestorMs * 1e6 / (std::max)(queries, static_cast<size_t>(1)),
+        queries ? 100.0 * yes / queries : 0.0);
+    printf("%-16s %10.1f ms %8.2f ns each (%zu widgets covered)\n", "GetSubtreeRange", rangeMs, rangeMs * 1e6 / (std::max)(queries, static_cast<size_t>(1)),
+        covered);
+    printf("%-16s %10.1f ms %8.1f us each\n", "move anywhere", moveMs[0], moveMs[0] * 1e3 / (std::max)(moves, static_cast<size_t>(1)));
+    printf("%-16s %10.1f ms %8.1f us each\n", "move in place", moveMs[1], moveMs[1] * 1e3 / (std::max)(moves, static_cast<size_t>(1)));
+    printf("%-16s %10.1f ms\n", "full rebuild", rebuildMs);
+    return 0;
+}
@@ -0,0 +1,197 @@
+// Moves random subtrees of a random forest with MoveWidget, which patches the
+// pre-order tables in place, and checks the patched preorder, subtreeSize and
+// depth tables and the tab order against a walk of the children lists after
+// every move, and against a full rebuild of the tables every few moves. Moves into the
+// widget's own subtree must be refused and leave everything as it was.
+//
+// Usage: HierarchyPatchTest [widgets] [moves] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+#include "../WidgetModel.h"
+
+struct Tables
+{
+    std::vector<WidgetId> preorder;
+    std::vector<uint32_t> subtreeSize;
+    std::vector<uint32_t> depth;
+    std::vector<WidgetId> focusOrder;
+};
+
+// The tables as the children lists define them
+static Tables Walk(WidgetModel& model)
+{
+    Tables tables;
+    std::vector<std::pair<WidgetId, uint32_t>> pending;
+    for (size_t i = model.GetRoots().size(); i-- > 0;)
+    {
+        pending.push_back({ model.GetRoots()[i], 0 });
+    }
+    std::vector<size_t> open;
+    while (!pending.empty())
+    {
+        WidgetId id = pending.back().first;
+        uint32_t depth = pending.back().second;
+        pending.pop_back();
+        // Subtrees deeper than this one have ended
+        while (!open.empty() && tables.depth[open.back()] >= depth)
+        {
+            open.pop_back();
+        }
+        for (size_t position : open)
+        {
+            tables.subtreeSize[position]++;
+        }
+        open.push_back(tables.preorder.size());
+        tables.preorder.push_back(id);
+        tables.subtreeSize.push_back(1);
+        tables.depth.push_back(depth);
+        const Widget& widget = *model.Get(id);
+        if (widget.focusable && widget.enabled)
+        {
+            tables.focusOrder.push_back(id);
+        }
+        const std::vector<WidgetId>& children = widget.children;
+        for (size_t i = children.size(); i-- > 0;)
+        {
+            pending.push_back({ children[i], depth + 1 });
+        }
+    }
+    return tables;
+}
+
+static Tables Current(WidgetModel& model)
+{
+    const DerivedData& derived = model.GetDerived();
+    return { derived.preorder, derived.subtreeSize, derived.depth, derived.focusOrder };
+}
+
+static bool Same(const Tables& tables, const Tables& expected, const char* what)
+{
+    if (tables.preorder.size() != expected.preorder.size())
+    {
+        fprintf(stderr, "%s: %zu widgets in pre-order, expected %zu\n", what, tables.preorder.size(), expected.preorder.size());
+        return false;
+    }
+    for (size_t p = 0; p < expected.preorder.size(); p++)
+    {
+        if (tables.preorder[p] != expected.preorder[p] || tables.subtreeSize[p] != expected.subtreeSize[p] || tables.depth[p] != expected.depth[p])
+        {
+            fprintf(stderr, "%s: position %zu holds widget %u with subtree %u at depth %u, expected widget %u with %u at %u\n", what, p,
+                tables.preorder[p].index, tables.subtreeSize[p], tables.depth[p], expected.preorder[p].index, expected.subtreeSize[p],
+                expected.depth[p]);
+            return false;
+        }
+    }
+    if (tables.focusOrder != expected.focusOrder)
+    {
+        fprintf(stderr, "%s: the tab order differs\n", what);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+    size_t moves = argc > 2 ? strtoul(argv[2], nullptr, 10) : 3000;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+    if (count < 2)
+    {
+        fprintf(stderr, "need at least two widgets\n");
+        return 1;
+    }
+
+    // A few roots, chains and bushy parts
+    std::mt19937 random(seed);
+    WidgetModel model;
+    std::vector<WidgetId> widgets;
+    for (size_t i = 0; i < count; i++)
+    {
+        WidgetId parent = kNoWidget;
+        if (!widgets.empty() && random() % 40 != 0)
+        {
+            parent = random() % 2 == 0 ? widgets.back() : widgets[random() % widgets.size()];
+        }
+        WidgetRole role = random() % 3 == 0 ? WidgetRole::Toolbar : WidgetRole::Button;
+        widgets.push_back(model.AddWidget(parent, role, { 0, 0, 10, 10 }, L"w", 0));
+        model.SetEnabled(widgets.back(), random() % 5 != 0);
+    }
+    if (!Same(Current(model), Walk(model), "after building"))
+    {
+        return 1;
+    }
+
+    uint64_t rebuilds = model.GetDerivedStats().structureRebuilds;
+    size_t refused = 0;
+    for (size_t move = 0; move < moves; move++)
+    {
+        WidgetId id = widgets[random() % count];
+        WidgetId parent = random() % 10 == 0 ? kNoWidget : widgets[random() % count];
+        size_t siblings = parent == kNoWidget ? model.GetRoots().size() : model.GetChildCount(parent);
+        size_t index = random() % (siblings + 2);
+        bool inside = parent == id || model.IsAncestor(id, parent);
+        Tables before = Current(model);
+        if (model.MoveWidget(id, parent, index) == inside)
+        {
+            fprintf(stderr, "move %zu of widget %u under %u was %s\n", move, id.index, parent.index, inside ? "allowed" : "refused");
+            return 1;
+        }
+        if (inside)
+        {
+            refused++;
+            if (!Same(Current(model), before, "after a refused move"))
+            {
+                return 1;
+            }
+            continue;
+        }
+        Tables patched = Current(model);
+        if (!Same(patched, Walk(model), "after a move"))
+        {
+            fprintf(stderr, "after move %zu of widget %u under %u at %zu\n", move, id.index, parent.index, index);
+            return 1;
+        }
+        const DerivedData& derived = model.GetDerived();
+        for (size_t i = 0; i < derived.focusOrder.size(); i++)
+        {
+            if (derived.focusPosition[derived.focusOrder[i].index] != i)
+            {
+                fprintf(stderr, "widget %u is at %zu in the tab order but has position %u\n", derived.focusOrder[i].index, i,
+                    derived.focusPosition[derived.focusOrder[i].index]);
+                return 1;
+            }
+        }
+        if (model.Get(id)->parent != parent || model.GetDepth(id) != (parent == kNoWidget ? 0 : model.GetDepth(parent) + 1)
+            || (parent != kNoWidget && !model.IsAncestor(parent, id)))
+        {
+            fprintf(stderr, "widget %u does not report its new place under %u\n", id.index, parent.index);
+            return 1;
+        }
+
+        if (move % 64 == 0)
+        {
+            // Adding and removing a widget leaves the tables to be rebuilt
+            model.RemoveWidget(model.AddWidget(kNoWidget, WidgetRole::Button, { 0, 0, 10, 10 }, L"w", 0));
+            if (!Same(Current(model), patched, "rebuilt"))
+            {
+                fprintf(stderr, "after move %zu\n", move);
+                return 1;
+            }
+            rebuilds++;
+        }
+    }
+    if (model.GetDerivedStats().structureRebuilds != rebuilds || model.GetDerivedStats().structurePatches != moves - refused)
+    {
+        fprintf(stderr, "%llu moves were patched and %llu rebuilt, expected %zu patched\n",
+            static_cast<unsigned long long>(model.GetDerivedStats().structurePatches),
+            static_cast<unsigned long long>(model.GetDerivedStats().structureRebuilds - rebuilds), moves - refused);
+        return 1;
+    }
+    printf("%zu moves in a forest of %zu widgets patched the tables the way a rebuild lays them out; %zu into their own subtree refused\n",
+        moves - refused, count, refused);
+    return 0;
+}
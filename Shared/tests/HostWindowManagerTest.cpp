@@ -0,0 +1,155 @@
+// Drives HostWindowManager against MockWindowSystem and checks what it asks
+// of the window system: the first Sync creates a host per widget, a widget
+// added after one was removed takes over its host without a create, a
+// relayout goes out as one batch of moves, hosts freed past kMaxPooled are
+// destroyed, and after Reserve later Syncs create nothing.
+//
+// Usage: HostWindowManagerTest [widgets]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "../MockWindowSystem.h"
+
+static bool SameRect(const WidgetRect& a, const WidgetRect& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// Every widget under root has a visible host with its bounds and name.
+static bool HostsMatch(const WidgetModel& model, WidgetId root, const HostWindowManager& manager, const MockWindowSystem& windows)
+{
+    std::vector<WidgetId> pending = { root };
+    while (!pending.empty())
+    {
+        WidgetId id = pending.back();
+        pending.pop_back();
+        const Widget& widget = *model.Get(id);
+        const MockWindowSystem::HostState* host = windows.Find(manager.GetHost(id));
+        if (!host || !host->visible || !SameRect(host->rect, widget.rect) || host->name != widget.name)
+        {
+            fprintf(stderr, "widget %u has no host, or one that is hidden or out of date\n", id.index);
+            return false;
+        }
+        pending.insert(pending.end(), widget.children.begin(), widget.children.end());
+    }
+    return true;
+}
+
+static WidgetId AddItem(WidgetModel& model, WidgetId toolbar, int32_t i)
+{
+    return model.AddWidget(toolbar, WidgetRole::Button, { i * 10, 0, i * 10 + 8, 20 }, L"Item " + std::to_wstring(i), 0xFFFFFF);
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+    if (count < HostWindowManager::kMaxPooled + 2)
+    {
+        fprintf(stderr, "need more than %zu widgets to fill the pool\n", HostWindowManager::kMaxPooled + 1);
+        return 1;
+    }
+
+    WidgetModel model;
+    WidgetId toolbar = model.AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, 4000, 40 }, L"Toolbar", 0);
+    std::vector<WidgetId> items;
+    for (size_t i = 0; i < count; i++)
+    {
+        items.push_back(AddItem(model, toolbar, static_cast<int32_t>(i)));
+    }
+
+    MockWindowSystem windows;
+    {
+        HostWindowManager manager(&windows);
+        manager.Sync(model, toolbar);
+        if (windows.GetCounters().creates != count + 1 || windows.GetLiveCount() != count + 1 || !HostsMatch(model, toolbar, manager, windows))
+        {
+            fprintf(stderr, "the first Sync made %llu hosts for %zu widgets\n", static_cast<unsigned long long>(windows.GetCounters().creates), count + 1);
+            return 1;
+        }
+
+        // A widget added in the same pass one was removed gets its host
+        windows.ResetCounters();
+        HostHandle freed = manager.GetHost(items[5]);
+        model.RemoveWidget(items[5]);
+        items[5] = AddItem(model, toolbar, static_cast<int32_t>(count));
+        manager.Sync(model, toolbar);
+        if (windows.GetCounters().creates != 0 || manager.GetHost(items[5]) != freed || !HostsMatch(model, toolbar, manager, windows))
+        {
+            fprintf(stderr, "a remove and an add made %llu hosts instead of reusing one\n", static_cast<unsigned long long>(windows.GetCounters().creates));
+            return 1;
+        }
+
+        // A relayout moves every host, in one batch
+        windows.ResetCounters();
+        for (WidgetId item : items)
+        {
+            WidgetRect rect = model.Get(item)->rect;
+            model.SetRect(item, { rect.left, rect.top + 30, rect.right, rect.bottom + 30 });
+        }
+        manager.Sync(model, toolbar);
+        const MockWindowSystem::Counters& moved = windows.GetCounters();
+        if (moved.moveBatches != 1 || moved.moves != count || moved.creates != 0 || !HostsMatch(model, toolbar, manager, windows))
+        {
+            fprintf(stderr, "a relayout of %zu widgets made %llu moves in %llu batches\n", count,
+                static_cast<unsigned long long>(moved.moves), static_cast<unsigned long long>(moved.moveBatches));
+            return 1;
+        }
+
+        // Hosts freed past what the pool keeps are destroyed; the rest are hidden
+        windows.ResetCounters();
+        size_t removed = HostWindowManager::kMaxPooled + 10;
+        std::vector<HostHandle> freedHosts;
+        for (size_t i = 0; i < removed; i++)
+        {
+            freedHosts.push_back(manager.GetHost(items.back()));
+            model.RemoveWidget(items.back());
+            items.pop_back();
+        }
+        manager.Sync(model, toolbar);
+        size_t hidden = 0;
+        for (HostHandle host : freedHosts)
+        {
+            const MockWindowSystem::HostState* state = windows.Find(host);
+            hidden += state && !state->visible;
+        }
+        if (manager.GetPooledCount() != HostWindowManager::kMaxPooled || windows.GetCounters().destroys != removed - HostWindowManager::kMaxPooled
+            || hidden != HostWindowManager::kMaxPooled || windows.GetCounters().moveBatches != 1)
+        {
+            fprintf(stderr, "removing %zu widgets left %zu pooled and %zu hidden, with %llu destroyed\n", removed, manager.GetPooledCount(), hidden,
+                static_cast<unsigned long long>(windows.GetCounters().destroys));
+            return 1;
+        }
+    }
+    if (windows.GetLiveCount() != 0)
+    {
+        fprintf(stderr, "%zu hosts outlived their manager\n", windows.GetLiveCount());
+        return 1;
+    }
+
+    // With hosts reserved up front, building the toolbar up creates none
+    {
+        WidgetModel grown;
+        WidgetId root = grown.AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, 4000, 40 }, L"Toolbar", 0);
+        HostWindowManager manager(&windows);
+        manager.Reserve(HostWindowManager::kMaxPooled);
+        windows.ResetCounters();
+        for (size_t i = 0; i + 1 < HostWindowManager::kMaxPooled; i++)
+        {
+            AddItem(grown, root, static_cast<int32_t>(i));
+            if (i % 8 == 0)
+            {
+                manager.Sync(grown, root);
+            }
+        }
+        manager.Sync(grown, root);
+        if (windows.GetCounters().creates != 0 || !HostsMatch(grown, root, manager, windows))
+        {
+            fprintf(stderr, "Syncs after Reserve made %llu hosts\n", static_cast<unsigned long long>(windows.GetCounters().creates));
+            return 1;
+        }
+    }
+    printf("%zu widgets: hosts created once, reused, moved in one batch and pooled up to %zu\n", count, HostWindowManager::kMaxPooled);
+    return 0;
+}
@@ -0,0 +1,282 @@
+// Adds, renames and removes elements in a NameIndex at random and checks
+// every lookup against a scan of the live elements: GetByName, GetByCategory,
+// CountPrefix and both VisitPrefix overloads. Names are short strings over a
+// few letters in both cases, so edges are split and folded back all the time,
+// and categories are skewed so the category-restricted visit walks both the
+// prefix subtree and the category list. Along the way the trie must use as
+// many nodes as the live names need and no more, so edges left with a single
+// child get folded, and after the churn it must be no bigger than the live
+// names can need, which it only stays if freed nodes are reused.
+//
+// Usage: NameIndexTest [operations] [live elements] [seed]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cwctype>
+#include <random>
+#include <string>
+#include <vector>
+#include "../NameIndex.h"
+
+static const uint8_t kCategories = 4;
+
+struct Element
+{
+    SlotHandle handle;
+    uint8_t category;
+    std::wstring name;
+    bool live;
+};
+
+static std::wstring Fold(std::wstring text)
+{
+    for (wchar_t& c : text)
+    {
+        c = static_cast<wchar_t>(std::towlower(c));
+    }
+    return text;
+}
+
+static std::wstring RandomName(std::mt19937& random, size_t longest)
+{
+    static const wchar_t kLetters[] = L"abAB c";
+    std::wstring name(random() % (longest + 1), L'a');
+    for (wchar_t& c : name)
+    {
+        c = kLetters[random() % 6];
+    }
+    return name;
+}
+
+static bool Less(const SlotHandle& a, const SlotHandle& b)
+{
+    return a.index != b.index ? a.index < b.index : a.generation < b.generation;
+}
+
+static std::vector<SlotHandle> Sorted(std::vector<SlotHandle> handles)
+{
+    std::sort(handles.begin(), handles.end(), Less);
+    return handles;
+}
+
+// Checks every lookup for key, both as a name and as a prefix.
+static bool Check(const NameIndex& index, const std::vector<Element>& elements, const std::wstring& key)
+{
+    std::wstring folded = Fold(key);
+    std::vector<SlotHandle> named;
+    std::vector<SlotHandle> prefixed;
+    std::vector<SlotHandle> inCategory[kCategories];
+    std::vector<SlotHandle> categories[kCategories];
+    for (const Element& element : elements)
+    {
+        if (!element.live)
+        {
+            continue;
+        }
+        std::wstring name = Fold(element.name);
+        categories[element.category].push_back(element.handle);
+        if (name == folded)
+        {
+            named.push_back(element.handle);
+        }
+        if (name.compare(0, folded.size(), folded) == 0)
+        {
+            prefixed.push_back(element.handle);
+            inCategory[element.category].push_back(element.handle);
+        }
+    }
+
+    if (Sorted(index.GetByName(key)) != Sorted(named))
+    {
+        fprintf(stderr, "GetByName(\"%ls\") found %zu elements, expected %zu\n", key.c_str(), index.GetByName(key).size(), named.size());
+        return false;
+    }
+    if (index.CountPrefix(key) != prefixed.size())
+    {
+        fprintf(stderr, "CountPrefix(\"%ls\") is %zu, expected %zu\n", key.c_str(), index.CountPrefix(key), prefixed.size());
+        return false;
+    }
+    std::vector<SlotHandle> visited;
+    index.VisitPrefix(key, [&](SlotHandle handle) { visited.push_back(handle); });
+    if (Sorted(visited) != Sorted(prefixed))
+    {
+        fprintf(stderr, "VisitPrefix(\"%ls\") visited %zu elements, expected %zu\n", key.c_str(), visited.size(), prefixed.size());
+        return false;
+    }
+    for (uint8_t category = 0; category < kCategories; category++)
+    {
+        visited.clear();
+        index.VisitPrefix(key, category, [&](SlotHandle handle) { visited.push_back(handle); });
+        if (Sorted(visited) != Sorted(inCategory[category]))
+        {
+            fprintf(stderr, "VisitPrefix(\"%ls\", %u) visited %zu elements, expected %zu\n", key.c_str(), category, visited.size(),
+                inCategory[category].size());
+            return false;
+        }
+        if (Sorted(index.GetByCategory(category)) != Sorted(categories[category]))
+        {
+            fprintf(stderr, "category %u holds %zu elements, expected %zu\n", category, index.GetByCategory(category).size(),
+                categories[category].size());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Nodes in use: every name added with a new first character takes one node,
+// from the free list while it lasts, so the probes it takes to make the trie
+// grow count the free nodes.
+static size_t LiveNodeCount(NameIndex& index, uint32_t spareIndex)
+{
+    size_t total = index.GetNodeCount();
+    std::vector<SlotHandle> probes;
+    while (index.GetNodeCount() == total)
+    {
+        SlotHandle probe = { spareIndex + static_cast<uint32_t>(probes.size()), 0 };
+        index.Add(probe, 0, std::wstring(1, static_cast<wchar_t>(0x4E00 + probes.size())));
+        probes.push_back(probe);
+    }
+    for (SlotHandle probe : probes)
+    {
+        index.Remove(probe);
+    }
+    return total - (probes.size() - 1);
+}
+
+// A compressed trie is the same for the same names however they got there,
+// so the nodes in use must match an index built from the live names alone.
+static bool IsCompressed(NameIndex& index, const std::vector<Element>& elements)
+{
+    NameIndex fresh;
+    for (const Element& element : elements)
+    {
+        if (element.live)
+        {
+            fresh.Add(element.handle, element.category, element.name);
+        }
+    }
+    size_t live = LiveNodeCount(index, static_cast<uint32_t>(elements.size()));
+    if (live != fresh.GetNodeCount())
+    {
+        fprintf(stderr, "the trie uses %zu nodes where the same names need %zu\n", live, fresh.GetNodeCount());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t operations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50000;
+    size_t capacity = argc > 2 ? strtoul(argv[2], nullptr, 10) : 300;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+    if (capacity == 0)
+    {
+        fprintf(stderr, "need room for at least one element\n");
+        return 1;
+    }
+
+    std::mt19937 random(seed);
+    NameIndex index;
+    std::vector<Element> elements(capacity);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        elements[i].handle = { static_cast<uint32_t>(i), 0 };
+        elements[i].live = false;
+    }
+
+    size_t adds = 0;
+    size_t renames = 0;
+    size_t removes = 0;
+    for (size_t op = 0; op < operations; op++)
+    {
+        Element& element = elements[random() % capacity];
+        if (!element.live)
+        {
+            // Mostly category 0, rarely 3
+            uint32_t roll = random() % 16;
+            element.category = static_cast<uint8_t>(roll < 10 ? 0 : roll < 13 ? 1 : roll < 15 ? 2 : 3);
+            element.name = RandomName(random, 6);
+            element.live = true;
+            index.Add(element.handle, element.category, element.name);
+            adds++;
+        }
+        else if (random() % 2 == 0)
+        {
+            element.name = RandomName(random, 6);
+            index.Rename(element.handle, element.name);
+            renames++;
+        }
+        else
+        {
+            index.Remove(element.handle);
+            element.live = false;
+            SlotHandle stale = element.handle;
+            element.handle.generation++;
+            if (index.Contains(stale))
+            {
+                fprintf(stderr, "element %u is still indexed after its removal\n", stale.index);
+                return 1;
+            }
+            // Neither a stale handle nor one never added changes anything
+            index.Remove(stale);
+            index.Rename(element.handle, L"ignored");
+            removes++;
+        }
+
+        if (op % 64 == 0 || op + 1 == operations)
+        {
+            std::wstring key = random() % 2 == 0 ? RandomName(random, 4) : elements[random() % capacity].name;
+            if (!Check(index, elements, key) || !Check(index, elements, key.substr(0, key.size() / 2))
+                || (op % 4096 == 0 && !IsCompressed(index, elements)))
+            {
+                fprintf(stderr, "after %zu operations\n", op + 1);
+                return 1;
+            }
+        }
+    }
+
+    // A compressed trie over n names has at most 2n nodes besides the root,
+    // and the live names never exceed capacity. Without the free list the
+    // node count would follow the number of operations instead.
+    if (!IsCompressed(index, elements))
+    {
+        return 1;
+    }
+    if (index.GetNodeCount() > 2 * capacity + 1)
+    {
+        fprintf(stderr, "%zu operations on at most %zu names left %zu trie nodes\n", operations, capacity, index.GetNodeCount());
+        return 1;
+    }
+
+    // A compressed trie is the same for the same names, so emptying the index
+    // and adding the names back must take every node from the free list
+    size_t nodeCount = index.GetNodeCount();
+    std::vector<Element*> removed;
+    for (Element& element : elements)
+    {
+        if (element.live)
+        {
+            index.Remove(element.handle);
+            element.live = false;
+            removed.push_back(&element);
+        }
+    }
+    if (!Check(index, elements, L"") || index.CountPrefix(L"") != 0)
+    {
+        return 1;
+    }
+    for (Element* element : removed)
+    {
+        element->live = true;
+        index.Add(element->handle, element->category, element->name);
+    }
+    if (!Check(index, elements, L"") || index.GetNodeCount() != nodeCount)
+    {
+        fprintf(stderr, "adding %zu names back changed the trie from %zu to %zu nodes\n", removed.size(), nodeCount, index.GetNodeCount());
+        return 1;
+    }
+    printf("%zu adds, %zu renames and %zu removes agreed with a scan; the trie holds %zu nodes for up to %zu names\n", adds, renames, removes,
+        index.GetNodeCount(), capacity);
+    return 0;
+}
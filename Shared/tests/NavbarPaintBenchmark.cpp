@@ -0,0 +1,110 @@
+// Times painting a large navbar into a SoftwareRenderer the way the UI
+// Automation sample paints its Navbar: PaintWidget for the bar and every
+// item, a third of them selected, recorded in a DrawBatch and flushed once a
+// frame, with a translucent hover highlight and a dimmed disabled strip on
+// top. Also times bare full-width fills and blends, to show the span loops
+// apart from the rest of the frame. The last frame must give the same
+// checksum as the first. Define SOFTWARE_RENDERER_NO_SSE2 to time the scalar
+// spans.
+//
+// Usage: NavbarPaintBenchmark [items] [frames] [width] [height]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "../DrawBatch.h"
+#include "../SelectionSet.h"
+#include "../SoftwareRenderer.h"
+#include "../WidgetPainter.h"
+
+static const int32_t kItemWidth = 96;
+static const int32_t kItemHeight = 40;
+static const int32_t kSpacing = 4;
+
+// The bar wraps its items into rows, so a large one fills the framebuffer
+static void PaintFrame(const WidgetModel& model, WidgetId bar, const SelectionSet& selection, SoftwareRenderer& renderer, DrawBatch& batch,
+    Framebuffer& framebuffer)
+{
+    renderer.GetTextCache().BeginFrame();
+    PaintWidgetTree(batch, model, bar, &selection);
+    const Widget& item = *model.Get(model.GetChild(bar, model.GetChildCount(bar) / 2));
+    batch.BlendRect(item.rect, 0xFFFFFF, 96);
+    batch.BlendRect({ 0, framebuffer.height - 2 * kItemHeight, framebuffer.width, framebuffer.height }, 0x808080, 160);
+    batch.Flush(renderer);
+    renderer.GetTextCache().EndFrame();
+}
+
+int main(int argc, char** argv)
+{
+    size_t items = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+    size_t frames = argc > 2 ? strtoul(argv[2], nullptr, 10) : 50;
+    int32_t width = argc > 3 ? atoi(argv[3]) : 3840;
+    int32_t height = argc > 4 ? atoi(argv[4]) : 2160;
+    if (items == 0 || frames == 0 || width < kItemWidth + kSpacing || height <= 0)
+    {
+        fprintf(stderr, "need at least one item, one frame and room for an item\n");
+        return 1;
+    }
+
+    WidgetModel model;
+    WidgetId bar = model.AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, width, height }, L"Navbar", 0xF0F0F0);
+    int32_t perRow = (width - kSpacing) / (kItemWidth + kSpacing);
+    for (size_t i = 0; i < items; i++)
+    {
+        int32_t x = kSpacing + static_cast<int32_t>(i % perRow) * (kItemWidth + kSpacing);
+        int32_t y = kSpacing + static_cast<int32_t>(i / perRow) * (kItemHeight + kSpacing);
+        model.AddWidget(bar, WidgetRole::Button, { x, y, x + kItemWidth, y + kItemHeight }, L"Item " + std::to_wstring(i), 0xC0C0C0);
+    }
+    SelectionSet selection;
+    selection.Resize(items);
+    for (size_t i = 0; i < items; i += 3)
+    {
+        selection.Select(i);
+    }
+
+    Framebuffer framebuffer(width, height);
+    SoftwareRenderer renderer(&framebuffer);
+    DrawBatch batch;
+    PaintFrame(model, bar, selection, renderer, batch, framebuffer);
+    uint64_t first = framebuffer.Checksum();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+        PaintFrame(model, bar, selection, renderer, batch, framebuffer);
+    }
+    double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    if (framebuffer.Checksum() != first)
+    {
+        fprintf(stderr, "the last frame painted different pixels from the first\n");
+        return 1;
+    }
+
+    // The span loops alone, over the whole framebuffer
+    WidgetRect all = { 0, 0, width, height };
+    start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+        renderer.FillRect(all, static_cast<uint32_t>(frame));
+    }
+    double fillMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+        renderer.BlendRect(all, 0x3C7A15, static_cast<uint8_t>(frame % 254 + 1));
+    }
+    double blendMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+#ifdef SOFTWARE_RENDERER_SSE2
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    double megapixels = static_cast<double>(width) * height / 1e6;
+    printf("%zu items on a %dx%d navbar, %s spans, checksum %016llX\n", items, width, height, path, static_cast<unsigned long long>(first));
+    printf("%-12s %10.3f ms %10.1f Mpixel/s\n", "frame", frameMs, megapixels / frameMs * 1e3);
+    printf("%-12s %10.3f ms %10.1f Mpixel/s\n", "fill", fillMs, megapixels / fillMs * 1e3);
+    printf("%-12s %10.3f ms %10.1f Mpixel/s\n", "blend", blendMs, megapixels / blendMs * 1e3);
+    return 0;
+}
@@ -0,0 +1,189 @@
+// Applies random edits to a PieceTable and a plain std::wstring side by side
+// and checks that the text, the line count and the line index agree after
+// every step. Edits mix inserts at random offsets with runs of typing, which
+// grow the last added piece in place, and the same edits keep a TextDocument
+// selection on the text it covered.
+//
+// Usage: PieceTableTest [iterations] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include "../TextDocument.h"
+
+static size_t ExpectedLineCount(const std::wstring& text)
+{
+    size_t lines = 1;
+    for (wchar_t c : text)
+    {
+        lines += c == L'\n';
+    }
+    return lines;
+}
+
+static size_t ExpectedLineStart(const std::wstring& text, size_t line)
+{
+    if (line == 0)
+    {
+        return 0;
+    }
+    size_t seen = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == L'\n' && ++seen == line)
+        {
+            return i + 1;
+        }
+    }
+    return text.size();
+}
+
+static size_t ExpectedLineOfOffset(const std::wstring& text, size_t offset)
+{
+    size_t line = 0;
+    for (size_t i = 0; i < offset && i < text.size(); i++)
+    {
+        line += text[i] == L'\n';
+    }
+    return line;
+}
+
+static bool Check(const PieceTable& table, const std::wstring& expected, std::mt19937& random, size_t iteration)
+{
+    if (table.GetLength() != expected.size() || table.GetText(0, expected.size()) != expected)
+    {
+        fprintf(stderr, "step %zu: text differs\n", iteration);
+        return false;
+    }
+    size_t lines = ExpectedLineCount(expected);
+    if (table.GetLineCount() != lines)
+    {
+        fprintf(stderr, "step %zu: %zu lines, expected %zu\n", iteration, table.GetLineCount(), lines);
+        return false;
+    }
+    for (int probe = 0; probe < 16; probe++)
+    {
+        size_t line = random() % (lines + 1);
+        if (table.GetLineStart(line) != ExpectedLineStart(expected, line))
+        {
+            fprintf(stderr, "step %zu: line %zu starts at %zu, expected %zu\n", iteration, line, table.GetLineStart(line),
+                ExpectedLineStart(expected, line));
+            return false;
+        }
+    }
+    for (int probe = 0; probe < 16; probe++)
+    {
+        size_t offset = random() % (expected.size() + 1);
+        if (table.GetLineOfOffset(offset) != ExpectedLineOfOffset(expected, offset))
+        {
+            fprintf(stderr, "step %zu: offset %zu is on line %zu, expected %zu\n", iteration, offset, table.GetLineOfOffset(offset),
+                ExpectedLineOfOffset(expected, offset));
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t ExpectedAfterInsert(size_t position, size_t offset, size_t count)
+{
+    return position >= offset ? position + count : position;
+}
+
+static size_t ExpectedAfterErase(size_t position, size_t offset, size_t count)
+{
+    if (position <= offset)
+    {
+        return position;
+    }
+    return position >= offset + count ? position - count : offset;
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], nullptr, 10)) : 7;
+
+    // Typing a line break right after other typed text
+    PieceTable typed(L"abc");
+    typed.Insert(3, L"x");
+    typed.Insert(4, L"\ny\n");
+    if (typed.GetLineCount() != 3 || typed.GetLineStart(1) != 5 || typed.GetLineOfOffset(6) != 1)
+    {
+        fprintf(stderr, "typed line breaks are missing from the line index\n");
+        return 1;
+    }
+
+    std::mt19937 random(seed);
+    const wchar_t alphabet[] = L"ab c\n.,x  ";
+    std::wstring expected = L"hello world\nfoo, bar baz\n\nlast line";
+    TextDocument document(8, 16);
+    document.SetText(expected);
+    size_t caret = 0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        size_t selectionStart = document.GetSelectionStart();
+        size_t selectionEnd = document.GetSelectionEnd();
+        unsigned action = random() % 8;
+        if (action < 3)
+        {
+            // Type a few characters at the caret, one insert each
+            size_t count = random() % 6 + 1;
+            for (size_t c = 0; c < count; c++)
+            {
+                std::wstring text(1, alphabet[random() % 10]);
+                document.Insert(caret, text);
+                expected.insert(caret, text);
+                selectionStart = ExpectedAfterInsert(selectionStart, caret, 1);
+                selectionEnd = ExpectedAfterInsert(selectionEnd, caret, 1);
+                caret++;
+            }
+        }
+        else if (action < 6)
+        {
+            size_t offset = random() % (expected.size() + 1);
+            std::wstring text;
+            for (size_t c = random() % 6 + 1; c > 0; c--)
+            {
+                text += alphabet[random() % 10];
+            }
+            document.Insert(offset, text);
+            expected.insert(offset, text);
+            selectionStart = ExpectedAfterInsert(selectionStart, offset, text.size());
+            selectionEnd = ExpectedAfterInsert(selectionEnd, offset, text.size());
+            caret = offset + text.size();
+        }
+        else if (action == 6 && !expected.empty())
+        {
+            size_t offset = random() % expected.size();
+            size_t count = (std::min)(static_cast<size_t>(random() % 8), expected.size() - offset);
+            document.Erase(offset, count);
+            expected.erase(offset, count);
+            selectionStart = ExpectedAfterErase(selectionStart, offset, count);
+            selectionEnd = ExpectedAfterErase(selectionEnd, offset, count);
+            caret = offset;
+        }
+        else
+        {
+            size_t start = random() % (expected.size() + 1);
+            size_t end = random() % (expected.size() + 1);
+            document.SetSelection((std::min)(start, end), (std::max)(start, end));
+            selectionStart = (std::min)(start, end);
+            selectionEnd = (std::max)(start, end);
+        }
+
+        if (document.GetSelectionStart() != selectionStart || document.GetSelectionEnd() != selectionEnd)
+        {
+            fprintf(stderr, "step %zu: selection [%zu, %zu), expected [%zu, %zu)\n", i, document.GetSelectionStart(),
+                document.GetSelectionEnd(), selectionStart, selectionEnd);
+            return 1;
+        }
+        if (!Check(document.GetText(), expected, random, i))
+        {
+            return 1;
+        }
+    }
+    printf("%zu edits matched: %zu characters, %zu lines, %zu pieces\n", iterations, expected.size(),
+        document.GetText().GetLineCount(), document.GetText().GetPieceCount());
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Checks ScreenTransform at common and odd DPIs, with origins left of and
+// above the primary monitor. Every layout coordinate in a range around zero
+// is mapped with Apply and compared with exact rounding, ties to even, where
+// the scale is a multiple of a quarter so the float product is exact, which
+// covers the half-pixel ties at 144 and 240 DPI. TransformRects, in place
+// and not, must agree with Apply on every rect, which compares the SSE2 path
+// with the scalar one. ToLayout must give back every layout coordinate Apply
+// maps, and put each screen pixel in the layout pixel whose span holds it.
+// Define SCREEN_TRANSFORM_NO_SSE2 to test the scalar path alone.
+//
+// Usage: ScreenTransformTest [range] [random rects] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../ScreenTransform.h"
+
+static bool SameRect(const WidgetRect& a, const WidgetRect& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// x * dpi / 96 rounded to nearest, ties to even, in integers
+static int64_t ExactScale(int64_t x, int64_t dpi)
+{
+    int64_t product = x * dpi;
+    int64_t quotient = product / 96;
+    int64_t remainder = product % 96;
+    if (remainder < 0)
+    {
+        quotient--;
+        remainder += 96;
+    }
+    if (remainder * 2 > 96 || (remainder * 2 == 96 && quotient % 2 != 0))
+    {
+        quotient++;
+    }
+    return quotient;
+}
+
+static bool CheckTransform(const ScreenTransform& transform, int32_t range, size_t randomRects, std::mt19937& random, size_t* ties)
+{
+    // Quarter steps of scale are exact in float
+    bool exact = transform.dpi % 24 == 0;
+    std::vector<WidgetRect> rects;
+    for (int32_t x = -range; x <= range; x++)
+    {
+        WidgetRect screen = transform.Apply({ x, -x, x + 1, x + 7 });
+        int64_t expected = ExactScale(x, transform.dpi) + transform.originX;
+        if (exact && screen.left != expected)
+        {
+            fprintf(stderr, "dpi %u: Apply took %d to %d, expected %lld\n", transform.dpi, x, screen.left, static_cast<long long>(expected));
+            return false;
+        }
+        *ties += (static_cast<int64_t>(x) * transform.dpi) % 96 == 48 || (static_cast<int64_t>(x) * transform.dpi) % 96 == -48;
+
+        // Each layout pixel comes back from the screen pixel it starts at
+        int32_t layoutX;
+        int32_t layoutY;
+        transform.ToLayout(screen.left, screen.top, &layoutX, &layoutY);
+        if (transform.dpi >= ScreenTransform::kDefaultDpi && (layoutX != x || layoutY != -x))
+        {
+            fprintf(stderr, "dpi %u: ToLayout took %d, %d back to %d, %d, expected %d, %d\n", transform.dpi, screen.left, screen.top, layoutX,
+                layoutY, x, -x);
+            return false;
+        }
+
+        // And every screen pixel lands in the layout pixel whose span holds it
+        int32_t pixel = x + transform.originX;
+        transform.ToLayout(pixel, transform.originY, &layoutX, &layoutY);
+        int32_t start = transform.Apply({ layoutX, 0, layoutX + 1, 0 }).left;
+        int32_t end = transform.Apply({ layoutX, 0, layoutX + 1, 0 }).right;
+        if (pixel < start || pixel >= end || layoutY != 0)
+        {
+            fprintf(stderr, "dpi %u: pixel %d went to layout %d, which covers %d to %d\n", transform.dpi, pixel, layoutX, start, end);
+            return false;
+        }
+        rects.push_back({ x, -x, x + 1, x + 7 });
+    }
+
+    // Large and inverted rects too, which the vector path takes as they come
+    for (size_t i = 0; i < randomRects; i++)
+    {
+        int32_t a = static_cast<int32_t>(random() % 2000001) - 1000000;
+        int32_t b = static_cast<int32_t>(random() % 2000001) - 1000000;
+        int32_t c = static_cast<int32_t>(random() % 4001) - 2000;
+        int32_t d = static_cast<int32_t>(random() % 4001) - 2000;
+        rects.push_back({ a, c, b, d });
+    }
+
+    // Odd counts leave a tail for any unrolled loop
+    std::vector<WidgetRect> out(rects.size() + 1);
+    TransformRects(transform, rects.data(), out.data(), rects.size() - 1);
+    std::vector<WidgetRect> inPlace(rects.begin(), rects.end());
+    TransformRects(transform, inPlace.data(), inPlace.data(), inPlace.size());
+    for (size_t i = 0; i < rects.size(); i++)
+    {
+        WidgetRect expected = transform.Apply(rects[i]);
+        if ((i + 1 < rects.size() && !SameRect(out[i], expected)) || !SameRect(inPlace[i], expected))
+        {
+            fprintf(stderr, "dpi %u: TransformRects gave { %d, %d, %d, %d } for rect %zu, Apply { %d, %d, %d, %d }\n", transform.dpi,
+                inPlace[i].left, inPlace[i].top, inPlace[i].right, inPlace[i].bottom, i, expected.left, expected.top, expected.right,
+                expected.bottom);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int32_t range = argc > 1 ? atoi(argv[1]) : 20000;
+    size_t randomRects = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+    if (range < 1)
+    {
+        fprintf(stderr, "need a range of at least one\n");
+        return 1;
+    }
+
+    static const uint32_t kDpis[] = { 72, 96, 100, 110, 120, 144, 168, 192, 216, 240, 288, 336, 384, 480 };
+    static const int32_t kOrigins[][2] = { { 0, 0 }, { 137, 48 }, { -1920, -1 }, { -2561, -1440 } };
+    std::mt19937 random(seed);
+    size_t ties = 0;
+    size_t transforms = 0;
+    for (uint32_t dpi : kDpis)
+    {
+        for (const int32_t* origin : kOrigins)
+        {
+            ScreenTransform transform = { origin[0], origin[1], dpi };
+            if (!CheckTransform(transform, range, randomRects, random, &ties))
+            {
+                fprintf(stderr, "origin %d, %d\n", origin[0], origin[1]);
+                return 1;
+            }
+            transforms++;
+        }
+    }
+
+#ifdef SCREEN_TRANSFORM_SSE2
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    printf("%zu transforms agree with exact rounding (%zu half-pixel ties) and invert with ToLayout, %s TransformRects\n", transforms, ties,
+        path);
+    return 0;
+}
@@ -0,0 +1,415 @@
+// Runs random selection operations on a SelectionSet and on a
+// std::vector<bool> model side by side: clicks with and without toggle and
+// extend, ranges that cross 64-item words, select-all, anchors and resizes.
+// After each one it checks every item, the selected count, the anchor and
+// NextSelected. Now and then it takes the pending changes and checks their
+// runs, joined across words and dropped past 20, against the model's log of
+// flips, or dispatches them and checks the events: Invalidated past 20
+// changed items or runs, Selected when one item replaced the selection, and
+// Added or Removed per item otherwise.
+//
+// Usage: SelectionSetTest [operations] [items] [seed]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+#include "../SelectionSet.h"
+
+typedef std::pair<SelectionEvent, size_t> Event;
+
+// What SelectionSet should hold, kept the simplest way
+struct Model
+{
+    std::vector<bool> selected;
+    size_t anchor = SelectionSet::kNoItem;
+    // Pending changes, one per item flipped, in order
+    std::vector<std::pair<size_t, bool>> flips;
+
+    size_t Count() const { return static_cast<size_t>(std::count(selected.begin(), selected.end(), true)); }
+
+    void SetRange(size_t first, size_t last, bool value)
+    {
+        for (size_t i = first; i < (std::min)(last, selected.size()); i++)
+        {
+            if (selected[i] != value)
+            {
+                selected[i] = value;
+                flips.push_back({ i, value });
+            }
+        }
+    }
+
+    void Resize(size_t count)
+    {
+        selected.resize(count, false);
+        if (anchor != SelectionSet::kNoItem && anchor >= count)
+        {
+            anchor = SelectionSet::kNoItem;
+        }
+    }
+
+    void Click(size_t index, bool toggle, bool extend)
+    {
+        size_t count = selected.size();
+        if (index >= count)
+        {
+            return;
+        }
+        if (extend && anchor != SelectionSet::kNoItem)
+        {
+            size_t first = (std::min)(anchor, index);
+            size_t last = (std::max)(anchor, index) + 1;
+            SetRange(0, first, false);
+            SetRange(last, count, false);
+            SetRange(first, last, true);
+            return;
+        }
+        if (toggle)
+        {
+            SetRange(index, index + 1, !selected[index]);
+        }
+        else
+        {
+            SetRange(0, index, false);
+            SetRange(index + 1, count, false);
+            SetRange(index, index + 1, true);
+        }
+        anchor = index;
+    }
+
+    // The flips since the last dispatch as runs of flips the same way, each
+    // joining the last if it carries on where that one ended
+    SelectionSummary Summarize() const
+    {
+        SelectionSummary summary;
+        for (const std::pair<size_t, bool>& flip : flips)
+        {
+            (flip.second ? summary.added : summary.removed)++;
+            std::vector<SelectionChange>& runs = summary.runs;
+            if (!runs.empty() && runs.back().selected == flip.second && runs.back().last == flip.first)
+            {
+                runs.back().last++;
+            }
+            else
+            {
+                runs.push_back({ flip.first, flip.first + 1, flip.second });
+            }
+        }
+        if (summary.runs.size() > SelectionSummary::kMaxItemEvents)
+        {
+            summary.runs.clear();
+            summary.overflowed = true;
+        }
+        return summary;
+    }
+
+    // The events those flips call for
+    std::vector<Event> Dispatch()
+    {
+        SelectionSummary summary = Summarize();
+        flips.clear();
+        std::vector<Event> events;
+        if (summary.IsEmpty())
+        {
+            return events;
+        }
+        if (summary.IsBulk())
+        {
+            events.push_back({ SelectionEvent::Invalidated, SelectionSet::kNoItem });
+            return events;
+        }
+        for (const SelectionChange& run : summary.runs)
+        {
+            if (summary.added == 1 && Count() == 1 && run.selected && run.first < selected.size() && selected[run.first])
+            {
+                events.assign(1, { SelectionEvent::Selected, run.first });
+                break;
+            }
+            for (size_t i = run.first; i < run.last; i++)
+            {
+                events.push_back({ run.selected ? SelectionEvent::Added : SelectionEvent::Removed, i });
+            }
+        }
+        return events;
+    }
+};
+
+static std::vector<Event> Dispatch(SelectionSet& set)
+{
+    std::vector<Event> events;
+    set.DispatchChanges([&](SelectionEvent event, size_t index) { events.push_back({ event, index }); });
+    return events;
+}
+
+static bool Matches(const SelectionSet& set, const Model& model)
+{
+    if (set.GetItemCount() != model.selected.size() || set.GetSelectedCount() != model.Count() || set.GetAnchor() != model.anchor)
+    {
+        fprintf(stderr, "%zu items with %zu selected and the anchor at %zu, expected %zu with %zu and %zu\n", set.GetItemCount(),
+            set.GetSelectedCount(), set.GetAnchor(), model.selected.size(), model.Count(), model.anchor);
+        return false;
+    }
+    size_t next = set.NextSelected(0);
+    for (size_t i = 0; i < model.selected.size(); i++)
+    {
+        if (set.IsSelected(i) != model.selected[i])
+        {
+            fprintf(stderr, "item %zu is %s\n", i, set.IsSelected(i) ? "selected" : "not selected");
+            return false;
+        }
+        if (model.selected[i])
+        {
+            if (next != i)
+            {
+                fprintf(stderr, "NextSelected gave %zu where item %zu is the next selected\n", next, i);
+                return false;
+            }
+            next = set.NextSelected(i + 1);
+        }
+    }
+    if (next != SelectionSet::kNoItem)
+    {
+        fprintf(stderr, "NextSelected gave %zu past the last selected item\n", next);
+        return false;
+    }
+    return true;
+}
+
+static bool SameSummary(const SelectionSummary& summary, const SelectionSummary& expected)
+{
+    bool same = summary.added == expected.added && summary.removed == expected.removed && summary.overflowed == expected.overflowed
+        && summary.runs.size() == expected.runs.size();
+    for (size_t i = 0; same && i < summary.runs.size(); i++)
+    {
+        const SelectionChange& run = summary.runs[i];
+        same = run.first == expected.runs[i].first && run.last == expected.runs[i].last && run.selected == expected.runs[i].selected;
+    }
+    if (!same)
+    {
+        fprintf(stderr, "the changes were %zu added and %zu removed in %zu runs%s, expected %zu and %zu in %zu%s\n", summary.added, summary.removed,
+            summary.runs.size(), summary.overflowed ? " (overflowed)" : "", expected.added, expected.removed, expected.runs.size(),
+            expected.overflowed ? " (overflowed)" : "");
+    }
+    return same;
+}
+
+static bool SameEvents(const std::vector<Event>& events, const std::vector<Event>& expected, const char* what)
+{
+    if (events != expected)
+    {
+        fprintf(stderr, "%s raised %zu events, expected %zu", what, events.size(), expected.size());
+        if (!events.empty() && !expected.empty())
+        {
+            fprintf(stderr, ", first %d on %zu, expected %d on %zu", static_cast<int>(events[0].first), events[0].second,
+                static_cast<int>(expected[0].first), expected[0].second);
+        }
+        fprintf(stderr, "\n");
+        return false;
+    }
+    return true;
+}
+
+// The three kinds of announcement, and the edge of the bulk limit
+static bool CheckDispatch()
+{
+    SelectionSet set;
+    set.Resize(1000);
+    set.Click(70, false, false);
+    if (!SameEvents(Dispatch(set), { { SelectionEvent::Selected, 70 } }, "a click"))
+    {
+        return false;
+    }
+    set.Click(60, false, true);
+    std::vector<Event> expected;
+    for (size_t i = 60; i < 70; i++)
+    {
+        expected.push_back({ SelectionEvent::Added, i });
+    }
+    if (!SameEvents(Dispatch(set), expected, "a shift+click back across a word boundary"))
+    {
+        return false;
+    }
+    set.Click(5, false, false);
+    if (!SameEvents(Dispatch(set), { { SelectionEvent::Selected, 5 } }, "a click replacing 11 selected items"))
+    {
+        return false;
+    }
+
+    // Twenty separate items are announced one by one, twenty-one in bulk
+    set.Clear();
+    Dispatch(set);
+    expected.clear();
+    for (size_t i = 0; i < SelectionSummary::kMaxItemEvents; i++)
+    {
+        set.Toggle(i * 7 + 100);
+        expected.push_back({ SelectionEvent::Added, i * 7 + 100 });
+    }
+    if (!SameEvents(Dispatch(set), expected, "20 toggles"))
+    {
+        return false;
+    }
+    for (size_t i = 0; i <= SelectionSummary::kMaxItemEvents; i++)
+    {
+        set.Toggle(i * 3 + 500);
+    }
+    if (!SameEvents(Dispatch(set), { { SelectionEvent::Invalidated, SelectionSet::kNoItem } }, "21 toggles"))
+    {
+        return false;
+    }
+
+    // Shrinking drops selected items from the count without announcing them
+    set.SelectRange(900, 1000);
+    Dispatch(set);
+    set.Resize(950);
+    if (set.GetSelectedCount() != 20 + 21 + 50 || set.HasChanges())
+    {
+        fprintf(stderr, "shrinking left %zu selected\n", set.GetSelectedCount());
+        return false;
+    }
+    set.Resize(1000);
+    if (set.IsSelected(960) || set.GetSelectedCount() != 20 + 21 + 50)
+    {
+        fprintf(stderr, "growing again brought back dropped items\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t operations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t items = argc > 2 ? strtoul(argv[2], nullptr, 10) : 700;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+    if (items == 0)
+    {
+        fprintf(stderr, "need at least one item\n");
+        return 1;
+    }
+    if (!CheckDispatch())
+    {
+        return 1;
+    }
+
+    std::mt19937 random(seed);
+    SelectionSet set;
+    Model model;
+    set.Resize(items);
+    model.Resize(items);
+    size_t dispatches = 0;
+    size_t events = 0;
+    for (size_t op = 0; op < operations; op++)
+    {
+        size_t count = model.selected.size();
+        // Indexes a little past the end check that those are ignored
+        size_t index = random() % (count + 4);
+        size_t span = random() % 4 == 0 ? random() % 200 : random() % 5;
+        switch (random() % 12)
+        {
+        case 0:
+        case 1:
+        case 2:
+        {
+            bool toggle = random() % 3 == 0;
+            bool extend = random() % 3 == 0;
+            set.Click(index, toggle, extend);
+            model.Click(index, toggle, extend);
+            break;
+        }
+        case 3:
+            set.SelectRange(index, index + span);
+            model.SetRange(index, index + span, true);
+            break;
+        case 4:
+            set.DeselectRange(index, index + span);
+            model.SetRange(index, index + span, false);
+            break;
+        case 5:
+            set.Toggle(index);
+            if (index < count)
+            {
+                model.SetRange(index, index + 1, !model.selected[index]);
+            }
+            break;
+        case 6:
+            set.SetAnchor(index);
+            model.anchor = index < count ? index : SelectionSet::kNoItem;
+            break;
+        case 7:
+        {
+            bool selected = random() % 2 == 0;
+            set.ExtendTo(index, selected);
+            if (index < count)
+            {
+                size_t from = model.anchor == SelectionSet::kNoItem ? index : model.anchor;
+                model.SetRange((std::min)(from, index), (std::max)(from, index) + 1, selected);
+            }
+            break;
+        }
+        case 8:
+            if (random() % 8 == 0)
+            {
+                set.SelectAll();
+                model.SetRange(0, count, true);
+            }
+            else if (random() % 8 == 0)
+            {
+                set.Clear();
+                model.SetRange(0, count, false);
+            }
+            break;
+        case 9:
+            if (random() % 16 == 0)
+            {
+                // Grow or shrink by up to two words, to an odd size
+                size_t resized = count + random() % 257;
+                resized = resized > 129 ? resized - 128 : 1;
+                set.Resize(resized);
+                model.Resize(resized);
+            }
+            break;
+        case 10:
+            if (random() % 64 == 0)
+            {
+                set.Reset(items);
+                model = Model();
+                model.Resize(items);
+            }
+            break;
+        default:
+        {
+            // Every other time, the runs behind the events
+            if (random() % 2 == 0)
+            {
+                SelectionSummary summary;
+                set.TakeChanges(&summary);
+                if (!SameSummary(summary, model.Summarize()))
+                {
+                    fprintf(stderr, "after %zu operations\n", op + 1);
+                    return 1;
+                }
+                model.flips.clear();
+                break;
+            }
+            std::vector<Event> expected = model.Dispatch();
+            if (!SameEvents(Dispatch(set), expected, "dispatching"))
+            {
+                fprintf(stderr, "after %zu operations\n", op + 1);
+                return 1;
+            }
+            dispatches++;
+            events += expected.size();
+            break;
+        }
+        }
+        if (set.HasChanges() != !model.flips.empty() || !Matches(set, model))
+        {
+            fprintf(stderr, "after %zu operations\n", op + 1);
+            return 1;
+        }
+    }
+    printf("%zu operations on %zu items agreed with the model, with %zu events over %zu dispatches\n", operations, items, events, dispatches);
+    return 0;
+}
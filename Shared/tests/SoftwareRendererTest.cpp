@@ -0,0 +1,142 @@
+// Checks the span loops in SoftwareRenderer against per-pixel fills and
+// BlendPixel: random fills and blends of every alpha, clipped at all four
+// edges of a framebuffer whose width is not a multiple of four, must give the
+// same Framebuffer::Checksum as the reference, and a blend of every alpha
+// over every channel value must match it pixel for pixel. BlendPixel itself
+// is checked against rounded division for every input. Built once as is and
+// once with SOFTWARE_RENDERER_NO_SSE2, so the SSE2 and the scalar spans both
+// have to match the same reference.
+//
+// Usage: SoftwareRendererTest [operations] [seed]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "../SoftwareRenderer.h"
+
+static void ReferenceRect(Framebuffer& framebuffer, const WidgetRect& rect, uint32_t color, uint32_t alpha)
+{
+    uint32_t pixel = ColorToPixel(color);
+    for (int32_t y = (std::max)(rect.top, 0); y < (std::min)(rect.bottom, framebuffer.height); y++)
+    {
+        for (int32_t x = (std::max)(rect.left, 0); x < (std::min)(rect.right, framebuffer.width); x++)
+        {
+            uint32_t& dst = framebuffer.Row(y)[x];
+            dst = alpha == 255 ? pixel : BlendPixel(dst, pixel, alpha);
+        }
+    }
+}
+
+static bool SamePixels(const Framebuffer& framebuffer, const Framebuffer& reference, const char* what)
+{
+    if (framebuffer.Checksum() == reference.Checksum())
+    {
+        return true;
+    }
+    for (int32_t y = 0; y < reference.height; y++)
+    {
+        for (int32_t x = 0; x < reference.width; x++)
+        {
+            if (framebuffer.Pixel(x, y) != reference.Pixel(x, y))
+            {
+                fprintf(stderr, "%s: pixel (%d, %d) is %08X, expected %08X\n", what, x, y, framebuffer.Pixel(x, y), reference.Pixel(x, y));
+                return false;
+            }
+        }
+    }
+    fprintf(stderr, "%s: the checksums differ but the pixels do not\n", what);
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    size_t operations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], nullptr, 10)) : 1;
+
+    for (uint32_t alpha = 0; alpha < 256; alpha++)
+    {
+        for (uint32_t src = 0; src < 256; src++)
+        {
+            for (uint32_t dst = 0; dst < 256; dst++)
+            {
+                uint32_t exact = (src * alpha + dst * (255 - alpha) + 127) / 255;
+                if (BlendPixel(dst, src, alpha) != exact)
+                {
+                    fprintf(stderr, "BlendPixel(%u, %u, %u) is %u, expected %u\n", dst, src, alpha, BlendPixel(dst, src, alpha), exact);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    // Each row blends one alpha over every channel value, in each channel
+    static const uint32_t kColors[] = { 0x000000, 0xFFFFFF, 0x3C7A15, 0xC0FFEE };
+    for (uint32_t color : kColors)
+    {
+        Framebuffer framebuffer(259, 256);
+        for (int32_t y = 0; y < 256; y++)
+        {
+            for (int32_t x = 0; x < 259; x++)
+            {
+                uint32_t value = static_cast<uint32_t>(x % 256);
+                framebuffer.Row(y)[x] = value * 0x01010101u ^ static_cast<uint32_t>(x / 256) * 0x00FF00FFu;
+            }
+        }
+        Framebuffer reference = framebuffer;
+        SoftwareRenderer renderer(&framebuffer);
+        for (int32_t alpha = 0; alpha < 256; alpha++)
+        {
+            renderer.BlendRect({ 0, alpha, 259, alpha + 1 }, color, static_cast<uint8_t>(alpha));
+            ReferenceRect(reference, { 0, alpha, 259, alpha + 1 }, color, static_cast<uint32_t>(alpha));
+        }
+        if (!SamePixels(framebuffer, reference, "blending every alpha"))
+        {
+            return 1;
+        }
+    }
+
+    // Random rects on a noisy background, many narrower than four pixels and
+    // many hanging off an edge
+    std::mt19937 random(seed);
+    Framebuffer framebuffer(203, 67);
+    for (uint32_t& pixel : framebuffer.pixels)
+    {
+        pixel = static_cast<uint32_t>(random());
+    }
+    Framebuffer reference = framebuffer;
+    SoftwareRenderer renderer(&framebuffer);
+    for (size_t op = 0; op < operations; op++)
+    {
+        int32_t left = static_cast<int32_t>(random() % 240) - 20;
+        int32_t top = static_cast<int32_t>(random() % 90) - 10;
+        int32_t width = random() % 8 == 0 ? static_cast<int32_t>(random() % 260) : static_cast<int32_t>(random() % 9);
+        int32_t height = static_cast<int32_t>(random() % 12);
+        WidgetRect rect = { left, top, left + width, top + height };
+        uint32_t color = static_cast<uint32_t>(random()) & 0xFFFFFF;
+        uint32_t alpha = random() % 4 == 0 ? 255 : random() % 256;
+        if (random() % 3 == 0)
+        {
+            renderer.FillRect(rect, color);
+            ReferenceRect(reference, rect, color, 255);
+        }
+        else
+        {
+            renderer.BlendRect(rect, color, static_cast<uint8_t>(alpha));
+            ReferenceRect(reference, rect, color, alpha);
+        }
+        if ((op % 1024 == 0 || op + 1 == operations) && !SamePixels(framebuffer, reference, "random fills and blends"))
+        {
+            fprintf(stderr, "after %zu operations\n", op + 1);
+            return 1;
+        }
+    }
+#ifdef SOFTWARE_RENDERER_SSE2
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    printf("%zu fills and blends matched the reference (%s spans, checksum %016llX)\n", operations, path,
+        static_cast<unsigned long long>(framebuffer.Checksum()));
+    return 0;
+}
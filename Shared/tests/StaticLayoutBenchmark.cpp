@@ -0,0 +1,162 @@
+// Times the first tree of a fixed screen built two ways: from tables the
+// compiler lays out, as the AccessKit sample does for its static layout with
+// StaticTree.h, and through the runtime path its added widgets take, adding
+// each node to a WidgetModel and reading names and screen rects back from
+// the derived data. Screens of the sample's five nodes and of 50 and 500
+// nodes are timed, each building one stub node per widget as the initial
+// tree does. StaticTree.h needs windows.h and accesskit.h, so the tables
+// here are a local constexpr equivalent of the same shape.
+//
+// Usage: StaticLayoutBenchmark [repetitions]
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../WidgetModel.h"
+
+struct LayoutNode
+{
+    uint32_t parent;
+    WidgetRole role;
+    WidgetRect rect;
+    const char* name;
+};
+
+struct StubNode
+{
+    WidgetRole role;
+    double bounds[4];
+    std::string name;
+    uint32_t childCount;
+};
+
+static const char* const kNames[] = { "Window", "Navbar", "Button 1", "Button 2", "Button 3" };
+
+// A window, a navbar, and buttons under it in rows
+template <size_t N>
+constexpr std::array<LayoutNode, N> MakeLayout()
+{
+    std::array<LayoutNode, N> nodes{};
+    nodes[0] = { 0, WidgetRole::Window, { 0, 0, 800, 600 }, kNames[0] };
+    nodes[1] = { 0, WidgetRole::Toolbar, { 0, 0, 320, 100 }, kNames[1] };
+    for (size_t i = 2; i < N; i++)
+    {
+        int32_t x = static_cast<int32_t>((i - 2) % 3) * 100 + 10;
+        int32_t y = static_cast<int32_t>((i - 2) / 3) * 50 + 10;
+        nodes[i] = { 1, WidgetRole::Button, { x, y, x + 90, y + 40 }, kNames[2 + (i - 2) % 3] };
+    }
+    return nodes;
+}
+
+// Child counts are part of the compiled tables, as StaticTree's are
+template <size_t N>
+constexpr std::array<uint32_t, N> CountChildren(const std::array<LayoutNode, N>& nodes)
+{
+    std::array<uint32_t, N> counts{};
+    for (size_t i = 1; i < N; i++)
+    {
+        counts[nodes[i].parent]++;
+    }
+    return counts;
+}
+
+template <size_t N>
+static uint64_t BuildFromTables(std::vector<StubNode>* out)
+{
+    static constexpr std::array<LayoutNode, N> kLayout = MakeLayout<N>();
+    static constexpr std::array<uint32_t, N> kChildCounts = CountChildren(kLayout);
+    out->resize(N);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        StubNode& node = (*out)[i];
+        const LayoutNode& layout = kLayout[i];
+        node.role = layout.role;
+        node.bounds[0] = layout.rect.left;
+        node.bounds[1] = layout.rect.top;
+        node.bounds[2] = layout.rect.right;
+        node.bounds[3] = layout.rect.bottom;
+        node.name = layout.name;
+        node.childCount = kChildCounts[i];
+        sum += node.name.size() + node.childCount + static_cast<uint64_t>(node.bounds[2]);
+    }
+    return sum;
+}
+
+template <size_t N>
+static uint64_t BuildAtRuntime(std::vector<StubNode>* out)
+{
+    static constexpr std::array<LayoutNode, N> kLayout = MakeLayout<N>();
+    WidgetModel model;
+    std::vector<WidgetId> ids;
+    for (size_t i = 0; i < N; i++)
+    {
+        const LayoutNode& layout = kLayout[i];
+        const char* name = layout.name;
+        std::wstring wide(name, name + strlen(name));
+        ids.push_back(model.AddWidget(i == 0 ? kNoWidget : ids[layout.parent], layout.role, layout.rect, wide, 0xC8C8C8));
+    }
+    const DerivedData& derived = model.GetDerived();
+    out->resize(N);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        StubNode& node = (*out)[i];
+        const Widget& widget = *model.Get(ids[i]);
+        const WidgetRect& rect = derived.screenRects[ids[i].index];
+        node.role = widget.role;
+        node.bounds[0] = rect.left;
+        node.bounds[1] = rect.top;
+        node.bounds[2] = rect.right;
+        node.bounds[3] = rect.bottom;
+        node.name = derived.utf8Names[ids[i].index];
+        node.childCount = static_cast<uint32_t>(widget.children.size());
+        sum += node.name.size() + node.childCount + static_cast<uint64_t>(node.bounds[2]);
+    }
+    return sum;
+}
+
+template <size_t N>
+static bool Time(size_t repetitions)
+{
+    std::vector<StubNode> nodes;
+    uint64_t tableSum = 0;
+    uint64_t runtimeSum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repetitions; r++)
+    {
+        tableSum += BuildFromTables<N>(&nodes);
+    }
+    double tableUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repetitions;
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repetitions; r++)
+    {
+        runtimeSum += BuildAtRuntime<N>(&nodes);
+    }
+    double runtimeUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repetitions;
+    if (tableSum != runtimeSum)
+    {
+        fprintf(stderr, "%zu nodes: the tables and the model built different trees\n", N);
+        return false;
+    }
+    printf("%-8zu %14.2f %14.2f %10.1fx\n", N, tableUs, runtimeUs, runtimeUs / tableUs);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t repetitions = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    if (repetitions == 0)
+    {
+        fprintf(stderr, "need at least one repetition\n");
+        return 1;
+    }
+
+    printf("first tree of a fixed screen, mean of %zu builds, us\n", repetitions);
+    printf("%-8s %14s %14s %11s\n", "nodes", "tables", "runtime model", "ratio");
+    return Time<5>(repetitions) && Time<50>(repetitions) && Time<500>(repetitions) ? 0 : 1;
+}
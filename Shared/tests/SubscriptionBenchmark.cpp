@@ -0,0 +1,190 @@
+// Times the same script of widget mutations with no event listeners, with
+// only value changes listened for, as a progress bar's AT would, and with
+// every kind subscribed: names, rects, enabled states, values and focus on a
+// flat list of widgets, drained with TakeEvents and refreshed with
+// GetDerived once a frame, as the front-ends do. Only the mutations and the
+// drain are timed, best of three runs. Every scripted mutation changes
+// something, so the queued events must equal the mutations of the kinds
+// listened for, and the rest must be counted as skipped.
+//
+// Usage: SubscriptionBenchmark [widgets] [frames] [mutations per frame] [seed]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../WidgetModel.h"
+
+struct Mutation
+{
+    WidgetEventKind kind;
+    uint32_t widget;
+    int32_t argument;
+};
+
+struct Run
+{
+    double ms;
+    uint64_t queued;
+    uint64_t skipped;
+    uint64_t taken;
+};
+
+static Run Replay(size_t count, size_t perFrame, const std::vector<Mutation>& script, const std::vector<std::wstring>& names,
+    uint32_t subscribedMask)
+{
+    WidgetModel model;
+    for (uint32_t k = 0; k < static_cast<uint32_t>(WidgetEventKind::Count); k++)
+    {
+        model.GetEventSubscriptions().SetSubscribed(static_cast<WidgetEventKind>(k), (subscribedMask >> k) & 1);
+    }
+    WidgetId list = model.AddWidget(kNoWidget, WidgetRole::Window, { 0, 0, 400, 30000 }, L"List", 0xFFFFFF);
+    std::vector<WidgetId> widgets;
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t y = static_cast<int32_t>(i) * 24;
+        WidgetRole role = i % 4 == 0 ? WidgetRole::ProgressBar : WidgetRole::Button;
+        widgets.push_back(model.AddWidget(list, role, { 0, y, 400, y + 24 }, names[2 * i], 0xF0F0F0));
+    }
+    model.GetDerived();
+    std::vector<WidgetEvent> events;
+    model.TakeEvents(&events);
+    EventStats before = model.GetEventStats();
+
+    Run run = {};
+    for (size_t first = 0; first < script.size(); first += perFrame)
+    {
+        size_t last = (std::min)(first + perFrame, script.size());
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t m = first; m < last; m++)
+        {
+            const Mutation& mutation = script[m];
+            WidgetId id = widgets[mutation.widget];
+            switch (mutation.kind)
+            {
+            case WidgetEventKind::NameChanged:
+                model.SetName(id, names[2 * mutation.widget + mutation.argument]);
+                break;
+            case WidgetEventKind::BoundsChanged:
+            {
+                int32_t y = static_cast<int32_t>(mutation.widget) * 24;
+                model.SetRect(id, { mutation.argument, y, mutation.argument + 400, y + 24 });
+                break;
+            }
+            case WidgetEventKind::EnabledChanged:
+                model.SetEnabled(id, mutation.argument != 0);
+                break;
+            case WidgetEventKind::ValueChanged:
+                model.SetValue(id, mutation.argument);
+                break;
+            default:
+                model.SetFocus(id);
+                break;
+            }
+        }
+        model.TakeEvents(&events);
+        run.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        run.taken += events.size();
+        model.GetDerived();
+    }
+    run.queued = model.GetEventStats().queued - before.queued;
+    run.skipped = model.GetEventStats().skipped - before.skipped;
+    return run;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+    size_t frames = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000;
+    size_t perFrame = argc > 3 ? strtoul(argv[3], nullptr, 10) : 500;
+    unsigned seed = argc > 4 ? static_cast<unsigned>(strtoul(argv[4], nullptr, 10)) : 1;
+    if (count < 8 || perFrame == 0)
+    {
+        fprintf(stderr, "need at least eight widgets and one mutation a frame\n");
+        return 1;
+    }
+
+    // Two names a widget, so renames copy strings but allocate nothing new
+    std::vector<std::wstring> names;
+    for (size_t i = 0; i < count; i++)
+    {
+        names.push_back(L"Item " + std::to_wstring(i));
+        names.push_back(L"Item " + std::to_wstring(i) + L" (changed)");
+    }
+
+    // Each mutation flips one of its widget's states, so it is always a change.
+    // Values change on every fourth widget, the progress bars, and make up
+    // most of the script, as sampled values do
+    std::mt19937 random(seed);
+    std::vector<int32_t> state(3 * count, 0);
+    std::vector<int32_t> value(count, 0);
+    std::vector<Mutation> script;
+    size_t perKind[static_cast<size_t>(WidgetEventKind::Count)] = {};
+    uint32_t focused = UINT32_MAX;
+    for (size_t m = 0; m < frames * perFrame; m++)
+    {
+        uint32_t roll = random() % 16;
+        uint32_t widget = static_cast<uint32_t>(random() % count);
+        Mutation mutation;
+        if (roll < 10)
+        {
+            widget -= widget % 4;
+            value[widget] = (value[widget] + 1 + random() % 99) % 100;
+            mutation = { WidgetEventKind::ValueChanged, widget, value[widget] };
+        }
+        else if (roll < 15)
+        {
+            static const WidgetEventKind kKinds[] = { WidgetEventKind::NameChanged, WidgetEventKind::BoundsChanged, WidgetEventKind::EnabledChanged };
+            int32_t& flipped = state[3 * widget + roll % 3];
+            flipped ^= 1;
+            WidgetEventKind kind = kKinds[roll % 3];
+            mutation = { kind, widget, kind == WidgetEventKind::EnabledChanged ? 1 - flipped : flipped };
+        }
+        else
+        {
+            widget = widget == focused ? (widget + 1) % count : widget;
+            focused = widget;
+            mutation = { WidgetEventKind::Focus, widget, 0 };
+        }
+        script.push_back(mutation);
+        perKind[static_cast<size_t>(mutation.kind)]++;
+    }
+
+    struct Mode
+    {
+        const char* name;
+        uint32_t mask;
+    };
+    const uint32_t valueOnly = 1u << static_cast<uint32_t>(WidgetEventKind::ValueChanged);
+    const Mode modes[] = { { "no listeners", 0 }, { "value only", valueOnly }, { "everything", (1u << static_cast<uint32_t>(WidgetEventKind::Count)) - 1 } };
+    printf("%zu widgets, %zu frames of %zu mutations (%zu values, %zu focus, %zu other)\n", count, frames, perFrame,
+        perKind[static_cast<size_t>(WidgetEventKind::ValueChanged)], perKind[static_cast<size_t>(WidgetEventKind::Focus)],
+        script.size() - perKind[static_cast<size_t>(WidgetEventKind::ValueChanged)] - perKind[static_cast<size_t>(WidgetEventKind::Focus)]);
+    printf("%-14s %10s %12s %10s %10s\n", "listening", "total ms", "ns/mutation", "queued", "skipped");
+    for (const Mode& mode : modes)
+    {
+        // Best of three, as the runs are short
+        Run run = Replay(count, perFrame, script, names, mode.mask);
+        for (int repeat = 1; repeat < 3; repeat++)
+        {
+            run.ms = (std::min)(run.ms, Replay(count, perFrame, script, names, mode.mask).ms);
+        }
+        size_t expected = 0;
+        for (uint32_t k = 0; k < static_cast<uint32_t>(WidgetEventKind::Count); k++)
+        {
+            expected += (mode.mask >> k) & 1 ? perKind[k] : 0;
+        }
+        if (run.queued != expected || run.taken != expected || run.skipped != script.size() - expected)
+        {
+            fprintf(stderr, "%s: %llu queued, %llu taken and %llu skipped, expected %zu queued of %zu\n", mode.name,
+                static_cast<unsigned long long>(run.queued), static_cast<unsigned long long>(run.taken),
+                static_cast<unsigned long long>(run.skipped), expected, script.size());
+            return 1;
+        }
+        printf("%-14s %10.1f %12.1f %10llu %10llu\n", mode.name, run.ms, run.ms * 1e6 / (std::max)(script.size(), static_cast<size_t>(1)),
+            static_cast<unsigned long long>(run.queued), static_cast<unsigned long long>(run.skipped));
+    }
+    return 0;
+}
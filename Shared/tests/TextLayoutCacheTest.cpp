@@ -0,0 +1,114 @@
+// Checks that TextLayoutCache keys hold their own copy of the text and face
+// they were stored with, so a hit does not depend on the caller's strings
+// outliving the lookup, and that every part of the key tells entries apart.
+//
+// Usage: TextLayoutCacheTest [labels]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "../TextLayoutCache.h"
+
+// Every character is as wide as its code modulo 7, plus one
+class CountingMeasurer : public TextMeasurer
+{
+public:
+    CountingMeasurer() : calls(0) {}
+
+    int32_t MeasureText(const std::wstring& text, const FontDesc& font, std::vector<int32_t>* advances) override
+    {
+        calls++;
+        for (wchar_t c : text)
+        {
+            advances->push_back(static_cast<int32_t>(c % 7) + 1);
+        }
+        return font.height;
+    }
+
+    size_t calls;
+};
+
+static int32_t ExpectedWidth(const std::wstring& text)
+{
+    int32_t width = 0;
+    for (wchar_t c : text)
+    {
+        width += static_cast<int32_t>(c % 7) + 1;
+    }
+    return width;
+}
+
+int main(int argc, char** argv)
+{
+    size_t labels = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+
+    TextLayoutCache cache;
+    CountingMeasurer measurer;
+    for (size_t i = 0; i < labels; i++)
+    {
+        // A temporary the cache must not keep pointing at, with a face that
+        // is not a literal either
+        std::wstring face = i % 2 ? L"Arial" : L"Segoe UI";
+        FontDesc font = { 18, i % 3 == 0, face.c_str() };
+        cache.GetLayout(L"Item " + std::to_wstring(i), font, 100, 20, measurer);
+    }
+    if (measurer.calls != labels || cache.GetSize() != labels)
+    {
+        fprintf(stderr, "%zu distinct labels measured %zu times into %zu entries\n", labels, measurer.calls, cache.GetSize());
+        return 1;
+    }
+
+    for (size_t i = 0; i < labels; i++)
+    {
+        std::wstring text = L"Item " + std::to_wstring(i);
+        std::wstring face = i % 2 ? L"Arial" : L"Segoe UI";
+        FontDesc font = { 18, i % 3 == 0, face.c_str() };
+        const TextLayout& layout = cache.GetLayout(text, font, 100, 20, measurer);
+        if (layout.width != ExpectedWidth(text) || layout.x != (100 - layout.width) / 2 || layout.advances.size() != text.size())
+        {
+            fprintf(stderr, "label %zu came back with the wrong layout\n", i);
+            return 1;
+        }
+    }
+    if (measurer.calls != labels || cache.GetStats().hits != labels)
+    {
+        fprintf(stderr, "repeated lookups measured %zu more times\n", measurer.calls - labels);
+        return 1;
+    }
+
+    // Each part of the key on its own makes a new entry
+    const std::wstring text = L"Item 1";
+    FontDesc arial = { 18, false, L"Arial" };
+    FontDesc bold = { 18, true, L"Arial" };
+    FontDesc taller = { 20, false, L"Arial" };
+    FontDesc fallback = { 18, false, nullptr };
+    cache.GetLayout(text, arial, 100, 20, measurer);
+    size_t before = measurer.calls;
+    cache.GetLayout(L"Item 1 ", arial, 100, 20, measurer);
+    cache.GetLayout(text, bold, 100, 20, measurer);
+    cache.GetLayout(text, taller, 100, 20, measurer);
+    cache.GetLayout(text, fallback, 100, 20, measurer);
+    cache.GetLayout(text, arial, 101, 20, measurer);
+    cache.GetLayout(text, arial, 100, 21, measurer);
+    cache.GetLayout(L"", fallback, 100, 20, measurer);
+    cache.GetLayout(L"", fallback, 100, 20, measurer);
+    if (measurer.calls - before != 7)
+    {
+        fprintf(stderr, "7 new keys measured %zu times\n", measurer.calls - before);
+        return 1;
+    }
+
+    for (uint64_t frame = 0; frame <= TextLayoutCache::kIdleFrames + 1; frame++)
+    {
+        cache.BeginFrame();
+        cache.GetLayout(text, arial, 100, 20, measurer);
+        cache.EndFrame();
+    }
+    if (cache.GetSize() != 1)
+    {
+        fprintf(stderr, "%zu entries left after the others went idle\n", cache.GetSize());
+        return 1;
+    }
+    printf("%zu labels laid out once each\n", labels);
+    return 0;
+}
@@ -0,0 +1,168 @@
+// Times the range operations a text pattern provider makes on a large
+// TextDocument: moving by line and by word, reading a line's text, and the
+// bounding rectangles of a range after scrolling it into view. The document
+// is a few hundred thousand lines of words, edited at random first so the
+// piece table holds many pieces, as it would after a session of typing. The
+// edited text is checked against the same edits on a std::wstring.
+//
+// Usage: TextRangeBenchmark [lines] [edits] [queries] [seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <random>
+#include <string>
+#include <vector>
+#include "../TextDocument.h"
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Report(const char* what, double ms, size_t queries)
+{
+    printf("%-22s %10.1f ms %8.3f us each\n", what, ms, queries ? ms * 1e3 / queries : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+    size_t lines = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    size_t edits = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20000;
+    size_t queries = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1000000;
+    unsigned seed = argc > 4 ? static_cast<unsigned>(strtoul(argv[4], nullptr, 10)) : 1;
+    if (lines == 0)
+    {
+        fprintf(stderr, "need at least one line\n");
+        return 1;
+    }
+
+    static const wchar_t* const kWords[] = { L"lorem", L"ipsum", L"dolor", L"sit", L"amet,", L"consectetur", L"adipiscing", L"elit." };
+    std::mt19937 random(seed);
+    std::wstring text;
+    for (size_t line = 0; line < lines; line++)
+    {
+        for (int word = 0; word < 6; word++)
+        {
+            text += kWords[random() % 8];
+            text += word < 5 ? L' ' : L'\n';
+        }
+    }
+
+    TextDocument document(8, 16);
+    document.SetViewport({ 0, 0, 800, 600 });
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    document.SetText(text);
+    double loadMs = MillisecondsSince(start);
+
+    // Only the document's edits are timed; the string catches up after
+    struct Edit
+    {
+        size_t offset;
+        size_t erased;
+        const wchar_t* inserted;
+    };
+    std::vector<Edit> planned;
+    size_t planLength = text.size();
+    for (size_t i = 0; i < edits; i++)
+    {
+        size_t offset = random() % (planLength + 1);
+        if (random() % 2 == 0 || planLength < 16)
+        {
+            const wchar_t* inserted = random() % 4 == 0 ? L"new line\n" : L"word ";
+            planned.push_back({ offset, 0, inserted });
+            planLength += wcslen(inserted);
+        }
+        else
+        {
+            size_t count = (std::min)(static_cast<size_t>(random() % 12), planLength - offset);
+            planned.push_back({ offset, count, nullptr });
+            planLength -= count;
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    for (const Edit& edit : planned)
+    {
+        if (edit.inserted)
+        {
+            document.Insert(edit.offset, edit.inserted);
+        }
+        else
+        {
+            document.Erase(edit.offset, edit.erased);
+        }
+    }
+    double editMs = MillisecondsSince(start);
+    for (const Edit& edit : planned)
+    {
+        if (edit.inserted)
+        {
+            text.insert(edit.offset, edit.inserted);
+        }
+        else
+        {
+            text.erase(edit.offset, edit.erased);
+        }
+    }
+    if (document.GetText().GetText(0, document.GetLength()) != text)
+    {
+        fprintf(stderr, "the edited document does not match the edited string\n");
+        return 1;
+    }
+
+    size_t length = document.GetLength();
+    std::vector<size_t> offsets(4096);
+    for (size_t& offset : offsets)
+    {
+        offset = random() % length;
+    }
+
+    size_t sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++)
+    {
+        sum += document.NextBoundary(offsets[i % offsets.size()], TextUnitKind::Line);
+    }
+    double lineMs = MillisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++)
+    {
+        size_t offset = offsets[i % offsets.size()];
+        sum += document.NextBoundary(offset, TextUnitKind::Word) + document.PreviousBoundary(offset, TextUnitKind::Word);
+    }
+    double wordMs = MillisecondsSince(start);
+
+    std::wstring lineText;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++)
+    {
+        size_t lineStart = document.UnitStart(offsets[i % offsets.size()], TextUnitKind::Line);
+        document.GetText().GetText(lineStart, 80, &lineText);
+        sum += lineText.size();
+    }
+    double textMs = MillisecondsSince(start);
+
+    std::vector<WidgetRect> rects;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++)
+    {
+        size_t offset = offsets[i % offsets.size()];
+        document.ScrollIntoView(offset, true);
+        document.GetRangeRects(offset, (std::min)(offset + 200, length), &rects);
+        sum += rects.size();
+    }
+    double rectMs = MillisecondsSince(start);
+
+    printf("%zu lines, %zu characters in %zu pieces after %zu edits (checksum %zu)\n", document.GetText().GetLineCount(), length,
+        document.GetText().GetPieceCount(), edits, sum);
+    Report("load", loadMs, 1);
+    Report("edit", editMs, edits);
+    Report("move by line", lineMs, queries);
+    Report("move by word (both)", wordMs, queries);
+    Report("line text (80)", textMs, queries);
+    Report("rects (200 chars)", rectMs, queries);
+    return 0;
+}
@@ -0,0 +1,421 @@
+// Records a random session of model, selection and text document changes,
+// with entry point records among them, then replays the trace into a fresh
+// ModelReplayTarget and checks that it ends on the same widgets, selection,
+// subscriptions and document, with every record applied. Then checks that a
+// trace cut off inside a record or with a bad header or event is rejected,
+// and replays copies with random bytes changed or cut off, one per seed, to
+// check that no trace makes the replay fail in any way but refusing records.
+//
+// Usage: TraceReplayTest [steps] [fuzz seeds] [seed]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../TraceReplay.h"
+
+static const char* const kTracePath = "TraceReplayTest.trace";
+
+// Widgets in document order, for comparing models whose slots differ
+static void Flatten(const WidgetModel& model, std::vector<WidgetId>* order)
+{
+    std::vector<WidgetId> pending(model.GetRoots().rbegin(), model.GetRoots().rend());
+    while (!pending.empty())
+    {
+        WidgetId id = pending.back();
+        pending.pop_back();
+        order->push_back(id);
+        const std::vector<WidgetId>& children = model.Get(id)->children;
+        pending.insert(pending.end(), children.rbegin(), children.rend());
+    }
+}
+
+static bool SameRect(const WidgetRect& a, const WidgetRect& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+static bool SameModel(WidgetModel& live, WidgetModel& replayed)
+{
+    std::vector<WidgetId> a;
+    std::vector<WidgetId> b;
+    Flatten(live, &a);
+    Flatten(replayed, &b);
+    if (a.size() != b.size())
+    {
+        fprintf(stderr, "%zu widgets live, %zu replayed\n", a.size(), b.size());
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        const Widget& x = *live.Get(a[i]);
+        const Widget& y = *replayed.Get(b[i]);
+        if (x.role != y.role || x.enabled != y.enabled || x.color != y.color || !SameRect(x.rect, y.rect) || x.name != y.name
+            || x.value != y.value || x.minimum != y.minimum || x.maximum != y.maximum || x.children.size() != y.children.size())
+        {
+            fprintf(stderr, "widget %zu in document order differs\n", i);
+            return false;
+        }
+        if ((live.GetFocus() == a[i]) != (replayed.GetFocus() == b[i]))
+        {
+            fprintf(stderr, "focus differs at widget %zu\n", i);
+            return false;
+        }
+    }
+    if (live.GetScreenTransform() != replayed.GetScreenTransform())
+    {
+        fprintf(stderr, "screen transforms differ\n");
+        return false;
+    }
+    for (size_t kind = 0; kind < static_cast<size_t>(WidgetEventKind::Count); kind++)
+    {
+        WidgetEventKind k = static_cast<WidgetEventKind>(kind);
+        if (live.GetEventSubscriptions().GetCount(k) != replayed.GetEventSubscriptions().GetCount(k))
+        {
+            fprintf(stderr, "listener counts differ for event kind %zu\n", kind);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool SameSelection(const SelectionSet& live, const SelectionSet* replayed)
+{
+    if (!replayed || live.GetItemCount() != replayed->GetItemCount() || live.GetSelectedCount() != replayed->GetSelectedCount()
+        || live.GetAnchor() != replayed->GetAnchor())
+    {
+        fprintf(stderr, "selection counts or anchor differ\n");
+        return false;
+    }
+    for (size_t i = 0; i < live.GetItemCount(); i++)
+    {
+        if (live.IsSelected(i) != replayed->IsSelected(i))
+        {
+            fprintf(stderr, "item %zu is selected in one selection only\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool SameDocument(const TextDocument& live, const TextDocument& replayed)
+{
+    if (live.GetText().GetText(0, live.GetLength()) != replayed.GetText().GetText(0, replayed.GetLength())
+        || live.GetSelectionStart() != replayed.GetSelectionStart() || live.GetSelectionEnd() != replayed.GetSelectionEnd()
+        || live.GetFirstVisibleLine() != replayed.GetFirstVisibleLine() || !SameRect(live.GetViewport(), replayed.GetViewport())
+        || live.GetCharWidth() != replayed.GetCharWidth() || live.GetLineHeight() != replayed.GetLineHeight())
+    {
+        fprintf(stderr, "documents differ\n");
+        return false;
+    }
+    return true;
+}
+
+static std::wstring RandomText(std::mt19937& random, size_t length)
+{
+    static const wchar_t kChars[] = L"abc xyz.\né中";
+    std::wstring text;
+    for (size_t i = 0; i < length; i++)
+    {
+        text += kChars[random() % (sizeof(kChars) / sizeof(kChars[0]) - 1)];
+    }
+    return text;
+}
+
+// Makes one random change, or records one entry point call, the way the
+// samples do while a trace is active
+static void Step(std::mt19937& random, WidgetModel& model, WidgetId navbar, std::vector<WidgetId>& live, SelectionSet& selection, TextDocument& document)
+{
+    WidgetId target = live[random() % live.size()];
+    int32_t x = static_cast<int32_t>(random() % 1000) - 100;
+    int32_t y = static_cast<int32_t>(random() % 600) - 100;
+    size_t items = selection.GetItemCount();
+    size_t item = items ? random() % items : 0;
+    size_t length = document.GetLength();
+    switch (random() % 16)
+    {
+    case 0:
+    {
+        WidgetRole role = static_cast<WidgetRole>(random() % (static_cast<unsigned>(WidgetRole::ProgressBar) + 1));
+        WidgetId parent = random() % 2 ? navbar : target;
+        live.push_back(model.AddWidget(parent, role, { x, y, x + 40, y + 20 }, RandomText(random, random() % 12), random() % 0x1000000));
+        break;
+    }
+    case 1:
+        if (target != navbar)
+        {
+            model.RemoveWidget(target);
+            live.erase(std::remove_if(live.begin(), live.end(), [&](WidgetId id) { return !model.Contains(id); }), live.end());
+        }
+        break;
+    case 2:
+        if (target != navbar)
+        {
+            model.MoveWidget(target, random() % 4 ? live[random() % live.size()] : kNoWidget, random() % 6);
+        }
+        break;
+    case 3:
+        model.SetName(target, RandomText(random, random() % 20));
+        break;
+    case 4:
+        model.SetRect(target, { x, y, x + static_cast<int32_t>(random() % 200), y + static_cast<int32_t>(random() % 50) });
+        break;
+    case 5:
+        model.SetEnabled(target, random() % 2 != 0);
+        break;
+    case 6:
+        model.SetRange(target, 0, 50 + random() % 100);
+        model.SetValue(target, random() % 200);
+        break;
+    case 7:
+        model.SetFocus(random() % 8 ? target : kNoWidget);
+        break;
+    case 8:
+    {
+        WidgetEventKind kind = static_cast<WidgetEventKind>(random() % static_cast<unsigned>(WidgetEventKind::Count));
+        if (random() % 2)
+        {
+            model.GetEventSubscriptions().Add(kind);
+        }
+        else
+        {
+            model.GetEventSubscriptions().Remove(kind);
+        }
+        break;
+    }
+    case 9:
+        selection.Click(item, random() % 3 == 0, random() % 3 == 0);
+        break;
+    case 10:
+    {
+        // Ranges that cross word boundaries, and sometimes the end
+        size_t first = items ? random() % items : 0;
+        size_t last = first + random() % 150;
+        if (random() % 2)
+        {
+            selection.SelectRange(first, last);
+        }
+        else
+        {
+            selection.DeselectRange(first, last);
+        }
+        if (random() % 4 == 0)
+        {
+            selection.SetAnchor(item);
+        }
+        break;
+    }
+    case 11:
+        if (random() % 8 == 0)
+        {
+            selection.Reset(random() % 300);
+        }
+        else
+        {
+            selection.Resize(random() % 300);
+        }
+        break;
+    case 12:
+        if (random() % 2)
+        {
+            document.Insert(length ? random() % length : 0, RandomText(random, 1 + random() % 30));
+        }
+        else
+        {
+            document.Erase(length ? random() % length : 0, random() % 20);
+        }
+        break;
+    case 13:
+        if (random() % 3 == 0)
+        {
+            document.SetSelection(length ? random() % length : 0, length ? random() % length : 0);
+        }
+        else if (random() % 2)
+        {
+            document.ScrollBy(static_cast<int>(random() % 21) - 10);
+        }
+        else
+        {
+            document.ScrollIntoView(length ? random() % length : 0, random() % 2 != 0);
+        }
+        break;
+    case 14:
+    {
+        // Entry points, on elements that exist when they are made
+        int64_t slot = navbar.index;
+        int64_t child = static_cast<int64_t>(random() % (model.GetChildCount(navbar) + 1)) - 1;
+        int64_t start = length ? random() % length : 0;
+        int64_t end = start + random() % 200;
+        TraceCall(TraceEvent::GetPropertyValue, { slot, child, 30005 });
+        TraceCall(TraceEvent::GetRuntimeId, { slot, child });
+        TraceCall(TraceEvent::GetValue, { slot, child });
+        TraceCall(TraceEvent::GetSelection, { slot, kTraceSelf });
+        TraceCall(TraceEvent::SelectItem, { slot, static_cast<int64_t>(item), static_cast<int64_t>(random() % 3) });
+        TraceCall(TraceEvent::AdviseEvent, { slot, kTraceSelf, 20005, static_cast<int64_t>(random() % 2) });
+        TraceCall(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetText), start, end, -1 });
+        TraceCall(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetBoundingRectangles), start, end });
+        TraceCall(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::Move), start, end, static_cast<int64_t>(TextUnitKind::Word), static_cast<int64_t>(random() % 7) - 3 });
+        TraceCall(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::ExpandToEnclosingUnit), start, start, static_cast<int64_t>(TextUnitKind::Line) });
+        TraceCall(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::RangeFromPoint), 0, 0, x, y });
+        std::string needle = "ab";
+        ActiveTrace()->Write(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::FindText), 0, static_cast<int64_t>(length), 0, 1 }, {}, &needle);
+        break;
+    }
+    default:
+        model.SetScreenTransform({ x, y, 96u + 24u * static_cast<uint32_t>(random() % 3) });
+        break;
+    }
+    std::vector<WidgetEvent> events;
+    model.TakeEvents(&events);
+}
+
+static ReplayStats Replay(const std::vector<uint8_t>& trace, ModelReplayTarget& target, bool* valid)
+{
+    QueryTraceReader reader(trace.data(), trace.size());
+    *valid = reader.IsValid();
+    return ReplayTrace(reader, target, ReplaySpeed::Maximum);
+}
+
+int main(int argc, char** argv)
+{
+    size_t steps = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+    size_t fuzzSeeds = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1800;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+
+    // State from before recording starts, which the snapshots carry over
+    std::mt19937 random(seed);
+    WidgetModel model;
+    SelectionSet selection;
+    TextDocument document(8, 16);
+    WidgetId navbar = model.AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, 800, 50 }, L"Navbar", 0xFF0000);
+    std::vector<WidgetId> live = { navbar };
+    for (int32_t i = 0; i < 10; i++)
+    {
+        live.push_back(model.AddWidget(navbar, WidgetRole::Button, { i * 50, 0, i * 50 + 40, 40 }, L"Box " + std::to_wstring(i), 0xFFFFFF));
+    }
+    model.GetEventSubscriptions().Add(WidgetEventKind::Focus);
+    selection.SetTraceSlot(navbar.index);
+    selection.Resize(100);
+    selection.SelectRange(60, 70);
+    selection.Click(3, true, false);
+    document.SetText(RandomText(random, 5000));
+    document.SetViewport({ 0, 0, 400, 300 });
+    document.ScrollToLine(3);
+    document.SetSelection(10, 20);
+
+    QueryTraceWriter writer;
+    if (!writer.Open(kTracePath))
+    {
+        fprintf(stderr, "cannot write %s\n", kTracePath);
+        return 1;
+    }
+    model.TraceSnapshot(&writer);
+    selection.TraceSnapshot(&writer);
+    document.TraceSnapshot(&writer);
+    ActiveTrace() = &writer;
+    for (size_t i = 0; i < steps; i++)
+    {
+        Step(random, model, navbar, live, selection, document);
+    }
+    // Ends on a long record, so there is a record to cut in half
+    model.SetName(navbar, std::wstring(300, L'n'));
+    ActiveTrace() = nullptr;
+    uint64_t recorded = writer.GetRecordCount();
+    writer.Close();
+
+    std::vector<uint8_t> trace;
+    {
+        MappedFile file;
+        if (!file.Open(kTracePath))
+        {
+            fprintf(stderr, "cannot read %s back\n", kTracePath);
+            return 1;
+        }
+        trace.assign(file.GetData(), file.GetData() + file.GetSize());
+    }
+    remove(kTracePath);
+
+    bool valid;
+    ModelReplayTarget target;
+    ReplayStats stats = Replay(trace, target, &valid);
+    if (!valid || stats.corrupt || stats.records != recorded || stats.failed != 0)
+    {
+        fprintf(stderr, "%llu of %llu records replayed, %llu not applied%s\n", static_cast<unsigned long long>(stats.records),
+            static_cast<unsigned long long>(recorded), static_cast<unsigned long long>(stats.failed), stats.corrupt ? ", corrupt" : "");
+        return 1;
+    }
+    if (!SameModel(model, target.GetModel()) || !SameSelection(selection, target.GetSelection(navbar.index)) || !SameDocument(document, target.GetDocument()))
+    {
+        return 1;
+    }
+    printf("%zu steps, %llu records in %zu bytes replayed to the same state\n", steps, static_cast<unsigned long long>(recorded), trace.size());
+
+    // Cut inside the last record, a trace reads as corrupt; a cut between
+    // records cannot be told from a shorter session
+    {
+        std::vector<uint8_t> cut(trace.begin(), trace.end() - 100);
+        ModelReplayTarget cutTarget;
+        ReplayStats cutStats = Replay(cut, cutTarget, &valid);
+        if (!cutStats.corrupt || cutStats.records != recorded - 1)
+        {
+            fprintf(stderr, "a trace cut inside its last record was not reported as corrupt\n");
+            return 1;
+        }
+    }
+    {
+        std::vector<uint8_t> version = trace;
+        version[sizeof(kTraceMagic) - 1]++;
+        ModelReplayTarget versionTarget;
+        ReplayStats versionStats = Replay(version, versionTarget, &valid);
+        if (valid || versionStats.records != 0)
+        {
+            fprintf(stderr, "a trace of another format version was read\n");
+            return 1;
+        }
+    }
+    {
+        // The first record's event, after its time varint
+        std::vector<uint8_t> event = trace;
+        size_t position = sizeof(kTraceMagic);
+        while (event[position] & 0x80)
+        {
+            position++;
+        }
+        event[position + 1] = static_cast<uint8_t>(TraceEvent::Count);
+        ModelReplayTarget eventTarget;
+        ReplayStats eventStats = Replay(event, eventTarget, &valid);
+        if (!eventStats.corrupt || eventStats.records != 0)
+        {
+            fprintf(stderr, "a record of an unknown event was read\n");
+            return 1;
+        }
+    }
+
+    // Random damage: whatever a copy decodes to, replaying it must only ever
+    // refuse records or stop at a corrupt one
+    size_t corrupt = 0;
+    size_t refused = 0;
+    for (size_t s = 0; s < fuzzSeeds; s++)
+    {
+        std::mt19937 damage(static_cast<unsigned>(s));
+        std::vector<uint8_t> copy = trace;
+        size_t changes = 1 + damage() % 8;
+        for (size_t i = 0; i < changes; i++)
+        {
+            copy[sizeof(kTraceMagic) + damage() % (copy.size() - sizeof(kTraceMagic))] = static_cast<uint8_t>(damage());
+        }
+        if (damage() % 4 == 0)
+        {
+            copy.resize(sizeof(kTraceMagic) + damage() % (copy.size() - sizeof(kTraceMagic)));
+        }
+        ModelReplayTarget fuzzTarget;
+        ReplayStats fuzzStats = Replay(copy, fuzzTarget, &valid);
+        corrupt += fuzzStats.corrupt;
+        refused += fuzzStats.failed != 0;
+        fuzzTarget.GetModel().GetDerived();
+    }
+    printf("%zu damaged traces replayed: %zu stopped at a corrupt record, %zu had records refused\n", fuzzSeeds, corrupt, refused);
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Times building one node per widget on a WorkStealingPool, the way the
+// AccessKit sample builds its initial tree, for 1, 2, 4, ... threads up to
+// the core count. The node builder is a stand-in that allocates and copies
+// what an accesskit_node_builder is given, so this runs without AccessKit and
+// on any platform; run it on a machine with several cores to see the scaling.
+//
+// Usage: TreeBuildBenchmark [widgets] [max threads] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../WidgetModel.h"
+#include "../WorkStealingPool.h"
+
+// As in the AccessKit sample
+static const size_t kNodesPerTask = 2048;
+
+struct StubNode
+{
+    WidgetRole role;
+    double bounds[4];
+    std::string name;
+    std::vector<uint64_t> children;
+    double value;
+};
+
+static StubNode* BuildNode(const WidgetModel& model, WidgetId id, const DerivedData& derived)
+{
+    const Widget& widget = *model.Get(id);
+    const WidgetRect& rect = derived.screenRects[id.index];
+    StubNode* node = new StubNode;
+    node->role = widget.role;
+    node->bounds[0] = rect.left;
+    node->bounds[1] = rect.top;
+    node->bounds[2] = rect.right;
+    node->bounds[3] = rect.bottom;
+    node->name = derived.utf8Names[id.index];
+    node->value = widget.value;
+    node->children.reserve(widget.children.size());
+    for (WidgetId child : widget.children)
+    {
+        node->children.push_back(child.index);
+    }
+    return node;
+}
+
+static void Free(std::vector<StubNode*>* nodes)
+{
+    for (StubNode* node : *nodes)
+    {
+        delete node;
+    }
+    nodes->clear();
+}
+
+// A toolbar-heavy forest: every fifth widget is a container, and each widget
+// goes under a pseudo-random earlier container
+static void BuildModel(WidgetModel* model, size_t count)
+{
+    std::vector<WidgetId> containers = { kNoWidget };
+    for (size_t i = 0; i < count; i++)
+    {
+        WidgetId parent = containers[(i * 7919) % containers.size()];
+        WidgetRole role = i % 5 ? WidgetRole::Button : WidgetRole::Toolbar;
+        int32_t x = static_cast<int32_t>(i % 900);
+        int32_t y = static_cast<int32_t>(i % 700);
+        WidgetId id = model->AddWidget(parent, role, { x, y, x + 20, y + 20 }, L"Widget " + std::to_wstring(i), 0xFFFFFF);
+        if (role == WidgetRole::Toolbar)
+        {
+            containers.push_back(id);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t widgets = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    size_t maxThreads = argc > 2 ? strtoul(argv[2], nullptr, 10) : (std::max)(std::thread::hardware_concurrency(), 1u);
+    int repetitions = argc > 3 ? atoi(argv[3]) : 5;
+
+    WidgetModel model;
+    BuildModel(&model, widgets);
+    const DerivedData& derived = model.GetDerived();
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    SplitIntoSubtrees(derived, kNodesPerTask, &runs);
+    printf("%zu widgets in %zu runs, %u cores\n", widgets, runs.size(), std::thread::hardware_concurrency());
+
+    // The sample's single-threaded path, in storage order
+    std::vector<StubNode*> serial(model.GetWidgets().slotCount(), nullptr);
+    double serialMs = 1e30;
+    for (int rep = 0; rep < repetitions; rep++)
+    {
+        Free(&serial);
+        serial.assign(model.GetWidgets().slotCount(), nullptr);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < model.GetWidgets().size(); i++)
+        {
+            WidgetId widget = model.GetWidgets().handleAt(i);
+            serial[widget.index] = BuildNode(model, widget, derived);
+        }
+        serialMs = (std::min)(serialMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    printf("%8s %10s %8s\n", "threads", "ms", "speedup");
+    printf("%8s %10.2f %8s\n", "serial", serialMs, "1.00");
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+    for (size_t threads : threadCounts)
+    {
+        WorkStealingPool pool(threads);
+        std::vector<StubNode*> built;
+        double best = 1e30;
+        for (int rep = 0; rep < repetitions; rep++)
+        {
+            Free(&built);
+            built.assign(model.GetWidgets().slotCount(), nullptr);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            pool.ForEach(runs.size(), [&](size_t run, size_t) {
+                for (uint32_t p = runs[run].first; p < runs[run].second; p++)
+                {
+                    WidgetId widget = derived.preorder[p];
+                    built[widget.index] = BuildNode(model, widget, derived);
+                }
+            });
+            best = (std::min)(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        for (size_t slot = 0; slot < built.size(); slot++)
+        {
+            if ((built[slot] == nullptr) != (serial[slot] == nullptr) || (built[slot] && (built[slot]->name != serial[slot]->name || built[slot]->children != serial[slot]->children)))
+            {
+                fprintf(stderr, "%zu threads built a different node for slot %zu\n", threads, slot);
+                return 1;
+            }
+        }
+        printf("%8zu %10.2f %8.2f\n", threads, best, serialMs / best);
+        Free(&built);
+    }
+    Free(&serial);
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Times WidgetTreeDiff on a WorkStealingPool for 1, 2, 4, ... threads up to
+// the core count, after no change, after a few widgets moved and after a
+// relayout that moves them all. Before that it checks that a baseline seeded
+// while the tree is built, the way the AccessKit sample does it, is the one
+// a full diff would have kept. Run it on a machine with several cores to see
+// the scaling.
+//
+// Usage: TreeDiffBenchmark [widgets] [max threads] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../WidgetTreeDiff.h"
+
+// As in the AccessKit sample
+static const size_t kNodesPerTask = 2048;
+
+// A toolbar-heavy forest: every fifth widget is a container, and each widget
+// goes under a pseudo-random earlier container
+static void BuildModel(WidgetModel* model, size_t count)
+{
+    std::vector<WidgetId> containers = { kNoWidget };
+    for (size_t i = 0; i < count; i++)
+    {
+        WidgetId parent = containers[(i * 7919) % containers.size()];
+        WidgetRole role = i % 5 ? WidgetRole::Button : WidgetRole::Toolbar;
+        int32_t x = static_cast<int32_t>(i % 900);
+        int32_t y = static_cast<int32_t>(i % 700);
+        WidgetId id = model->AddWidget(parent, role, { x, y, x + 20, y + 20 }, L"Widget " + std::to_wstring(i), 0xFFFFFF);
+        if (role == WidgetRole::Toolbar)
+        {
+            containers.push_back(id);
+        }
+    }
+}
+
+static double Milliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Moves every hundredth widget by a pixel, or back
+static void MoveFew(WidgetModel& model, int32_t offset)
+{
+    const SlotMap<Widget>& widgets = model.GetWidgets();
+    for (size_t i = 0; i < widgets.size(); i += 100)
+    {
+        WidgetId id = widgets.handleAt(i);
+        WidgetRect rect = model.Get(id)->rect;
+        model.SetRect(id, { rect.left + offset, rect.top, rect.right + offset, rect.bottom });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t widgets = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    size_t maxThreads = argc > 2 ? strtoul(argv[2], nullptr, 10) : (std::max)(std::thread::hardware_concurrency(), 1u);
+    int repetitions = argc > 3 ? atoi(argv[3]) : 5;
+
+    WidgetModel model;
+    BuildModel(&model, widgets);
+    const DerivedData& derived = model.GetDerived();
+    printf("%zu widgets, %u cores\n", widgets, std::thread::hardware_concurrency());
+
+    std::vector<WidgetId> changed;
+    std::vector<WidgetId> removed;
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    SplitIntoSubtrees(derived, kNodesPerTask, &runs);
+    {
+        WorkStealingPool pool(maxThreads);
+        WidgetTreeDiff diff;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        diff.Diff(model, pool, &changed, &removed);
+        double fullMs = Milliseconds(start);
+
+        start = std::chrono::steady_clock::now();
+        diff.BeginSeed(model);
+        pool.ForEach(runs.size(), [&](size_t run, size_t) {
+            diff.SeedRun(model, derived, runs[run].first, runs[run].second, kNodesPerTask);
+        });
+        diff.EndSeed(derived, kNodesPerTask);
+        double seedMs = Milliseconds(start);
+
+        diff.Diff(model, pool, &changed, &removed);
+        if (!changed.empty() || !removed.empty())
+        {
+            fprintf(stderr, "the seeded baseline differs from the tree: %zu changed, %zu removed\n", changed.size(), removed.size());
+            return 1;
+        }
+        printf("baseline on %zu threads: diff from empty %.2f ms, seeded %.2f ms\n", maxThreads, fullMs, seedMs);
+    }
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    printf("%8s %10s %10s %10s\n", "threads", "none ms", "few ms", "all ms");
+    std::vector<WidgetId> expectedFew;
+    double oneThread[3] = {};
+    for (size_t threads : threadCounts)
+    {
+        WorkStealingPool pool(threads);
+        WidgetTreeDiff diff;
+        diff.Diff(model, pool, &changed, &removed);
+        double best[3] = { 1e30, 1e30, 1e30 };
+        for (int rep = 0; rep < repetitions; rep++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            diff.Diff(model, pool, &changed, &removed);
+            best[0] = (std::min)(best[0], Milliseconds(start));
+            if (!changed.empty())
+            {
+                fprintf(stderr, "%zu threads found %zu changes where there were none\n", threads, changed.size());
+                return 1;
+            }
+
+            MoveFew(model, 1);
+            start = std::chrono::steady_clock::now();
+            diff.Diff(model, pool, &changed, &removed);
+            best[1] = (std::min)(best[1], Milliseconds(start));
+            std::sort(changed.begin(), changed.end(), [](WidgetId a, WidgetId b) { return a.index < b.index; });
+            if (expectedFew.empty())
+            {
+                expectedFew = changed;
+            }
+            else if (changed != expectedFew)
+            {
+                fprintf(stderr, "%zu threads found %zu moved widgets, expected %zu\n", threads, changed.size(), expectedFew.size());
+                return 1;
+            }
+            MoveFew(model, -1);
+            diff.Diff(model, pool, &changed, &removed);
+
+            model.SetScreenOrigin(10, 0);
+            start = std::chrono::steady_clock::now();
+            diff.Diff(model, pool, &changed, &removed);
+            best[2] = (std::min)(best[2], Milliseconds(start));
+            if (changed.size() != widgets)
+            {
+                fprintf(stderr, "%zu threads found %zu widgets moved by a relayout of %zu\n", threads, changed.size(), widgets);
+                return 1;
+            }
+            model.SetScreenOrigin(0, 0);
+            diff.Diff(model, pool, &changed, &removed);
+        }
+        if (threads == 1)
+        {
+            std::copy(best, best + 3, oneThread);
+        }
+        printf("%8zu %10.2f %10.2f %10.2f   speedup %.2f %.2f %.2f\n", threads, best[0], best[1], best[2],
+            oneThread[0] / best[0], oneThread[1] / best[1], oneThread[2] / best[2]);
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+// Drives a ValueNotifier with synthetic timestamps. Fixed scenarios check
+// the leading edge (the first change after a quiet period goes out on the
+// next Flush), throttling to one notification per interval, the trailing
+// edge (the last change in a burst is still delivered once the interval has
+// passed, with the last value), GetNextDue, Forget and slot reuse. Then
+// random bursts on many widgets are checked for the same rules: no widget
+// hears twice within an interval, nothing is delivered without a change
+// since the last delivery, and once the changes stop every widget hears
+// its last value.
+//
+// Usage: ValueNotifierTest [changes] [widgets] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../ValueNotifier.h"
+
+static WidgetId Id(uint32_t index, uint32_t generation = 1)
+{
+    return { index, generation };
+}
+
+static bool Expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "%s\n", what);
+    }
+    return condition;
+}
+
+static bool CheckScenarios()
+{
+    // 10 per second is one notification per 100 ms
+    ValueNotifier notifier(10);
+    std::vector<WidgetId> heard;
+    auto record = [&heard](WidgetId id) { heard.push_back(id); };
+
+    bool ok = Expect(notifier.GetNextDue(0) == ValueNotifier::kNothingPending && notifier.Flush(0, record) == 0, "an idle notifier had something due");
+
+    notifier.Changed(Id(1));
+    ok = ok && Expect(notifier.GetNextDue(5) == 0, "a first change was not due at once");
+    ok = ok && Expect(notifier.Flush(5, record) == 1 && heard.back() == Id(1), "a first change was not delivered on the next Flush");
+    ok = ok && Expect(notifier.GetNextDue(5) == ValueNotifier::kNothingPending && !notifier.HasPending(), "a delivered change stayed pending");
+
+    // A burst inside the interval folds into one trailing notification
+    notifier.Changed(Id(1));
+    notifier.Changed(Id(1));
+    notifier.Changed(Id(1));
+    ok = ok && Expect(notifier.GetStats().coalesced == 2, "changes to a pending widget were not coalesced");
+    ok = ok && Expect(notifier.GetNextDue(40) == 65, "the trailing notification was not due at the end of the interval");
+    ok = ok && Expect(notifier.Flush(104, record) == 0, "a notification went out inside the interval");
+    ok = ok && Expect(notifier.GetNextDue(104) == 1, "GetNextDue did not count down");
+    ok = ok && Expect(notifier.Flush(105, record) == 1 && heard.back() == Id(1), "the trailing notification was not delivered");
+    ok = ok && Expect(notifier.Flush(1000, record) == 0, "a burst was delivered twice");
+
+    // Widgets are throttled apart; a quiet widget goes out at once
+    notifier.Changed(Id(1));
+    notifier.Changed(Id(2));
+    ok = ok && Expect(notifier.GetNextDue(150) == 0, "the quiet widget was not due at once");
+    ok = ok && Expect(notifier.Flush(150, record) == 1 && heard.back() == Id(2), "a change after a quiet period waited");
+    notifier.Changed(Id(2));
+    ok = ok && Expect(notifier.Flush(200, record) == 0 && notifier.GetNextDue(200) == 5, "widgets were not throttled on their own");
+
+    // A forgotten widget is not delivered, and its slot's next widget is new
+    notifier.Forget(Id(2));
+    ok = ok && Expect(notifier.Flush(250, record) == 1 && heard.back() == Id(1), "a forgotten widget was delivered");
+    notifier.Changed(Id(1, 2));
+    ok = ok && Expect(notifier.Flush(251, record) == 1 && heard.back() == Id(1, 2), "a reused slot inherited the old widget's throttle");
+    notifier.Forget(Id(1));
+    notifier.Changed(Id(1, 2));
+    ok = ok && Expect(notifier.Flush(252, record) == 0 && notifier.Flush(351, record) == 1 && heard.back() == Id(1, 2),
+        "forgetting a stale id dropped the slot's current widget");
+
+    // No cap delivers every Flush that has a change
+    notifier.SetMaxRate(0);
+    notifier.Changed(Id(3));
+    ok = ok && Expect(notifier.Flush(360, record) == 1, "an uncapped notifier held a change");
+    notifier.Changed(Id(3));
+    ok = ok && Expect(notifier.Flush(360, record) == 1, "an uncapped notifier throttled");
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    size_t changes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    uint32_t count = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 8;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+    if (count == 0)
+    {
+        fprintf(stderr, "need at least one widget\n");
+        return 1;
+    }
+    if (!CheckScenarios())
+    {
+        return 1;
+    }
+
+    // Each widget's value is the number of changes made to it; a delivery
+    // reads it, as the front-ends read the model
+    const uint64_t interval = 100;
+    ValueNotifier notifier(1000 / interval);
+    std::vector<uint64_t> values(count, 0);
+    std::vector<uint64_t> announced(count, 0);
+    std::vector<uint64_t> lastSent(count, 0);
+    std::vector<bool> sent(count, false);
+    std::mt19937 random(seed);
+    uint64_t now = 0;
+    bool failed = false;
+    auto deliver = [&](WidgetId id)
+    {
+        uint32_t i = id.index;
+        if (sent[i] && now - lastSent[i] < interval)
+        {
+            fprintf(stderr, "widget %u heard twice within %llu ms\n", i, static_cast<unsigned long long>(now - lastSent[i]));
+            failed = true;
+        }
+        if (announced[i] == values[i])
+        {
+            fprintf(stderr, "widget %u was delivered without a change\n", i);
+            failed = true;
+        }
+        announced[i] = values[i];
+        lastSent[i] = now;
+        sent[i] = true;
+    };
+
+    for (size_t c = 0; c < changes && !failed; c++)
+    {
+        // Bursts of samples, with an occasional quiet spell
+        now += random() % 500 == 0 ? 200 + random() % 500 : random() % 8;
+        uint32_t i = random() % count;
+        values[i]++;
+        notifier.Changed(Id(i));
+        if (random() % 4 == 0)
+        {
+            uint64_t due = notifier.GetNextDue(now);
+            size_t delivered = notifier.Flush(now, deliver);
+            if ((due == 0) != (delivered > 0))
+            {
+                fprintf(stderr, "GetNextDue said %llu but Flush delivered %zu\n", static_cast<unsigned long long>(due), delivered);
+                return 1;
+            }
+        }
+    }
+
+    // The trailing edge: following GetNextDue delivers everything left
+    for (uint64_t due = notifier.GetNextDue(now); due != ValueNotifier::kNothingPending && !failed; due = notifier.GetNextDue(now))
+    {
+        now += due;
+        if (notifier.Flush(now, deliver) == 0)
+        {
+            fprintf(stderr, "nothing was delivered when GetNextDue said it was due\n");
+            return 1;
+        }
+    }
+    if (failed)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (announced[i] != values[i])
+        {
+            fprintf(stderr, "widget %u last heard %llu of %llu changes\n", i, static_cast<unsigned long long>(announced[i]),
+                static_cast<unsigned long long>(values[i]));
+            return 1;
+        }
+    }
+
+    const NotifierStats& stats = notifier.GetStats();
+    printf("%llu changes to %u widgets over %.1f s delivered as %llu notifications, %llu coalesced\n",
+        static_cast<unsigned long long>(stats.changes), count, now / 1000.0, static_cast<unsigned long long>(stats.delivered),
+        static_cast<unsigned long long>(stats.coalesced));
+    return 0;
+}
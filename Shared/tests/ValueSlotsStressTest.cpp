@@ -0,0 +1,149 @@
+// Has writer threads hammer ValueSlots while this thread samples them once a
+// frame the way the samples' UI threads do, then checks that:
+// - the slot and mask atomics are lock-free, so a write never waits on the UI,
+// - no sample saw a slot's value go backwards,
+// - a frame never applies more than one value per slot, however fast the writes,
+// - after the writers stop, every widget holds the last value written to its slot.
+// It prints the write rate and the UI thread's time per frame.
+//
+// Usage: ValueSlotsStressTest [seconds] [writers] [slots]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "../ValueSlots.h"
+
+int main(int argc, char** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    size_t writers = argc > 2 ? strtoul(argv[2], nullptr, 10) : 4;
+    size_t slotCount = argc > 3 ? strtoul(argv[3], nullptr, 10) : 256;
+    if (writers == 0 || slotCount < writers)
+    {
+        fprintf(stderr, "need at least one writer and a slot for each\n");
+        return 1;
+    }
+
+    std::atomic<uint64_t> probe(0);
+    if (!probe.is_lock_free())
+    {
+        fprintf(stderr, "std::atomic<uint64_t> takes a lock on this platform\n");
+        return 1;
+    }
+
+    WidgetModel model;
+    WidgetId root = model.AddWidget(kNoWidget, WidgetRole::Toolbar, { 0, 0, 1000, 100 }, L"Progress", 0);
+    std::vector<WidgetId> bound;
+    for (size_t i = 0; i < slotCount; i++)
+    {
+        int32_t x = static_cast<int32_t>(i % 100) * 10;
+        WidgetId bar = model.AddWidget(root, WidgetRole::ProgressBar, { x, 0, x + 10, 10 }, L"Bar", 0);
+        model.SetRange(bar, 0, 1e18);
+        bound.push_back(bar);
+    }
+
+    // Each writer owns every writers-th slot and writes it an increasing
+    // value, so the last value of each slot is known once the writers join
+    ValueSlots slots(slotCount);
+    std::atomic<bool> stop(false);
+    std::vector<double> lastWritten(slotCount, 0);
+    std::vector<uint64_t> writes(writers, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < writers; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            std::vector<double> last(slotCount, 0);
+            double value = 0;
+            uint64_t count = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                for (size_t slot = t; slot < slotCount; slot += writers)
+                {
+                    slots.Write(slot, ++value);
+                    last[slot] = value;
+                    count++;
+                }
+            }
+            for (size_t slot = t; slot < slotCount; slot += writers)
+            {
+                lastWritten[slot] = last[slot];
+            }
+            writes[t] = count;
+        });
+    }
+
+    std::vector<double> seen(slotCount, 0);
+    std::vector<WidgetRect> invalid;
+    size_t frames = 0;
+    size_t applied = 0;
+    size_t mostInFrame = 0;
+    double totalMicroseconds = 0;
+    double worstMicroseconds = 0;
+    bool backwards = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < seconds)
+    {
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        invalid.clear();
+        size_t count = SampleValueSlots(slots, bound, model, &invalid);
+        double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - frameStart).count();
+        for (size_t slot = 0; slot < slotCount; slot++)
+        {
+            double value = model.Get(bound[slot])->value;
+            backwards |= value < seen[slot];
+            seen[slot] = value;
+        }
+        frames++;
+        applied += count;
+        mostInFrame = (std::max)(mostInFrame, count);
+        totalMicroseconds += microseconds;
+        worstMicroseconds = (std::max)(worstMicroseconds, microseconds);
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    stop = true;
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    invalid.clear();
+    SampleValueSlots(slots, bound, model, &invalid);
+    size_t stale = 0;
+    for (size_t slot = 0; slot < slotCount; slot++)
+    {
+        stale += model.Get(bound[slot])->value != lastWritten[slot];
+    }
+
+    uint64_t totalWrites = 0;
+    for (uint64_t count : writes)
+    {
+        totalWrites += count;
+    }
+    printf("%zu writers on %u cores, %zu slots: %.1fM writes/s\n", writers, std::thread::hardware_concurrency(), slotCount, totalWrites / elapsed / 1e6);
+    printf("UI: %zu frames, %.1f slots per frame, %.1f us per frame on average, %.1f us at worst\n", frames,
+        frames ? static_cast<double>(applied) / frames : 0.0, frames ? totalMicroseconds / frames : 0.0, worstMicroseconds);
+
+    if (backwards)
+    {
+        fprintf(stderr, "a sample saw a slot's value go backwards\n");
+        return 1;
+    }
+    if (mostInFrame > slotCount)
+    {
+        fprintf(stderr, "a frame applied %zu values for %zu slots\n", mostInFrame, slotCount);
+        return 1;
+    }
+    if (stale)
+    {
+        fprintf(stderr, "%zu slots did not end on their last written value\n", stale);
+        return 1;
+    }
+    printf("every slot held its last value\n");
+    return 0;
+}
@@ -0,0 +1,60 @@
+// Checks the widget model's hierarchy edits against parents that are gone and
+// trees too deep to walk recursively.
+//
+// Usage: WidgetModelTest [depth]
+
+#include <cstdio>
+#include <cstdlib>
+#include "../CompactWidgetTree.h"
+#include "../WidgetModel.h"
+
+static WidgetId Add(WidgetModel& model, WidgetId parent)
+{
+    return model.AddWidget(parent, WidgetRole::Button, { 0, 0, 10, 10 }, L"w", 0);
+}
+
+int main(int argc, char** argv)
+{
+    size_t depth = argc > 1 ? strtoul(argv[1], nullptr, 10) : 400000;
+
+    // A widget added under a removed parent becomes a root with no parent
+    WidgetModel model;
+    WidgetId a = Add(model, kNoWidget);
+    model.RemoveWidget(a);
+    WidgetId b = Add(model, a);
+    WidgetId c = Add(model, kNoWidget);
+    if (model.Get(b)->parent != kNoWidget || model.GetRoots().size() != 2)
+    {
+        fprintf(stderr, "a widget under a removed parent kept the stale handle\n");
+        return 1;
+    }
+    if (!model.MoveWidget(c, b, 0) || model.Get(c)->parent != b || model.MoveWidget(b, c, 0))
+    {
+        fprintf(stderr, "moves under a former orphan went wrong\n");
+        return 1;
+    }
+    CompactWidgetTree compact(model);
+    if (compact.GetParent(0) != CompactWidgetTree::kNoNode || compact.GetParent(1) != 0)
+    {
+        fprintf(stderr, "the compact tree has the wrong parents\n");
+        return 1;
+    }
+
+    // Removing the root of a chain deeper than the stack could recurse
+    WidgetModel chain;
+    WidgetId root = Add(chain, kNoWidget);
+    WidgetId last = root;
+    for (size_t i = 1; i < depth; i++)
+    {
+        last = Add(chain, last);
+    }
+    chain.SetFocus(last);
+    chain.RemoveWidget(root);
+    if (chain.GetWidgets().size() != 0 || chain.GetFocus() != kNoWidget)
+    {
+        fprintf(stderr, "removing a %zu-deep chain left %zu widgets\n", depth, chain.GetWidgets().size());
+        return 1;
+    }
+    printf("orphans and a %zu-deep chain ok\n", depth);
+    return 0;
+}
@@ -0,0 +1,262 @@
+// Checks WidgetQuery against a per-widget evaluator of the uncompiled
+// condition. Random conditions are run from random roots in every scope, so
+// ranges start and end anywhere in a 64-widget word and span several blocks,
+// and the conditions nest Not, And and Or over every leaf, so constant
+// folding, negation of role and state tests, double Not and merging all get
+// compiled. A few conditions are also checked for the program they compile
+// to. Built once as is and once with WIDGET_QUERY_NO_SSE2, for both the SSE2
+// and the scalar column loops.
+//
+// Usage: WidgetQueryTest [widgets] [conditions] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cwctype>
+#include <random>
+#include <string>
+#include <vector>
+#include "../WidgetQuery.h"
+
+static const wchar_t* const kNames[] = { L"Alpha", L"alpha", L"ALPHA", L"Alphabet", L"Beta", L"beta 2", L"Gamma", L"" };
+static const size_t kNameCount = sizeof(kNames) / sizeof(kNames[0]);
+
+static std::wstring Fold(std::wstring text)
+{
+    for (wchar_t& c : text)
+    {
+        c = static_cast<wchar_t>(std::towlower(c));
+    }
+    return text;
+}
+
+// Runs the condition's postfix code on one widget.
+static bool Evaluate(const WidgetCondition& condition, const Widget& widget, const WidgetRect& screen)
+{
+    std::vector<bool> stack;
+    for (const QueryInstruction& instruction : condition.GetCode())
+    {
+        const std::wstring* text = WidgetCondition::IsText(instruction.op) ? &condition.GetStrings()[instruction.operand] : nullptr;
+        uint8_t state = (widget.enabled ? DerivedData::kStateEnabled : 0) | (widget.focusable ? DerivedData::kStateFocusable : 0);
+        const WidgetRect& r = instruction.rect;
+        bool a;
+        bool b;
+        switch (instruction.op)
+        {
+        case QueryOp::Always:
+            stack.push_back(true);
+            break;
+        case QueryOp::Never:
+            stack.push_back(false);
+            break;
+        case QueryOp::RoleIn:
+            stack.push_back(((instruction.roles >> static_cast<uint8_t>(widget.role)) & 1) != 0);
+            break;
+        case QueryOp::StateIs:
+            stack.push_back((state & instruction.stateMask) == instruction.stateValue);
+            break;
+        case QueryOp::BoundsIntersect:
+            stack.push_back(screen.left < r.right && screen.top < r.bottom && screen.right > r.left && screen.bottom > r.top);
+            break;
+        case QueryOp::NameIs:
+            stack.push_back(widget.name == *text);
+            break;
+        case QueryOp::NameIsIgnoreCase:
+            stack.push_back(Fold(widget.name) == Fold(*text));
+            break;
+        case QueryOp::NameStartsWith:
+            stack.push_back(Fold(widget.name).compare(0, text->size(), Fold(*text)) == 0);
+            break;
+        case QueryOp::And:
+        case QueryOp::Or:
+            b = stack.back();
+            stack.pop_back();
+            a = stack.back();
+            stack.back() = instruction.op == QueryOp::And ? a && b : a || b;
+            break;
+        case QueryOp::Not:
+            stack.back() = !stack.back();
+            break;
+        }
+    }
+    return stack.back();
+}
+
+static void Collect(const WidgetModel& model, WidgetId id, bool self, std::vector<WidgetId>* out)
+{
+    if (self)
+    {
+        out->push_back(id);
+    }
+    for (WidgetId child : model.Get(id)->children)
+    {
+        Collect(model, child, true, out);
+    }
+}
+
+// The widgets a scope covers, in document order
+static std::vector<WidgetId> ScopeOf(const WidgetModel& model, WidgetId root, QueryScope scope)
+{
+    std::vector<WidgetId> widgets;
+    if (scope == QueryScope::Element)
+    {
+        widgets.push_back(root);
+    }
+    else if (scope == QueryScope::Children)
+    {
+        widgets = model.Get(root)->children;
+    }
+    else
+    {
+        Collect(model, root, scope == QueryScope::Subtree, &widgets);
+    }
+    return widgets;
+}
+
+static WidgetRole RandomRole(std::mt19937& random)
+{
+    return static_cast<WidgetRole>(random() % (static_cast<unsigned>(WidgetRole::ProgressBar) + 1));
+}
+
+static WidgetCondition RandomLeaf(std::mt19937& random)
+{
+    switch (random() % 10)
+    {
+    case 0:
+        return WidgetCondition::Always();
+    case 1:
+        return WidgetCondition::Never();
+    case 2:
+        return WidgetCondition::RoleIs(RandomRole(random));
+    case 3:
+        return WidgetCondition::RoleIn({ RandomRole(random), RandomRole(random) });
+    case 4:
+        return WidgetCondition::IsEnabled(random() % 2 != 0);
+    case 5:
+        return WidgetCondition::IsFocusable(random() % 2 != 0);
+    case 6:
+    {
+        int32_t x = static_cast<int32_t>(random() % 1200) - 100;
+        int32_t y = static_cast<int32_t>(random() % 900) - 100;
+        return WidgetCondition::BoundsIntersect({ x, y, x + static_cast<int32_t>(random() % 300), y + static_cast<int32_t>(random() % 300) });
+    }
+    case 7:
+        return WidgetCondition::NameIs(kNames[random() % kNameCount], random() % 2 != 0);
+    case 8:
+        return WidgetCondition::NameStartsWith(std::wstring(kNames[random() % kNameCount]).substr(0, random() % 4));
+    default:
+        return WidgetCondition::NameIs(L"No such name");
+    }
+}
+
+static WidgetCondition RandomCondition(std::mt19937& random, int depth)
+{
+    if (depth == 0 || random() % 4 == 0)
+    {
+        return RandomLeaf(random);
+    }
+    switch (random() % 4)
+    {
+    case 0:
+        return WidgetCondition::Not(RandomCondition(random, depth - 1));
+    case 1:
+        return WidgetCondition::Not(WidgetCondition::Not(RandomCondition(random, depth - 1)));
+    case 2:
+        return WidgetCondition::And(RandomCondition(random, depth - 1), RandomCondition(random, depth - 1));
+    default:
+        return WidgetCondition::Or(RandomCondition(random, depth - 1), RandomCondition(random, depth - 1));
+    }
+}
+
+// Compiling folds these to a single instruction of the given kind
+static bool CompilesTo(const WidgetCondition& condition, QueryOp op, const char* what)
+{
+    WidgetQuery query(condition);
+    if (query.GetProgram().size() != 1 || query.GetProgram()[0].op != op)
+    {
+        fprintf(stderr, "%s compiled to %zu instructions\n", what, query.GetProgram().size());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+    size_t conditions = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 1;
+
+    typedef WidgetCondition C;
+    bool folded = CompilesTo(C::And(C::RoleIs(WidgetRole::Button), C::Not(C::Never())), QueryOp::RoleIn, "Button and not Never")
+        && CompilesTo(C::Or(C::RoleIs(WidgetRole::Button), C::RoleIs(WidgetRole::Toolbar)), QueryOp::RoleIn, "Button or Toolbar")
+        && CompilesTo(C::Not(C::RoleIs(WidgetRole::Button)), QueryOp::RoleIn, "not Button")
+        && CompilesTo(C::Not(C::IsEnabled(true)), QueryOp::StateIs, "not enabled")
+        && CompilesTo(C::And(C::IsEnabled(true), C::IsFocusable(true)), QueryOp::StateIs, "enabled and focusable")
+        && CompilesTo(C::And(C::IsEnabled(true), C::IsEnabled(false)), QueryOp::Never, "enabled and not enabled")
+        && CompilesTo(C::Not(C::Not(C::BoundsIntersect({ 0, 0, 10, 10 }))), QueryOp::BoundsIntersect, "not not bounds")
+        && CompilesTo(C::Or(C::NameIs(L"Alpha"), C::Always()), QueryOp::Always, "name or Always");
+    if (!folded)
+    {
+        return 1;
+    }
+
+    // A forest with long chains and wide containers, so subtrees of every
+    // size start at every offset within a word
+    std::mt19937 random(seed);
+    WidgetModel model;
+    std::vector<WidgetId> widgets;
+    for (size_t i = 0; i < count; i++)
+    {
+        WidgetId parent = kNoWidget;
+        if (!widgets.empty() && random() % 50 != 0)
+        {
+            parent = random() % 3 == 0 ? widgets.back() : widgets[random() % widgets.size()];
+        }
+        int32_t x = static_cast<int32_t>(random() % 1000) - 50;
+        int32_t y = static_cast<int32_t>(random() % 700) - 50;
+        WidgetId id = model.AddWidget(parent, RandomRole(random), { x, y, x + 1 + static_cast<int32_t>(random() % 120), y + 1 + static_cast<int32_t>(random() % 40) },
+            kNames[random() % kNameCount], 0);
+        model.SetEnabled(id, random() % 4 != 0);
+        widgets.push_back(id);
+    }
+    const DerivedData& derived = model.GetDerived();
+
+    static const QueryScope kScopes[] = { QueryScope::Element, QueryScope::Children, QueryScope::Descendants, QueryScope::Subtree };
+    std::vector<WidgetId> found;
+    size_t matched = 0;
+    for (size_t c = 0; c < conditions; c++)
+    {
+        WidgetCondition condition = RandomCondition(random, 4);
+        WidgetQuery query(condition);
+        for (QueryScope scope : kScopes)
+        {
+            // Roots of large subtrees as well as random ones
+            WidgetId root = c % 5 == 0 ? model.GetRoots()[random() % model.GetRoots().size()] : widgets[random() % widgets.size()];
+            std::vector<WidgetId> expected;
+            for (WidgetId id : ScopeOf(model, root, scope))
+            {
+                if (Evaluate(condition, *model.Get(id), derived.screenRects[id.index]))
+                {
+                    expected.push_back(id);
+                }
+            }
+            found.clear();
+            query.FindAll(model, root, scope, &found);
+            WidgetId first = query.FindFirst(model, root, scope);
+            size_t counted = query.Count(model, root, scope);
+            if (found != expected || first != (expected.empty() ? kNoWidget : expected[0]) || counted != expected.size())
+            {
+                fprintf(stderr, "condition %zu in scope %d from widget %u found %zu widgets, expected %zu\n", c, static_cast<int>(scope), root.index,
+                    found.size(), expected.size());
+                return 1;
+            }
+            matched += expected.size();
+        }
+    }
+#ifdef WIDGET_QUERY_SSE2
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    printf("%zu conditions in 4 scopes over %zu widgets agreed with the per-widget evaluator (%s loops, %zu matches)\n", conditions, count, path, matched);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Replays a trace recorded with --trace=<path> by the UIAutomation or
+// IAccessible sample against a widget model, without a window, COM or an AT,
+// and reports where the time went. Platform-neutral, so a trace from a user's
+// machine can be profiled anywhere.
+//
+// Usage: TraceReplay <trace> [--max-speed] [--repeat N]
+//   --max-speed  run records back to back instead of at their recorded times
+//   --repeat N   replay N times, each into a fresh model, and report the sum
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../Shared/QueryTrace.h"
+#include "../Shared/TraceReplay.h"
+
+int main(int argc, char** argv)
+{
+    const char* path = nullptr;
+    ReplaySpeed speed = ReplaySpeed::Original;
+    int repeat = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max-speed") == 0)
+        {
+            speed = ReplaySpeed::Maximum;
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = (std::max)(1, atoi(argv[++i]));
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr, "Usage: TraceReplay <trace> [--max-speed] [--repeat N]\n");
+        return 2;
+    }
+
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return 1;
+    }
+    QueryTraceReader reader(file.GetData(), file.GetSize());
+    if (!reader.IsValid())
+    {
+        fprintf(stderr, "%s is not a trace\n", path);
+        return 1;
+    }
+
+    ReplayStats total = {};
+    uint64_t checksum = 0;
+    size_t widgetCount = 0;
+    for (int run = 0; run < repeat; run++)
+    {
+        // Each run starts from an empty model, since the trace builds its own
+        ModelReplayTarget target;
+        reader.Rewind();
+        ReplayStats stats = ReplayTrace(reader, target, speed);
+        total.records += stats.records;
+        total.failed += stats.failed;
+        total.totalNanoseconds += stats.totalNanoseconds;
+        total.corrupt = total.corrupt || stats.corrupt;
+        for (size_t event = 0; event < static_cast<size_t>(TraceEvent::Count); event++)
+        {
+            total.counts[event] += stats.counts[event];
+            total.nanoseconds[event] += stats.nanoseconds[event];
+        }
+        checksum = target.GetChecksum();
+        widgetCount = target.GetModel().GetWidgets().size();
+    }
+
+    printf("%-22s %12s %12s %10s\n", "event", "count", "total ms", "ns/call");
+    for (size_t event = 0; event < static_cast<size_t>(TraceEvent::Count); event++)
+    {
+        if (total.counts[event] == 0)
+        {
+            continue;
+        }
+        printf("%-22s %12llu %12.3f %10.0f\n", TraceEventName(static_cast<TraceEvent>(event)),
+            static_cast<unsigned long long>(total.counts[event]), total.nanoseconds[event] / 1e6,
+            static_cast<double>(total.nanoseconds[event]) / total.counts[event]);
+    }
+    printf("%llu records in %.3f ms, %llu not applied; %zu widgets at the end, checksum %016llx\n",
+        static_cast<unsigned long long>(total.records), total.totalNanoseconds / 1e6, static_cast<unsigned long long>(total.failed),
+        widgetCount, static_cast<unsigned long long>(checksum));
+    if (total.corrupt)
+    {
+        fprintf(stderr, "Trace ends in a corrupt record\n");
+        return 1;
+    }
+    return 0;
+}
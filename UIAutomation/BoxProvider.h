@@ -3,12 +3,90 @@
 #include <windows.h>
 #include <ole2.h>
 #include <uiautomation.h>
-#include "Box.h"
+#include "../Shared/AllocationCounter.h"
+#include "Navbar.h"
+#include "PropertyTable.h"
+#include "PropertyCache.h"
 
-class BoxProvider : public IRawElementProviderSimple, public IRawElementProviderFragment
+// Providers are created on demand when an AT navigates to an item and only
+// hold the item index, so they stay valid while the navbar is virtualized.
+// Progress bar items also expose the read-only value and range value patterns.
+// Every item can be selected; the state lives in the navbar's selection set.
+class BoxProvider : public IRawElementProviderSimple, public IRawElementProviderFragment, public IVirtualizedItemProvider, public IValueProvider, public IRangeValueProvider, public ISelectionItemProvider
 {
 public:
-    BoxProvider(Box* box, HWND hwnd) : box(box), hwnd(hwnd), refCount(1) {}
+    BoxProvider(Navbar* navbar, size_t itemIndex, IRawElementProviderFragmentRoot* root, HWND hwnd)
+        : navbar(navbar), itemIndex(itemIndex), root(root), hwnd(hwnd), refCount(1)
+    {
+        root->AddRef();
+    }
+
+    ~BoxProvider()
+    {
+        root->Release();
+    }
+
+    // Returns the item index behind a provider handed out by this class, as
+    // stored in its runtime id.
+    static bool GetIndexFromProvider(IUnknown* provider, size_t* pIndex)
+    {
+        IRawElementProviderFragment* fragment = NULL;
+        if (!provider || FAILED(provider->QueryInterface(__uuidof(IRawElementProviderFragment), (void**)&fragment)))
+        {
+            return false;
+        }
+
+        SAFEARRAY* runtimeId = NULL;
+        HRESULT hr = fragment->GetRuntimeId(&runtimeId);
+        fragment->Release();
+        if (FAILED(hr) || runtimeId == NULL)
+        {
+            return false;
+        }
+
+        LONG position = 1;
+        int value = 0;
+        hr = SafeArrayGetElement(runtimeId, &position, &value);
+        SafeArrayDestroy(runtimeId);
+        if (FAILED(hr))
+        {
+            return false;
+        }
+        *pIndex = static_cast<size_t>(value);
+        return true;
+    }
+
+    // Raises UIA events for the navbar's pending selection changes.
+    static void RaiseSelectionEvents(Navbar* navbar, IRawElementProviderFragmentRoot* root, HWND hwnd)
+    {
+        navbar->GetSelection().DispatchChanges([=](SelectionEvent event, size_t index)
+        {
+            if (event == SelectionEvent::Invalidated)
+            {
+                IRawElementProviderSimple* container = NULL;
+                if (SUCCEEDED(root->QueryInterface(__uuidof(IRawElementProviderSimple), (void**)&container)))
+                {
+                    UiaRaiseAutomationEvent(container, UIA_Selection_InvalidatedEventId);
+                    container->Release();
+                }
+                return;
+            }
+
+            EVENTID eventId = event == SelectionEvent::Selected ? UIA_SelectionItem_ElementSelectedEventId
+                : event == SelectionEvent::Added ? UIA_SelectionItem_ElementAddedToSelectionEventId
+                : UIA_SelectionItem_ElementRemovedFromSelectionEventId;
+            BoxProvider* provider = new BoxProvider(navbar, index, root, hwnd);
+            UiaRaiseAutomationEvent(provider, eventId);
+            provider->Release();
+        });
+    }
+
+    // Reads the requested properties of this item in one call.
+    HRESULT Prefetch(const CacheRequest& request, PropertyCache* cache)
+    {
+        CallScope call(TraceEvent::Prefetch, { navbar->GetId().index, static_cast<int64_t>(itemIndex), static_cast<int64_t>(request.scope), static_cast<int64_t>(request.properties.size()) });
+        return cache->Gather(navbar, hwnd, itemIndex, request);
+    }
 
     // IUnknown methods
     ULONG STDMETHODCALLTYPE AddRef() { return ++refCount; }
@@ -23,14 +101,37 @@ public:
     }
     HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppInterface)
     {
-        if (riid == __uuidof(IUnknown) || riid == __uuidof(IRawElementProviderSimple) || riid == __uuidof(IRawElementProviderFragment))
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IRawElementProviderSimple))
         {
             *ppInterface = static_cast<IRawElementProviderSimple*>(this);
-            AddRef();
-            return S_OK;
         }
-        *ppInterface = NULL;
-        return E_NOINTERFACE;
+        else if (riid == __uuidof(IRawElementProviderFragment))
+        {
+            *ppInterface = static_cast<IRawElementProviderFragment*>(this);
+        }
+        else if (riid == __uuidof(IVirtualizedItemProvider) && navbar->IsVirtualized())
+        {
+            *ppInterface = static_cast<IVirtualizedItemProvider*>(this);
+        }
+        else if (riid == __uuidof(IValueProvider) && IsProgressBar())
+        {
+            *ppInterface = static_cast<IValueProvider*>(this);
+        }
+        else if (riid == __uuidof(IRangeValueProvider) && IsProgressBar())
+        {
+            *ppInterface = static_cast<IRangeValueProvider*>(this);
+        }
+        else if (riid == __uuidof(ISelectionItemProvider))
+        {
+            *ppInterface = static_cast<ISelectionItemProvider*>(this);
+        }
+        else
+        {
+            *ppInterface = NULL;
+            return E_NOINTERFACE;
+        }
+        AddRef();
+        return S_OK;
     }
 
     // IRawElementProviderSimple methods
@@ -42,81 +143,92 @@ public:
     HRESULT STDMETHODCALLTYPE GetPatternProvider(PATTERNID iid, IUnknown** pRetVal)
     {
         *pRetVal = NULL;
-        return S_OK;
-    }
-    HRESULT STDMETHODCALLTYPE GetPropertyValue(PROPERTYID idProp, VARIANT* pRetVal)
-    {
-        pRetVal->vt = VT_EMPTY;
-        if (idProp == UIA_ControlTypePropertyId)
+        if (iid == UIA_VirtualizedItemPatternId && navbar->IsVirtualized())
         {
-            pRetVal->vt = VT_I4;
-            pRetVal->lVal = UIA_ButtonControlTypeId;
+            *pRetVal = static_cast<IVirtualizedItemProvider*>(this);
+            AddRef();
         }
-        else if (idProp == UIA_NamePropertyId)
+        else if (iid == UIA_ValuePatternId && IsProgressBar())
         {
-            pRetVal->vt = VT_BSTR;
-            pRetVal->bstrVal = SysAllocString(box->GetText().c_str());
+            *pRetVal = static_cast<IValueProvider*>(this);
+            AddRef();
         }
-        else if (idProp == UIA_BoundingRectanglePropertyId)
+        else if (iid == UIA_RangeValuePatternId && IsProgressBar())
         {
-            RECT rect = box->GetRect();
-            UiaRect uiaRect = { (double)rect.left, (double)rect.top, (double)(rect.right - rect.left), (double)(rect.bottom - rect.top) };
-            pRetVal->vt = VT_R8 | VT_ARRAY;
-            SAFEARRAY* psa = SafeArrayCreateVector(VT_R8, 0, 4);
-
-            if (psa != NULL)
-            {
-                LONG index = 0;
-                HRESULT hr = SafeArrayPutElement(psa, &index, &uiaRect.left);
-                if (SUCCEEDED(hr))
-                {
-                    index = 1;
-                    hr = SafeArrayPutElement(psa, &index, &uiaRect.top);
-                    if (SUCCEEDED(hr))
-                    {
-                        index = 2;
-                        hr = SafeArrayPutElement(psa, &index, &uiaRect.width);
-                        if (SUCCEEDED(hr))
-                        {
-                            index = 3;
-                            hr = SafeArrayPutElement(psa, &index, &uiaRect.height);
-                            if (SUCCEEDED(hr))
-                            {
-                                pRetVal->parray = psa;
-                                return S_OK;
-                            }
-                        }
-                    }
-                }
-
-                // Cleanup on failure
-                SafeArrayDestroy(psa);
-                return hr; // Return the error code if any SafeArrayPutElement failed
-            }
-
-            return E_FAIL; // Return appropriate error if SafeArrayCreateVector failed
+            *pRetVal = static_cast<IRangeValueProvider*>(this);
+            AddRef();
+        }
+        else if (iid == UIA_SelectionItemPatternId)
+        {
+            *pRetVal = static_cast<ISelectionItemProvider*>(this);
+            AddRef();
         }
         return S_OK;
     }
+    HRESULT STDMETHODCALLTYPE GetPropertyValue(PROPERTYID idProp, VARIANT* pRetVal)
+    {
+        CallScope call(TraceEvent::GetPropertyValue, { navbar->GetId().index, static_cast<int64_t>(itemIndex), idProp });
+        GetProviderStats().propertyReads++;
+        pRetVal->vt = VT_EMPTY;
+        WidgetId widget = navbar->RealizeItem(itemIndex);
+        if (widget == kNoWidget)
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        const PropertyTable& table = navbar->GetModel()->Get(widget)->role == WidgetRole::ProgressBar ? ProgressBarPropertyTable() : ButtonPropertyTable();
+        return table.GetValue(idProp, { navbar, itemIndex, widget, hwnd }, pRetVal);
+    }
     HRESULT STDMETHODCALLTYPE get_HostRawElementProvider(IRawElementProviderSimple** pRetVal)
     {
-        return UiaHostProviderFromHwnd(hwnd, pRetVal);
+        *pRetVal = NULL;
+        return S_OK;
     }
 
     // IRawElementProviderFragment methods
     HRESULT STDMETHODCALLTYPE Navigate(NavigateDirection direction, IRawElementProviderFragment** pRetVal)
     {
+        CallScope call(TraceEvent::Navigate, { navbar->GetId().index, static_cast<int64_t>(itemIndex), direction });
+        GetProviderStats().navigations++;
         *pRetVal = NULL;
+        if (direction == NavigateDirection_Parent)
+        {
+            return root->QueryInterface(__uuidof(IRawElementProviderFragment), (void**)pRetVal);
+        }
+        else if (direction == NavigateDirection_NextSibling && itemIndex + 1 < navbar->GetItemCount())
+        {
+            *pRetVal = new BoxProvider(navbar, itemIndex + 1, root, hwnd);
+        }
+        else if (direction == NavigateDirection_PreviousSibling && itemIndex > 0 && itemIndex - 1 < navbar->GetItemCount())
+        {
+            *pRetVal = new BoxProvider(navbar, itemIndex - 1, root, hwnd);
+        }
         return S_OK;
     }
     HRESULT STDMETHODCALLTYPE GetRuntimeId(SAFEARRAY** pRetVal)
     {
-        *pRetVal = NULL;
+        CallScope call(TraceEvent::GetRuntimeId, { navbar->GetId().index, static_cast<int64_t>(itemIndex) });
+        int runtimeId[] = { UiaAppendRuntimeId, static_cast<int>(itemIndex) };
+        *pRetVal = SafeArrayCreateVector(VT_I4, 0, 2);
+        if (*pRetVal == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        for (LONG i = 0; i < 2; i++)
+        {
+            SafeArrayPutElement(*pRetVal, &i, &runtimeId[i]);
+        }
         return S_OK;
     }
     HRESULT STDMETHODCALLTYPE get_BoundingRectangle(UiaRect* pRetVal)
     {
-        RECT rect = box->GetRect();
+        CallScope call(TraceEvent::GetBoundingRectangle, { navbar->GetId().index, static_cast<int64_t>(itemIndex) });
+        WidgetId widget = navbar->RealizeItem(itemIndex);
+        if (widget == kNoWidget)
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+
+        RECT rect = ToRect(navbar->GetModel()->GetDerived().screenRects[widget.index]);
         pRetVal->left = (double)rect.left;
         pRetVal->top = (double)rect.top;
         pRetVal->width = (double)(rect.right - rect.left);
@@ -130,16 +242,169 @@ public:
     }
     HRESULT STDMETHODCALLTYPE SetFocus()
     {
+        CallScope call(TraceEvent::FocusElement, { navbar->GetId().index, static_cast<int64_t>(itemIndex) });
+        if (itemIndex >= navbar->GetItemCount())
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        navbar->SetFocusedItem(itemIndex);
         return S_OK;
     }
     HRESULT STDMETHODCALLTYPE get_FragmentRoot(IRawElementProviderFragmentRoot** pRetVal)
     {
-        *pRetVal = NULL;
+        *pRetVal = root;
+        root->AddRef();
+        return S_OK;
+    }
+
+    // IVirtualizedItemProvider methods
+    HRESULT STDMETHODCALLTYPE Realize()
+    {
+        CallScope call(TraceEvent::Realize, { navbar->GetId().index, static_cast<int64_t>(itemIndex) });
+        if (navbar->RealizeItem(itemIndex) == kNoWidget)
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        navbar->ScrollIntoView(itemIndex);
+        InvalidateRect(hwnd, NULL, TRUE);
         return S_OK;
     }
 
+    // IValueProvider and IRangeValueProvider methods; progress bars are read-only
+    HRESULT STDMETHODCALLTYPE SetValue(LPCWSTR val)
+    {
+        return UIA_E_INVALIDOPERATION;
+    }
+    HRESULT STDMETHODCALLTYPE SetValue(double val)
+    {
+        return UIA_E_INVALIDOPERATION;
+    }
+    HRESULT STDMETHODCALLTYPE get_Value(BSTR* pRetVal)
+    {
+        CallScope call(TraceEvent::GetValue, { navbar->GetId().index, static_cast<int64_t>(itemIndex) });
+        const Widget* widget = GetWidget();
+        if (!widget)
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        *pRetVal = SysAllocString(GetValueText(*widget).c_str());
+        return *pRetVal ? S_OK : E_OUTOFMEMORY;
+    }
+    HRESULT STDMETHODCALLTYPE get_Value(double* pRetVal)
+    {
+        CallScope call(TraceEvent::GetValue, { navbar->GetId().index, static_cast<int64_t>(itemIndex) });
+        const Widget* widget = GetWidget();
+        if (!widget)
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        *pRetVal = widget->value;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_IsReadOnly(BOOL* pRetVal)
+    {
+        *pRetVal = TRUE;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_Maximum(double* pRetVal)
+    {
+        const Widget* widget = GetWidget();
+        if (!widget)
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        *pRetVal = widget->maximum;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_Minimum(double* pRetVal)
+    {
+        const Widget* widget = GetWidget();
+        if (!widget)
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        *pRetVal = widget->minimum;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_LargeChange(double* pRetVal)
+    {
+        *pRetVal = 0;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_SmallChange(double* pRetVal)
+    {
+        *pRetVal = 0;
+        return S_OK;
+    }
+
+    // ISelectionItemProvider methods
+    HRESULT STDMETHODCALLTYPE Select()
+    {
+        CallScope call(TraceEvent::SelectItem, { navbar->GetId().index, static_cast<int64_t>(itemIndex), static_cast<int64_t>(TraceSelect::Select) });
+        if (itemIndex >= navbar->GetItemCount())
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        navbar->GetSelection().SelectOnly(itemIndex);
+        SelectionChanged();
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE AddToSelection()
+    {
+        CallScope call(TraceEvent::SelectItem, { navbar->GetId().index, static_cast<int64_t>(itemIndex), static_cast<int64_t>(TraceSelect::AddToSelection) });
+        if (itemIndex >= navbar->GetItemCount())
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        navbar->GetSelection().Select(itemIndex);
+        navbar->GetSelection().SetAnchor(itemIndex);
+        SelectionChanged();
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE RemoveFromSelection()
+    {
+        CallScope call(TraceEvent::SelectItem, { navbar->GetId().index, static_cast<int64_t>(itemIndex), static_cast<int64_t>(TraceSelect::RemoveFromSelection) });
+        if (itemIndex >= navbar->GetItemCount())
+        {
+            return UIA_E_ELEMENTNOTAVAILABLE;
+        }
+        navbar->GetSelection().Deselect(itemIndex);
+        SelectionChanged();
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_IsSelected(BOOL* pRetVal)
+    {
+        *pRetVal = navbar->GetSelection().IsSelected(itemIndex) ? TRUE : FALSE;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_SelectionContainer(IRawElementProviderSimple** pRetVal)
+    {
+        return root->QueryInterface(__uuidof(IRawElementProviderSimple), (void**)pRetVal);
+    }
+
 private:
-    Box* box;
+    void SelectionChanged()
+    {
+        InvalidateRect(hwnd, NULL, FALSE);
+        RaiseSelectionEvents(navbar, root, hwnd);
+    }
+
+    const Widget* GetWidget() const
+    {
+        WidgetId widget = navbar->RealizeItem(itemIndex);
+        return widget == kNoWidget ? nullptr : navbar->GetModel()->Get(widget);
+    }
+
+    // Asked from QueryInterface and GetPatternProvider, so it must not realize
+    // the item. Otherwise an AT probing for patterns would evict visible items.
+    bool IsProgressBar() const
+    {
+        return itemIndex < navbar->GetItemCount() && navbar->GetItemRole(itemIndex) == WidgetRole::ProgressBar;
+    }
+
+    Navbar* navbar;
+    size_t itemIndex;
+    IRawElementProviderFragmentRoot* root;
     HWND hwnd;
     ULONG refCount;
 };
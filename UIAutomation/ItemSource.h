@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// Describes the items of a virtualized container. Only the item count is
+// known up front; the text of an item is fetched when the item is realized.
+class ItemSource
+{
+public:
+    virtual ~ItemSource() {}
+
+    virtual size_t GetItemCount() const = 0;
+    virtual std::wstring GetItemText(size_t index) const = 0;
+};
@@ -2,36 +2,324 @@
 
 #include <windows.h>
 #include <vector>
+#include <unordered_map>
+#include "../Shared/WidgetModel.h"
+#include "../Shared/DrawBatch.h"
+#include "../Shared/GdiRenderer.h"
+#include "../Shared/SelectionSet.h"
+#include "../Shared/WidgetPainter.h"
 #include "Box.h"
+#include "ItemSource.h"
 
 class Navbar
 {
 public:
-    Navbar(RECT rect) : rect(rect) {}
+    static const size_t kNoItem = (size_t)-1;
+
+    Navbar(WidgetModel* model, RECT rect)
+        : model(model), rect(rect), focusedItem(kNoItem), source(nullptr), itemSize({ 0, 0 }), itemSpacing(0), scrollOffset(0), useTick(0)
+    {
+        id = model->AddWidget(kNoWidget, WidgetRole::Toolbar, ToWidgetRect(rect), L"Navbar", RGB(0, 0, 255));
+        selection.SetTraceSlot(id.index);
+    }
 
     void AddBox(const Box& box)
     {
-        boxes.push_back(box);
+        WidgetId widget = model->AddWidget(id, WidgetRole::Button, ToWidgetRect(box.GetRect()), box.GetText(), RGB(255, 255, 255));
+        model->SetEnabled(widget, box.IsEnabled());
+        selection.Resize(GetItemCount());
+    }
+
+    // Adds a read-only progress bar item; its value is set through the model.
+    WidgetId AddProgressBar(RECT barRect, const std::wstring& name)
+    {
+        WidgetId widget = model->AddWidget(id, WidgetRole::ProgressBar, ToWidgetRect(barRect), name, RGB(255, 255, 255));
+        selection.Resize(GetItemCount());
+        return widget;
+    }
+
+    // Switches the navbar to virtualized mode. Items are laid out left to right
+    // with a fixed size, and only the visible items plus a few that an AT has
+    // navigated to are kept realized, so memory is bounded by the viewport.
+    // Realized items are widgets in the model that get recycled on eviction.
+    // Items are at least a pixel wide and the spacing is not negative, so the
+    // pitch that item positions are divided by is never zero.
+    void SetItemSource(ItemSource* itemSource, SIZE size, LONG spacing)
+    {
+        while (model->GetChildCount(id) > 0)
+        {
+            model->RemoveWidget(model->GetChild(id, 0));
+        }
+        source = itemSource;
+        itemSize = { max(size.cx, 1L), size.cy };
+        itemSpacing = max(spacing, 0L);
+        scrollOffset = 0;
+        realized.clear();
+        slotOfIndex.clear();
+        selection.Reset(GetItemCount());
+    }
+
+    bool IsVirtualized() const { return source != nullptr; }
+    const ItemSource* GetItemSource() const { return source; }
+
+    size_t GetItemCount() const
+    {
+        return source ? source->GetItemCount() : model->GetChildCount(id);
+    }
+
+    // Returns the widget for an item, fetching it from the item source if
+    // needed. In virtualized mode the widget is reused for another item once
+    // it is evicted, so callers should not hold on to it.
+    WidgetId RealizeItem(size_t index)
+    {
+        if (index >= GetItemCount())
+        {
+            return kNoWidget;
+        }
+        if (!source)
+        {
+            return model->GetChild(id, index);
+        }
+
+        auto it = slotOfIndex.find(index);
+        if (it != slotOfIndex.end())
+        {
+            realized[it->second].lastUse = ++useTick;
+            return realized[it->second].widget;
+        }
+
+        WidgetRect itemRect = ToWidgetRect(GetItemRect(index));
+        std::wstring text = source->GetItemText(index);
+        size_t slot;
+        if (realized.size() < GetRealizedCapacity())
+        {
+            slot = realized.size();
+            realized.push_back({ index, 0, model->AddWidget(id, WidgetRole::Button, itemRect, text, RGB(255, 255, 255)) });
+        }
+        else
+        {
+            slot = FindEvictionSlot();
+            slotOfIndex.erase(realized[slot].index);
+            realized[slot].index = index;
+            model->SetName(realized[slot].widget, text);
+            model->SetRect(realized[slot].widget, itemRect);
+        }
+        realized[slot].lastUse = ++useTick;
+        slotOfIndex[index] = slot;
+        return realized[slot].widget;
+    }
+
+    RECT GetItemRect(size_t index) const
+    {
+        if (!source)
+        {
+            return ToRect(model->Get(model->GetChild(id, index))->rect);
+        }
+
+        LONG left = rect.left + itemSpacing + static_cast<LONG>(index) * GetItemPitch() - scrollOffset;
+        LONG top = rect.top + itemSpacing;
+        return { left, top, left + itemSize.cx, top + itemSize.cy };
+    }
+
+    // Returns the half-open range of items that intersect the navbar.
+    void GetVisibleRange(size_t* first, size_t* last) const
+    {
+        size_t count = GetItemCount();
+        if (!source)
+        {
+            *first = 0;
+            *last = count;
+            return;
+        }
+
+        LONG pitch = GetItemPitch();
+        LONG start = scrollOffset > itemSpacing ? (scrollOffset - itemSpacing) / pitch : 0;
+        LONG end = (scrollOffset + (rect.right - rect.left) - itemSpacing) / pitch + 1;
+        *first = min(static_cast<size_t>(start), count);
+        *last = min(static_cast<size_t>(end), count);
+    }
+
+    bool IsItemVisible(size_t index) const
+    {
+        size_t first, last;
+        GetVisibleRange(&first, &last);
+        return index >= first && index < last;
+    }
+
+    size_t GetFocusedItem() const { return focusedItem; }
+
+    void SetFocusedItem(size_t index)
+    {
+        focusedItem = index;
+        model->SetFocus(RealizeItem(index));
+    }
+
+    // Returns the index of the item under a point in layout coordinates (see
+    // ClientToLayout), or GetItemCount() if the point is not over an item.
+    size_t ItemFromPoint(LONG x, LONG y) const
+    {
+        POINT pt = { x, y };
+        size_t first, last;
+        GetVisibleRange(&first, &last);
+        if (source && last > first)
+        {
+            // Items have a fixed pitch, so only the item the point falls in needs checking.
+            LONG offset = x - (rect.left + itemSpacing) + scrollOffset;
+            if (offset < 0)
+            {
+                return GetItemCount();
+            }
+            first = min(static_cast<size_t>(offset / GetItemPitch()), last);
+            last = min(first + 1, last);
+        }
+        for (size_t i = first; i < last; i++)
+        {
+            RECT itemRect = GetItemRect(i);
+            if (PtInRect(&itemRect, pt))
+            {
+                return i;
+            }
+        }
+        return GetItemCount();
+    }
+
+    void ScrollBy(LONG delta)
+    {
+        if (!source)
+        {
+            return;
+        }
+
+        LONG contentWidth = itemSpacing + static_cast<LONG>(GetItemCount()) * GetItemPitch();
+        LONG maxOffset = max(contentWidth - (rect.right - rect.left), 0L);
+        scrollOffset = min(max(scrollOffset + delta, 0L), maxOffset);
+
+        // Keep the realized widgets where they are drawn
+        for (auto& item : realized)
+        {
+            model->SetRect(item.widget, ToWidgetRect(GetItemRect(item.index)));
+        }
+    }
+
+    void ScrollIntoView(size_t index)
+    {
+        if (!source || index >= GetItemCount())
+        {
+            return;
+        }
+
+        RECT itemRect = GetItemRect(index);
+        if (itemRect.left < rect.left)
+        {
+            ScrollBy(itemRect.left - rect.left - itemSpacing);
+        }
+        else if (itemRect.right > rect.right)
+        {
+            ScrollBy(itemRect.right - rect.right + itemSpacing);
+        }
     }
 
     void Draw(HDC hdc)
     {
-        // Create a blue brush for the navbar
-        HBRUSH hBrush = CreateSolidBrush(RGB(0, 0, 255));
-        FillRect(hdc, &rect, hBrush);
-        DeleteObject(hBrush);
+        textCache.BeginFrame();
+        GdiRenderer renderer(hdc, &textCache, model->GetScreenTransform().dpi);
+        Draw(drawBatch);
+        drawBatch.Flush(renderer);
+        textCache.EndFrame();
+    }
+
+    void Draw(Renderer& renderer)
+    {
+        PaintWidget(renderer, *model->Get(id));
 
-        // Draw each box
-        for (auto& box : boxes)
+        // Draw each visible box
+        size_t first, last;
+        GetVisibleRange(&first, &last);
+        for (size_t i = first; i < last; i++)
         {
-            box.Draw(hdc);
+            PaintWidget(renderer, *model->Get(RealizeItem(i)), selection.IsSelected(i));
         }
     }
 
-    const std::vector<Box>& GetBoxes() const { return boxes; }
+    std::wstring GetItemText(size_t index) const
+    {
+        return source ? source->GetItemText(index) : model->Get(model->GetChild(id, index))->name;
+    }
+
+    // Items from an item source are always realized as buttons, so the role
+    // is known without realizing the item.
+    WidgetRole GetItemRole(size_t index) const
+    {
+        return source ? WidgetRole::Button : model->Get(model->GetChild(id, index))->role;
+    }
+
+    // Selection state by item index, so selecting items does not realize them.
+    SelectionSet& GetSelection() { return selection; }
+    const SelectionSet& GetSelection() const { return selection; }
+
+    WidgetModel* GetModel() const { return model; }
+    WidgetId GetId() const { return id; }
     RECT GetRect() const { return rect; }
 
 private:
+    // Items realized on top of the visible ones, so an AT walking siblings
+    // off-screen does not thrash the cache.
+    static const size_t kExtraRealizedItems = 16;
+
+    struct RealizedItem
+    {
+        size_t index;
+        unsigned long long lastUse;
+        WidgetId widget;
+    };
+
+    LONG GetItemPitch() const { return itemSize.cx + itemSpacing; }
+
+    size_t GetRealizedCapacity() const
+    {
+        LONG visibleCount = (rect.right - rect.left) / GetItemPitch() + 2;
+        return static_cast<size_t>(visibleCount) + kExtraRealizedItems;
+    }
+
+    // Picks the least recently used slot, preferring items that are not
+    // visible. The focused item's slot is never picked: the model's focus is
+    // its widget, which must not be recycled into another item.
+    size_t FindEvictionSlot() const
+    {
+        size_t first, last;
+        GetVisibleRange(&first, &last);
+        size_t best = realized.size();
+        bool bestVisible = true;
+        for (size_t slot = 0; slot < realized.size(); slot++)
+        {
+            if (realized[slot].index == focusedItem)
+            {
+                continue;
+            }
+            bool visible = realized[slot].index >= first && realized[slot].index < last;
+            if (best == realized.size() || (bestVisible && !visible) || (bestVisible == visible && realized[slot].lastUse < realized[best].lastUse))
+            {
+                best = slot;
+                bestVisible = visible;
+            }
+        }
+        return best;
+    }
+
+    WidgetModel* model;
+    WidgetId id;
+    TextLayoutCache textCache;
+    DrawBatch drawBatch;
     RECT rect;
-    std::vector<Box> boxes;
+    size_t focusedItem;
+    SelectionSet selection;
+
+    // Virtualized mode
+    ItemSource* source;
+    SIZE itemSize;
+    LONG itemSpacing;
+    LONG scrollOffset;
+    unsigned long long useTick;
+    std::vector<RealizedItem> realized;
+    std::unordered_map<size_t, size_t> slotOfIndex;
 };
@@ -3,11 +3,14 @@
 #include <windows.h>
 #include <ole2.h>
 #include <uiautomation.h>
+#include "../Shared/AllocationCounter.h"
+#include "../Shared/WidgetQuery.h"
+#include "../Shared/Win32ScreenTransform.h"
 #include "Navbar.h"
 #include "BoxProvider.h"
 #include <iostream>
 
-class NavbarProvider : public IRawElementProviderSimple, public IRawElementProviderFragmentRoot
+class NavbarProvider : public IRawElementProviderSimple, public IRawElementProviderFragment, public IRawElementProviderFragmentRoot, public IItemContainerProvider, public ISelectionProvider, public IRawElementProviderAdviseEvents
 {
 public:
     NavbarProvider(Navbar* navbar, HWND hwnd) : navbar(navbar), hwnd(hwnd), refCount(1)
@@ -22,6 +25,15 @@ public:
         }
     }
 
+    // Reads the requested properties of the navbar and its items in one
+    // pass, for a client that would otherwise walk the toolbar reading each
+    // property of each item.
+    HRESULT Prefetch(const CacheRequest& request, PropertyCache* cache)
+    {
+        CallScope call(TraceEvent::Prefetch, { navbar->GetId().index, kTraceSelf, static_cast<int64_t>(request.scope), static_cast<int64_t>(request.properties.size()) });
+        return cache->Gather(navbar, hwnd, ElementContext::kNavbarElement, request);
+    }
+
     // IUnknown methods
     ULONG STDMETHODCALLTYPE AddRef() { return ++refCount; }
     ULONG STDMETHODCALLTYPE Release()
@@ -37,14 +49,37 @@ public:
     {
         if (!ppInterface) return E_POINTER;
 
-        if (riid == __uuidof(IUnknown) || riid == __uuidof(IRawElementProviderSimple) || riid == __uuidof(IRawElementProviderFragment) || riid == __uuidof(IRawElementProviderFragmentRoot))
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IRawElementProviderSimple))
         {
             *ppInterface = static_cast<IRawElementProviderSimple*>(this);
-            AddRef();
-            return S_OK;
         }
-        *ppInterface = NULL;
-        return E_NOINTERFACE;
+        else if (riid == __uuidof(IRawElementProviderFragment))
+        {
+            *ppInterface = static_cast<IRawElementProviderFragment*>(this);
+        }
+        else if (riid == __uuidof(IRawElementProviderFragmentRoot))
+        {
+            *ppInterface = static_cast<IRawElementProviderFragmentRoot*>(this);
+        }
+        else if (riid == __uuidof(IItemContainerProvider))
+        {
+            *ppInterface = static_cast<IItemContainerProvider*>(this);
+        }
+        else if (riid == __uuidof(ISelectionProvider))
+        {
+            *ppInterface = static_cast<ISelectionProvider*>(this);
+        }
+        else if (riid == __uuidof(IRawElementProviderAdviseEvents))
+        {
+            *ppInterface = static_cast<IRawElementProviderAdviseEvents*>(this);
+        }
+        else
+        {
+            *ppInterface = NULL;
+            return E_NOINTERFACE;
+        }
+        AddRef();
+        return S_OK;
     }
 
     // IRawElementProviderSimple methods
@@ -60,63 +95,25 @@ public:
         if (!pRetVal) return E_POINTER;
 
         *pRetVal = NULL;
+        if (iid == UIA_ItemContainerPatternId)
+        {
+            *pRetVal = static_cast<IItemContainerProvider*>(this);
+            AddRef();
+        }
+        else if (iid == UIA_SelectionPatternId)
+        {
+            *pRetVal = static_cast<ISelectionProvider*>(this);
+            AddRef();
+        }
         return S_OK;
     }
     HRESULT STDMETHODCALLTYPE GetPropertyValue(PROPERTYID idProp, VARIANT* pRetVal)
     {
         if (!pRetVal) return E_POINTER;
 
-        pRetVal->vt = VT_EMPTY;
-        if (idProp == UIA_ControlTypePropertyId)
-        {
-            pRetVal->vt = VT_I4;
-            pRetVal->lVal = UIA_PaneControlTypeId;
-        }
-        else if (idProp == UIA_NamePropertyId)
-        {
-            pRetVal->vt = VT_BSTR;
-            pRetVal->bstrVal = SysAllocString(L"Navbar");
-        }
-        else if (idProp == UIA_BoundingRectanglePropertyId)
-        {
-            RECT rect = navbar->GetRect();
-            UiaRect uiaRect = { (double)rect.left, (double)rect.top, (double)(rect.right - rect.left), (double)(rect.bottom - rect.top) };
-            pRetVal->vt = VT_R8 | VT_ARRAY;
-            SAFEARRAY* psa = SafeArrayCreateVector(VT_R8, 0, 4);
-
-            if (psa != NULL)
-            {
-                LONG index = 0;
-                HRESULT hr = SafeArrayPutElement(psa, &index, &uiaRect.left);
-                if (SUCCEEDED(hr))
-                {
-                    index = 1;
-                    hr = SafeArrayPutElement(psa, &index, &uiaRect.top);
-                    if (SUCCEEDED(hr))
-                    {
-                        index = 2;
-                        hr = SafeArrayPutElement(psa, &index, &uiaRect.width);
-                        if (SUCCEEDED(hr))
-                        {
-                            index = 3;
-                            hr = SafeArrayPutElement(psa, &index, &uiaRect.height);
-                            if (SUCCEEDED(hr))
-                            {
-                                pRetVal->parray = psa;
-                                return S_OK;
-                            }
-                        }
-                    }
-                }
-
-                // Cleanup on failure
-                SafeArrayDestroy(psa);
-            }
-
-            // Return appropriate error if creation or element insertion failed
-            return E_FAIL;
-        }
-        return S_OK;
+        CallScope call(TraceEvent::GetPropertyValue, { navbar->GetId().index, kTraceSelf, idProp });
+        GetProviderStats().propertyReads++;
+        return NavbarPropertyTable().GetValue(idProp, { navbar, ElementContext::kNavbarElement, navbar->GetId(), hwnd }, pRetVal);
     }
 
     HRESULT STDMETHODCALLTYPE get_HostRawElementProvider(IRawElementProviderSimple** pRetVal)
@@ -131,13 +128,25 @@ public:
     {
         if (!pRetVal) return E_POINTER;
 
+        CallScope call(TraceEvent::Navigate, { navbar->GetId().index, kTraceSelf, direction });
+        GetProviderStats().navigations++;
         *pRetVal = NULL;
+        size_t count = navbar->GetItemCount();
+        if (direction == NavigateDirection_FirstChild && count > 0)
+        {
+            *pRetVal = new BoxProvider(navbar, 0, this, hwnd);
+        }
+        else if (direction == NavigateDirection_LastChild && count > 0)
+        {
+            *pRetVal = new BoxProvider(navbar, count - 1, this, hwnd);
+        }
         return S_OK;
     }
     HRESULT STDMETHODCALLTYPE GetRuntimeId(SAFEARRAY** pRetVal)
     {
         if (!pRetVal) return E_POINTER;
 
+        CallScope call(TraceEvent::GetRuntimeId, { navbar->GetId().index, kTraceSelf });
         *pRetVal = NULL;
         return S_OK;
     }
@@ -145,7 +154,8 @@ public:
     {
         if (!pRetVal) return E_POINTER;
 
-        RECT rect = navbar->GetRect();
+        CallScope call(TraceEvent::GetBoundingRectangle, { navbar->GetId().index, kTraceSelf });
+        RECT rect = ToRect(navbar->GetModel()->GetDerived().screenRects[navbar->GetId().index]);
         pRetVal->left = (double)rect.left;
         pRetVal->top = (double)rect.top;
         pRetVal->width = (double)(rect.right - rect.left);
@@ -161,13 +171,15 @@ public:
     }
     HRESULT STDMETHODCALLTYPE SetFocus()
     {
+        CallScope call(TraceEvent::FocusElement, { navbar->GetId().index, kTraceSelf });
         return S_OK;
     }
     HRESULT STDMETHODCALLTYPE get_FragmentRoot(IRawElementProviderFragmentRoot** pRetVal)
     {
         if (!pRetVal) return E_POINTER;
 
-        *pRetVal = NULL;
+        *pRetVal = static_cast<IRawElementProviderFragmentRoot*>(this);
+        AddRef();
         return S_OK;
     }
 
@@ -176,18 +188,271 @@ public:
     {
         if (!pRetVal) return E_POINTER;
 
+        CallScope call(TraceEvent::ElementFromPoint, { navbar->GetId().index, kTraceSelf, static_cast<int64_t>(x), static_cast<int64_t>(y) });
         *pRetVal = NULL;
+        POINT pt = ScreenToLayout(navbar->GetModel()->GetScreenTransform(), { (LONG)x, (LONG)y });
+        size_t index = navbar->ItemFromPoint(pt.x, pt.y);
+        if (index < navbar->GetItemCount())
+        {
+            *pRetVal = new BoxProvider(navbar, index, this, hwnd);
+        }
         return S_OK;
     }
     HRESULT STDMETHODCALLTYPE GetFocus(IRawElementProviderFragment** pRetVal)
     {
         if (!pRetVal) return E_POINTER;
 
+        CallScope call(TraceEvent::GetFocus, { navbar->GetId().index, kTraceSelf });
         *pRetVal = NULL;
+        size_t focused = navbar->GetFocusedItem();
+        if (focused < navbar->GetItemCount())
+        {
+            *pRetVal = new BoxProvider(navbar, focused, this, hwnd);
+        }
+        return S_OK;
+    }
+
+    // IItemContainerProvider methods
+    HRESULT STDMETHODCALLTYPE FindItemByProperty(IRawElementProviderSimple* pStartAfter, PROPERTYID propertyId, VARIANT value, IRawElementProviderSimple** pFound)
+    {
+        if (!pFound) return E_POINTER;
+
+        CallScope call(TraceEvent::FindItem);
+        *pFound = NULL;
+        WidgetCondition condition = WidgetCondition::Always();
+        if (propertyId != 0 && !GetItemCondition(propertyId, value, &condition))
+        {
+            return E_INVALIDARG;
+        }
+
+        size_t start = 0;
+        if (pStartAfter)
+        {
+            if (!BoxProvider::GetIndexFromProvider(pStartAfter, &start))
+            {
+                return E_INVALIDARG;
+            }
+            start++;
+        }
+        TraceFindItem(start, propertyId, value);
+
+        if (!navbar->IsVirtualized())
+        {
+            // Items are widgets, so the condition runs as a query over the
+            // navbar's children, in order; the first one at or after start wins
+            WidgetModel* model = navbar->GetModel();
+            const DerivedData& data = model->GetDerived();
+            WidgetQuery query(condition);
+            query.Run(*model, navbar->GetId(), QueryScope::Children, [&](WidgetId match)
+            {
+                size_t index = data.childIndex[match.index];
+                if (index < start)
+                {
+                    return true;
+                }
+                *pFound = new BoxProvider(navbar, index, this, hwnd);
+                return false;
+            });
+            return S_OK;
+        }
+
+        // Virtualized items are all enabled buttons, so only the name tells them apart
+        if (propertyId != 0 && propertyId != UIA_NamePropertyId)
+        {
+            bool all = propertyId == UIA_ControlTypePropertyId ? value.lVal == UIA_ButtonControlTypeId : value.boolVal == VARIANT_TRUE;
+            if (all && start < navbar->GetItemCount())
+            {
+                *pFound = new BoxProvider(navbar, start, this, hwnd);
+            }
+            return S_OK;
+        }
+
+        // Searching by name reads item text without realizing the items that do not match
+        size_t count = navbar->GetItemCount();
+        for (size_t i = start; i < count; i++)
+        {
+            if (propertyId == 0 || navbar->GetItemText(i) == value.bstrVal)
+            {
+                *pFound = new BoxProvider(navbar, i, this, hwnd);
+                return S_OK;
+            }
+        }
+        return S_OK;
+    }
+
+    // ISelectionProvider methods
+    HRESULT STDMETHODCALLTYPE GetSelection(SAFEARRAY** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::GetSelection, { navbar->GetId().index, kTraceSelf });
+        // Walks the bitset a word at a time, so unselected items are skipped 64 at a time
+        const SelectionSet& selection = navbar->GetSelection();
+        *pRetVal = SafeArrayCreateVector(VT_UNKNOWN, 0, static_cast<ULONG>(selection.GetSelectedCount()));
+        if (*pRetVal == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        IUnknown** elements = NULL;
+        HRESULT hr = SafeArrayAccessData(*pRetVal, (void**)&elements);
+        if (FAILED(hr))
+        {
+            SafeArrayDestroy(*pRetVal);
+            *pRetVal = NULL;
+            return hr;
+        }
+        size_t count = 0;
+        for (size_t i = selection.NextSelected(0); i != SelectionSet::kNoItem; i = selection.NextSelected(i + 1))
+        {
+            elements[count++] = static_cast<IRawElementProviderSimple*>(new BoxProvider(navbar, i, this, hwnd));
+        }
+        SafeArrayUnaccessData(*pRetVal);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_CanSelectMultiple(BOOL* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        *pRetVal = TRUE;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_IsSelectionRequired(BOOL* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        *pRetVal = FALSE;
+        return S_OK;
+    }
+
+    // IRawElementProviderAdviseEvents methods; UIA calls these as clients add
+    // and remove handlers, so the model builds only events someone will hear
+    HRESULT STDMETHODCALLTYPE AdviseEventAdded(EVENTID eventId, SAFEARRAY* propertyIDs)
+    {
+        CallScope call(TraceEvent::AdviseEvent, { navbar->GetId().index, kTraceSelf, eventId, 1 });
+        AdviseEvents(eventId, propertyIDs, true);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE AdviseEventRemoved(EVENTID eventId, SAFEARRAY* propertyIDs)
+    {
+        CallScope call(TraceEvent::AdviseEvent, { navbar->GetId().index, kTraceSelf, eventId, 0 });
+        AdviseEvents(eventId, propertyIDs, false);
         return S_OK;
     }
 
 private:
+    void AdviseEvents(EVENTID eventId, SAFEARRAY* propertyIDs, bool added)
+    {
+        EventSubscriptions& subscriptions = navbar->GetModel()->GetEventSubscriptions();
+        auto update = [&subscriptions, added](WidgetEventKind kind)
+        {
+            if (added)
+            {
+                subscriptions.Add(kind);
+            }
+            else
+            {
+                subscriptions.Remove(kind);
+            }
+        };
+        if (eventId == UIA_AutomationFocusChangedEventId)
+        {
+            update(WidgetEventKind::Focus);
+        }
+        else if (eventId == UIA_StructureChangedEventId)
+        {
+            update(WidgetEventKind::StructureChanged);
+        }
+        else if (eventId == UIA_NotificationEventId)
+        {
+            update(WidgetEventKind::Notification);
+        }
+        else if (eventId == UIA_AutomationPropertyChangedEventId && propertyIDs)
+        {
+            LONG lower, upper;
+            PROPERTYID* ids = NULL;
+            if (FAILED(SafeArrayGetLBound(propertyIDs, 1, &lower)) || FAILED(SafeArrayGetUBound(propertyIDs, 1, &upper))
+                || FAILED(SafeArrayAccessData(propertyIDs, (void**)&ids)))
+            {
+                return;
+            }
+            for (LONG i = 0; i <= upper - lower; i++)
+            {
+                switch (ids[i])
+                {
+                case UIA_NamePropertyId:
+                    update(WidgetEventKind::NameChanged);
+                    break;
+                case UIA_BoundingRectanglePropertyId:
+                    update(WidgetEventKind::BoundsChanged);
+                    break;
+                case UIA_IsEnabledPropertyId:
+                    update(WidgetEventKind::EnabledChanged);
+                    break;
+                case UIA_ValueValuePropertyId:
+                case UIA_RangeValueValuePropertyId:
+                    update(WidgetEventKind::ValueChanged);
+                    break;
+                }
+            }
+            SafeArrayUnaccessData(propertyIDs);
+        }
+    }
+
+    // Records a FindItemByProperty call, with items searched from start.
+    void TraceFindItem(size_t start, PROPERTYID propertyId, const VARIANT& value)
+    {
+        QueryTraceWriter* trace = ActiveTrace();
+        if (!trace)
+        {
+            return;
+        }
+        int64_t after = static_cast<int64_t>(start) - 1;
+        int64_t slot = navbar->GetId().index;
+        if (propertyId == UIA_NamePropertyId)
+        {
+            std::string name = WideToUtf8(value.bstrVal);
+            trace->Write(TraceEvent::FindItem, { slot, kTraceSelf, after, static_cast<int64_t>(TraceFind::Name) }, {}, &name);
+        }
+        else if (propertyId == UIA_IsEnabledPropertyId)
+        {
+            trace->Write(TraceEvent::FindItem, { slot, kTraceSelf, after, static_cast<int64_t>(TraceFind::Enabled), value.boolVal == VARIANT_TRUE });
+        }
+        else if (propertyId == UIA_ControlTypePropertyId)
+        {
+            int64_t role = value.lVal == UIA_ButtonControlTypeId ? static_cast<int64_t>(WidgetRole::Button)
+                : value.lVal == UIA_ProgressBarControlTypeId ? static_cast<int64_t>(WidgetRole::ProgressBar)
+                : -1;
+            trace->Write(TraceEvent::FindItem, { slot, kTraceSelf, after, static_cast<int64_t>(TraceFind::Role), role });
+        }
+        else
+        {
+            trace->Write(TraceEvent::FindItem, { slot, kTraceSelf, after, static_cast<int64_t>(TraceFind::Any) });
+        }
+    }
+
+    // Maps a property search an item container supports to a widget condition.
+    static bool GetItemCondition(PROPERTYID propertyId, const VARIANT& value, WidgetCondition* condition)
+    {
+        if (propertyId == UIA_NamePropertyId && value.vt == VT_BSTR)
+        {
+            *condition = WidgetCondition::NameIs(value.bstrVal);
+            return true;
+        }
+        if (propertyId == UIA_IsEnabledPropertyId && value.vt == VT_BOOL)
+        {
+            *condition = WidgetCondition::IsEnabled(value.boolVal == VARIANT_TRUE);
+            return true;
+        }
+        if (propertyId == UIA_ControlTypePropertyId && value.vt == VT_I4)
+        {
+            *condition = value.lVal == UIA_ButtonControlTypeId ? WidgetCondition::RoleIs(WidgetRole::Button)
+                : value.lVal == UIA_ProgressBarControlTypeId ? WidgetCondition::RoleIs(WidgetRole::ProgressBar)
+                : WidgetCondition::Never();
+            return true;
+        }
+        return false;
+    }
+
     Navbar* navbar;
     HWND hwnd;
     ULONG refCount;
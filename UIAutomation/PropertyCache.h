@@ -0,0 +1,154 @@
+#pragma once
+
+#include <windows.h>
+#include <ole2.h>
+#include <uiautomation.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "../Shared/WidgetQuery.h"
+#include "Navbar.h"
+#include "PropertyTable.h"
+
+// How many times clients entered the providers, to compare ways of reading
+// the tree.
+struct ProviderStats
+{
+    uint64_t propertyReads;
+    uint64_t navigations;
+    uint64_t prefetches;
+};
+
+inline ProviderStats& GetProviderStats()
+{
+    static ProviderStats stats = {};
+    return stats;
+}
+
+// What to prefetch, as in a UIA cache request: the elements in scope of the
+// element it is made on, and the properties to read for each of them.
+struct CacheRequest
+{
+    QueryScope scope;
+    std::vector<PROPERTYID> properties;
+};
+
+// Property values gathered in one pass, one row per element in document order
+// and one column per requested property, so reading a whole toolbar costs one
+// call instead of one per property per element.
+class PropertyCache
+{
+public:
+    static const size_t kNoRow = (size_t)-1;
+
+    PropertyCache() : propertyCount(0) {}
+    ~PropertyCache() { Clear(); }
+
+    PropertyCache(const PropertyCache&) = delete;
+    PropertyCache& operator=(const PropertyCache&) = delete;
+
+    size_t GetElementCount() const { return elements.size(); }
+    size_t GetPropertyCount() const { return propertyCount; }
+
+    // Item index of the element in a row, or ElementContext::kNavbarElement.
+    size_t GetElement(size_t row) const { return elements[row]; }
+
+    // Row holding an element, or kNoRow if it was not in scope.
+    size_t FindRow(size_t element) const
+    {
+        // The navbar comes first and items follow in index order
+        size_t first = !elements.empty() && elements[0] == ElementContext::kNavbarElement ? 1 : 0;
+        if (element == ElementContext::kNavbarElement)
+        {
+            return first == 1 ? 0 : kNoRow;
+        }
+        auto it = std::lower_bound(elements.begin() + first, elements.end(), element);
+        return it != elements.end() && *it == element ? static_cast<size_t>(it - elements.begin()) : kNoRow;
+    }
+
+    const VARIANT& GetValue(size_t row, size_t column) const { return values[row * propertyCount + column]; }
+
+    // Copies a value out the way GetPropertyValue would return it.
+    HRESULT CopyValue(size_t row, size_t column, VARIANT* pRetVal) const
+    {
+        VariantInit(pRetVal);
+        return VariantCopy(pRetVal, &GetValue(row, column));
+    }
+
+    void Clear()
+    {
+        for (VARIANT& value : values)
+        {
+            VariantClear(&value);
+        }
+        values.clear();
+        elements.clear();
+        propertyCount = 0;
+    }
+
+    // Fills the cache with the requested properties of the elements in scope
+    // of element, an item index or kNavbarElement. Items are leaves, so for
+    // an item only Element and Subtree include anything. The property tables
+    // are resolved once per element rather than once per read, and in
+    // virtualized mode only the visible items are gathered, since the rest
+    // would have to be realized just to be read.
+    HRESULT Gather(Navbar* navbar, HWND hwnd, size_t element, const CacheRequest& request)
+    {
+        GetProviderStats().prefetches++;
+        Clear();
+
+        bool includeSelf = request.scope == QueryScope::Element || request.scope == QueryScope::Subtree;
+        if (includeSelf)
+        {
+            elements.push_back(element);
+        }
+        if (element == ElementContext::kNavbarElement && request.scope != QueryScope::Element)
+        {
+            size_t first, last;
+            navbar->GetVisibleRange(&first, &last);
+            for (size_t i = first; i < last; i++)
+            {
+                elements.push_back(i);
+            }
+        }
+
+        propertyCount = request.properties.size();
+        values.resize(elements.size() * propertyCount);
+        for (VARIANT& value : values)
+        {
+            VariantInit(&value);
+        }
+
+        WidgetModel* model = navbar->GetModel();
+        for (size_t row = 0; row < elements.size(); row++)
+        {
+            ElementContext context = { navbar, elements[row], navbar->GetId(), hwnd };
+            const PropertyTable* table = &NavbarPropertyTable();
+            if (context.index != ElementContext::kNavbarElement)
+            {
+                context.widget = navbar->RealizeItem(context.index);
+                if (context.widget == kNoWidget)
+                {
+                    Clear();
+                    return UIA_E_ELEMENTNOTAVAILABLE;
+                }
+                table = model->Get(context.widget)->role == WidgetRole::ProgressBar ? &ProgressBarPropertyTable() : &ButtonPropertyTable();
+            }
+            for (size_t column = 0; column < propertyCount; column++)
+            {
+                HRESULT hr = table->GetValue(request.properties[column], context, &values[row * propertyCount + column]);
+                if (FAILED(hr))
+                {
+                    Clear();
+                    return hr;
+                }
+            }
+        }
+        return S_OK;
+    }
+
+private:
+    std::vector<size_t> elements;
+    std::vector<VARIANT> values;
+    size_t propertyCount;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <windows.h>
+#include <ole2.h>
+#include <uiautomation.h>
+#include "Navbar.h"
+
+// Element a property is being read for. index is kNavbarElement for the navbar
+// itself; otherwise widget is the realized item at index.
+struct ElementContext
+{
+    static const size_t kNavbarElement = (size_t)-1;
+
+    Navbar* navbar;
+    size_t index;
+    WidgetId widget;
+    HWND hwnd;
+
+    const Widget& GetWidget() const { return *navbar->GetModel()->Get(widget); }
+    RECT GetScreenRect() const { return ToRect(navbar->GetModel()->GetDerived().screenRects[widget.index]); }
+};
+
+typedef HRESULT (*PropertyGetter)(const ElementContext& element, VARIANT* pRetVal);
+
+// Dense table of property getters indexed by PROPERTYID offset, so each
+// GetPropertyValue call is a single array lookup. Unset entries report
+// VT_EMPTY, which tells UIA to fall back to its defaults.
+class PropertyTable
+{
+public:
+    static const PROPERTYID kFirstPropertyId = UIA_RuntimeIdPropertyId;
+    static const PROPERTYID kLastPropertyId = UIA_IsDialogPropertyId;
+
+    PropertyTable()
+    {
+        for (auto& getter : getters)
+        {
+            getter = nullptr;
+        }
+    }
+
+    void Set(PROPERTYID idProp, PropertyGetter getter)
+    {
+        getters[idProp - kFirstPropertyId] = getter;
+    }
+
+    HRESULT GetValue(PROPERTYID idProp, const ElementContext& element, VARIANT* pRetVal) const
+    {
+        pRetVal->vt = VT_EMPTY;
+        if (idProp < kFirstPropertyId || idProp > kLastPropertyId)
+        {
+            return S_OK;
+        }
+        PropertyGetter getter = getters[idProp - kFirstPropertyId];
+        return getter ? getter(element, pRetVal) : S_OK;
+    }
+
+    static HRESULT SetI4(VARIANT* pRetVal, LONG value)
+    {
+        pRetVal->vt = VT_I4;
+        pRetVal->lVal = value;
+        return S_OK;
+    }
+
+    static HRESULT SetBool(VARIANT* pRetVal, bool value)
+    {
+        pRetVal->vt = VT_BOOL;
+        pRetVal->boolVal = value ? VARIANT_TRUE : VARIANT_FALSE;
+        return S_OK;
+    }
+
+    static HRESULT SetDouble(VARIANT* pRetVal, double value)
+    {
+        pRetVal->vt = VT_R8;
+        pRetVal->dblVal = value;
+        return S_OK;
+    }
+
+    static HRESULT SetString(VARIANT* pRetVal, const wchar_t* value)
+    {
+        pRetVal->bstrVal = SysAllocString(value);
+        if (!pRetVal->bstrVal)
+        {
+            return E_OUTOFMEMORY;
+        }
+        pRetVal->vt = VT_BSTR;
+        return S_OK;
+    }
+
+    static HRESULT SetDoubleArray(VARIANT* pRetVal, const double* values, ULONG count)
+    {
+        SAFEARRAY* psa = SafeArrayCreateVector(VT_R8, 0, count);
+        if (psa == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        double* data = NULL;
+        HRESULT hr = SafeArrayAccessData(psa, (void**)&data);
+        if (FAILED(hr))
+        {
+            SafeArrayDestroy(psa);
+            return hr;
+        }
+        for (ULONG i = 0; i < count; i++)
+        {
+            data[i] = values[i];
+        }
+        SafeArrayUnaccessData(psa);
+
+        pRetVal->vt = VT_R8 | VT_ARRAY;
+        pRetVal->parray = psa;
+        return S_OK;
+    }
+
+    static HRESULT SetRect(VARIANT* pRetVal, RECT rect)
+    {
+        double values[] = { (double)rect.left, (double)rect.top, (double)(rect.right - rect.left), (double)(rect.bottom - rect.top) };
+        return SetDoubleArray(pRetVal, values, 4);
+    }
+
+private:
+    PropertyGetter getters[kLastPropertyId - kFirstPropertyId + 1];
+};
+
+// Properties shared by every element in the sample.
+inline void AddCommonProperties(PropertyTable& table)
+{
+    table.Set(UIA_FrameworkIdPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"Win32"); });
+    table.Set(UIA_ProcessIdPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetI4(v, (LONG)GetCurrentProcessId()); });
+    table.Set(UIA_IsControlElementPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+    table.Set(UIA_IsContentElementPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+    table.Set(UIA_IsPasswordPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+    table.Set(UIA_IsRequiredForFormPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+}
+
+// Every navbar item is a selection item of the navbar.
+inline void AddSelectionItemProperties(PropertyTable& table)
+{
+    table.Set(UIA_IsSelectionItemPatternAvailablePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+    table.Set(UIA_SelectionItemIsSelectedPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetBool(v, e.navbar->GetSelection().IsSelected(e.index)); });
+}
+
+inline const PropertyTable& ButtonPropertyTable()
+{
+    static const PropertyTable table = []()
+    {
+        PropertyTable t;
+        AddCommonProperties(t);
+        t.Set(UIA_ControlTypePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetI4(v, UIA_ButtonControlTypeId); });
+        t.Set(UIA_LocalizedControlTypePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"button"); });
+        t.Set(UIA_ClassNamePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"Box"); });
+        t.Set(UIA_NamePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetString(v, e.GetWidget().name.c_str()); });
+        t.Set(UIA_AutomationIdPropertyId, [](const ElementContext& e, VARIANT* v)
+        {
+            return PropertyTable::SetString(v, (L"Box" + std::to_wstring(e.index + 1)).c_str());
+        });
+        t.Set(UIA_BoundingRectanglePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetRect(v, e.GetScreenRect()); });
+        t.Set(UIA_ClickablePointPropertyId, [](const ElementContext& e, VARIANT* v)
+        {
+            RECT rect = e.GetScreenRect();
+            double point[] = { (rect.left + rect.right) / 2.0, (rect.top + rect.bottom) / 2.0 };
+            return PropertyTable::SetDoubleArray(v, point, 2);
+        });
+        t.Set(UIA_IsEnabledPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetBool(v, e.GetWidget().enabled); });
+        t.Set(UIA_IsKeyboardFocusablePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetBool(v, e.GetWidget().enabled); });
+        t.Set(UIA_HasKeyboardFocusPropertyId, [](const ElementContext& e, VARIANT* v)
+        {
+            return PropertyTable::SetBool(v, GetFocus() == e.hwnd && e.navbar->GetFocusedItem() == e.index);
+        });
+        t.Set(UIA_IsOffscreenPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetBool(v, !e.navbar->IsItemVisible(e.index)); });
+        t.Set(UIA_PositionInSetPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetI4(v, (LONG)e.index + 1); });
+        t.Set(UIA_SizeOfSetPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetI4(v, (LONG)e.navbar->GetItemCount()); });
+        t.Set(UIA_IsVirtualizedItemPatternAvailablePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetBool(v, e.navbar->IsVirtualized()); });
+        AddSelectionItemProperties(t);
+        return t;
+    }();
+    return table;
+}
+
+inline const PropertyTable& ProgressBarPropertyTable()
+{
+    static const PropertyTable table = []()
+    {
+        PropertyTable t;
+        AddCommonProperties(t);
+        t.Set(UIA_ControlTypePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetI4(v, UIA_ProgressBarControlTypeId); });
+        t.Set(UIA_LocalizedControlTypePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"progress bar"); });
+        t.Set(UIA_ClassNamePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"ProgressBar"); });
+        t.Set(UIA_NamePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetString(v, e.GetWidget().name.c_str()); });
+        t.Set(UIA_AutomationIdPropertyId, [](const ElementContext& e, VARIANT* v)
+        {
+            return PropertyTable::SetString(v, (L"Progress" + std::to_wstring(e.index + 1)).c_str());
+        });
+        t.Set(UIA_BoundingRectanglePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetRect(v, e.GetScreenRect()); });
+        t.Set(UIA_IsEnabledPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetBool(v, e.GetWidget().enabled); });
+        t.Set(UIA_IsKeyboardFocusablePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+        t.Set(UIA_HasKeyboardFocusPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+        t.Set(UIA_IsOffscreenPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetBool(v, !e.navbar->IsItemVisible(e.index)); });
+        t.Set(UIA_IsValuePatternAvailablePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        t.Set(UIA_IsRangeValuePatternAvailablePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        t.Set(UIA_ValueValuePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetString(v, GetValueText(e.GetWidget()).c_str()); });
+        t.Set(UIA_ValueIsReadOnlyPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        t.Set(UIA_RangeValueValuePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetDouble(v, e.GetWidget().value); });
+        t.Set(UIA_RangeValueMinimumPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetDouble(v, e.GetWidget().minimum); });
+        t.Set(UIA_RangeValueMaximumPropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetDouble(v, e.GetWidget().maximum); });
+        t.Set(UIA_RangeValueIsReadOnlyPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        AddSelectionItemProperties(t);
+        return t;
+    }();
+    return table;
+}
+
+inline const PropertyTable& NavbarPropertyTable()
+{
+    static const PropertyTable table = []()
+    {
+        PropertyTable t;
+        AddCommonProperties(t);
+        t.Set(UIA_ControlTypePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetI4(v, UIA_PaneControlTypeId); });
+        t.Set(UIA_LocalizedControlTypePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"pane"); });
+        t.Set(UIA_ClassNamePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"Navbar"); });
+        t.Set(UIA_NamePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetString(v, e.GetWidget().name.c_str()); });
+        t.Set(UIA_AutomationIdPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetString(v, L"Navbar"); });
+        t.Set(UIA_BoundingRectanglePropertyId, [](const ElementContext& e, VARIANT* v) { return PropertyTable::SetRect(v, e.GetScreenRect()); });
+        t.Set(UIA_IsEnabledPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        t.Set(UIA_IsKeyboardFocusablePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+        t.Set(UIA_HasKeyboardFocusPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+        t.Set(UIA_IsOffscreenPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+        t.Set(UIA_OrientationPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetI4(v, OrientationType_Horizontal); });
+        t.Set(UIA_IsItemContainerPatternAvailablePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        t.Set(UIA_IsSelectionPatternAvailablePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        t.Set(UIA_SelectionCanSelectMultiplePropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, true); });
+        t.Set(UIA_SelectionIsSelectionRequiredPropertyId, [](const ElementContext&, VARIANT* v) { return PropertyTable::SetBool(v, false); });
+        return t;
+    }();
+    return table;
+}
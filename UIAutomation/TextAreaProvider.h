@@ -0,0 +1,187 @@
+#pragma once
+
+#include <windows.h>
+#include <ole2.h>
+#include <uiautomation.h>
+#include "PropertyTable.h"
+#include "TextRangeProvider.h"
+
+// Root provider for a window that shows a TextDocument, exposing it through
+// the text pattern. All text queries are answered from the document's piece
+// table, so ATs can read and navigate documents of several megabytes.
+class TextAreaProvider : public IRawElementProviderSimple, public ITextProvider
+{
+public:
+    TextAreaProvider(TextDocument* document, HWND hwnd) : document(document), hwnd(hwnd), refCount(1) {}
+
+    // IUnknown methods
+    ULONG STDMETHODCALLTYPE AddRef() { return ++refCount; }
+    ULONG STDMETHODCALLTYPE Release()
+    {
+        if (--refCount == 0)
+        {
+            delete this;
+            return 0;
+        }
+        return refCount;
+    }
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppInterface)
+    {
+        if (!ppInterface) return E_POINTER;
+
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IRawElementProviderSimple))
+        {
+            *ppInterface = static_cast<IRawElementProviderSimple*>(this);
+        }
+        else if (riid == __uuidof(ITextProvider))
+        {
+            *ppInterface = static_cast<ITextProvider*>(this);
+        }
+        else
+        {
+            *ppInterface = NULL;
+            return E_NOINTERFACE;
+        }
+        AddRef();
+        return S_OK;
+    }
+
+    // IRawElementProviderSimple methods
+    HRESULT STDMETHODCALLTYPE get_ProviderOptions(ProviderOptions* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetProviderOptions), 0, 0 });
+        *pRetVal = ProviderOptions_ServerSideProvider;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetPatternProvider(PATTERNID iid, IUnknown** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetPatternProvider), 0, 0, iid });
+        *pRetVal = NULL;
+        if (iid == UIA_TextPatternId)
+        {
+            *pRetVal = static_cast<ITextProvider*>(this);
+            AddRef();
+        }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetPropertyValue(PROPERTYID idProp, VARIANT* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetPropertyValue), 0, 0, idProp });
+        pRetVal->vt = VT_EMPTY;
+        switch (idProp)
+        {
+        case UIA_ControlTypePropertyId:
+            return PropertyTable::SetI4(pRetVal, UIA_DocumentControlTypeId);
+        case UIA_LocalizedControlTypePropertyId:
+            return PropertyTable::SetString(pRetVal, L"document");
+        case UIA_NamePropertyId:
+            return PropertyTable::SetString(pRetVal, L"Document");
+        case UIA_AutomationIdPropertyId:
+            return PropertyTable::SetString(pRetVal, L"TextArea");
+        case UIA_ClassNamePropertyId:
+            return PropertyTable::SetString(pRetVal, L"TextArea");
+        case UIA_FrameworkIdPropertyId:
+            return PropertyTable::SetString(pRetVal, L"Win32");
+        case UIA_IsKeyboardFocusablePropertyId:
+            return PropertyTable::SetBool(pRetVal, true);
+        case UIA_HasKeyboardFocusPropertyId:
+            return PropertyTable::SetBool(pRetVal, ::GetFocus() == hwnd);
+        case UIA_IsTextPatternAvailablePropertyId:
+            return PropertyTable::SetBool(pRetVal, true);
+        default:
+            return S_OK;
+        }
+    }
+    HRESULT STDMETHODCALLTYPE get_HostRawElementProvider(IRawElementProviderSimple** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetHostProvider), 0, 0 });
+        return UiaHostProviderFromHwnd(hwnd, pRetVal);
+    }
+
+    // ITextProvider methods
+    HRESULT STDMETHODCALLTYPE GetSelection(SAFEARRAY** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetSelection), 0, 0 });
+        return WrapRange(NewRange(document->GetSelectionStart(), document->GetSelectionEnd()), pRetVal);
+    }
+    HRESULT STDMETHODCALLTYPE GetVisibleRanges(SAFEARRAY** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetVisibleRanges), 0, 0 });
+        size_t first = document->GetFirstVisibleLine();
+        size_t last = (std::min)(first + document->GetVisibleLineCount(), document->GetText().GetLineCount()) - 1;
+        return WrapRange(NewRange(document->GetText().GetLineStart(first), document->LineEnd(last)), pRetVal);
+    }
+    HRESULT STDMETHODCALLTYPE RangeFromChild(IRawElementProviderSimple* childElement, ITextRangeProvider** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::RangeFromChild), 0, 0 });
+        // The document has no embedded objects
+        *pRetVal = NULL;
+        return E_INVALIDARG;
+    }
+    HRESULT STDMETHODCALLTYPE RangeFromPoint(UiaPoint point, ITextRangeProvider** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        POINT pt = { (LONG)point.x, (LONG)point.y };
+        ScreenToClient(hwnd, &pt);
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::RangeFromPoint), 0, 0, pt.x, pt.y });
+        size_t offset = document->OffsetFromPoint(pt.x, pt.y);
+        *pRetVal = NewRange(offset, offset);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_DocumentRange(ITextRangeProvider** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetDocumentRange), 0, 0 });
+        *pRetVal = NewRange(0, document->GetLength());
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE get_SupportedTextSelection(SupportedTextSelection* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetSupportedSelection), 0, 0 });
+        *pRetVal = SupportedTextSelection_Single;
+        return S_OK;
+    }
+
+private:
+    ITextRangeProvider* NewRange(size_t start, size_t end)
+    {
+        return new TextRangeProvider(document, static_cast<IRawElementProviderSimple*>(this), hwnd, start, end);
+    }
+
+    // Returns a one-element array holding range, taking over its reference.
+    static HRESULT WrapRange(ITextRangeProvider* range, SAFEARRAY** pRetVal)
+    {
+        *pRetVal = SafeArrayCreateVector(VT_UNKNOWN, 0, 1);
+        if (*pRetVal == NULL)
+        {
+            range->Release();
+            return E_OUTOFMEMORY;
+        }
+        LONG index = 0;
+        HRESULT hr = SafeArrayPutElement(*pRetVal, &index, range);
+        range->Release();
+        return hr;
+    }
+
+    TextDocument* document;
+    HWND hwnd;
+    ULONG refCount;
+};
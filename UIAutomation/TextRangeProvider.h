@@ -0,0 +1,382 @@
+#pragma once
+
+#include <windows.h>
+#include <ole2.h>
+#include <uiautomation.h>
+#include <algorithm>
+#include <cwctype>
+#include <string>
+#include <vector>
+#include "../Shared/AllocationCounter.h"
+#include "../Shared/TextDocument.h"
+
+// A span [start, end) of a TextDocument. Ranges only hold offsets, so they
+// are cheap to clone and are clamped to the text if it has since shrunk.
+class TextRangeProvider : public ITextRangeProvider
+{
+public:
+    TextRangeProvider(TextDocument* document, IRawElementProviderSimple* element, HWND hwnd, size_t start, size_t end)
+        : document(document), element(element), hwnd(hwnd), start(start), end(end), refCount(1)
+    {
+        element->AddRef();
+    }
+
+    ~TextRangeProvider()
+    {
+        element->Release();
+    }
+
+    // UIA text units map onto the units the document knows; Format falls back
+    // to Word and Paragraph to Line, the next larger units it supports.
+    static TextUnitKind ToUnitKind(TextUnit unit)
+    {
+        switch (unit)
+        {
+        case TextUnit_Character:
+            return TextUnitKind::Character;
+        case TextUnit_Format:
+        case TextUnit_Word:
+            return TextUnitKind::Word;
+        case TextUnit_Line:
+        case TextUnit_Paragraph:
+            return TextUnitKind::Line;
+        case TextUnit_Page:
+            return TextUnitKind::Page;
+        default:
+            return TextUnitKind::Document;
+        }
+    }
+
+    // IUnknown methods
+    ULONG STDMETHODCALLTYPE AddRef() { return ++refCount; }
+    ULONG STDMETHODCALLTYPE Release()
+    {
+        if (--refCount == 0)
+        {
+            delete this;
+            return 0;
+        }
+        return refCount;
+    }
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppInterface)
+    {
+        if (!ppInterface) return E_POINTER;
+
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(ITextRangeProvider))
+        {
+            *ppInterface = static_cast<ITextRangeProvider*>(this);
+        }
+        else
+        {
+            *ppInterface = NULL;
+            return E_NOINTERFACE;
+        }
+        AddRef();
+        return S_OK;
+    }
+
+    // ITextRangeProvider methods
+    HRESULT STDMETHODCALLTYPE Clone(ITextRangeProvider** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::Clone), static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        *pRetVal = new TextRangeProvider(document, element, hwnd, start, end);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Compare(ITextRangeProvider* range, BOOL* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        TextRangeProvider* other = FromProvider(range);
+        if (!other)
+        {
+            return E_INVALIDARG;
+        }
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::Compare), static_cast<int64_t>(start), static_cast<int64_t>(end), static_cast<int64_t>(other->start), static_cast<int64_t>(other->end) });
+        Clamp();
+        other->Clamp();
+        *pRetVal = start == other->start && end == other->end;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE CompareEndpoints(TextPatternRangeEndpoint endpoint, ITextRangeProvider* targetRange, TextPatternRangeEndpoint targetEndpoint, int* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        TextRangeProvider* other = FromProvider(targetRange);
+        if (!other)
+        {
+            return E_INVALIDARG;
+        }
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::CompareEndpoints), static_cast<int64_t>(start), static_cast<int64_t>(end), static_cast<int64_t>(other->start), static_cast<int64_t>(other->end), endpoint, targetEndpoint });
+        Clamp();
+        other->Clamp();
+        size_t position = Endpoint(endpoint);
+        size_t target = other->Endpoint(targetEndpoint);
+        *pRetVal = position < target ? -1 : (position > target ? 1 : 0);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE ExpandToEnclosingUnit(TextUnit unit)
+    {
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::ExpandToEnclosingUnit), static_cast<int64_t>(start), static_cast<int64_t>(end), static_cast<int64_t>(ToUnitKind(unit)) });
+        Clamp();
+        TextUnitKind kind = ToUnitKind(unit);
+        start = document->UnitStart(start, kind);
+        end = kind == TextUnitKind::Document ? document->GetLength() : document->NextBoundary(start, kind);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE FindAttribute(TEXTATTRIBUTEID attributeId, VARIANT val, BOOL backward, ITextRangeProvider** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::FindAttribute), static_cast<int64_t>(start), static_cast<int64_t>(end), attributeId, backward != FALSE });
+        // The text is unformatted, so no run has a distinguishing attribute
+        *pRetVal = NULL;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE FindText(BSTR text, BOOL backward, BOOL ignoreCase, ITextRangeProvider** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        *pRetVal = NULL;
+        CallScope call(TraceEvent::TextCall);
+        std::wstring needle(text ? text : L"");
+        if (QueryTraceWriter* trace = ActiveTrace())
+        {
+            std::string utf8 = WideToUtf8(needle);
+            trace->Write(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::FindText), static_cast<int64_t>(start), static_cast<int64_t>(end), backward != FALSE, ignoreCase != FALSE }, {}, &utf8);
+        }
+        Clamp();
+        if (needle.empty())
+        {
+            return E_INVALIDARG;
+        }
+
+        std::wstring haystack = document->GetText().GetText(start, end - start);
+        if (ignoreCase)
+        {
+            std::transform(haystack.begin(), haystack.end(), haystack.begin(), ::towlower);
+            std::transform(needle.begin(), needle.end(), needle.begin(), ::towlower);
+        }
+        size_t found = backward ? haystack.rfind(needle) : haystack.find(needle);
+        if (found != std::wstring::npos)
+        {
+            *pRetVal = new TextRangeProvider(document, element, hwnd, start + found, start + found + needle.size());
+        }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetAttributeValue(TEXTATTRIBUTEID attributeId, VARIANT* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetAttributeValue), static_cast<int64_t>(start), static_cast<int64_t>(end), attributeId });
+        if (attributeId == UIA_IsReadOnlyAttributeId)
+        {
+            pRetVal->vt = VT_BOOL;
+            pRetVal->boolVal = VARIANT_TRUE;
+            return S_OK;
+        }
+        pRetVal->vt = VT_UNKNOWN;
+        return UiaGetReservedNotSupportedValue(&pRetVal->punkVal);
+    }
+    HRESULT STDMETHODCALLTYPE GetBoundingRectangles(SAFEARRAY** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetBoundingRectangles), static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        Clamp();
+        std::vector<WidgetRect> rects;
+        document->GetRangeRects(start, end, &rects);
+
+        POINT origin = { 0, 0 };
+        ClientToScreen(hwnd, &origin);
+        *pRetVal = SafeArrayCreateVector(VT_R8, 0, static_cast<ULONG>(rects.size() * 4));
+        if (*pRetVal == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        for (size_t i = 0; i < rects.size(); i++)
+        {
+            double values[] = { (double)(rects[i].left + origin.x), (double)(rects[i].top + origin.y), (double)(rects[i].right - rects[i].left), (double)(rects[i].bottom - rects[i].top) };
+            for (LONG j = 0; j < 4; j++)
+            {
+                LONG index = static_cast<LONG>(i * 4) + j;
+                SafeArrayPutElement(*pRetVal, &index, &values[j]);
+            }
+        }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetEnclosingElement(IRawElementProviderSimple** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetEnclosingElement), static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        *pRetVal = element;
+        element->AddRef();
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetText(int maxLength, BSTR* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetText), static_cast<int64_t>(start), static_cast<int64_t>(end), maxLength });
+        Clamp();
+        size_t count = end - start;
+        if (maxLength >= 0)
+        {
+            count = (std::min)(count, static_cast<size_t>(maxLength));
+        }
+        std::wstring text = document->GetText().GetText(start, count);
+        *pRetVal = SysAllocStringLen(text.data(), static_cast<UINT>(text.size()));
+        return *pRetVal ? S_OK : E_OUTOFMEMORY;
+    }
+    HRESULT STDMETHODCALLTYPE Move(TextUnit unit, int count, int* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::Move), static_cast<int64_t>(start), static_cast<int64_t>(end), static_cast<int64_t>(ToUnitKind(unit)), count });
+        // A degenerate range moves as a caret; any other range is moved by its
+        // start and then spans exactly one unit
+        Clamp();
+        TextUnitKind kind = ToUnitKind(unit);
+        bool degenerate = start == end;
+        size_t position = degenerate ? start : document->UnitStart(start, kind);
+        *pRetVal = MoveBoundary(&position, kind, count, degenerate);
+        start = position;
+        if (!degenerate)
+        {
+            end = kind == TextUnitKind::Document ? document->GetLength() : document->NextBoundary(start, kind);
+        }
+        else
+        {
+            end = start;
+        }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE MoveEndpointByUnit(TextPatternRangeEndpoint endpoint, TextUnit unit, int count, int* pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::MoveEndpointByUnit), static_cast<int64_t>(start), static_cast<int64_t>(end), endpoint, static_cast<int64_t>(ToUnitKind(unit)), count });
+        Clamp();
+        size_t position = Endpoint(endpoint);
+        *pRetVal = MoveBoundary(&position, ToUnitKind(unit), count, true);
+        SetEndpoint(endpoint, position);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE MoveEndpointByRange(TextPatternRangeEndpoint endpoint, ITextRangeProvider* targetRange, TextPatternRangeEndpoint targetEndpoint)
+    {
+        TextRangeProvider* other = FromProvider(targetRange);
+        if (!other)
+        {
+            return E_INVALIDARG;
+        }
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::MoveEndpointByRange), static_cast<int64_t>(start), static_cast<int64_t>(end), static_cast<int64_t>(other->start), static_cast<int64_t>(other->end), endpoint, targetEndpoint });
+        Clamp();
+        other->Clamp();
+        SetEndpoint(endpoint, other->Endpoint(targetEndpoint));
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Select()
+    {
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::Select), static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        Clamp();
+        document->SetSelection(start, end);
+        InvalidateRect(hwnd, NULL, TRUE);
+        UiaRaiseAutomationEvent(element, UIA_Text_TextSelectionChangedEventId);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE AddToSelection()
+    {
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::AddToSelection), static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        return UIA_E_INVALIDOPERATION;
+    }
+    HRESULT STDMETHODCALLTYPE RemoveFromSelection()
+    {
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::RemoveFromSelection), static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        return UIA_E_INVALIDOPERATION;
+    }
+    HRESULT STDMETHODCALLTYPE ScrollIntoView(BOOL alignToTop)
+    {
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::ScrollIntoView), static_cast<int64_t>(start), static_cast<int64_t>(end), alignToTop != FALSE });
+        Clamp();
+        document->ScrollIntoView(alignToTop ? start : end, alignToTop != FALSE);
+        InvalidateRect(hwnd, NULL, TRUE);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetChildren(SAFEARRAY** pRetVal)
+    {
+        if (!pRetVal) return E_POINTER;
+
+        CallScope call(TraceEvent::TextCall, { static_cast<int64_t>(TraceText::GetChildren), static_cast<int64_t>(start), static_cast<int64_t>(end) });
+        *pRetVal = SafeArrayCreateVector(VT_UNKNOWN, 0, 0);
+        return *pRetVal ? S_OK : E_OUTOFMEMORY;
+    }
+
+private:
+    // Ranges passed back in are only usable if they are ours and over the same text.
+    TextRangeProvider* FromProvider(ITextRangeProvider* range) const
+    {
+        TextRangeProvider* other = dynamic_cast<TextRangeProvider*>(range);
+        return other && other->document == document ? other : NULL;
+    }
+
+    void Clamp()
+    {
+        size_t length = document->GetLength();
+        start = (std::min)(start, length);
+        end = (std::min)((std::max)(start, end), length);
+    }
+
+    size_t Endpoint(TextPatternRangeEndpoint endpoint) const
+    {
+        return endpoint == TextPatternRangeEndpoint_Start ? start : end;
+    }
+
+    // Moving one endpoint past the other drags the other along.
+    void SetEndpoint(TextPatternRangeEndpoint endpoint, size_t position)
+    {
+        if (endpoint == TextPatternRangeEndpoint_Start)
+        {
+            start = position;
+            end = (std::max)(end, position);
+        }
+        else
+        {
+            end = position;
+            start = (std::min)(start, position);
+        }
+    }
+
+    // Steps position count boundaries forward or back and returns how many
+    // steps were taken. A range that must stay non-empty cannot step onto the
+    // end of the text.
+    int MoveBoundary(size_t* position, TextUnitKind kind, int count, bool allowEnd) const
+    {
+        size_t length = document->GetLength();
+        int moved = 0;
+        while (moved < count)
+        {
+            size_t next = document->NextBoundary(*position, kind);
+            if (next == *position || (!allowEnd && next >= length))
+            {
+                break;
+            }
+            *position = next;
+            moved++;
+        }
+        while (moved > count && *position > 0)
+        {
+            *position = document->PreviousBoundary(*position, kind);
+            moved--;
+        }
+        return moved;
+    }
+
+    TextDocument* document;
+    IRawElementProviderSimple* element;
+    HWND hwnd;
+    size_t start;
+    size_t end;
+    ULONG refCount;
+};
@@ -3,21 +3,382 @@
 #include <uiautomation.h>
 #include "Navbar.h"
 #include "NavbarProvider.h"
+#include "TextAreaProvider.h"
+#include "../Shared/ValueNotifier.h"
+#include "../Shared/Win32ScreenTransform.h"
+#ifdef A11Y_COUNT_ALLOCATIONS
+#include "../Shared/CountingAllocator.h"
+#include "../Shared/Win32MallocSpy.h"
+#endif
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <cstring>
 
+// Item source for the virtualized demo, standing in for a large data set.
+class NumberedItemSource : public ItemSource
+{
+public:
+    NumberedItemSource(size_t count) : count(count) {}
+
+    size_t GetItemCount() const { return count; }
+    std::wstring GetItemText(size_t index) const { return L"Item " + std::to_wstring(index + 1); }
+
+private:
+    size_t count;
+};
+
+WidgetModel gModel;
+QueryTraceWriter gTrace;
 Navbar* gNavbar;
 NavbarProvider* gNavbarProvider;
+NumberedItemSource gItemSource(500000);
+ValueNotifier gNotifier(10);
+WidgetId gProgress = kNoWidget;
+TextDocument gDocument(8, 16);
+TextAreaProvider* gTextProvider;
+HFONT gTextFont;
+std::vector<WidgetEvent> gModelEvents;
+
+// Text for the document demo: enough lines to make a multi-megabyte buffer.
+std::wstring MakeDocumentText(size_t lines)
+{
+    std::wstring text;
+    for (size_t i = 0; i < lines; i++)
+    {
+        text += L"Line " + std::to_wstring(i + 1) + L": The quick brown fox jumps over the lazy dog.\n";
+    }
+    return text;
+}
+
+// Properties a screen reader announces for the toolbar and each item.
+const std::vector<PROPERTYID> kAnnouncedProperties = { UIA_NamePropertyId, UIA_ControlTypePropertyId, UIA_BoundingRectanglePropertyId, UIA_IsEnabledPropertyId, UIA_HasKeyboardFocusPropertyId, UIA_SelectionItemIsSelectedPropertyId };
+
+// Reads properties of the toolbar and its items the way a client walking the
+// tree does, and returns how many elements it visited.
+size_t WalkToolbar(NavbarProvider* navbarProvider, const std::vector<PROPERTYID>& properties)
+{
+    size_t elements = 1;
+    VARIANT value;
+    for (PROPERTYID property : properties)
+    {
+        navbarProvider->GetPropertyValue(property, &value);
+        VariantClear(&value);
+    }
+    IRawElementProviderFragment* item = NULL;
+    navbarProvider->Navigate(NavigateDirection_FirstChild, &item);
+    while (item)
+    {
+        IRawElementProviderSimple* simple = NULL;
+        if (SUCCEEDED(item->QueryInterface(__uuidof(IRawElementProviderSimple), (void**)&simple)))
+        {
+            for (PROPERTYID property : properties)
+            {
+                simple->GetPropertyValue(property, &value);
+                VariantClear(&value);
+            }
+            simple->Release();
+        }
+        IRawElementProviderFragment* next = NULL;
+        item->Navigate(NavigateDirection_NextSibling, &next);
+        item->Release();
+        item = next;
+        elements++;
+    }
+    return elements;
+}
+
+// Reads every property a screen reader announces for the toolbar and its
+// items, first the way a client walking the tree does and then with one
+// prefetch, and prints how many provider calls each took.
+void CountToolbarReads(NavbarProvider* navbarProvider)
+{
+    CacheRequest request = { QueryScope::Subtree, kAnnouncedProperties };
+    ProviderStats& stats = GetProviderStats();
+
+    stats = ProviderStats();
+    size_t elements = WalkToolbar(navbarProvider, request.properties);
+    std::cout << "Walk: " << elements << " elements, " << stats.propertyReads << " property reads, " << stats.navigations << " navigations" << std::endl;
+
+    stats = ProviderStats();
+    PropertyCache cache;
+    HRESULT hr = navbarProvider->Prefetch(request, &cache);
+    std::cout << "Prefetch: " << cache.GetElementCount() << " elements, " << stats.prefetches << " call, hr " << hr << std::endl;
+}
+
+// A client's mix of property reads: what is announced, what inspection tools
+// and filters ask for, and a few the sample leaves to UIA's defaults.
+const std::vector<PROPERTYID> kMixedProperties = { UIA_NamePropertyId, UIA_ControlTypePropertyId, UIA_BoundingRectanglePropertyId,
+    UIA_IsEnabledPropertyId, UIA_HasKeyboardFocusPropertyId, UIA_SelectionItemIsSelectedPropertyId, UIA_AutomationIdPropertyId,
+    UIA_ClassNamePropertyId, UIA_LocalizedControlTypePropertyId, UIA_IsKeyboardFocusablePropertyId, UIA_IsOffscreenPropertyId,
+    UIA_PositionInSetPropertyId, UIA_SizeOfSetPropertyId, UIA_ClickablePointPropertyId, UIA_FrameworkIdPropertyId,
+    UIA_IsControlElementPropertyId, UIA_HelpTextPropertyId, UIA_AcceleratorKeyPropertyId, UIA_ItemStatusPropertyId };
+
+// Reads kMixedProperties from the toolbar and its first items in an
+// interleaved order, so no property or element is read twice in a row, and
+// prints the throughput and how many reads fell back to VT_EMPTY.
+void TimePropertyReads(NavbarProvider* navbarProvider, size_t reads)
+{
+    std::vector<IRawElementProviderSimple*> elements = { navbarProvider };
+    navbarProvider->AddRef();
+    IRawElementProviderFragment* item = NULL;
+    navbarProvider->Navigate(NavigateDirection_FirstChild, &item);
+    while (item && elements.size() < 64)
+    {
+        IRawElementProviderSimple* simple = NULL;
+        if (SUCCEEDED(item->QueryInterface(__uuidof(IRawElementProviderSimple), (void**)&simple)))
+        {
+            elements.push_back(simple);
+        }
+        IRawElementProviderFragment* next = NULL;
+        item->Navigate(NavigateDirection_NextSibling, &next);
+        item->Release();
+        item = next;
+    }
+    if (item)
+    {
+        item->Release();
+    }
+
+    size_t empty = 0;
+    VARIANT value;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads; i++)
+    {
+        elements[i % elements.size()]->GetPropertyValue(kMixedProperties[(i * 7) % kMixedProperties.size()], &value);
+        empty += value.vt == VT_EMPTY;
+        VariantClear(&value);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Property reads: " << reads << " over " << elements.size() << " elements in " << seconds * 1e3 << " ms, "
+        << seconds * 1e9 / reads << " ns each, " << empty << " empty" << std::endl;
+
+    for (IRawElementProviderSimple* element : elements)
+    {
+        element->Release();
+    }
+}
+
+#ifdef A11Y_COUNT_ALLOCATIONS
+// Reads the toolbar as a screen reader does, once to let items and caches be
+// created and once counted, and prints what each kind of call allocated on
+// the second pass. The budgets those calls are held to are checked by
+// Shared/tests/AllocationBudgetTest.
+void CountToolbarAllocations(NavbarProvider* navbarProvider, HWND hwnd)
+{
+    // BSTRs and SAFEARRAYs come from COM task memory, not operator new
+    CoInitialize(NULL);
+    MallocSpy spy;
+    spy.Register();
+
+    RECT client;
+    GetClientRect(hwnd, &client);
+    POINT center = { (client.left + client.right) / 2, (client.top + client.bottom) / 2 };
+    ClientToScreen(hwnd, &center);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        ResetCallAllocations();
+        WalkToolbar(navbarProvider, kAnnouncedProperties);
+        UiaRect bounds;
+        navbarProvider->get_BoundingRectangle(&bounds);
+        IRawElementProviderFragment* found = NULL;
+        navbarProvider->ElementProviderFromPoint(center.x, center.y, &found);
+        if (found)
+        {
+            found->Release();
+        }
+        navbarProvider->GetFocus(&found);
+        if (found)
+        {
+            found->Release();
+        }
+    }
+
+    spy.Revoke();
+    CoUninitialize();
+
+    std::cout << "Allocations per call:" << std::endl;
+    for (size_t event = 0; event < static_cast<size_t>(TraceEvent::Count); event++)
+    {
+        const CallAllocations& stats = GetCallAllocations()[event];
+        if (stats.calls > 0)
+        {
+            std::cout << "  " << TraceEventName(static_cast<TraceEvent>(event)) << ": " << stats.calls << " calls, "
+                << (double)stats.allocations / stats.calls << " allocations and " << (double)stats.bytes / stats.calls << " bytes each, at most "
+                << stats.maxAllocations << std::endl;
+        }
+    }
+}
+#endif
+
+// Paints the visible lines of the document and inverts the selection.
+void DrawDocument(HDC hdc)
+{
+    HGDIOBJ oldFont = SelectObject(hdc, gTextFont);
+    const PieceTable& text = gDocument.GetText();
+    const WidgetRect& viewport = gDocument.GetViewport();
+    size_t first = gDocument.GetFirstVisibleLine();
+    size_t last = (std::min)(first + gDocument.GetVisibleLineCount(), text.GetLineCount());
+    std::wstring line;
+    for (size_t i = first; i < last; i++)
+    {
+        size_t start = text.GetLineStart(i);
+        text.GetText(start, gDocument.LineEnd(i) - start, &line);
+        TextOutW(hdc, viewport.left, viewport.top + (int)(i - first) * gDocument.GetLineHeight(), line.c_str(), (int)line.size());
+    }
+    SelectObject(hdc, oldFont);
+
+    std::vector<WidgetRect> selection;
+    gDocument.GetRangeRects(gDocument.GetSelectionStart(), gDocument.GetSelectionEnd(), &selection);
+    for (const WidgetRect& rect : selection)
+    {
+        RECT r = ToRect(rect);
+        InvertRect(hdc, &r);
+    }
+}
+
+// The progress bar is fed samples far faster than an AT should hear about
+// them, so value change events go through a per-element throttle.
+const UINT_PTR kSampleTimer = 1;
+const UINT_PTR kNotifyTimer = 2;
+const int kSamplesPerTick = 8;
+
+// Raises UIA events for the model changes that clients listen for; the
+// model queued only those. Value changes go through the throttle instead.
+// Items of the virtualized navbar are recycled widgets whose changes are not
+// changes to the items, so it only raises focus.
+void RaiseModelEvents(HWND hwnd)
+{
+    gModel.TakeEvents(&gModelEvents);
+    bool childrenChanged = false;
+    for (const WidgetEvent& event : gModelEvents)
+    {
+        if (event.kind == WidgetEventKind::ValueChanged)
+        {
+            gNotifier.Changed(event.widget);
+            continue;
+        }
+        if (event.kind == WidgetEventKind::StructureChanged)
+        {
+            // Navbar items are leaves, so the removed child is all that goes
+            if (event.change == StructureChange::ChildRemoved)
+            {
+                gNotifier.Forget(event.child);
+            }
+            childrenChanged = childrenChanged || event.widget == gNavbar->GetId();
+            continue;
+        }
+
+        const Widget* widget = gModel.Get(event.widget);
+        if (!widget || widget->parent != gNavbar->GetId() || (gNavbar->IsVirtualized() && event.kind != WidgetEventKind::Focus))
+        {
+            continue;
+        }
+        size_t index = gNavbar->IsVirtualized() ? gNavbar->GetFocusedItem() : gModel.GetDerived().childIndex[event.widget.index];
+        BoxProvider* provider = new BoxProvider(gNavbar, index, gNavbarProvider, hwnd);
+        VARIANT oldValue, newValue;
+        oldValue.vt = VT_EMPTY;
+        newValue.vt = VT_EMPTY;
+        switch (event.kind)
+        {
+        case WidgetEventKind::Focus:
+            UiaRaiseAutomationEvent(provider, UIA_AutomationFocusChangedEventId);
+            break;
+        case WidgetEventKind::NameChanged:
+            oldValue.vt = VT_BSTR;
+            oldValue.bstrVal = SysAllocString(event.oldName.c_str());
+            newValue.vt = VT_BSTR;
+            newValue.bstrVal = SysAllocString(widget->name.c_str());
+            UiaRaiseAutomationPropertyChangedEvent(provider, UIA_NamePropertyId, oldValue, newValue);
+            break;
+        case WidgetEventKind::BoundsChanged:
+            // Clients read the new rectangle back; the event only says to
+            UiaRaiseAutomationPropertyChangedEvent(provider, UIA_BoundingRectanglePropertyId, oldValue, newValue);
+            break;
+        case WidgetEventKind::EnabledChanged:
+            oldValue.vt = VT_BOOL;
+            oldValue.boolVal = event.oldEnabled ? VARIANT_TRUE : VARIANT_FALSE;
+            newValue.vt = VT_BOOL;
+            newValue.boolVal = widget->enabled ? VARIANT_TRUE : VARIANT_FALSE;
+            UiaRaiseAutomationPropertyChangedEvent(provider, UIA_IsEnabledPropertyId, oldValue, newValue);
+            break;
+        default:
+            break;
+        }
+        VariantClear(&oldValue);
+        VariantClear(&newValue);
+        provider->Release();
+    }
+
+    // One event for any number of added, removed and moved items
+    if (childrenChanged && !gNavbar->IsVirtualized())
+    {
+        UiaRaiseStructureChangedEvent(gNavbarProvider, StructureChangeType_ChildrenInvalidated, NULL, 0);
+    }
+}
+
+// Raises the value change events that are due and arms a timer for the rest,
+// so the final value is announced even after the samples stop. Progress bars
+// expose both patterns, so each change is raised as the RangeValue number and
+// as the Value text clients of either one read.
+void FlushValueEvents(HWND hwnd)
+{
+    gNotifier.Flush(GetTickCount64(), [hwnd](WidgetId widget)
+    {
+        // Removed after it changed, with no structure listener to say so
+        const Widget* data = gModel.Get(widget);
+        if (!data)
+        {
+            gNotifier.Forget(widget);
+            return;
+        }
+        BoxProvider* provider = new BoxProvider(gNavbar, gModel.GetDerived().childIndex[widget.index], gNavbarProvider, hwnd);
+        VARIANT oldValue, newValue;
+        oldValue.vt = VT_EMPTY;
+        newValue.vt = VT_R8;
+        newValue.dblVal = data->value;
+        UiaRaiseAutomationPropertyChangedEvent(provider, UIA_RangeValueValuePropertyId, oldValue, newValue);
+        newValue.vt = VT_BSTR;
+        newValue.bstrVal = SysAllocString(GetValueText(*data).c_str());
+        UiaRaiseAutomationPropertyChangedEvent(provider, UIA_ValueValuePropertyId, oldValue, newValue);
+        VariantClear(&newValue);
+        provider->Release();
+    });
+
+    uint64_t due = gNotifier.GetNextDue(GetTickCount64());
+    if (due == ValueNotifier::kNothingPending)
+    {
+        KillTimer(hwnd, kNotifyTimer);
+    }
+    else
+    {
+        SetTimer(hwnd, kNotifyTimer, static_cast<UINT>((std::max)(due, (uint64_t)USER_TIMER_MINIMUM)), NULL);
+    }
+}
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
     HDC hdc;
     PAINTSTRUCT ps;
 
+    // Bounding rectangles are served from the model's cached screen rects
+    if (ChangesScreenTransform(msg))
+    {
+        gModel.SetScreenTransform(QueryScreenTransform(hwnd));
+    }
+
     switch (msg)
     {
     case WM_PAINT:
         hdc = BeginPaint(hwnd, &ps);
-        gNavbar->Draw(hdc);
+        if (gTextProvider)
+        {
+            DrawDocument(hdc);
+        }
+        else
+        {
+            gNavbar->Draw(hdc);
+        }
         EndPaint(hwnd, &ps);
         break;
 
@@ -25,11 +386,84 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         if (lParam == UiaRootObjectId)
         {
             std::cout << "WM_GETOBJECT received" << std::endl;
+            if (gTextProvider)
+            {
+                return UiaReturnRawElementProvider(hwnd, wParam, lParam, gTextProvider);
+            }
             return UiaReturnRawElementProvider(hwnd, wParam, lParam, gNavbarProvider);
         }
         break;
 
+    case WM_SIZE:
+        gDocument.SetViewport({ 0, 0, LOWORD(lParam), HIWORD(lParam) });
+        break;
+
+    case WM_DPICHANGED:
+        ApplySuggestedDpiRect(hwnd, lParam);
+        InvalidateRect(hwnd, NULL, TRUE);
+        break;
+
+    case WM_MOUSEWHEEL:
+        if (gTextProvider)
+        {
+            gDocument.ScrollBy(-3 * GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA);
+            InvalidateRect(hwnd, NULL, TRUE);
+        }
+        else if (gNavbar->IsVirtualized())
+        {
+            gNavbar->ScrollBy(-GET_WHEEL_DELTA_WPARAM(wParam));
+            InvalidateRect(hwnd, NULL, TRUE);
+        }
+        break;
+
+    case WM_LBUTTONDOWN:
+        if (!gTextProvider)
+        {
+            POINT pt = ClientToLayout(gModel.GetScreenTransform(), { (short)LOWORD(lParam), (short)HIWORD(lParam) });
+            size_t index = gNavbar->ItemFromPoint(pt.x, pt.y);
+            gNavbar->GetSelection().Click(index, (wParam & MK_CONTROL) != 0, (wParam & MK_SHIFT) != 0);
+            BoxProvider::RaiseSelectionEvents(gNavbar, gNavbarProvider, hwnd);
+            InvalidateRect(hwnd, NULL, FALSE);
+        }
+        break;
+
+    case WM_KEYDOWN:
+        // Ctrl+A selects every item and Escape clears the selection; either is
+        // one bulk event however many items it touches
+        if (!gTextProvider && (wParam == VK_ESCAPE || (wParam == 'A' && GetKeyState(VK_CONTROL) < 0)))
+        {
+            if (wParam == VK_ESCAPE)
+            {
+                gNavbar->GetSelection().Clear();
+            }
+            else
+            {
+                gNavbar->GetSelection().SelectAll();
+            }
+            BoxProvider::RaiseSelectionEvents(gNavbar, gNavbarProvider, hwnd);
+            InvalidateRect(hwnd, NULL, FALSE);
+        }
+        break;
+
+    case WM_TIMER:
+        if (wParam == kSampleTimer)
+        {
+            // Several samples arrive per tick; each is a cheap model write
+            for (int i = 0; i < kSamplesPerTick; i++)
+            {
+                const Widget* progress = gModel.Get(gProgress);
+                gModel.SetValue(gProgress, progress->value >= progress->maximum ? progress->minimum : progress->value + 0.05);
+            }
+            RECT rect = ToRect(gModel.Get(gProgress)->rect);
+            InvalidateRect(hwnd, &rect, FALSE);
+        }
+        RaiseModelEvents(hwnd);
+        FlushValueEvents(hwnd);
+        break;
+
     case WM_DESTROY:
+        KillTimer(hwnd, kSampleTimer);
+        KillTimer(hwnd, kNotifyTimer);
         PostQuitMessage(0);
         break;
 
@@ -43,13 +477,22 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
     (void)hPrevInstance;
-    (void)lpCmdLine;
+    EnablePerMonitorDpiAwareness();
 
     RECT navbarRect = { 0, 0, 400, 100 };
-    gNavbar = new Navbar(navbarRect);
-    gNavbar->AddBox(Box({ 10, 10, 90, 60 }, L"Button 1"));
-    gNavbar->AddBox(Box({ 110, 10, 190, 60 }, L"Button 2"));
-    gNavbar->AddBox(Box({ 210, 10, 290, 60 }, L"Button 3"));
+    gNavbar = new Navbar(&gModel, navbarRect);
+    if (lpCmdLine && strstr(lpCmdLine, "--virtual"))
+    {
+        // Items are fetched from the source as they are scrolled into view
+        gNavbar->SetItemSource(&gItemSource, { 80, 50 }, 10);
+    }
+    else
+    {
+        gNavbar->AddBox(Box({ 10, 10, 90, 60 }, L"Button 1"));
+        gNavbar->AddBox(Box({ 110, 10, 190, 60 }, L"Button 2"));
+        gNavbar->AddBox(Box({ 210, 10, 290, 60 }, L"Button 3"));
+        gProgress = gNavbar->AddProgressBar({ 10, 70, 290, 90 }, L"Progress");
+    }
 
     WNDCLASS wc = { 0 };
     wc.lpfnWndProc = WndProc;
@@ -65,7 +508,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         wc.lpszClassName,
         TEXT("Accessible Navbar"),
         WS_OVERLAPPEDWINDOW,
-        CW_USEDEFAULT, CW_USEDEFAULT, 400, 200,
+        CW_USEDEFAULT, CW_USEDEFAULT, MulDiv(400, GetDpiForSystem(), ScreenTransform::kDefaultDpi), MulDiv(200, GetDpiForSystem(), ScreenTransform::kDefaultDpi),
         NULL, NULL, hInstance, NULL);
 
     if (hwnd == NULL)
@@ -75,6 +518,48 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
 
     gNavbarProvider = new NavbarProvider(gNavbar, hwnd);
+    // A client's focus handler is desktop-wide rather than on this element,
+    // so the provider may never be advised of it; focus events are always built
+    gModel.GetEventSubscriptions().Add(WidgetEventKind::Focus);
+    if (lpCmdLine && strstr(lpCmdLine, "--text"))
+    {
+        // A large document exposed through the text pattern instead of the navbar
+        gDocument.SetText(MakeDocumentText(200000));
+        gTextFont = CreateFontW(gDocument.GetLineHeight(), gDocument.GetCharWidth(), 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, FIXED_PITCH | FF_MODERN, L"Consolas");
+        gTextProvider = new TextAreaProvider(&gDocument, hwnd);
+    }
+
+    if (lpCmdLine && strstr(lpCmdLine, "--count-reads"))
+    {
+        CountToolbarReads(gNavbarProvider);
+    }
+
+    if (lpCmdLine && strstr(lpCmdLine, "--time-properties"))
+    {
+        TimePropertyReads(gNavbarProvider, 1000000);
+    }
+
+#ifdef A11Y_COUNT_ALLOCATIONS
+    if (lpCmdLine && strstr(lpCmdLine, "--count-allocations"))
+    {
+        CountToolbarAllocations(gNavbarProvider, hwnd);
+    }
+#endif
+
+    // --trace=<path> records the model and every call made on it, for TraceReplay
+    const char* traceArg = lpCmdLine ? strstr(lpCmdLine, "--trace=") : NULL;
+    if (traceArg && gTrace.Open(std::string(traceArg + 8, strcspn(traceArg + 8, " ")).c_str()))
+    {
+        gModel.TraceSnapshot(&gTrace);
+        gNavbar->GetSelection().TraceSnapshot(&gTrace);
+        gDocument.TraceSnapshot(&gTrace);
+        ActiveTrace() = &gTrace;
+    }
+
+    if (gProgress != kNoWidget && !gTextProvider)
+    {
+        SetTimer(hwnd, kSampleTimer, USER_TIMER_MINIMUM, NULL);
+    }
 
     ShowWindow(hwnd, nCmdShow);
     UpdateWindow(hwnd);
@@ -84,10 +569,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
+        // Picks up changes made by input handlers and provider calls
+        RaiseModelEvents(hwnd);
     }
 
+    ActiveTrace() = nullptr;
+    gTrace.Close();
     delete gNavbar;
     gNavbarProvider->Release();
+    if (gTextProvider)
+    {
+        gTextProvider->Release();
+        DeleteObject(gTextFont);
+    }
 
     return (int)msg.wParam;
 }
@@ -3,108 +3,76 @@
 #include <string>
 #include <atlbase.h>
 #include <atlcom.h>
+#include "Shared/WidgetModel.h"
+#include "Shared/DrawBatch.h"
+#include "Shared/GdiRenderer.h"
+#include "Shared/HostWindowManager.h"
+#include "Shared/Win32WindowSystem.h"
+#include "Shared/WidgetPainter.h"
 
-// Helper function to set accessible name using Windows API
-void SetAccessibleName(HWND hwnd, const std::wstring& name) {
-	SetWindowText(hwnd, name.c_str());
-}
-
-class Box {
+class Navbar {
 public:
-	Box(RECT rect, const std::wstring& text) : rect(rect), text(text), hwnd(nullptr) {}
-
-	void Draw(HDC hdc, HWND parentHwnd) {
-		// Create a white brush for the boxes
-		HBRUSH hBrush = CreateSolidBrush(RGB(255, 255, 255));
-		FillRect(hdc, &rect, hBrush);
-		DeleteObject(hBrush);
-
-		// Create a font for the text
-		HFONT hFont = CreateFont(18, 0, 0, 0, FW_BOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, VARIABLE_PITCH, TEXT("Arial"));
-		HFONT hOldFont = (HFONT)SelectObject(hdc, hFont);
-
-		// Set text color to black
-		SetTextColor(hdc, RGB(0, 0, 0));
-		SetBkMode(hdc, TRANSPARENT); // Set background mode to transparent
-
-		// Draw the text in the center of the box
-		DrawText(hdc, text.c_str(), -1, &rect, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
-
-		// Restore the old font
-		SelectObject(hdc, hOldFont);
-		DeleteObject(hFont);
-
-		// Create an off-screen window to host the accessible object for this box
-		if (!hwnd) {
-			hwnd = CreateWindowEx(
-				WS_EX_TRANSPARENT, TEXT("STATIC"), NULL,
-				WS_CHILD | WS_VISIBLE,
-				rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top,
-				parentHwnd, NULL, GetModuleHandle(NULL), NULL);
-			SetAccessibleName(hwnd, text);
-		}
+	Navbar(WidgetModel* model, RECT rect) : model(model) {
+		id = model->AddWidget(kNoWidget, WidgetRole::Toolbar, ToWidgetRect(rect), L"Navbar", RGB(0, 0, 255));
 	}
 
-private:
-	RECT rect;
-	std::wstring text;
-	HWND hwnd;
-};
-
-class Navbar {
-public:
-	Navbar(RECT rect) : rect(rect), hwnd(nullptr) {}
+	void AddBox(RECT rect, const std::wstring& text) {
+		model->AddWidget(id, WidgetRole::Button, ToWidgetRect(rect), text, RGB(255, 255, 255));
+	}
 
-	void AddBox(const Box& box) {
-		boxes.push_back(box);
+	void Draw(HDC hdc) {
+		textCache.BeginFrame();
+		GdiRenderer renderer(hdc, &textCache);
+		PaintWidgetTree(drawBatch, *model, id);
+		drawBatch.Flush(renderer);
+		textCache.EndFrame();
 	}
 
-	void Draw(HDC hdc, HWND parentHwnd) {
-		// Create a blue brush for the navbar
-		HBRUSH hBrush = CreateSolidBrush(RGB(0, 0, 255));
-		FillRect(hdc, &rect, hBrush);
-		DeleteObject(hBrush);
-
-		// Create an off-screen window to host the accessible object for the navbar
-		if (!hwnd) {
-			hwnd = CreateWindowEx(
-				WS_EX_TRANSPARENT, TEXT("STATIC"), NULL,
-				WS_CHILD | WS_VISIBLE,
-				rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top,
-				parentHwnd, NULL, GetModuleHandle(NULL), NULL);
-			SetAccessibleName(hwnd, L"Navbar");
-		}
-
-		// Draw each box
-		for (auto& box : boxes) {
-			box.Draw(hdc, parentHwnd);
-		}
+	// Brings the accessible host windows in line with the model. Call after
+	// the layout changes, never while painting.
+	void SyncHosts(HostWindowManager& hosts) {
+		hosts.Sync(*model, id);
 	}
 
 private:
-	RECT rect;
-	std::vector<Box> boxes;
-	HWND hwnd;
+	WidgetModel* model;
+	WidgetId id;
+	TextLayoutCache textCache;
+	DrawBatch drawBatch;
 };
 
-// Global instance of Navbar
+// Global instances of the widget model and Navbar
+WidgetModel gModel;
 Navbar* gNavbar;
+Win32WindowSystem* gWindowSystem;
+HostWindowManager* gHosts;
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 	HDC hdc;
 	PAINTSTRUCT ps;
 
 	switch (msg) {
+	case WM_CREATE:
+		// Create the accessible host windows up front, outside of painting
+		gWindowSystem = new Win32WindowSystem(hwnd);
+		gHosts = new HostWindowManager(gWindowSystem);
+		gNavbar->SyncHosts(*gHosts);
+		break;
+
 	case WM_PAINT:
 		hdc = BeginPaint(hwnd, &ps);
 
 		// Draw the navbar and boxes
-		gNavbar->Draw(hdc, hwnd);
+		gNavbar->Draw(hdc);
 
 		EndPaint(hwnd, &ps);
 		break;
 
 	case WM_DESTROY:
+		delete gHosts;
+		gHosts = nullptr;
+		delete gWindowSystem;
+		gWindowSystem = nullptr;
 		PostQuitMessage(0);
 		break;
 
@@ -121,12 +89,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
 	// Define the rectangle for the main window (navbar)
 	RECT navbarRect = { 0, 0, 400, 100 };
-	gNavbar = new Navbar(navbarRect);
+	gNavbar = new Navbar(&gModel, navbarRect);
 
 	// Define the boxes and add them to the navbar
-	gNavbar->AddBox(Box({ 10, 10, 90, 60 }, L"Button 1"));
-	gNavbar->AddBox(Box({ 110, 10, 190, 60 }, L"Button 2"));
-	gNavbar->AddBox(Box({ 210, 10, 290, 60 }, L"Button 3"));
+	gNavbar->AddBox({ 10, 10, 90, 60 }, L"Button 1");
+	gNavbar->AddBox({ 110, 10, 190, 60 }, L"Button 2");
+	gNavbar->AddBox({ 210, 10, 290, 60 }, L"Button 3");
 
 	// Register window class
 	WNDCLASS wc = { 0 };